@@ -17,6 +17,9 @@
 #include "gpu.h"
 #include "pipeline.h"
 
+#include <limits.h>
+#include <string.h>
+
 #if __ANDROID_API__ >= 26
 #include <android/hardware_buffer.h>
 #endif // __ANDROID_API__ >= 26
@@ -357,6 +360,841 @@ void UnlockedPoolAllocator::fastFree(void* ptr)
     ncnn::fastFree(ptr);
 }
 
+// atomic counters of the size class pool allocator
+#if NCNN_THREADS && (defined __GNUC__ || defined __clang__)
+static NCNN_FORCEINLINE void atomic_add_size(size_t* p, size_t v)
+{
+    __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+static NCNN_FORCEINLINE void atomic_sub_size(size_t* p, size_t v)
+{
+    __atomic_fetch_sub(p, v, __ATOMIC_RELAXED);
+}
+#elif NCNN_THREADS && defined _MSC_VER
+static NCNN_FORCEINLINE void atomic_add_size(size_t* p, size_t v)
+{
+#if _WIN64
+    InterlockedExchangeAdd64((LONG64 volatile*)p, (LONG64)v);
+#else
+    InterlockedExchangeAdd((LONG volatile*)p, (LONG)v);
+#endif
+}
+
+static NCNN_FORCEINLINE void atomic_sub_size(size_t* p, size_t v)
+{
+#if _WIN64
+    InterlockedExchangeAdd64((LONG64 volatile*)p, -(LONG64)v);
+#else
+    InterlockedExchangeAdd((LONG volatile*)p, -(LONG)v);
+#endif
+}
+#else
+static NCNN_FORCEINLINE void atomic_add_size(size_t* p, size_t v)
+{
+    *p += v;
+}
+
+static NCNN_FORCEINLINE void atomic_sub_size(size_t* p, size_t v)
+{
+    *p -= v;
+}
+#endif
+
+// four size classes per power of two, from 64 bytes up to 2G
+// larger requests bypass the pool
+#define NCNN_SIZE_CLASS_COUNT (1 + 25 * 4)
+
+static int size_class_index(size_t size)
+{
+    if (size <= 64)
+        return 0;
+
+    int p = 6;
+    while (p <= 30 && ((size_t)1 << (p + 1)) < size)
+        p++;
+
+    if (p > 30)
+        return -1;
+
+    const size_t step = (size_t)1 << (p - 2);
+    const int i = (int)((size - ((size_t)1 << p) + step - 1) / step);
+
+    return 1 + (p - 6) * 4 + (i - 1);
+}
+
+static size_t size_class_size(int index)
+{
+    if (index == 0)
+        return 64;
+
+    const int p = 6 + (index - 1) / 4;
+    const int i = (index - 1) % 4 + 1;
+
+    return ((size_t)1 << p) + i * ((size_t)1 << (p - 2));
+}
+
+// every block is prefixed by one aligned header slot holding its size class
+// a free block stores the next free block pointer in its payload
+static NCNN_FORCEINLINE int& block_size_class(void* ptr)
+{
+    return *(int*)((unsigned char*)ptr - NCNN_MALLOC_ALIGN);
+}
+
+static NCNN_FORCEINLINE void*& block_next(void* ptr)
+{
+    return *(void**)ptr;
+}
+
+struct size_class_thread_cache
+{
+    void* heads[NCNN_SIZE_CLASS_COUNT];
+    int counts[NCNN_SIZE_CLASS_COUNT];
+};
+
+class SizeClassPoolAllocatorPrivate
+{
+public:
+    size_class_thread_cache* thread_cache();
+
+    // blocks moved between a thread cache and the shared list at once
+    int batch_count() const;
+
+    // move up to batch_count blocks from the shared list into the thread cache
+    void refill(size_class_thread_cache* cache, int ci);
+
+    // move batch_count blocks from the thread cache into the shared list
+    void flush(size_class_thread_cache* cache, int ci);
+
+    // free every block held by the thread cache
+    void release(size_class_thread_cache* cache);
+
+    // free every block held by the shared lists
+    void release_shared();
+
+    // shared free lists, each guarded by its own lock
+    // the lock is only taken once per batch so that the fast path stays in the thread cache
+    // a lock-free list would need a pointer and an aba tag swapped together, a double-width cas
+    // that not every target has, and batching already keeps the lock off the per-block path
+    Mutex shared_locks[NCNN_SIZE_CLASS_COUNT];
+    void* heads[NCNN_SIZE_CLASS_COUNT];
+
+    int thread_cache_count;
+
+    ThreadLocalStorage tls_cache;
+
+    // every thread cache ever created, guarded by caches_lock
+    Mutex caches_lock;
+    std::vector<size_class_thread_cache*> caches;
+
+    size_t hit_count;
+    size_t miss_count;
+    size_t bytes_held;
+};
+
+size_class_thread_cache* SizeClassPoolAllocatorPrivate::thread_cache()
+{
+    size_class_thread_cache* cache = (size_class_thread_cache*)tls_cache.get();
+    if (cache)
+        return cache;
+
+    cache = new size_class_thread_cache;
+    memset(cache, 0, sizeof(size_class_thread_cache));
+    tls_cache.set(cache);
+
+    caches_lock.lock();
+    caches.push_back(cache);
+    caches_lock.unlock();
+
+    return cache;
+}
+
+int SizeClassPoolAllocatorPrivate::batch_count() const
+{
+    return std::max(1, (thread_cache_count + 1) / 2);
+}
+
+void SizeClassPoolAllocatorPrivate::refill(size_class_thread_cache* cache, int ci)
+{
+    const int batch = batch_count();
+
+    shared_locks[ci].lock();
+
+    void* first = heads[ci];
+    void* last = 0;
+    int count = 0;
+    for (void* p = first; p && count < batch; p = block_next(p))
+    {
+        last = p;
+        count++;
+    }
+
+    if (last)
+    {
+        heads[ci] = block_next(last);
+        block_next(last) = cache->heads[ci];
+    }
+
+    shared_locks[ci].unlock();
+
+    if (!last)
+        return;
+
+    cache->heads[ci] = first;
+    cache->counts[ci] += count;
+}
+
+void SizeClassPoolAllocatorPrivate::flush(size_class_thread_cache* cache, int ci)
+{
+    const int batch = batch_count();
+
+    void* first = cache->heads[ci];
+    void* last = 0;
+    int count = 0;
+    for (void* p = first; p && count < batch; p = block_next(p))
+    {
+        last = p;
+        count++;
+    }
+
+    if (!last)
+        return;
+
+    cache->heads[ci] = block_next(last);
+    cache->counts[ci] -= count;
+
+    shared_locks[ci].lock();
+    block_next(last) = heads[ci];
+    heads[ci] = first;
+    shared_locks[ci].unlock();
+}
+
+void SizeClassPoolAllocatorPrivate::release(size_class_thread_cache* cache)
+{
+    for (int ci = 0; ci < NCNN_SIZE_CLASS_COUNT; ci++)
+    {
+        void* ptr = cache->heads[ci];
+        while (ptr)
+        {
+            void* next = block_next(ptr);
+
+            atomic_sub_size(&bytes_held, size_class_size(ci));
+            ncnn::fastFree((unsigned char*)ptr - NCNN_MALLOC_ALIGN);
+
+            ptr = next;
+        }
+
+        cache->heads[ci] = 0;
+        cache->counts[ci] = 0;
+    }
+}
+
+void SizeClassPoolAllocatorPrivate::release_shared()
+{
+    for (int ci = 0; ci < NCNN_SIZE_CLASS_COUNT; ci++)
+    {
+        shared_locks[ci].lock();
+        void* ptr = heads[ci];
+        heads[ci] = 0;
+        shared_locks[ci].unlock();
+
+        while (ptr)
+        {
+            void* next = block_next(ptr);
+
+            atomic_sub_size(&bytes_held, size_class_size(ci));
+            ncnn::fastFree((unsigned char*)ptr - NCNN_MALLOC_ALIGN);
+
+            ptr = next;
+        }
+    }
+}
+
+SizeClassPoolAllocator::SizeClassPoolAllocator()
+    : Allocator(), d(new SizeClassPoolAllocatorPrivate)
+{
+    for (int i = 0; i < NCNN_SIZE_CLASS_COUNT; i++)
+    {
+        d->heads[i] = 0;
+    }
+
+    d->thread_cache_count = 4;
+    d->hit_count = 0;
+    d->miss_count = 0;
+    d->bytes_held = 0;
+}
+
+SizeClassPoolAllocator::~SizeClassPoolAllocator()
+{
+    // no thread uses the allocator any more, every thread cache could be released
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        d->release(d->caches[i]);
+        delete d->caches[i];
+    }
+
+    d->release_shared();
+
+    delete d;
+}
+
+SizeClassPoolAllocator::SizeClassPoolAllocator(const SizeClassPoolAllocator&)
+    : d(0)
+{
+}
+
+SizeClassPoolAllocator& SizeClassPoolAllocator::operator=(const SizeClassPoolAllocator&)
+{
+    return *this;
+}
+
+void SizeClassPoolAllocator::set_thread_cache_count(int count)
+{
+    if (count < 0)
+    {
+        NCNN_LOGE("invalid thread cache count %d", count);
+        return;
+    }
+
+    d->thread_cache_count = count;
+}
+
+void SizeClassPoolAllocator::clear()
+{
+    // no other thread uses the allocator during clear, so the caches of idle and exited threads can be released too
+    d->caches_lock.lock();
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        d->release(d->caches[i]);
+    }
+    d->caches_lock.unlock();
+
+    d->release_shared();
+}
+
+size_t SizeClassPoolAllocator::hit_count() const
+{
+    return d->hit_count;
+}
+
+size_t SizeClassPoolAllocator::miss_count() const
+{
+    return d->miss_count;
+}
+
+size_t SizeClassPoolAllocator::bytes_held() const
+{
+    return d->bytes_held;
+}
+
+void* SizeClassPoolAllocator::fastMalloc(size_t size)
+{
+    const int ci = size_class_index(size);
+    if (ci == -1)
+    {
+        // too large for pooling
+        atomic_add_size(&d->miss_count, 1);
+
+        unsigned char* data = (unsigned char*)ncnn::fastMalloc(size + NCNN_MALLOC_ALIGN);
+        if (!data)
+            return 0;
+
+        void* ptr = data + NCNN_MALLOC_ALIGN;
+        block_size_class(ptr) = -1;
+        return ptr;
+    }
+
+    const size_t class_size = size_class_size(ci);
+
+    size_class_thread_cache* cache = d->thread_cache();
+
+    if (!cache->heads[ci])
+    {
+        d->refill(cache, ci);
+    }
+
+    void* ptr = cache->heads[ci];
+    if (ptr)
+    {
+        cache->heads[ci] = block_next(ptr);
+        cache->counts[ci]--;
+
+        atomic_sub_size(&d->bytes_held, class_size);
+        atomic_add_size(&d->hit_count, 1);
+        return ptr;
+    }
+
+    atomic_add_size(&d->miss_count, 1);
+
+    unsigned char* data = (unsigned char*)ncnn::fastMalloc(class_size + NCNN_MALLOC_ALIGN);
+    if (!data)
+        return 0;
+
+    ptr = data + NCNN_MALLOC_ALIGN;
+    block_size_class(ptr) = ci;
+    return ptr;
+}
+
+void SizeClassPoolAllocator::fastFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    const int ci = block_size_class(ptr);
+    if (ci == -1)
+    {
+        ncnn::fastFree((unsigned char*)ptr - NCNN_MALLOC_ALIGN);
+        return;
+    }
+
+    size_class_thread_cache* cache = d->thread_cache();
+
+    block_next(ptr) = cache->heads[ci];
+    cache->heads[ci] = ptr;
+    cache->counts[ci]++;
+
+    atomic_add_size(&d->bytes_held, size_class_size(ci));
+
+    if (cache->counts[ci] > d->thread_cache_count)
+    {
+        // overflow into the shared list so that other threads could pick them up
+        d->flush(cache, ci);
+    }
+}
+
+struct arena_block
+{
+    int index;
+    size_t size;
+    size_t offset;
+    int alloc_tick;
+    int free_tick;
+    void* ptr;
+
+    // alive when planning, placed apart from every other block
+    bool exclusive;
+    // shared blocks freed before this one was allocated in the recording
+    int frees_before;
+};
+
+static bool arena_block_size_greater(const arena_block& a, const arena_block& b)
+{
+    return a.size > b.size || (a.size == b.size && a.index < b.index);
+}
+
+static bool arena_range_less(const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b)
+{
+    return a.first < b.first;
+}
+
+static bool arena_block_free_less(const arena_block& a, const arena_block& b)
+{
+    return a.free_tick < b.free_tick;
+}
+
+class ArenaAllocatorPrivate
+{
+public:
+    Mutex lock;
+
+    bool planned;
+    int tick;
+
+    // recorded blocks, in allocation order
+    std::vector<arena_block> blocks;
+    // shared blocks in the recorded free order
+    std::vector<int> free_order;
+    // blocks alive when planning
+    std::vector<int> exclusive_blocks;
+    // blocks currently handed out from the arena
+    std::vector<unsigned char> block_live;
+
+    unsigned char* arena;
+    size_t arena_size;
+    // shared blocks are packed below, exclusive blocks follow
+    size_t shared_size;
+
+    // replay position in blocks and in free_order
+    size_t cursor;
+    size_t free_cursor;
+    int live_count;
+    int shared_live_count;
+    // the calls left the recorded sequence, serve from heap until every shared block is back
+    bool diverged;
+
+    size_t hit_count;
+    size_t fallback_count;
+
+#ifndef NDEBUG
+    // arena ranges currently handed out, the replay never hands out overlapping blocks
+    std::list<std::pair<size_t, size_t> > live;
+
+    bool overlaps_live(size_t offset, size_t size) const;
+#endif
+
+    void release_block(int bi);
+};
+
+#ifndef NDEBUG
+bool ArenaAllocatorPrivate::overlaps_live(size_t offset, size_t size) const
+{
+    std::list<std::pair<size_t, size_t> >::const_iterator it = live.begin();
+    for (; it != live.end(); ++it)
+    {
+        if (offset < it->first + it->second && it->first < offset + size)
+            return true;
+    }
+
+    return false;
+}
+#endif
+
+void ArenaAllocatorPrivate::release_block(int bi)
+{
+    block_live[bi] = 0;
+    live_count--;
+    if (!blocks[bi].exclusive)
+        shared_live_count--;
+
+#ifndef NDEBUG
+    std::list<std::pair<size_t, size_t> >::iterator it = live.begin();
+    for (; it != live.end(); ++it)
+    {
+        if (it->first == blocks[bi].offset)
+        {
+            live.erase(it);
+            break;
+        }
+    }
+#endif
+}
+
+ArenaAllocator::ArenaAllocator()
+    : Allocator(), d(new ArenaAllocatorPrivate)
+{
+    d->planned = false;
+    d->tick = 0;
+    d->arena = 0;
+    d->arena_size = 0;
+    d->shared_size = 0;
+    d->cursor = 0;
+    d->free_cursor = 0;
+    d->live_count = 0;
+    d->shared_live_count = 0;
+    d->diverged = false;
+    d->hit_count = 0;
+    d->fallback_count = 0;
+}
+
+ArenaAllocator::~ArenaAllocator()
+{
+    if (d->live_count != 0)
+    {
+        NCNN_LOGE("FATAL ERROR! arena allocator destroyed too early");
+    }
+
+    clear();
+
+    delete d;
+}
+
+ArenaAllocator::ArenaAllocator(const ArenaAllocator&)
+    : d(0)
+{
+}
+
+ArenaAllocator& ArenaAllocator::operator=(const ArenaAllocator&)
+{
+    return *this;
+}
+
+size_t ArenaAllocator::plan()
+{
+    MutexLockGuard g(d->lock);
+
+    if (d->planned)
+        return d->arena_size;
+
+    const int block_count = (int)d->blocks.size();
+
+    // blocks still in use are returned to user, keep them apart from every other block
+    // so that the next inference never writes into them
+    std::vector<arena_block> sorted_blocks;
+    d->exclusive_blocks.clear();
+    for (int i = 0; i < block_count; i++)
+    {
+        arena_block& b = d->blocks[i];
+        b.exclusive = b.free_tick == -1;
+        if (b.exclusive)
+            d->exclusive_blocks.push_back(i);
+        else
+            sorted_blocks.push_back(b);
+    }
+
+    // the replay hands out a shared block once every block recorded as freed before it is back
+    std::vector<arena_block> freed_blocks = sorted_blocks;
+    std::partial_sort(freed_blocks.begin(), freed_blocks.end(), freed_blocks.end(), arena_block_free_less);
+
+    d->free_order.resize(freed_blocks.size());
+    std::vector<int> free_ticks(freed_blocks.size());
+    for (size_t i = 0; i < freed_blocks.size(); i++)
+    {
+        d->free_order[i] = freed_blocks[i].index;
+        free_ticks[i] = freed_blocks[i].free_tick;
+    }
+
+    for (int i = 0; i < block_count; i++)
+    {
+        arena_block& b = d->blocks[i];
+        b.frees_before = (int)(std::lower_bound(free_ticks.begin(), free_ticks.end(), b.alloc_tick) - free_ticks.begin());
+    }
+
+    // greedy by size, place the largest block first at the lowest offset
+    // that does not collide with any placed block alive at the same time
+    std::partial_sort(sorted_blocks.begin(), sorted_blocks.end(), sorted_blocks.end(), arena_block_size_greater);
+
+    size_t peak = 0;
+    std::vector<std::pair<size_t, size_t> > conflicts;
+    for (size_t i = 0; i < sorted_blocks.size(); i++)
+    {
+        arena_block& b = sorted_blocks[i];
+
+        conflicts.clear();
+        for (size_t j = 0; j < i; j++)
+        {
+            const arena_block& p = sorted_blocks[j];
+            if (b.alloc_tick < p.free_tick && p.alloc_tick < b.free_tick)
+                conflicts.push_back(std::make_pair(p.offset, p.offset + p.size));
+        }
+        std::partial_sort(conflicts.begin(), conflicts.end(), conflicts.end(), arena_range_less);
+
+        size_t offset = 0;
+        for (size_t j = 0; j < conflicts.size(); j++)
+        {
+            if (offset + b.size <= conflicts[j].first)
+                break;
+
+            offset = std::max(offset, conflicts[j].second);
+        }
+
+        b.offset = offset;
+        peak = std::max(peak, offset + b.size);
+
+        d->blocks[b.index].offset = offset;
+    }
+
+    d->shared_size = peak;
+
+    for (size_t i = 0; i < d->exclusive_blocks.size(); i++)
+    {
+        arena_block& b = d->blocks[d->exclusive_blocks[i]];
+        b.offset = peak;
+        peak += b.size;
+    }
+
+    d->block_live.assign(block_count, 0);
+
+    d->arena = (unsigned char*)ncnn::fastMalloc(peak);
+    d->arena_size = peak;
+    d->cursor = 0;
+    d->free_cursor = 0;
+    d->diverged = false;
+    d->hit_count = 0;
+    d->fallback_count = 0;
+    d->planned = true;
+
+    return peak;
+}
+
+size_t ArenaAllocator::planned_peak() const
+{
+    return d->planned ? d->arena_size : 0;
+}
+
+size_t ArenaAllocator::arena_hit_count() const
+{
+    return d->hit_count;
+}
+
+size_t ArenaAllocator::heap_fallback_count() const
+{
+    return d->fallback_count;
+}
+
+void ArenaAllocator::clear()
+{
+    MutexLockGuard g(d->lock);
+
+    if (d->live_count != 0)
+    {
+        NCNN_LOGE("arena allocator cleared with %d blocks in use", d->live_count);
+    }
+
+    ncnn::fastFree(d->arena);
+    d->arena = 0;
+    d->arena_size = 0;
+    d->shared_size = 0;
+    d->blocks.clear();
+    d->free_order.clear();
+    d->exclusive_blocks.clear();
+    d->block_live.clear();
+#ifndef NDEBUG
+    d->live.clear();
+#endif
+    d->planned = false;
+    d->tick = 0;
+    d->cursor = 0;
+    d->free_cursor = 0;
+    d->live_count = 0;
+    d->shared_live_count = 0;
+    d->diverged = false;
+    d->hit_count = 0;
+    d->fallback_count = 0;
+}
+
+void* ArenaAllocator::fastMalloc(size_t size)
+{
+    MutexLockGuard g(d->lock);
+
+    if (!d->planned)
+    {
+        void* ptr = ncnn::fastMalloc(size);
+
+        arena_block b;
+        b.index = (int)d->blocks.size();
+        b.size = alignSize(size, NCNN_MALLOC_ALIGN);
+        b.offset = (size_t)-1;
+        b.alloc_tick = d->tick++;
+        b.free_tick = -1;
+        b.ptr = ptr;
+        b.exclusive = false;
+        b.frees_before = 0;
+        d->blocks.push_back(b);
+
+        return ptr;
+    }
+
+    const size_t block_count = d->blocks.size();
+
+    // one inference replayed or abandoned, the next one starts over once its shared blocks are back
+    if ((d->cursor == block_count || d->diverged) && d->shared_live_count == 0)
+    {
+        d->cursor = 0;
+        d->free_cursor = 0;
+        d->diverged = false;
+    }
+
+    // the same inference replays the recorded sequence, the expected block is the only candidate
+    if (!d->diverged && d->cursor < block_count)
+    {
+        const int bi = (int)d->cursor;
+        const arena_block& b = d->blocks[bi];
+        if (b.size == alignSize(size, NCNN_MALLOC_ALIGN) && (b.exclusive || b.frees_before <= (int)d->free_cursor))
+        {
+            d->cursor++;
+
+            // an exclusive block may still be held from the previous inference
+            if (!d->block_live[bi])
+            {
+#ifndef NDEBUG
+                if (d->overlaps_live(b.offset, b.size))
+                {
+                    NCNN_LOGE("FATAL ERROR! arena allocator replay overlaps a live block");
+                }
+                d->live.push_back(std::make_pair(b.offset, b.size));
+#endif
+
+                d->block_live[bi] = 1;
+                d->live_count++;
+                if (!b.exclusive)
+                    d->shared_live_count++;
+                d->hit_count++;
+
+                return d->arena + b.offset;
+            }
+        }
+        else
+        {
+            d->diverged = true;
+        }
+    }
+
+    d->fallback_count++;
+
+    return ncnn::fastMalloc(size);
+}
+
+void ArenaAllocator::fastFree(void* ptr)
+{
+    MutexLockGuard g(d->lock);
+
+    if (!d->planned)
+    {
+        for (int i = (int)d->blocks.size() - 1; i >= 0; i--)
+        {
+            arena_block& b = d->blocks[i];
+            if (b.ptr == ptr && b.free_tick == -1)
+            {
+                b.free_tick = d->tick++;
+                break;
+            }
+        }
+
+        ncnn::fastFree(ptr);
+        return;
+    }
+
+    if (d->arena && (unsigned char*)ptr >= d->arena && (unsigned char*)ptr < d->arena + d->arena_size)
+    {
+        const size_t offset = (unsigned char*)ptr - d->arena;
+
+        if (offset >= d->shared_size)
+        {
+            for (size_t i = 0; i < d->exclusive_blocks.size(); i++)
+            {
+                const int bi = d->exclusive_blocks[i];
+                if (d->blocks[bi].offset == offset && d->block_live[bi])
+                {
+                    d->release_block(bi);
+                    return;
+                }
+            }
+        }
+        else
+        {
+            // the next recorded free
+            if (d->free_cursor < d->free_order.size())
+            {
+                const int bi = d->free_order[d->free_cursor];
+                if (d->blocks[bi].offset == offset && d->block_live[bi])
+                {
+                    d->release_block(bi);
+                    d->free_cursor++;
+                    return;
+                }
+            }
+
+            // freed out of the recorded order, stop replaying until every shared block is back
+            // live shared blocks never overlap, the offset identifies the block
+            for (size_t i = 0; i < d->blocks.size(); i++)
+            {
+                if (d->block_live[i] && !d->blocks[i].exclusive && d->blocks[i].offset == offset)
+                {
+                    d->release_block((int)i);
+                    d->diverged = true;
+                    return;
+                }
+            }
+        }
+
+        NCNN_LOGE("FATAL ERROR! arena allocator get wild %p", ptr);
+        return;
+    }
+
+    // heap fallback or block recorded before planning
+    ncnn::fastFree(ptr);
+}
+
 #if NCNN_VULKAN
 VkAllocator::VkAllocator(const VulkanDevice* _vkdev)
     : vkdev(_vkdev)
@@ -220,6 +220,80 @@ private:
     UnlockedPoolAllocatorPrivate* const d;
 };
 
+class SizeClassPoolAllocatorPrivate;
+class NCNN_EXPORT SizeClassPoolAllocator : public Allocator
+{
+public:
+    SizeClassPoolAllocator();
+    ~SizeClassPoolAllocator();
+
+    // requests are rounded up to one of four size classes per power of two
+    // freed blocks go to the calling thread cache first and overflow into a shared free list
+    // the shared free lists take a per size class lock once per batch, they are not lock-free
+    // blocks cached per size class in each thread before overflowing
+    // blocks move between a thread cache and the shared list in batches of half this count
+    // default count = 4
+    void set_thread_cache_count(int count);
+
+    // release the blocks cached by every thread and the shared free lists
+    // no other thread may use the allocator during clear
+    void clear();
+
+    // requests served from cached blocks
+    size_t hit_count() const;
+    // requests served by the system allocator
+    size_t miss_count() const;
+    // bytes of cached blocks not in use
+    size_t bytes_held() const;
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    SizeClassPoolAllocator(const SizeClassPoolAllocator&);
+    SizeClassPoolAllocator& operator=(const SizeClassPoolAllocator&);
+
+private:
+    SizeClassPoolAllocatorPrivate* const d;
+};
+
+class ArenaAllocatorPrivate;
+class NCNN_EXPORT ArenaAllocator : public Allocator
+{
+public:
+    ArenaAllocator();
+    ~ArenaAllocator();
+
+    // the allocator starts in recording mode, run one inference with the input shapes
+    // to plan for, then call plan() to pack every recorded blob into a single arena
+    // blobs with disjoint lifetimes share the same bytes, blobs alive when planning keep exclusive space
+    // later inferences replay the recorded allocation order, a call leaving it goes to heap
+    // until the arena blocks it handed out are all released
+    // return the planned arena size in bytes
+    size_t plan();
+
+    // arena size in bytes, 0 if not planned yet
+    size_t planned_peak() const;
+
+    // allocations served from the arena and from heap fallback since plan()
+    size_t arena_hit_count() const;
+    size_t heap_fallback_count() const;
+
+    // drop the plan and the arena, start recording again
+    // all the arena blobs must have been released
+    void clear();
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    ArenaAllocator(const ArenaAllocator&);
+    ArenaAllocator& operator=(const ArenaAllocator&);
+
+private:
+    ArenaAllocatorPrivate* const d;
+};
+
 #if NCNN_VULKAN
 
 class VulkanDevice;
@@ -21,6 +21,10 @@
 
 #include "benchmark.h"
 
+#if NCNN_STDIO
+#include <stdio.h>
+#endif // NCNN_STDIO
+
 #if NCNN_BENCHMARK
 #include "layer/convolution.h"
 #include "layer/convolutiondepthwise.h"
@@ -49,6 +53,94 @@ double get_current_time()
 #endif // _WIN32
 }
 
+LayerProfile::LayerProfile()
+{
+    layer = 0;
+    layer_index = -1;
+    start = 0;
+    end = 0;
+    num_threads = 0;
+    thread_index = 0;
+    top_blob_bytes = 0;
+}
+
+#if NCNN_STDIO
+#if NCNN_STRING
+static void write_json_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (const char* p = str; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fputc('\\', fp);
+
+        if ((unsigned char)*p < 0x20)
+            fprintf(fp, "\\u%04x", (unsigned char)*p);
+        else
+            fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+#endif // NCNN_STRING
+
+static void write_json_shapes(FILE* fp, const std::vector<Mat>& shapes)
+{
+    fprintf(fp, "\"");
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        const Mat& m = shapes[i];
+
+        if (i != 0)
+            fprintf(fp, " ");
+
+        if (m.dims == 1) fprintf(fp, "[%d]", m.w);
+        if (m.dims == 2) fprintf(fp, "[%d,%d]", m.w, m.h);
+        if (m.dims == 3) fprintf(fp, "[%d,%d,%d]", m.w, m.h, m.c);
+        if (m.dims == 4) fprintf(fp, "[%d,%d,%d,%d]", m.w, m.h, m.d, m.c);
+    }
+    fprintf(fp, "\"");
+}
+
+int save_chrome_trace(const std::vector<LayerProfile>& profiles, const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    // timestamps in us relative to the first record
+    const double t0 = profiles.empty() ? 0.0 : profiles[0].start;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < profiles.size(); i++)
+    {
+        const LayerProfile& p = profiles[i];
+
+        fprintf(fp, "{\"name\":");
+#if NCNN_STRING
+        write_json_string(fp, p.layer->name.c_str());
+        fprintf(fp, ",\"cat\":");
+        write_json_string(fp, p.layer->type.c_str());
+#else
+        fprintf(fp, "\"%d\",\"cat\":\"%d\"", p.layer_index, p.layer->typeindex);
+#endif
+        fprintf(fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d", (p.start - t0) * 1000, (p.end - p.start) * 1000, p.thread_index);
+        fprintf(fp, ",\"args\":{\"layer_index\":%d,\"num_threads\":%d,\"top_blob_bytes\":%zu,\"bottom_shapes\":", p.layer_index, p.num_threads, p.top_blob_bytes);
+        write_json_shapes(fp, p.bottom_shapes);
+        fprintf(fp, ",\"top_shapes\":");
+        write_json_shapes(fp, p.top_shapes);
+        fprintf(fp, "}}%s\n", i + 1 == profiles.size() ? "" : ",");
+    }
+    fprintf(fp, "]}\n");
+
+    int ret = ferror(fp) ? -1 : 0;
+    fclose(fp);
+    return ret;
+}
+#endif // NCNN_STDIO
+
 #if NCNN_BENCHMARK
 
 void benchmark(const Layer* layer, double start, double end)
@@ -24,6 +24,42 @@ namespace ncnn {
 // get now timestamp in ms
 NCNN_EXPORT double get_current_time();
 
+// one layer run recorded by Extractor profiling
+class NCNN_EXPORT LayerProfile
+{
+public:
+    // empty
+    LayerProfile();
+
+public:
+    // the layer which ran, owned by the net
+    const Layer* layer;
+    int layer_index;
+
+    // wall time in ms, same clock as get_current_time()
+    double start;
+    double end;
+
+    // thread count passed to the layer
+    int num_threads;
+    // thread running the layer, non-zero only when branches run concurrently
+    int thread_index;
+
+    // shapes of input and output blobs, no data
+    std::vector<Mat> bottom_shapes;
+    std::vector<Mat> top_shapes;
+
+    // sum of total() * elemsize of the output blobs, allocator padding not included
+    size_t top_blob_bytes;
+};
+
+#if NCNN_STDIO
+// write layer profiles in chrome trace event format
+// open with chrome://tracing or ui.perfetto.dev
+// return 0 if success
+NCNN_EXPORT int save_chrome_trace(const std::vector<LayerProfile>& profiles, const char* path);
+#endif // NCNN_STDIO
+
 #if NCNN_BENCHMARK
 
 NCNN_EXPORT void benchmark(const Layer* layer, double start, double end);
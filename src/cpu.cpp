@@ -2221,6 +2221,24 @@ int get_omp_thread_num()
 #endif
 }
 
+int get_omp_max_active_levels()
+{
+#if defined(_OPENMP) && !NCNN_SIMPLEOMP
+    return omp_get_max_active_levels();
+#else
+    return 1;
+#endif
+}
+
+void set_omp_max_active_levels(int max_levels)
+{
+#if defined(_OPENMP) && !NCNN_SIMPLEOMP
+    omp_set_max_active_levels(max_levels);
+#else
+    (void)max_levels;
+#endif
+}
+
 int get_kmp_blocktime()
 {
 #if defined(_OPENMP) && __clang__
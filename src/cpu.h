@@ -156,6 +156,9 @@ NCNN_EXPORT void set_omp_dynamic(int dynamic);
 
 NCNN_EXPORT int get_omp_thread_num();
 
+NCNN_EXPORT int get_omp_max_active_levels();
+NCNN_EXPORT void set_omp_max_active_levels(int max_levels);
+
 NCNN_EXPORT int get_kmp_blocktime();
 NCNN_EXPORT void set_kmp_blocktime(int time_ms);
 
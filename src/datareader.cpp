@@ -16,6 +16,17 @@
 
 #include <string.h>
 
+#if NCNN_STDIO
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif // NCNN_STDIO
+
 namespace ncnn {
 
 DataReader::DataReader()
@@ -85,6 +96,148 @@ size_t DataReaderFromStdio::read(void* buf, size_t size) const
 {
     return fread(buf, 1, size, d->fp);
 }
+
+class DataReaderFromMmapPrivate
+{
+public:
+    DataReaderFromMmapPrivate()
+        : mem(0), size(0), offset(0)
+    {
+    }
+    const unsigned char* mem;
+    size_t size;
+    mutable size_t offset;
+};
+
+DataReaderFromMmap::DataReaderFromMmap(const char* path)
+    : DataReader(), d(new DataReaderFromMmapPrivate)
+{
+#if defined _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        NCNN_LOGE("CreateFile %s failed", path);
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        NCNN_LOGE("GetFileSizeEx %s failed", path);
+        CloseHandle(file);
+        return;
+    }
+
+    if (file_size.QuadPart == 0)
+    {
+        NCNN_LOGE("%s is empty", path);
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        NCNN_LOGE("CreateFileMapping %s failed", path);
+        return;
+    }
+
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!ptr)
+    {
+        NCNN_LOGE("MapViewOfFile %s failed", path);
+        return;
+    }
+
+    d->mem = (const unsigned char*)ptr;
+    d->size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        NCNN_LOGE("open %s failed", path);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        NCNN_LOGE("fstat %s failed", path);
+        close(fd);
+        return;
+    }
+
+    if (st.st_size == 0)
+    {
+        NCNN_LOGE("%s is empty", path);
+        close(fd);
+        return;
+    }
+
+    // layers may modify weights in place, private writable pages keep that away from the file
+    void* ptr = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        NCNN_LOGE("mmap %s failed", path);
+        return;
+    }
+
+    d->mem = (const unsigned char*)ptr;
+    d->size = (size_t)st.st_size;
+#endif
+}
+
+DataReaderFromMmap::~DataReaderFromMmap()
+{
+    if (d && d->mem)
+    {
+#if defined _WIN32
+        UnmapViewOfFile((void*)d->mem);
+#else
+        munmap((void*)d->mem, d->size);
+#endif
+    }
+
+    delete d;
+}
+
+DataReaderFromMmap::DataReaderFromMmap(const DataReaderFromMmap&)
+    : d(0)
+{
+}
+
+DataReaderFromMmap& DataReaderFromMmap::operator=(const DataReaderFromMmap&)
+{
+    return *this;
+}
+
+bool DataReaderFromMmap::empty() const
+{
+    return d->mem == 0;
+}
+
+size_t DataReaderFromMmap::read(void* buf, size_t size) const
+{
+    if (d->offset + size > d->size)
+        size = d->size - d->offset;
+
+    memcpy(buf, d->mem + d->offset, size);
+    d->offset += size;
+    return size;
+}
+
+size_t DataReaderFromMmap::reference(size_t size, const void** buf) const
+{
+    if (d->offset + size > d->size)
+        return 0;
+
+    *buf = d->mem + d->offset;
+    d->offset += size;
+    return size;
+}
 #endif // NCNN_STDIO
 
 class DataReaderFromMemoryPrivate
@@ -70,6 +70,30 @@ private:
 private:
     DataReaderFromStdioPrivate* const d;
 };
+
+class DataReaderFromMmapPrivate;
+class NCNN_EXPORT DataReaderFromMmap : public DataReader
+{
+public:
+    // map the whole file with copy-on-write pages
+    // untouched pages are shared with every other process mapping the same file
+    explicit DataReaderFromMmap(const char* path);
+    virtual ~DataReaderFromMmap();
+
+    // return true if the file could not be mapped
+    bool empty() const;
+
+    virtual size_t read(void* buf, size_t size) const;
+    // referenced data stays valid until this reader is destroyed
+    virtual size_t reference(size_t size, const void** buf) const;
+
+private:
+    DataReaderFromMmap(const DataReaderFromMmap&);
+    DataReaderFromMmap& operator=(const DataReaderFromMmap&);
+
+private:
+    DataReaderFromMmapPrivate* const d;
+};
 #endif // NCNN_STDIO
 
 class DataReaderFromMemoryPrivate;
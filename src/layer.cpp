@@ -85,6 +85,26 @@ int Layer::destroy_pipeline(const Option& /*opt*/)
     return 0;
 }
 
+int Layer::save_pipeline(std::vector<Mat>& /*pipeline_data*/) const
+{
+    return -1;
+}
+
+int Layer::load_pipeline(const std::vector<Mat>& /*pipeline_data*/, const Option& /*opt*/)
+{
+    return -1;
+}
+
+int Layer::get_tuned_algorithm() const
+{
+    return -1;
+}
+
+int Layer::set_tuned_algorithm(int /*algo*/)
+{
+    return -1;
+}
+
 int Layer::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
     if (!support_inplace)
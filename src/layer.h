@@ -56,6 +56,22 @@ public:
     // return 0 if success
     virtual int destroy_pipeline(const Option& opt);
 
+    // export the data prepared by create_pipeline
+    // return 0 if success, -1 if not supported
+    virtual int save_pipeline(std::vector<Mat>& pipeline_data) const;
+
+    // restore the data exported by save_pipeline in place of create_pipeline
+    // return 0 if success, -1 if not supported
+    virtual int load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt);
+
+    // kernel variant picked by opt.use_algorithm_tuning in create_pipeline
+    // return -1 if the layer has no variants or picked by heuristics
+    virtual int get_tuned_algorithm() const;
+
+    // use this kernel variant in the following create_pipeline without timing
+    // return 0 if success, -1 if not supported
+    virtual int set_tuned_algorithm(int algo);
+
 public:
     // one input and one output blob
     bool one_blob_only;
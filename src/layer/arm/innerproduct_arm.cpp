@@ -60,6 +60,15 @@ int InnerProduct_arm::create_pipeline(const Option& opt)
         flatten->create_pipeline(opt);
     }
 
+    if (weight_quant_bits)
+    {
+        // weight-only quantized rows are dequantized by the reference path
+        support_packing = false;
+        support_fp16_storage = false;
+        support_bf16_storage = false;
+        return 0;
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -149,6 +158,11 @@ int InnerProduct_arm::destroy_pipeline(const Option& opt)
 
 int InnerProduct_arm::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return InnerProduct::forward(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
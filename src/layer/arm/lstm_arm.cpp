@@ -516,8 +516,10 @@ int LSTM_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     Allocator* hidden_cell_allocator = top_blobs.size() == 3 ? opt.blob_allocator : opt.workspace_allocator;
     if (bottom_blobs.size() == 3)
     {
-        hidden = bottom_blobs[1].clone(hidden_cell_allocator);
-        cell = bottom_blobs[2].clone(hidden_cell_allocator);
+        // state tops sharing their bottoms are updated in place
+        const bool inplace = top_blobs.size() == 3 && top_blobs[1].data == bottom_blobs[1].data && top_blobs[2].data == bottom_blobs[2].data;
+        hidden = inplace ? bottom_blobs[1] : bottom_blobs[1].clone(hidden_cell_allocator);
+        cell = inplace ? bottom_blobs[2] : bottom_blobs[2].clone(hidden_cell_allocator);
     }
     else
     {
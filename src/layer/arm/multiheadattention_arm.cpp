@@ -33,6 +33,18 @@ MultiHeadAttention_arm::MultiHeadAttention_arm()
 
 int MultiHeadAttention_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+    if (attn_mask || kv_cache || (opt.use_int8_inference && int8_scale_term))
+    {
+        // the packed kernels below only know fp32 q k v, defer mask, cache and int8 weights to the reference path
+        std::vector<Mat> bottom_blobs_unpacked(bottom_blobs.size());
+        for (size_t i = 0; i < bottom_blobs.size(); i++)
+        {
+            convert_packing(bottom_blobs[i], bottom_blobs_unpacked[i], 1, opt);
+        }
+
+        return MultiHeadAttention::forward(bottom_blobs_unpacked, top_blobs, opt);
+    }
+
     const Mat& q_blob = bottom_blobs[0];
     const Mat& k_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs[1];
     const Mat& v_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs.size() == 2 ? k_blob : bottom_blobs[2];
@@ -0,0 +1,104 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef DETECTION_POSTPROCESS_H
+#define DETECTION_POSTPROCESS_H
+
+#include "mat.h"
+
+#include <algorithm>
+#include <functional>
+
+// top-k selection and greedy nms shared by the detection output layers
+// boxes are passed as structure of arrays, arch layers test one candidate against many kept boxes in a simd loop
+
+// indices of the topk highest scores from highest to lowest, equal scores keep their original order
+// topk <= 0 keeps all, only the selected head is sorted
+static void detection_topk(const std::vector<float>& scores, int topk, std::vector<int>& indices)
+{
+    const int n = (int)scores.size();
+    if (topk <= 0 || topk > n)
+        topk = n;
+
+    std::vector<std::pair<float, int> > vec(n);
+    for (int i = 0; i < n; i++)
+    {
+        vec[i] = std::make_pair(scores[i], -i);
+    }
+
+    std::partial_sort(vec.begin(), vec.begin() + topk, vec.end(), std::greater<std::pair<float, int> >());
+
+    indices.resize(topk);
+    for (int i = 0; i < topk; i++)
+    {
+        indices[i] = -vec[i].second;
+    }
+}
+
+// greedy nms over boxes sorted from highest to lowest score
+// a box is dropped when its intersection over union with any kept box exceeds nms_threshold
+// stops once max_keep boxes are kept, max_keep <= 0 keeps all
+static void detection_nms_sorted(const float* xmin, const float* ymin, const float* xmax, const float* ymax, int n, float nms_threshold, std::vector<int>& picked, int max_keep = 0)
+{
+    picked.clear();
+
+    // the kept boxes packed together
+    std::vector<float> kxmin(n);
+    std::vector<float> kymin(n);
+    std::vector<float> kxmax(n);
+    std::vector<float> kymax(n);
+    std::vector<float> karea(n);
+
+    int nk = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const float ax0 = xmin[i];
+        const float ay0 = ymin[i];
+        const float ax1 = xmax[i];
+        const float ay1 = ymax[i];
+        const float area = (ax1 - ax0) * (ay1 - ay0);
+
+        // inter_area / union_area > nms_threshold without the division
+        int keep = 1;
+        for (int j = 0; j < nk; j++)
+        {
+            float w = std::min(ax1, kxmax[j]) - std::max(ax0, kxmin[j]);
+            float h = std::min(ay1, kymax[j]) - std::max(ay0, kymin[j]);
+            float inter = std::max(w, 0.f) * std::max(h, 0.f);
+            float union_area = area + karea[j] - inter;
+            if (inter > nms_threshold * union_area)
+            {
+                keep = 0;
+                break;
+            }
+        }
+
+        if (!keep)
+            continue;
+
+        kxmin[nk] = ax0;
+        kymin[nk] = ay0;
+        kxmax[nk] = ax1;
+        kymax[nk] = ay1;
+        karea[nk] = area;
+        nk++;
+
+        picked.push_back(i);
+
+        if (max_keep > 0 && nk == max_keep)
+            break;
+    }
+}
+
+#endif // DETECTION_POSTPROCESS_H
@@ -14,6 +14,8 @@
 
 #include "detectionoutput.h"
 
+#include "detection_postprocess.h"
+
 #include <math.h>
 
 namespace ncnn {
@@ -22,6 +24,8 @@ DetectionOutput::DetectionOutput()
 {
     one_blob_only = false;
     support_inplace = false;
+
+    nms_sorted = detection_nms_sorted;
 }
 
 int DetectionOutput::load_param(const ParamDict& pd)
@@ -48,101 +52,6 @@ struct BBoxRect
     int label;
 };
 
-static inline float intersection_area(const BBoxRect& a, const BBoxRect& b)
-{
-    if (a.xmin > b.xmax || a.xmax < b.xmin || a.ymin > b.ymax || a.ymax < b.ymin)
-    {
-        // no intersection
-        return 0.f;
-    }
-
-    float inter_width = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
-    float inter_height = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
-
-    return inter_width * inter_height;
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores, int left, int right)
-{
-    int i = left;
-    int j = right;
-    float p = scores[(left + right) / 2];
-
-    while (i <= j)
-    {
-        while (scores[i] > p)
-            i++;
-
-        while (scores[j] < p)
-            j--;
-
-        if (i <= j)
-        {
-            // swap
-            std::swap(datas[i], datas[j]);
-            std::swap(scores[i], scores[j]);
-
-            i++;
-            j--;
-        }
-    }
-
-    if (left < j)
-        qsort_descent_inplace(datas, scores, left, j);
-
-    if (i < right)
-        qsort_descent_inplace(datas, scores, i, right);
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores)
-{
-    if (datas.empty() || scores.empty())
-        return;
-
-    qsort_descent_inplace(datas, scores, 0, static_cast<int>(scores.size() - 1));
-}
-
-static void nms_sorted_bboxes(const std::vector<BBoxRect>& bboxes, std::vector<size_t>& picked, float nms_threshold)
-{
-    picked.clear();
-
-    const size_t n = bboxes.size();
-
-    std::vector<float> areas(n);
-    for (size_t i = 0; i < n; i++)
-    {
-        const BBoxRect& r = bboxes[i];
-
-        float width = r.xmax - r.xmin;
-        float height = r.ymax - r.ymin;
-
-        areas[i] = width * height;
-    }
-
-    for (size_t i = 0; i < n; i++)
-    {
-        const BBoxRect& a = bboxes[i];
-
-        int keep = 1;
-        for (int j = 0; j < (int)picked.size(); j++)
-        {
-            const BBoxRect& b = bboxes[picked[j]];
-
-            // intersection over union
-            float inter_area = intersection_area(a, b);
-            float union_area = areas[i] + areas[picked[j]] - inter_area;
-            //             float IoU = inter_area / union_area
-            if (inter_area / union_area > nms_threshold)
-                keep = 0;
-        }
-
-        if (keep)
-            picked.push_back(i);
-    }
-}
-
 int DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
     const Mat& location = bottom_blobs[0];
@@ -209,7 +118,7 @@ int DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::vector<M
     for (int i = 1; i < num_class_copy; i++)
     {
         // filter by confidence_threshold
-        std::vector<BBoxRect> class_bbox_rects;
+        std::vector<int> class_bbox_indices;
         std::vector<float> class_bbox_scores;
 
         for (int j = 0; j < num_prior; j++)
@@ -221,33 +130,40 @@ int DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::vector<M
 
             if (score > confidence_threshold)
             {
-                const float* bbox = bboxes.row(j);
-                BBoxRect c = {bbox[0], bbox[1], bbox[2], bbox[3], i};
-                class_bbox_rects.push_back(c);
+                class_bbox_indices.push_back(j);
                 class_bbox_scores.push_back(score);
             }
         }
 
-        // sort inplace
-        qsort_descent_inplace(class_bbox_rects, class_bbox_scores);
+        // keep nms_top_k sorted
+        std::vector<int> order;
+        detection_topk(class_bbox_scores, nms_top_k, order);
 
-        // keep nms_top_k
-        if (nms_top_k < (int)class_bbox_rects.size())
+        const int n = (int)order.size();
+        std::vector<float> xmin(n);
+        std::vector<float> ymin(n);
+        std::vector<float> xmax(n);
+        std::vector<float> ymax(n);
+        for (int j = 0; j < n; j++)
         {
-            class_bbox_rects.resize(nms_top_k);
-            class_bbox_scores.resize(nms_top_k);
+            const float* bbox = bboxes.row(class_bbox_indices[order[j]]);
+            xmin[j] = bbox[0];
+            ymin[j] = bbox[1];
+            xmax[j] = bbox[2];
+            ymax[j] = bbox[3];
         }
 
         // apply nms
-        std::vector<size_t> picked;
-        nms_sorted_bboxes(class_bbox_rects, picked, nms_threshold);
+        std::vector<int> picked;
+        nms_sorted(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked, 0);
 
         // select
         for (size_t j = 0; j < picked.size(); j++)
         {
-            size_t z = picked[j];
-            all_class_bbox_rects[i].push_back(class_bbox_rects[z]);
-            all_class_bbox_scores[i].push_back(class_bbox_scores[z]);
+            int z = picked[j];
+            BBoxRect c = {xmin[z], ymin[z], xmax[z], ymax[z], i};
+            all_class_bbox_rects[i].push_back(c);
+            all_class_bbox_scores[i].push_back(class_bbox_scores[order[z]]);
         }
     }
 
@@ -264,18 +180,12 @@ int DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::vector<M
         bbox_scores.insert(bbox_scores.end(), class_bbox_scores.begin(), class_bbox_scores.end());
     }
 
-    // global sort inplace
-    qsort_descent_inplace(bbox_rects, bbox_scores);
-
-    // keep_top_k
-    if (keep_top_k < (int)bbox_rects.size())
-    {
-        bbox_rects.resize(keep_top_k);
-        bbox_scores.resize(keep_top_k);
-    }
+    // global sort and keep_top_k
+    std::vector<int> order;
+    detection_topk(bbox_scores, keep_top_k, order);
 
     // fill result
-    int num_detected = static_cast<int>(bbox_rects.size());
+    int num_detected = static_cast<int>(order.size());
     if (num_detected == 0)
         return 0;
 
@@ -286,8 +196,8 @@ int DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::vector<M
 
     for (int i = 0; i < num_detected; i++)
     {
-        const BBoxRect& r = bbox_rects[i];
-        float score = bbox_scores[i];
+        const BBoxRect& r = bbox_rects[order[i]];
+        float score = bbox_scores[order[i]];
         float* outptr = top_blob.row(i);
 
         outptr[0] = static_cast<float>(r.label);
@@ -35,6 +35,10 @@ public:
     int keep_top_k;
     float confidence_threshold;
     float variances[4];
+
+protected:
+    // nms over the boxes sorted by score, arch layers swap in their simd version
+    void (*nms_sorted)(const float* xmin, const float* ymin, const float* xmax, const float* ymax, int n, float nms_threshold, std::vector<int>& picked, int max_keep);
 };
 
 } // namespace ncnn
@@ -14,6 +14,12 @@
 
 #include "gemm.h"
 
+#include "weight_quant.h"
+
+#include <math.h>
+
+#include <algorithm>
+
 namespace ncnn {
 
 Gemm::Gemm()
@@ -39,9 +45,12 @@ int Gemm::load_param(const ParamDict& pd)
     output_elempack = pd.get(12, 0);
     output_elemtype = pd.get(13, 0);
     output_transpose = pd.get(14, 0);
+    int8_scale_term = pd.get(18, 0);
     constant_TILE_M = pd.get(20, 0);
     constant_TILE_N = pd.get(21, 0);
     constant_TILE_K = pd.get(22, 0);
+    weight_quant_bits = pd.get(23, 0);
+    weight_quant_group_size = pd.get(24, 32);
 
     if (constantA == 1 && (constantM == 0 || constantK == 0))
     {
@@ -61,6 +70,27 @@ int Gemm::load_param(const ParamDict& pd)
         return -1;
     }
 
+    if (weight_quant_bits != 0 && weight_quant_bits != 4 && weight_quant_bits != 8)
+    {
+        NCNN_LOGE("weight_quant_bits must be 0, 4 or 8");
+        return -1;
+    }
+
+    if (weight_quant_bits && (weight_quant_group_size <= 0 || int8_scale_term))
+    {
+        NCNN_LOGE("weight_quant_bits requires positive weight_quant_group_size and no int8_scale_term");
+        return -1;
+    }
+
+    // activations stay fp32 and are quantized inside the layer, only the weights are int8
+#if !NCNN_INT8
+    if (int8_scale_term)
+    {
+        NCNN_LOGE("please build ncnn with NCNN_INT8 enabled for int8 inference");
+        return -1;
+    }
+#endif
+
     if (constantA == 0 && constantB == 1 && constantC == 1)
         one_blob_only = true;
 
@@ -77,7 +107,9 @@ int Gemm::load_model(const ModelBin& mb)
 {
     if (constantA == 1)
     {
-        if (transA == 0)
+        if (weight_quant_bits)
+            A_data = mb.load(weight_quant_row_bytes(constantK, weight_quant_bits) * constantM, 0);
+        else if (transA == 0)
             A_data = mb.load(constantK, constantM, 0);
         else
             A_data = mb.load(constantM, constantK, 0);
@@ -87,7 +119,9 @@ int Gemm::load_model(const ModelBin& mb)
 
     if (constantB == 1)
     {
-        if (transB == 0)
+        if (weight_quant_bits)
+            B_data = mb.load(weight_quant_row_bytes(constantK, weight_quant_bits) * constantN, 0);
+        else if (transB == 0)
             B_data = mb.load(constantN, constantK, 0);
         else
             B_data = mb.load(constantK, constantN, 0);
@@ -111,75 +145,185 @@ int Gemm::load_model(const ModelBin& mb)
             return -100;
     }
 
+    if (weight_quant_bits)
+    {
+        const int groups = weight_quant_group_count(constantK, weight_quant_group_size);
+
+        if (constantA == 1)
+        {
+            A_data_quant_scales = mb.load(groups * constantM, 1);
+            if (A_data_quant_scales.empty())
+                return -100;
+        }
+
+        if (constantB == 1)
+        {
+            B_data_quant_scales = mb.load(groups * constantN, 1);
+            if (B_data_quant_scales.empty())
+                return -100;
+        }
+    }
+
+#if NCNN_INT8
+    if (int8_scale_term)
+    {
+        if (constantA == 1)
+        {
+            A_data_int8_scales = mb.load(constantM, 1);
+            if (A_data_int8_scales.empty())
+                return -100;
+        }
+
+        if (constantB == 1)
+        {
+            B_data_int8_scales = mb.load(constantN, 1);
+            if (B_data_int8_scales.empty())
+                return -100;
+        }
+    }
+#endif // NCNN_INT8
+
     return 0;
 }
 
-int Gemm::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+#if NCNN_INT8
+static inline signed char float2int8(float v)
 {
-    std::vector<Mat> bottom_blobs(1, bottom_blob);
-    std::vector<Mat> top_blobs(1, top_blob);
-    int ret = forward(bottom_blobs, top_blobs, opt);
-    top_blob = top_blobs[0];
-    return ret;
+    int int32 = static_cast<int>(round(v));
+    if (int32 > 127) return 127;
+    if (int32 < -127) return -127;
+    return (signed char)int32;
 }
 
-int Gemm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+// gather X as int8 rows of length K, row r is the r-th row of X or the r-th column when transX
+// int8 X is copied with its scales, fp32 X is quantized with fixed_scales or the per-row absmax
+static int gemm_quantize_rows(const Mat& X, int transX, const Mat& fixed_scales, Mat& Xq, Mat& X_scales, const Option& opt)
 {
-    const Mat& A0 = constantA ? A_data : bottom_blobs[0];
-    const Mat& B0 = constantB ? B_data : constantA ? bottom_blobs[0] : bottom_blobs[1];
+    const int X_rows = X.dims == 3 ? X.c : X.h;
+    const int X_hstep = X.dims == 3 ? (int)X.cstep : X.w;
 
-    size_t elemsize = A0.elemsize;
+    const int rows = transX ? X.w : X_rows;
+    const int K = transX ? X_rows : X.w;
 
-    Mat A;
-    if (transA == 0)
+    Xq.create(K, rows, (size_t)1u, opt.workspace_allocator);
+    X_scales.create(rows, (size_t)4u, opt.workspace_allocator);
+    if (Xq.empty() || X_scales.empty())
+        return -100;
+
+    // only the constant operands are int8, they come with their scales
+    if (X.elemsize == 1 && fixed_scales.empty())
     {
-        A = A0;
+        NCNN_LOGE("gemm int8 operand has no scales");
+        return -1;
     }
-    else
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < rows; i++)
     {
-        // transpose A to row-major
-        A.create((A0.dims == 3 ? A0.c : A0.h), A0.w, elemsize, opt.workspace_allocator);
+        signed char* outptr = Xq.row<signed char>(i);
 
-        const int A0_hstep = A0.dims == 3 ? (int)A0.cstep : A0.w;
+        if (X.elemsize == 1)
+        {
+            const signed char* ptr = X;
+            for (int k = 0; k < K; k++)
+            {
+                outptr[k] = transX ? ptr[k * X_hstep + i] : ptr[i * X_hstep + k];
+            }
 
-        for (int i = 0; i < A.h; i++)
+            X_scales[i] = fixed_scales[i];
+            continue;
+        }
+
+        const float* ptr = X;
+
+        float scale;
+        if (!fixed_scales.empty())
         {
-            float* ptr = A.row(i);
-            for (int j = 0; j < A.w; j++)
+            scale = fixed_scales[i];
+        }
+        else
+        {
+            float absmax = 0.f;
+            for (int k = 0; k < K; k++)
             {
-                ptr[j] = A0[j * A0_hstep + i];
+                absmax = std::max(absmax, (float)fabs(transX ? ptr[k * X_hstep + i] : ptr[i * X_hstep + k]));
             }
+
+            scale = absmax == 0.f ? 1.f : 127.f / absmax;
         }
+
+        for (int k = 0; k < K; k++)
+        {
+            outptr[k] = float2int8((transX ? ptr[k * X_hstep + i] : ptr[i * X_hstep + k]) * scale);
+        }
+
+        X_scales[i] = scale;
     }
 
-    Mat B;
-    if (transB == 0)
-    {
-        // transpose B to col-major
-        B.create((B0.dims == 3 ? B0.c : B0.h), B0.w, elemsize, opt.workspace_allocator);
+    return 0;
+}
 
-        const int B0_hstep = B0.dims == 3 ? (int)B0.cstep : B0.w;
+// quantize a constant matrix in place of its layout, scales index the rows or the columns
+static int gemm_quantize_constant(const Mat& X, int per_column, const Mat& scales, Mat& Xq)
+{
+    const int X_rows = X.dims == 3 ? X.c : X.h;
+    const int X_hstep = X.dims == 3 ? (int)X.cstep : X.w;
 
-        for (int i = 0; i < B.h; i++)
+    Xq.create(X.w, X_rows, (size_t)1u);
+    if (Xq.empty())
+        return -100;
+
+    for (int i = 0; i < X_rows; i++)
+    {
+        const float* ptr = (const float*)X + i * X_hstep;
+        signed char* outptr = Xq.row<signed char>(i);
+
+        for (int j = 0; j < X.w; j++)
         {
-            float* ptr = B.row(i);
-            for (int j = 0; j < B.w; j++)
-            {
-                ptr[j] = B0[j * B0_hstep + i];
-            }
+            outptr[j] = float2int8(ptr[j] * scales[per_column ? j : i]);
         }
     }
-    else
+
+    return 0;
+}
+#endif // NCNN_INT8
+
+int Gemm::create_pipeline(const Option& opt)
+{
+#if NCNN_INT8
+    // runtime quantize the constant matrices
+    if (opt.use_int8_inference && int8_scale_term)
     {
-        B = B0;
+        if (constantA && A_data.elemsize == (size_t)4u)
+        {
+            Mat A_data_int8;
+            int ret = gemm_quantize_constant(A_data, transA, A_data_int8_scales, A_data_int8);
+            if (ret != 0)
+                return ret;
+
+            A_data = A_data_int8;
+        }
+
+        if (constantB && B_data.elemsize == (size_t)4u)
+        {
+            Mat B_data_int8;
+            int ret = gemm_quantize_constant(B_data, transB ? 0 : 1, B_data_int8_scales, B_data_int8);
+            if (ret != 0)
+                return ret;
+
+            B_data = B_data_int8;
+        }
     }
+#else
+    (void)(opt);
+#endif // NCNN_INT8
 
-    int M = A.dims == 3 ? A.c : A.h;
-    int K = A.w; // assert A.w == B.w
-    int N = B.dims == 3 ? B.c : B.h;
+    return 0;
+}
 
+const float* Gemm::resolve_C(const std::vector<Mat>& bottom_blobs, int M, int N, int& broadcast_type_C) const
+{
     const float* ptrC = 0;
-    int broadcast_type_C = 0;
     if (constantC)
     {
         ptrC = C_data;
@@ -242,6 +386,114 @@ int Gemm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
         }
     }
 
+    return ptrC;
+}
+
+// expand weight-only quantized rows of length K to fp32
+static int gemm_dequantize_rows(const Mat& Xq, const Mat& scales, int rows, int K, int bits, int group_size, Mat& X, const Option& opt)
+{
+    X.create(K, rows, 4u, opt.workspace_allocator);
+    if (X.empty())
+        return -100;
+
+    const int row_bytes = weight_quant_row_bytes(K, bits);
+    const int groups = weight_quant_group_count(K, group_size);
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < rows; i++)
+    {
+        weight_quant_dequantize_row((const unsigned char*)Xq + row_bytes * i, (const float*)scales + groups * i, bits, group_size, 0, K, X.row(i));
+    }
+
+    return 0;
+}
+
+int Gemm::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    std::vector<Mat> bottom_blobs(1, bottom_blob);
+    std::vector<Mat> top_blobs(1, top_blob);
+    int ret = forward(bottom_blobs, top_blobs, opt);
+    top_blob = top_blobs[0];
+    return ret;
+}
+
+int Gemm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+#if NCNN_INT8
+    if (opt.use_int8_inference && int8_scale_term)
+    {
+        return forward_int8(bottom_blobs, top_blobs, opt);
+    }
+#endif
+
+    const Mat& A0 = constantA ? A_data : bottom_blobs[0];
+    const Mat& B0 = constantB ? B_data : constantA ? bottom_blobs[0] : bottom_blobs[1];
+
+    size_t elemsize = weight_quant_bits ? 4u : A0.elemsize;
+
+    Mat A;
+    if (constantA && weight_quant_bits)
+    {
+        int ret = gemm_dequantize_rows(A_data, A_data_quant_scales, constantM, constantK, weight_quant_bits, weight_quant_group_size, A, opt);
+        if (ret != 0)
+            return ret;
+    }
+    else if (transA == 0)
+    {
+        A = A0;
+    }
+    else
+    {
+        // transpose A to row-major
+        A.create((A0.dims == 3 ? A0.c : A0.h), A0.w, elemsize, opt.workspace_allocator);
+
+        const int A0_hstep = A0.dims == 3 ? (int)A0.cstep : A0.w;
+
+        for (int i = 0; i < A.h; i++)
+        {
+            float* ptr = A.row(i);
+            for (int j = 0; j < A.w; j++)
+            {
+                ptr[j] = A0[j * A0_hstep + i];
+            }
+        }
+    }
+
+    Mat B;
+    if (constantB && weight_quant_bits)
+    {
+        int ret = gemm_dequantize_rows(B_data, B_data_quant_scales, constantN, constantK, weight_quant_bits, weight_quant_group_size, B, opt);
+        if (ret != 0)
+            return ret;
+    }
+    else if (transB == 0)
+    {
+        // transpose B to col-major
+        B.create((B0.dims == 3 ? B0.c : B0.h), B0.w, elemsize, opt.workspace_allocator);
+
+        const int B0_hstep = B0.dims == 3 ? (int)B0.cstep : B0.w;
+
+        for (int i = 0; i < B.h; i++)
+        {
+            float* ptr = B.row(i);
+            for (int j = 0; j < B.w; j++)
+            {
+                ptr[j] = B0[j * B0_hstep + i];
+            }
+        }
+    }
+    else
+    {
+        B = B0;
+    }
+
+    int M = A.dims == 3 ? A.c : A.h;
+    int K = A.w; // assert A.w == B.w
+    int N = B.dims == 3 ? B.c : B.h;
+
+    int broadcast_type_C = 0;
+    const float* ptrC = resolve_C(bottom_blobs, M, N, broadcast_type_C);
+
     Mat& top_blob = top_blobs[0];
     if (output_transpose)
     {
@@ -322,4 +574,118 @@ int Gemm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
     return 0;
 }
 
+#if NCNN_INT8
+int Gemm::forward_int8(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& A0 = constantA ? A_data : bottom_blobs[0];
+    const Mat& B0 = constantB ? B_data : constantA ? bottom_blobs[0] : bottom_blobs[1];
+
+    // A as int8 rows of M, B as int8 columns of N
+    Mat A;
+    Mat A_scales;
+    int ret = gemm_quantize_rows(A0, transA, constantA ? A_data_int8_scales : Mat(), A, A_scales, opt);
+    if (ret != 0)
+        return ret;
+
+    Mat B;
+    Mat B_scales;
+    ret = gemm_quantize_rows(B0, transB ? 0 : 1, constantB ? B_data_int8_scales : Mat(), B, B_scales, opt);
+    if (ret != 0)
+        return ret;
+
+    const int M = A.h;
+    const int K = A.w; // assert A.w == B.w
+    const int N = B.h;
+
+    int broadcast_type_C = 0;
+    const float* ptrC = resolve_C(bottom_blobs, M, N, broadcast_type_C);
+
+    Mat& top_blob = top_blobs[0];
+    if (output_transpose)
+    {
+        if (output_N1M)
+            top_blob.create(M, 1, N, 4u, opt.blob_allocator);
+        else
+            top_blob.create(M, N, 4u, opt.blob_allocator);
+    }
+    else
+    {
+        if (output_N1M)
+            top_blob.create(N, 1, M, 4u, opt.blob_allocator);
+        else
+            top_blob.create(N, M, 4u, opt.blob_allocator);
+    }
+    if (top_blob.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < M; i++)
+    {
+        const int out_hstep = top_blob.dims == 3 ? (int)top_blob.cstep : top_blob.w;
+
+        const signed char* ptrA = A.row<const signed char>(i);
+
+        for (int j = 0; j < N; j++)
+        {
+            const signed char* ptrB = B.row<const signed char>(j);
+
+            int sum = 0;
+            for (int k = 0; k < K; k++)
+            {
+                sum += ptrA[k] * ptrB[k];
+            }
+
+            // dequantize
+            float descale;
+            if (A_scales[i] == 0.f || B_scales[j] == 0.f)
+                descale = 0.f;
+            else
+                descale = 1.f / (A_scales[i] * B_scales[j]);
+
+            float sumfp32 = sum * descale;
+
+            if (ptrC)
+            {
+                float c = 0.f;
+                if (broadcast_type_C == 0)
+                {
+                    c = ptrC[0];
+                }
+                if (broadcast_type_C == 1)
+                {
+                    c = ptrC[i];
+                }
+                if (broadcast_type_C == 2)
+                {
+                    c = ptrC[i];
+                }
+                if (broadcast_type_C == 3)
+                {
+                    c = ptrC[i * N + j];
+                }
+                if (broadcast_type_C == 4)
+                {
+                    c = ptrC[j];
+                }
+
+                sumfp32 += c * beta;
+            }
+
+            sumfp32 *= alpha;
+
+            if (output_transpose)
+            {
+                top_blob[j * out_hstep + i] = sumfp32;
+            }
+            else
+            {
+                top_blob[i * out_hstep + j] = sumfp32;
+            }
+        }
+    }
+
+    return 0;
+}
+#endif // NCNN_INT8
+
 } // namespace ncnn
@@ -28,10 +28,19 @@ public:
 
     virtual int load_model(const ModelBin& mb);
 
+    virtual int create_pipeline(const Option& opt);
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
 
+protected:
+    const float* resolve_C(const std::vector<Mat>& bottom_blobs, int M, int N, int& broadcast_type_C) const;
+
+#if NCNN_INT8
+    int forward_int8(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
+#endif
+
 public:
     float alpha;
     float beta;
@@ -50,6 +59,12 @@ public:
     int output_elemtype; // 0=auto 1=fp32
     int output_transpose;
 
+    int int8_scale_term;
+
+    // 0=off 4=int4 8=int8 weight-only quantization of constant A / B
+    int weight_quant_bits;
+    int weight_quant_group_size;
+
     int constant_TILE_M;
     int constant_TILE_N;
     int constant_TILE_K;
@@ -58,6 +73,18 @@ public:
     Mat A_data;
     Mat B_data;
     Mat C_data;
+
+    // weight-only quantized A is stored as M rows of K and B as N rows of K, whatever transA / transB
+    // with per-group dequantize scales
+    Mat A_data_quant_scales;
+    Mat B_data_quant_scales;
+
+#if NCNN_INT8
+    // per-row scales of constant A and per-column scales of constant B
+    // the other operand is quantized per row / column at runtime
+    Mat A_data_int8_scales;
+    Mat B_data_int8_scales;
+#endif
 };
 
 } // namespace ncnn
@@ -17,6 +17,7 @@
 #include "layer_type.h"
 
 #include "fused_activation.h"
+#include "weight_quant.h"
 
 namespace ncnn {
 
@@ -34,6 +35,20 @@ int InnerProduct::load_param(const ParamDict& pd)
     int8_scale_term = pd.get(8, 0);
     activation_type = pd.get(9, 0);
     activation_params = pd.get(10, Mat());
+    weight_quant_bits = pd.get(11, 0);
+    weight_quant_group_size = pd.get(12, 32);
+
+    if (weight_quant_bits != 0 && weight_quant_bits != 4 && weight_quant_bits != 8)
+    {
+        NCNN_LOGE("weight_quant_bits must be 0, 4 or 8");
+        return -1;
+    }
+
+    if (weight_quant_bits && (weight_quant_group_size <= 0 || int8_scale_term))
+    {
+        NCNN_LOGE("weight_quant_bits requires positive weight_quant_group_size and no int8_scale_term");
+        return -1;
+    }
 
     if (int8_scale_term)
     {
@@ -50,7 +65,17 @@ int InnerProduct::load_param(const ParamDict& pd)
 
 int InnerProduct::load_model(const ModelBin& mb)
 {
-    weight_data = mb.load(weight_data_size, 0);
+    const int num_input = weight_data_size / num_output;
+
+    if (weight_quant_bits)
+    {
+        // num_output rows of packed int4 / int8 values, kept compressed
+        weight_data = mb.load(weight_quant_row_bytes(num_input, weight_quant_bits) * num_output, 0);
+    }
+    else
+    {
+        weight_data = mb.load(weight_data_size, 0);
+    }
     if (weight_data.empty())
         return -100;
 
@@ -61,6 +86,13 @@ int InnerProduct::load_model(const ModelBin& mb)
             return -100;
     }
 
+    if (weight_quant_bits)
+    {
+        weight_data_quant_scales = mb.load(weight_quant_group_count(num_input, weight_quant_group_size) * num_output, 1);
+        if (weight_data_quant_scales.empty())
+            return -100;
+    }
+
 #if NCNN_INT8
     if (int8_scale_term)
     {
@@ -100,6 +132,11 @@ int InnerProduct::create_pipeline(const Option& opt)
 
 int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return forward_weight_quant(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -180,6 +217,66 @@ int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob, const Option& o
     return 0;
 }
 
+int InnerProduct::forward_weight_quant(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    const int num_input = weight_data_size / num_output;
+
+    const int row_bytes = weight_quant_row_bytes(num_input, weight_quant_bits);
+    const int groups = weight_quant_group_count(num_input, weight_quant_group_size);
+
+    // treat a 1-D or flattened input as a single row
+    const int h = bottom_blob.dims == 2 && bottom_blob.w == num_input ? bottom_blob.h : 1;
+
+    if (bottom_blob.dims == 2 && bottom_blob.w == num_input && h > 1)
+        top_blob.create(num_output, h, 4u, opt.blob_allocator);
+    else
+        top_blob.create(num_output, 4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int p = 0; p < num_output; p++)
+    {
+        const unsigned char* kptr = (const unsigned char*)weight_data + row_bytes * p;
+        const float* scales = (const float*)weight_data_quant_scales + groups * p;
+
+        for (int j = 0; j < h; j++)
+        {
+            float sum = 0.f;
+
+            if (bias_term)
+                sum = bias_data[p];
+
+            if (bottom_blob.dims == 3)
+            {
+                // channels are cstep apart, walk them one by one
+                const int size = bottom_blob.w * bottom_blob.h;
+                for (int q = 0; q < bottom_blob.c; q++)
+                {
+                    const float* m = bottom_blob.channel(q);
+                    for (int i = 0; i < size; i++)
+                    {
+                        const int k = size * q + i;
+                        sum += m[i] * (weight_quant_value(kptr, weight_quant_bits, k) * scales[k / weight_quant_group_size]);
+                    }
+                }
+            }
+            else
+            {
+                const float* m = (const float*)bottom_blob + num_input * j;
+                for (int k = 0; k < num_input; k++)
+                {
+                    sum += m[k] * (weight_quant_value(kptr, weight_quant_bits, k) * scales[k / weight_quant_group_size]);
+                }
+            }
+
+            top_blob.row(j)[p] = activation_ss(sum, activation_type, activation_params);
+        }
+    }
+
+    return 0;
+}
+
 #if NCNN_INT8
 int InnerProduct::forward_int8(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
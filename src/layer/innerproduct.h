@@ -33,6 +33,7 @@ public:
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
 protected:
+    int forward_weight_quant(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 #if NCNN_INT8
     int forward_int8(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 #endif
@@ -50,10 +51,17 @@ public:
     int activation_type;
     Mat activation_params;
 
+    // 0=off 4=int4 8=int8 weight-only quantization
+    int weight_quant_bits;
+    int weight_quant_group_size;
+
     // model
     Mat weight_data;
     Mat bias_data;
 
+    // per-group dequantize scales of the weight-only quantized weight_data
+    Mat weight_data_quant_scales;
+
 #if NCNN_INT8
     Mat weight_data_int8_scales;
     Mat bottom_blob_int8_scales;
@@ -46,6 +46,13 @@ int InnerProduct_loongarch::create_pipeline(const Option& opt)
         flatten->create_pipeline(opt);
     }
 
+    if (weight_quant_bits)
+    {
+        // weight-only quantized rows are dequantized by the reference path
+        support_packing = false;
+        return 0;
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -121,6 +128,11 @@ int InnerProduct_loongarch::destroy_pipeline(const Option& opt)
 
 int InnerProduct_loongarch::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return InnerProduct::forward(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
@@ -15,6 +15,7 @@
 #include "multiheadattention.h"
 
 #include <float.h>
+#include <math.h>
 
 namespace ncnn {
 
@@ -29,6 +30,18 @@ int MultiHeadAttention::load_param(const ParamDict& pd)
     weight_data_size = pd.get(2, 0);
     kdim = pd.get(3, embed_dim);
     vdim = pd.get(4, embed_dim);
+    attn_mask = pd.get(5, 0);
+    kv_cache = pd.get(6, 0);
+    int8_scale_term = pd.get(18, 0);
+
+    // activations stay fp32 and are quantized inside the layer, only the weights are int8
+#if !NCNN_INT8
+    if (int8_scale_term)
+    {
+        NCNN_LOGE("please build ncnn with NCNN_INT8 enabled for int8 inference");
+        return -1;
+    }
+#endif
 
     return 0;
 }
@@ -67,27 +80,173 @@ int MultiHeadAttention::load_model(const ModelBin& mb)
     if (out_bias_data.empty())
         return -100;
 
+#if NCNN_INT8
+    if (int8_scale_term)
+    {
+        q_weight_data_int8_scales = mb.load(embed_dim, 1);
+        k_weight_data_int8_scales = mb.load(embed_dim, 1);
+        v_weight_data_int8_scales = mb.load(embed_dim, 1);
+        out_weight_data_int8_scales = mb.load(embed_dim, 1);
+        if (q_weight_data_int8_scales.empty() || k_weight_data_int8_scales.empty() || v_weight_data_int8_scales.empty() || out_weight_data_int8_scales.empty())
+            return -100;
+    }
+#endif // NCNN_INT8
+
     return 0;
 }
 
+#if NCNN_INT8
+static inline signed char float2int8(float v)
+{
+    int int32 = static_cast<int>(round(v));
+    if (int32 > 127) return 127;
+    if (int32 < -127) return -127;
+    return (signed char)int32;
+}
+
+static float int8_row_scale(const float* ptr, int K)
+{
+    float absmax = 0.f;
+    for (int k = 0; k < K; k++)
+    {
+        absmax = std::max(absmax, (float)fabs(ptr[k]));
+    }
+
+    return absmax == 0.f ? 1.f : 127.f / absmax;
+}
+
+// round trip through int8, matches the quantized gemm up to float summation order
+static void quantize_dequantize_row(const float* ptr, float* outptr, int K, float scale)
+{
+    const float descale = scale == 0.f ? 0.f : 1.f / scale;
+    for (int k = 0; k < K; k++)
+    {
+        outptr[k] = float2int8(ptr[k] * scale) * descale;
+    }
+}
+
+// tokens are quantized per row with their own absmax
+static int quantize_dequantize_tokens(const Mat& blob, Mat& blob_q, const Option& opt)
+{
+    blob_q.create(blob.w, blob.h, 4u, opt.workspace_allocator);
+    if (blob_q.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < blob.h; i++)
+    {
+        const float* ptr = blob.row(i);
+        quantize_dequantize_row(ptr, blob_q.row(i), blob.w, int8_row_scale(ptr, blob.w));
+    }
+
+    return 0;
+}
+
+// weights are quantized per output channel with the scales from the model
+static int dequantize_weight(const Mat& weight, const Mat& scales, int K, Mat& weight_q, const Option& opt)
+{
+    const int outch = scales.w;
+
+    weight_q.create(K * outch, 4u, opt.workspace_allocator);
+    if (weight_q.empty())
+        return -100;
+
+    for (int p = 0; p < outch; p++)
+    {
+        float* outptr = (float*)weight_q + K * p;
+
+        if (weight.elemsize == (size_t)1u)
+        {
+            const signed char* ptr = (const signed char*)weight + K * p;
+            const float descale = scales[p] == 0.f ? 0.f : 1.f / scales[p];
+            for (int k = 0; k < K; k++)
+            {
+                outptr[k] = ptr[k] * descale;
+            }
+        }
+        else
+        {
+            quantize_dequantize_row((const float*)weight + K * p, outptr, K, scales[p]);
+        }
+    }
+
+    return 0;
+}
+#endif // NCNN_INT8
+
 // refers to https://pytorch.org/docs/stable/generated/torch.nn.MultiheadAttention.html
 int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+    // bottoms are q [k] [v] [attn_mask] [cache_k cache_v]
+    const int qkv_count = (int)bottom_blobs.size() - (attn_mask ? 1 : 0) - (kv_cache ? 2 : 0);
+
     const Mat& q_blob = bottom_blobs[0];
-    const Mat& k_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs[1];
-    const Mat& v_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs.size() == 2 ? k_blob : bottom_blobs[2];
+    const Mat& k_blob = qkv_count == 1 ? q_blob : bottom_blobs[1];
+    const Mat& v_blob = qkv_count == 1 ? q_blob : qkv_count == 2 ? k_blob : bottom_blobs[2];
+    const Mat& attn_mask_blob = attn_mask ? bottom_blobs[qkv_count] : Mat();
+    const Mat& cache_k_blob = kv_cache ? bottom_blobs[bottom_blobs.size() - 2] : Mat();
+    const Mat& cache_v_blob = kv_cache ? bottom_blobs[bottom_blobs.size() - 1] : Mat();
+
+    Mat q_affine_blob = q_blob;
+    Mat k_affine_blob = k_blob;
+    Mat v_affine_blob = v_blob;
+    Mat q_weight = q_weight_data;
+    Mat k_weight = k_weight_data;
+    Mat v_weight = v_weight_data;
+    Mat out_weight = out_weight_data;
+
+#if NCNN_INT8
+    const bool use_int8 = opt.use_int8_inference && int8_scale_term;
+    if (use_int8)
+    {
+        // int8 affine on quantized tokens and weights
+        if (quantize_dequantize_tokens(q_blob, q_affine_blob, opt) != 0)
+            return -100;
+        if (quantize_dequantize_tokens(k_blob, k_affine_blob, opt) != 0)
+            return -100;
+        if (quantize_dequantize_tokens(v_blob, v_affine_blob, opt) != 0)
+            return -100;
+
+        if (dequantize_weight(q_weight_data, q_weight_data_int8_scales, embed_dim, q_weight, opt) != 0)
+            return -100;
+        if (dequantize_weight(k_weight_data, k_weight_data_int8_scales, kdim, k_weight, opt) != 0)
+            return -100;
+        if (dequantize_weight(v_weight_data, v_weight_data_int8_scales, vdim, v_weight, opt) != 0)
+            return -100;
+        if (dequantize_weight(out_weight_data, out_weight_data_int8_scales, embed_dim, out_weight, opt) != 0)
+            return -100;
+    }
+#endif // NCNN_INT8
+
+    // cached k v are already projected, only the new tokens go through affine
+    const int past_seqlen = cache_k_blob.dims == 2 ? cache_k_blob.h : 0;
+    const int cur_seqlen = k_blob.h;
 
     const int src_seqlen = q_blob.h;
-    const int dst_seqlen = k_blob.h;
+    const int dst_seqlen = past_seqlen + cur_seqlen;
     const int embed_dim_per_head = embed_dim / num_head;
 
     // assert k_blob.h == v_blob.h
+    // assert cache_k_blob.h == cache_v_blob.h
 
     Mat& top_blob = top_blobs[0];
     top_blob.create(embed_dim, src_seqlen, 4u, opt.blob_allocator);
     if (top_blob.empty())
         return -1;
 
+    Mat cache_k_out;
+    Mat cache_v_out;
+    if (kv_cache)
+    {
+        top_blobs[1].create(embed_dim, dst_seqlen, 4u, opt.blob_allocator);
+        top_blobs[2].create(embed_dim, dst_seqlen, 4u, opt.blob_allocator);
+        if (top_blobs[1].empty() || top_blobs[2].empty())
+            return -1;
+
+        cache_k_out = top_blobs[1];
+        cache_v_out = top_blobs[2];
+    }
+
     Mat xq(embed_dim_per_head, src_seqlen, num_head, 4u, opt.workspace_allocator);
     Mat xk(embed_dim_per_head, dst_seqlen, num_head, 4u, opt.workspace_allocator);
     Mat xv(dst_seqlen, embed_dim_per_head, num_head, 4u, opt.workspace_allocator);
@@ -111,8 +270,8 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
 
                 for (int j = 0; j < embed_dim_per_head; j++)
                 {
-                    const float* ptr = q_blob.row(i);
-                    const float* kptr = (const float*)q_weight_data + embed_dim * (q * embed_dim_per_head + j);
+                    const float* ptr = q_affine_blob.row(i);
+                    const float* kptr = (const float*)q_weight + embed_dim * (q * embed_dim_per_head + j);
 
                     float sum = q_bias_data[q * embed_dim_per_head + j];
                     for (int k = 0; k < embed_dim; k++)
@@ -125,18 +284,29 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
             }
         }
 
-        // xk = affine(k)
+        // xk = concat(cache_k, affine(k))
         {
             Mat outm = xk.channel(q);
 
-            for (int i = 0; i < dst_seqlen; i++)
+            for (int i = 0; i < past_seqlen; i++)
+            {
+                const float* ptr = (const float*)cache_k_blob.row(i) + q * embed_dim_per_head;
+                float* outptr = outm.row(i);
+
+                for (int j = 0; j < embed_dim_per_head; j++)
+                {
+                    outptr[j] = ptr[j];
+                }
+            }
+
+            for (int i = past_seqlen; i < dst_seqlen; i++)
             {
                 float* outptr = outm.row(i);
 
                 for (int j = 0; j < embed_dim_per_head; j++)
                 {
-                    const float* ptr = k_blob.row(i);
-                    const float* kptr = (const float*)k_weight_data + kdim * (q * embed_dim_per_head + j);
+                    const float* ptr = k_affine_blob.row(i - past_seqlen);
+                    const float* kptr = (const float*)k_weight + kdim * (q * embed_dim_per_head + j);
 
                     float sum = k_bias_data[q * embed_dim_per_head + j];
                     for (int k = 0; k < kdim; k++)
@@ -149,16 +319,23 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
             }
         }
 
-        // xv = affine(v)
+        // xv = concat(cache_v, affine(v))
         {
             Mat outm = xv.channel(q);
 
             for (int i = 0; i < embed_dim_per_head; i++)
             {
-                for (int j = 0; j < dst_seqlen; j++)
+                float* outptr = outm.row(i);
+
+                for (int j = 0; j < past_seqlen; j++)
+                {
+                    outptr[j] = cache_v_blob.row(j)[q * embed_dim_per_head + i];
+                }
+
+                for (int j = past_seqlen; j < dst_seqlen; j++)
                 {
-                    const float* ptr = v_blob.row(j);
-                    const float* kptr = (const float*)v_weight_data + vdim * (q * embed_dim_per_head + i);
+                    const float* ptr = v_affine_blob.row(j - past_seqlen);
+                    const float* kptr = (const float*)v_weight + vdim * (q * embed_dim_per_head + i);
 
                     float sum = v_bias_data[q * embed_dim_per_head + i];
                     for (int k = 0; k < vdim; k++)
@@ -166,13 +343,31 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
                         sum += *ptr++ * *kptr++;
                     }
 
-                    float* outptr = outm.row(i);
-
                     outptr[j] = sum;
                 }
             }
         }
 
+        // cache_k = xk  cache_v = xv
+        if (kv_cache)
+        {
+            const Mat xkm = xk.channel(q);
+            const Mat xvm = xv.channel(q);
+
+            for (int i = 0; i < dst_seqlen; i++)
+            {
+                const float* kptr = xkm.row(i);
+                float* outkptr = (float*)cache_k_out.row(i) + q * embed_dim_per_head;
+                float* outvptr = (float*)cache_v_out.row(i) + q * embed_dim_per_head;
+
+                for (int j = 0; j < embed_dim_per_head; j++)
+                {
+                    outkptr[j] = kptr[j];
+                    outvptr[j] = xvm.row(j)[i];
+                }
+            }
+        }
+
         // xqk = xq * xk
         // xq  (embed_dim_per_head, src_seqlen)
         // xk  (embed_dim_per_head, dst_seqlen)
@@ -202,6 +397,25 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
             }
         }
 
+        // xqk += attn_mask
+        if (attn_mask)
+        {
+            const Mat maskm = attn_mask_blob.dims == 3 ? attn_mask_blob.channel(q) : attn_mask_blob;
+
+            Mat outm = xqk.channel(q);
+
+            for (int i = 0; i < src_seqlen; i++)
+            {
+                const float* mptr = maskm.row(i);
+                float* outptr = outm.row(i);
+
+                for (int j = 0; j < dst_seqlen; j++)
+                {
+                    outptr[j] += mptr[j];
+                }
+            }
+        }
+
         // softmax(xqk)
         {
             Mat outm = xqk.channel(q);
@@ -266,10 +480,18 @@ int MultiHeadAttention::forward(const std::vector<Mat>& bottom_blobs, std::vecto
     {
         float* outptr = top_blob.row(i);
 
+#if NCNN_INT8
+        if (use_int8)
+        {
+            float* ptr = xqkv.channel(i);
+            quantize_dequantize_row(ptr, ptr, embed_dim, int8_row_scale(ptr, embed_dim));
+        }
+#endif // NCNN_INT8
+
         for (int j = 0; j < embed_dim; j++)
         {
             const float* ptr = xqkv.channel(i);
-            const float* kptr = (const float*)out_weight_data + embed_dim * j;
+            const float* kptr = (const float*)out_weight + embed_dim * j;
 
             float sum = out_bias_data[j];
             for (int k = 0; k < embed_dim; k++)
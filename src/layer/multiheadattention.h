@@ -36,6 +36,9 @@ public:
     int weight_data_size;
     int kdim;
     int vdim;
+    int attn_mask;
+    int kv_cache;
+    int int8_scale_term;
 
     Mat q_weight_data;
     Mat q_bias_data;
@@ -45,6 +48,14 @@ public:
     Mat v_bias_data;
     Mat out_weight_data;
     Mat out_bias_data;
+
+#if NCNN_INT8
+    // per output channel, the projected tokens are quantized at runtime
+    Mat q_weight_data_int8_scales;
+    Mat k_weight_data_int8_scales;
+    Mat v_weight_data_int8_scales;
+    Mat out_weight_data_int8_scales;
+#endif // NCNN_INT8
 };
 
 } // namespace ncnn
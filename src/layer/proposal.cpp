@@ -14,6 +14,8 @@
 
 #include "proposal.h"
 
+#include "detection_postprocess.h"
+
 #include <math.h>
 
 namespace ncnn {
@@ -23,6 +25,8 @@ Proposal::Proposal()
     one_blob_only = false;
     support_inplace = false;
 
+    nms_sorted = detection_nms_sorted;
+
     // TODO load from param
     ratios.create(3);
     ratios[0] = 0.5f;
@@ -89,109 +93,6 @@ int Proposal::load_param(const ParamDict& pd)
     return 0;
 }
 
-struct Rect
-{
-    float x1;
-    float y1;
-    float x2;
-    float y2;
-};
-
-static inline float intersection_area(const Rect& a, const Rect& b)
-{
-    if (a.x1 > b.x2 || a.x2 < b.x1 || a.y1 > b.y2 || a.y2 < b.y1)
-    {
-        // no intersection
-        return 0.f;
-    }
-
-    float inter_width = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
-    float inter_height = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
-
-    return inter_width * inter_height;
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores, int left, int right)
-{
-    int i = left;
-    int j = right;
-    float p = scores[(left + right) / 2];
-
-    while (i <= j)
-    {
-        while (scores[i] > p)
-            i++;
-
-        while (scores[j] < p)
-            j--;
-
-        if (i <= j)
-        {
-            // swap
-            std::swap(datas[i], datas[j]);
-            std::swap(scores[i], scores[j]);
-
-            i++;
-            j--;
-        }
-    }
-
-    if (left < j)
-        qsort_descent_inplace(datas, scores, left, j);
-
-    if (i < right)
-        qsort_descent_inplace(datas, scores, i, right);
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores)
-{
-    if (datas.empty() || scores.empty())
-        return;
-
-    qsort_descent_inplace(datas, scores, 0, static_cast<int>(scores.size() - 1));
-}
-
-static void nms_sorted_bboxes(const std::vector<Rect>& bboxes, std::vector<size_t>& picked, float nms_threshold)
-{
-    picked.clear();
-
-    const size_t n = bboxes.size();
-
-    std::vector<float> areas(n);
-    for (size_t i = 0; i < n; i++)
-    {
-        const Rect& r = bboxes[i];
-
-        float width = r.x2 - r.x1;
-        float height = r.y2 - r.y1;
-
-        areas[i] = width * height;
-    }
-
-    for (size_t i = 0; i < n; i++)
-    {
-        const Rect& a = bboxes[i];
-
-        int keep = 1;
-        for (size_t j = 0; j < picked.size(); j++)
-        {
-            const Rect& b = bboxes[picked[j]];
-
-            // intersection over union
-            float inter_area = intersection_area(a, b);
-            float union_area = areas[i] + areas[picked[j]] - inter_area;
-            //             float IoU = inter_area / union_area
-            if (inter_area / union_area > nms_threshold)
-                keep = 0;
-        }
-
-        if (keep)
-            picked.push_back(i);
-    }
-}
-
 int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
     const Mat& score_blob = bottom_blobs[0];
@@ -287,7 +188,7 @@ int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     }
 
     // remove predicted boxes with either height or width < threshold
-    std::vector<Rect> proposal_boxes;
+    std::vector<const float*> proposal_boxes;
     std::vector<float> scores;
 
     float im_scale = im_info_blob[2];
@@ -300,35 +201,41 @@ int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
 
         for (int i = 0; i < w * h; i++)
         {
-            float* pb = pbs.row(i);
+            const float* pb = pbs.row(i);
 
             float pb_w = pb[2] - pb[0] + 1;
             float pb_h = pb[3] - pb[1] + 1;
 
             if (pb_w >= min_boxsize && pb_h >= min_boxsize)
             {
-                Rect r = {pb[0], pb[1], pb[2], pb[3]};
-                proposal_boxes.push_back(r);
+                proposal_boxes.push_back(pb);
                 scores.push_back(scoreptr[i]);
             }
         }
     }
 
-    // sort all (proposal, score) pairs by score from highest to lowest
-    qsort_descent_inplace(proposal_boxes, scores);
+    // sort all (proposal, score) pairs by score from highest to lowest and take top pre_nms_topN
+    std::vector<int> order;
+    detection_topk(scores, pre_nms_topN, order);
 
-    // take top pre_nms_topN
-    if (pre_nms_topN > 0 && pre_nms_topN < (int)proposal_boxes.size())
+    const int n = (int)order.size();
+    std::vector<float> x1(n);
+    std::vector<float> y1(n);
+    std::vector<float> x2(n);
+    std::vector<float> y2(n);
+    for (int i = 0; i < n; i++)
     {
-        proposal_boxes.resize(pre_nms_topN);
-        scores.resize(pre_nms_topN);
+        const float* pb = proposal_boxes[order[i]];
+        x1[i] = pb[0];
+        y1[i] = pb[1];
+        x2[i] = pb[2];
+        y2[i] = pb[3];
     }
 
-    // apply nms with nms_thresh
-    std::vector<size_t> picked;
-    nms_sorted_bboxes(proposal_boxes, picked, nms_thresh);
+    // apply nms with nms_thresh and take after_nms_topN
+    std::vector<int> picked;
+    nms_sorted(x1.data(), y1.data(), x2.data(), y2.data(), n, nms_thresh, picked, after_nms_topN);
 
-    // take after_nms_topN
     int picked_count = std::min((int)picked.size(), after_nms_topN);
 
     // return the top proposals
@@ -341,10 +248,10 @@ int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     {
         float* outptr = roi_blob.channel(i);
 
-        outptr[0] = proposal_boxes[picked[i]].x1;
-        outptr[1] = proposal_boxes[picked[i]].y1;
-        outptr[2] = proposal_boxes[picked[i]].x2;
-        outptr[3] = proposal_boxes[picked[i]].y2;
+        outptr[0] = x1[picked[i]];
+        outptr[1] = y1[picked[i]];
+        outptr[2] = x2[picked[i]];
+        outptr[3] = y2[picked[i]];
     }
 
     if (top_blobs.size() > 1)
@@ -357,7 +264,7 @@ int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
         for (int i = 0; i < picked_count; i++)
         {
             float* outptr = roi_score_blob.channel(i);
-            outptr[0] = scores[picked[i]];
+            outptr[0] = scores[order[picked[i]]];
         }
     }
 
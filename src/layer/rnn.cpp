@@ -178,7 +178,9 @@ int RNN::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blo
     Allocator* hidden_allocator = top_blobs.size() == 2 ? opt.blob_allocator : opt.workspace_allocator;
     if (bottom_blobs.size() == 2)
     {
-        hidden = bottom_blobs[1].clone(hidden_allocator);
+        // a state top sharing its bottom is updated in place
+        const bool inplace = top_blobs.size() == 2 && top_blobs[1].data == bottom_blobs[1].data;
+        hidden = inplace ? bottom_blobs[1] : bottom_blobs[1].clone(hidden_allocator);
     }
     else
     {
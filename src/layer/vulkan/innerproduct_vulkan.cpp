@@ -36,6 +36,14 @@ InnerProduct_vulkan::InnerProduct_vulkan()
 
 int InnerProduct_vulkan::create_pipeline(const Option& _opt)
 {
+    if (weight_quant_bits)
+    {
+        // weight-only quantized rows run on the cpu reference path
+        support_vulkan = false;
+        support_image_storage = false;
+        return 0;
+    }
+
     Option opt = _opt;
     const Mat& shape = bottom_shapes.empty() ? Mat() : bottom_shapes[0];
     const Mat& out_shape = top_shapes.empty() ? Mat() : top_shapes[0];
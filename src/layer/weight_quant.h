@@ -0,0 +1,74 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef WEIGHT_QUANT_H
+#define WEIGHT_QUANT_H
+
+#include "mat.h"
+
+// weight-only quantized weights are rows of K values split into groups of group_size
+// every group has one fp32 scale and dequantizes as value * scale
+// int8 rows hold one signed byte per value
+// int4 rows are padded to blocks of 32 values stored in 16 bytes, each value stored as value + 8
+// value j of a block sits in the low nibble of byte j and value 16 + j in its high nibble
+// so a block unpacks into two runs of 16 consecutive values with a mask and a shift
+
+static NCNN_FORCEINLINE int weight_quant_row_bytes(int K, int bits)
+{
+    return bits == 4 ? (K + 31) / 32 * 16 : K;
+}
+
+static NCNN_FORCEINLINE int weight_quant_group_count(int K, int group_size)
+{
+    return (K + group_size - 1) / group_size;
+}
+
+static NCNN_FORCEINLINE int weight_quant_value(const unsigned char* qptr, int bits, int k)
+{
+    if (bits == 4)
+        return ((qptr[k / 32 * 16 + k % 16] >> (k % 32 / 16 * 4)) & 15) - 8;
+
+    return ((const signed char*)qptr)[k];
+}
+
+// dequantize values k .. k + max_kk of one quantized row into outptr
+static void weight_quant_dequantize_row(const unsigned char* qptr, const float* scales, int bits, int group_size, int k, int max_kk, float* outptr)
+{
+    int kk = 0;
+    while (kk < max_kk)
+    {
+        const int g = (k + kk) / group_size;
+        const int group_end = (g + 1) * group_size - k;
+        const int end = group_end < max_kk ? group_end : max_kk;
+        const float scale = scales[g];
+
+        if (bits == 4)
+        {
+            for (; kk < end; kk++)
+            {
+                outptr[kk] = weight_quant_value(qptr, 4, k + kk) * scale;
+            }
+        }
+        else
+        {
+            const signed char* ptr = (const signed char*)qptr + k;
+            for (; kk < end; kk++)
+            {
+                outptr[kk] = ptr[kk] * scale;
+            }
+        }
+    }
+}
+
+#endif // WEIGHT_QUANT_H
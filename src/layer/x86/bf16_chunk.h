@@ -0,0 +1,222 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// bf16 storage for layers running on their fp32 kernels
+// when the outer slices of a blob are processed independently, a chunk of them is widened into per-thread fp32 scratch,
+// run through the fp32 kernels and narrowed back, so the blob itself only travels to and from memory as bf16
+
+// channels for 3d and 4d blobs, rows for 2d blobs, the whole blob for 1d
+static int bf16_chunk_outer_count(const Mat& m)
+{
+    if (m.dims == 1)
+        return 1;
+
+    if (m.dims == 2)
+        return m.h;
+
+    return m.c;
+}
+
+static Mat bf16_chunk_outer_range(const Mat& m, int i, int n)
+{
+    if (m.dims == 1)
+        return m;
+
+    if (m.dims == 2)
+        return m.row_range(i, n);
+
+    return m.channel_range(i, n);
+}
+
+// outer slices per chunk, one chunk per thread at least while each chunk stays around 64KB of fp32
+static int bf16_chunk_outer_step(const Mat& m, int num_threads)
+{
+    const int outer = bf16_chunk_outer_count(m);
+    const int slice_size = m.dims <= 2 ? m.w * m.elempack : m.w * m.h * m.d * m.elempack;
+
+    const int step = (outer + num_threads - 1) / num_threads;
+    const int max_step = std::max(1, 16384 / std::max(slice_size, 1));
+
+    return std::min(step, max_step);
+}
+
+// fp32 scratch shaped like m with step outer slices for each of num_threads threads
+static void bf16_chunk_create_scratch(const Mat& m, int step, int num_threads, Mat& scratch, Allocator* allocator)
+{
+    const size_t elemsize = 4u * m.elempack;
+
+    if (m.dims == 1)
+        scratch.create(m.w, elemsize, m.elempack, allocator);
+    if (m.dims == 2)
+        scratch.create(m.w, step * num_threads, elemsize, m.elempack, allocator);
+    if (m.dims == 3)
+        scratch.create(m.w, m.h, step * num_threads, elemsize, m.elempack, allocator);
+    if (m.dims == 4)
+        scratch.create(m.w, m.h, m.d, step * num_threads, elemsize, m.elempack, allocator);
+}
+
+// run the fp32 forward_inplace of layer over bf16 bottom_top_blob chunk by chunk
+static int bf16_chunk_forward_inplace(const Layer* layer, Mat& bottom_top_blob, const Option& opt)
+{
+    const int outer = bf16_chunk_outer_count(bottom_top_blob);
+    const int step = bf16_chunk_outer_step(bottom_top_blob, opt.num_threads);
+    const int nn_outer = (outer + step - 1) / step;
+    const int nT = std::min(opt.num_threads, nn_outer);
+
+    Mat scratch;
+    bf16_chunk_create_scratch(bottom_top_blob, step, nT, scratch, opt.workspace_allocator);
+    if (scratch.empty())
+        return -100;
+
+    // chunks run concurrently, keep their allocations off the shared allocators
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+    opt_1.blob_allocator = 0;
+    opt_1.workspace_allocator = 0;
+
+    int ret = 0;
+
+    #pragma omp parallel for num_threads(nT)
+    for (int ii = 0; ii < nn_outer; ii++)
+    {
+        const int i = ii * step;
+        const int n = std::min(step, outer - i);
+
+        Mat chunk = bf16_chunk_outer_range(bottom_top_blob, i, n);
+        Mat chunk_fp32 = bf16_chunk_outer_range(scratch, get_omp_thread_num() * step, n);
+
+        cast_bf16_to_fp32_sse(chunk, chunk_fp32, opt_1);
+
+        if (layer->forward_inplace(chunk_fp32, opt_1) != 0)
+            ret = -1;
+
+        cast_fp32_to_bf16_sse(chunk_fp32, chunk, opt_1);
+    }
+
+    return ret;
+}
+
+// the packing net gives fp32 blobs, bf16 blobs only get up to pack4
+static int bf16_whole_fp32_elempack(const Mat& m)
+{
+    int elemcount = 0;
+    if (m.dims == 1) elemcount = m.elempack * m.w;
+    if (m.dims == 2) elemcount = m.elempack * m.h;
+    if (m.dims == 3 || m.dims == 4) elemcount = m.elempack * m.c;
+
+#if __AVX512F__
+    if (elemcount % 16 == 0)
+        return 16;
+#endif
+#if __AVX__
+    if (elemcount % 8 == 0)
+        return 8;
+#endif
+    if (elemcount % 4 == 0)
+        return 4;
+
+    return 1;
+}
+
+// layers whose kernels need the whole blob take it as a single chunk
+// bf16 bottom blobs are widened once into the fp32 packing the kernels were prepared for, the fp32 top blobs are narrowed back
+static int bf16_whole_widen(const Mat& bottom_blob, Mat& bottom_blob_fp32, const Option& opt)
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    bottom_blob_fp32 = bottom_blob;
+    if (bottom_blob.elembits() == 16)
+    {
+        cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt_ws);
+        if (bottom_blob_fp32.empty())
+            return -100;
+
+        if (opt.use_packing_layout)
+        {
+            Mat bottom_blob_fp32_packed;
+            convert_packing(bottom_blob_fp32, bottom_blob_fp32_packed, bf16_whole_fp32_elempack(bottom_blob_fp32), opt_ws);
+            if (bottom_blob_fp32_packed.empty())
+                return -100;
+
+            bottom_blob_fp32 = bottom_blob_fp32_packed;
+        }
+    }
+
+    return 0;
+}
+
+static int bf16_whole_narrow(const Mat& top_blob_fp32, Mat& top_blob, const Option& opt)
+{
+    if (top_blob_fp32.elembits() == 32)
+    {
+        cast_float32_to_bfloat16(top_blob_fp32, top_blob, opt);
+    }
+    else
+    {
+        // requantized int8 output
+        top_blob = top_blob_fp32.clone(opt.blob_allocator);
+    }
+
+    if (top_blob.empty())
+        return -100;
+
+    return 0;
+}
+
+static int bf16_whole_forward(const Layer* layer, const Mat& bottom_blob, Mat& top_blob, const Option& opt)
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    Mat bottom_blob_fp32;
+    int ret = bf16_whole_widen(bottom_blob, bottom_blob_fp32, opt);
+    if (ret != 0)
+        return ret;
+
+    Mat top_blob_fp32;
+    ret = layer->forward(bottom_blob_fp32, top_blob_fp32, opt_ws);
+    if (ret != 0)
+        return ret;
+
+    return bf16_whole_narrow(top_blob_fp32, top_blob, opt);
+}
+
+static int bf16_whole_forward(const Layer* layer, const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt)
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    std::vector<Mat> bottom_blobs_fp32(bottom_blobs.size());
+    for (size_t i = 0; i < bottom_blobs.size(); i++)
+    {
+        int ret = bf16_whole_widen(bottom_blobs[i], bottom_blobs_fp32[i], opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    std::vector<Mat> top_blobs_fp32(top_blobs.size());
+    int ret = layer->forward(bottom_blobs_fp32, top_blobs_fp32, opt_ws);
+    if (ret != 0)
+        return ret;
+
+    for (size_t i = 0; i < top_blobs.size(); i++)
+    {
+        ret = bf16_whole_narrow(top_blobs_fp32[i], top_blobs[i], opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -28,13 +28,25 @@
 
 #include <math.h>
 
+#include "x86_usability.h"
+
+#include "cpu.h"
+
 namespace ncnn {
 
+#if NCNN_BF16
+#include "cast_bf16.h"
+#include "bf16_chunk.h"
+#endif
+
 BinaryOp_x86::BinaryOp_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 }
 
 template<typename Op>
@@ -1171,21 +1183,8 @@ static int get_reverse_op_type(int op_type)
     return op_type;
 }
 
-int BinaryOp_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+static int binary_op(const Mat& A, const Mat& B, Mat& top_blob, int op_type_r, const Option& opt)
 {
-    const bool b_is_scalar = bottom_blobs[1].w * bottom_blobs[1].h * bottom_blobs[1].d * bottom_blobs[1].c * bottom_blobs[1].elempack == 1;
-    const bool a_rank_is_lower = bottom_blobs[0].dims < bottom_blobs[1].dims && !b_is_scalar;
-    const bool a_size_is_lower = bottom_blobs[0].w * bottom_blobs[0].h * bottom_blobs[0].d * bottom_blobs[0].c * bottom_blobs[0].elempack < bottom_blobs[1].w * bottom_blobs[1].h * bottom_blobs[1].d * bottom_blobs[1].c * bottom_blobs[1].elempack;
-    const bool a_is_lower = a_rank_is_lower || (!a_rank_is_lower && a_size_is_lower);
-    const Mat& A = a_is_lower ? bottom_blobs[1] : bottom_blobs[0];
-    const Mat& B = a_is_lower ? bottom_blobs[0] : bottom_blobs[1];
-    const int op_type_r = a_is_lower ? get_reverse_op_type(op_type) : op_type;
-
-    Mat& top_blob = top_blobs[0];
-    top_blob.create_like(A, opt.blob_allocator);
-    if (top_blob.empty())
-        return -100;
-
     // B is a scalar
     if (B.w * B.h * B.d * B.c * B.elempack == 1)
     {
@@ -1225,8 +1224,179 @@ int BinaryOp_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>
     return 0;
 }
 
+#if NCNN_BF16
+// a lower rank B is aligned to the outer axes of A, so a 1d B is sliced along its width
+static Mat binary_op_outer_range_bf16s(const Mat& m, int i, int n)
+{
+    if (m.dims == 1)
+        return m.range(i, n);
+
+    return bf16_chunk_outer_range(m, i, n);
+}
+
+static int binary_op_bf16s(const Mat& A, const Mat& B, Mat& top_blob, int op_type_r, const Option& opt)
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    const int outer = bf16_chunk_outer_count(A);
+    const int B_outer = B.dims == 1 ? B.w : bf16_chunk_outer_count(B);
+    const bool b_is_scalar = B.w * B.h * B.d * B.c * B.elempack == 1;
+
+    // B with the same outer slices as A is streamed along with it
+    const bool chunk_B = !b_is_scalar && B.elembits() == 16 && B_outer == outer && B.elempack == A.elempack;
+    // B broadcast along the outer axis of A is widened once
+    const bool shared_B = !b_is_scalar && B.dims == A.dims && B_outer == 1;
+
+    if (A.elembits() != 16 || A.dims == 1 || !(b_is_scalar || chunk_B || shared_B))
+    {
+        // widen the whole blobs
+        Mat A_fp32 = A;
+        if (A.elembits() == 16)
+        {
+            cast_bfloat16_to_float32(A, A_fp32, opt_ws);
+            if (A_fp32.empty())
+                return -100;
+        }
+
+        Mat B_fp32 = B;
+        if (B.elembits() == 16)
+        {
+            cast_bfloat16_to_float32(B, B_fp32, opt_ws);
+            if (B_fp32.empty())
+                return -100;
+        }
+
+        Mat top_blob_fp32;
+        top_blob_fp32.create_like(A_fp32, opt.workspace_allocator);
+        if (top_blob_fp32.empty())
+            return -100;
+
+        int ret = binary_op(A_fp32, B_fp32, top_blob_fp32, op_type_r, opt);
+        if (ret != 0)
+            return ret;
+
+        cast_float32_to_bfloat16(top_blob_fp32, top_blob, opt);
+        if (top_blob.empty())
+            return -100;
+
+        return 0;
+    }
+
+    top_blob.create_like(A, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    const int step = bf16_chunk_outer_step(A, opt.num_threads);
+    const int nn_outer = (outer + step - 1) / step;
+    const int nT = std::min(opt.num_threads, nn_outer);
+
+    Mat scratch;
+    bf16_chunk_create_scratch(A, step, nT, scratch, opt.workspace_allocator);
+    if (scratch.empty())
+        return -100;
+
+    Mat B_scratch;
+    if (chunk_B)
+    {
+        if (B.dims == 1)
+            B_scratch.create(step * nT, 4u * B.elempack, B.elempack, opt.workspace_allocator);
+        else
+            bf16_chunk_create_scratch(B, step, nT, B_scratch, opt.workspace_allocator);
+        if (B_scratch.empty())
+            return -100;
+    }
+
+    float b = 0.f;
+    if (b_is_scalar)
+        b = B.elembits() == 16 ? bfloat16_to_float32(((const unsigned short*)B)[0]) : B[0];
+
+    Mat B_fp32 = B;
+    if (shared_B && B.elembits() == 16)
+    {
+        cast_bfloat16_to_float32(B, B_fp32, opt_ws);
+        if (B_fp32.empty())
+            return -100;
+    }
+
+    // chunks run concurrently, keep their allocations off the shared allocators
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+    opt_1.blob_allocator = 0;
+    opt_1.workspace_allocator = 0;
+
+    int ret = 0;
+
+    #pragma omp parallel for num_threads(nT)
+    for (int ii = 0; ii < nn_outer; ii++)
+    {
+        const int i = ii * step;
+        const int n = std::min(step, outer - i);
+        const int tid = get_omp_thread_num();
+
+        // the result overwrites the widened A chunk
+        Mat A_chunk_fp32 = bf16_chunk_outer_range(scratch, tid * step, n);
+        cast_bf16_to_fp32_sse(bf16_chunk_outer_range(A, i, n), A_chunk_fp32, opt_1);
+
+        int ret_chunk = 0;
+        if (b_is_scalar)
+        {
+            ret_chunk = binary_op_scalar(A_chunk_fp32, b, A_chunk_fp32, op_type_r, opt_1);
+        }
+        else if (chunk_B)
+        {
+            Mat B_chunk_fp32 = binary_op_outer_range_bf16s(B_scratch, tid * step, n);
+            cast_bf16_to_fp32_sse(binary_op_outer_range_bf16s(B, i, n), B_chunk_fp32, opt_1);
+
+            ret_chunk = binary_op(A_chunk_fp32, B_chunk_fp32, A_chunk_fp32, op_type_r, opt_1);
+        }
+        else
+        {
+            ret_chunk = binary_op(A_chunk_fp32, B_fp32, A_chunk_fp32, op_type_r, opt_1);
+        }
+
+        if (ret_chunk != 0)
+            ret = ret_chunk;
+
+        Mat top_chunk = bf16_chunk_outer_range(top_blob, i, n);
+        cast_fp32_to_bf16_sse(A_chunk_fp32, top_chunk, opt_1);
+    }
+
+    return ret;
+}
+#endif // NCNN_BF16
+
+int BinaryOp_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const bool b_is_scalar = bottom_blobs[1].w * bottom_blobs[1].h * bottom_blobs[1].d * bottom_blobs[1].c * bottom_blobs[1].elempack == 1;
+    const bool a_rank_is_lower = bottom_blobs[0].dims < bottom_blobs[1].dims && !b_is_scalar;
+    const bool a_size_is_lower = bottom_blobs[0].w * bottom_blobs[0].h * bottom_blobs[0].d * bottom_blobs[0].c * bottom_blobs[0].elempack < bottom_blobs[1].w * bottom_blobs[1].h * bottom_blobs[1].d * bottom_blobs[1].c * bottom_blobs[1].elempack;
+    const bool a_is_lower = a_rank_is_lower || (!a_rank_is_lower && a_size_is_lower);
+    const Mat& A = a_is_lower ? bottom_blobs[1] : bottom_blobs[0];
+    const Mat& B = a_is_lower ? bottom_blobs[0] : bottom_blobs[1];
+    const int op_type_r = a_is_lower ? get_reverse_op_type(op_type) : op_type;
+
+    Mat& top_blob = top_blobs[0];
+
+#if NCNN_BF16
+    if (opt.use_bf16_storage && (A.elembits() == 16 || B.elembits() == 16))
+        return binary_op_bf16s(A, B, top_blob, op_type_r, opt);
+#endif
+
+    top_blob.create_like(A, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    return binary_op(A, B, top_blob, op_type_r, opt);
+}
+
 int BinaryOp_x86::forward_inplace(Mat& bottom_top_blob, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_top_blob.elembits() == 16)
+        return bf16_chunk_forward_inplace(this, bottom_top_blob, opt);
+#endif
+
     using namespace BinaryOp_x86_functor;
 
     if (op_type == Operation_ADD) return binary_op_scalar_inplace<binary_op_add>(bottom_top_blob, b, opt);
@@ -79,9 +79,9 @@ static void cast_fp32_to_bf16_sse(const Mat& bottom_blob, Mat& top_blob, const O
         for (; i + 7 < size; i += 8)
         {
 #if __AVX__
-            _mm_store_si128((__m128i*)outptr, float2bfloat_avx(_mm256_loadu_ps(ptr)));
+            _mm_storeu_si128((__m128i*)outptr, float2bfloat_avx(_mm256_loadu_ps(ptr)));
 #else
-            _mm_store_si128((__m128i*)outptr, float2bfloat_sse(_mm_loadu_ps(ptr), _mm_loadu_ps(ptr + 4)));
+            _mm_storeu_si128((__m128i*)outptr, float2bfloat_sse(_mm_loadu_ps(ptr), _mm_loadu_ps(ptr + 4)));
 #endif
             ptr += 8;
             outptr += 8;
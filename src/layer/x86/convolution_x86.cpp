@@ -79,14 +79,23 @@ namespace ncnn {
 #endif // __AVX__
 #endif // __SSE2__
 
+#if NCNN_BF16
+#include "cast_bf16.h"
+#include "bf16_chunk.h"
+#endif
+
 Convolution_x86::Convolution_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 
     activation = 0;
     nT = 0;
+    tuned_algo = -1;
     convolution_dilation1 = 0;
     gemm = 0;
 }
@@ -127,6 +136,27 @@ static void convolution_transform_kernel_packed_sse(const Mat& weight_data, Mat&
     }
 }
 
+static Layer* create_gemm_layer(int num_output, int K, int bias_term)
+{
+    Layer* gemm = ncnn::create_layer(ncnn::LayerType::Gemm);
+
+    ncnn::ParamDict pd;
+    pd.set(2, 0);                   // transA
+    pd.set(3, 0);                   // transB
+    pd.set(4, 1);                   // constantA
+    pd.set(5, 0);                   // constantB
+    pd.set(6, 1);                   // constantC
+    pd.set(7, num_output);          // M = outch
+    pd.set(8, 0);                   // N = size
+    pd.set(9, K);                   // K = maxk*inch
+    pd.set(10, bias_term ? 1 : -1); // constant_broadcast_type_C = (M)
+    pd.set(11, 1);                  // output_N1M
+
+    gemm->load_param(pd);
+
+    return gemm;
+}
+
 static bool test_prefer_winograd63(int num_input, int num_output, int w, int h)
 {
     // winograd selection strategy (profiled on i7-7700 single thread)
@@ -296,6 +326,17 @@ int Convolution_x86::create_pipeline(const Option& opt)
     if (dynamic_weight)
         return 0;
 
+    if (opt.use_algorithm_tuning && tuned_algo == -1)
+    {
+        tuned_algo = tune_algorithm(opt);
+    }
+
+    // a tuned variant never brings back an algorithm disabled in opt
+    if (!is_algorithm_enabled(tuned_algo, opt))
+    {
+        tuned_algo = -1;
+    }
+
     activation = create_activation_layer(activation_type, activation_params, opt);
     nT = opt.num_threads;
 
@@ -377,9 +418,21 @@ int Convolution_x86::create_pipeline(const Option& opt)
 
     bool prefer_winograd = (opt.use_winograd23_convolution || opt.use_winograd43_convolution || opt.use_winograd63_convolution) && (num_input > 8 || num_output > 8);
 
-    if (opt.use_winograd_convolution && prefer_winograd && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
+    if ((tuned_algo == -1 ? opt.use_winograd_convolution && prefer_winograd : tuned_algo >= 2) && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
     {
-        if ((bottom_shapes.empty() || bottom_shapes[0].w == 0 || bottom_shapes[0].h == 0) && (top_shapes.empty() || top_shapes[0].w == 0 || top_shapes[0].h == 0))
+        if (tuned_algo == 2)
+        {
+            conv3x3s1_winograd23_transform_kernel(weight_data, weight_winograd23_data, num_input, num_output, opt);
+        }
+        else if (tuned_algo == 3)
+        {
+            conv3x3s1_winograd43_transform_kernel(weight_data, weight_winograd43_data, num_input, num_output, opt);
+        }
+        else if (tuned_algo == 4)
+        {
+            conv3x3s1_winograd63_transform_kernel(weight_data, weight_winograd63_data, num_input, num_output, opt);
+        }
+        else if ((bottom_shapes.empty() || bottom_shapes[0].w == 0 || bottom_shapes[0].h == 0) && (top_shapes.empty() || top_shapes[0].w == 0 || top_shapes[0].h == 0))
         {
             // dynamic shape
             if ((opt.use_winograd63_convolution) && (num_input <= 32 && num_output <= 32))
@@ -479,25 +532,11 @@ int Convolution_x86::create_pipeline(const Option& opt)
     int l2_cache_size = get_cpu_level2_cache_size();
     bool prefer_sgemm = num_input * num_output * kernel_w * kernel_h * dilation_w * dilation_h * stride_w * stride_h * (int)sizeof(float) * 2 > l2_cache_size || (num_input > 16 || num_output > 16);
 
-    if ((opt.use_sgemm_convolution && prefer_sgemm) || (kernel_w == 1 && kernel_h == 1))
+    if ((tuned_algo == -1 ? opt.use_sgemm_convolution && prefer_sgemm : tuned_algo == 1) || (kernel_w == 1 && kernel_h == 1))
     {
         const int maxk = kernel_w * kernel_h;
 
-        gemm = ncnn::create_layer(ncnn::LayerType::Gemm);
-
-        ncnn::ParamDict pd;
-        pd.set(2, 0);                   // transA
-        pd.set(3, 0);                   // transB
-        pd.set(4, 1);                   // constantA
-        pd.set(5, 0);                   // constantB
-        pd.set(6, 1);                   // constantC
-        pd.set(7, num_output);          // M = outch
-        pd.set(8, 0);                   // N = size
-        pd.set(9, maxk * num_input);    // K = maxk*inch
-        pd.set(10, bias_term ? 1 : -1); // constant_broadcast_type_C = (M)
-        pd.set(11, 1);                  // output_N1M
-
-        gemm->load_param(pd);
+        gemm = create_gemm_layer(num_output, maxk * num_input, bias_term);
 
         // maxk-inch-outch to pa-maxk-inch/pa-outch
         Mat tmp;
@@ -596,8 +635,233 @@ int Convolution_x86::destroy_pipeline(const Option& opt)
     return 0;
 }
 
+int Convolution_x86::save_pipeline(std::vector<Mat>& pipeline_data) const
+{
+    // the dilation fallback wraps a whole convolution layer, leave it to create_pipeline
+    if (dynamic_weight || convolution_dilation1)
+        return -1;
+
+    pipeline_data.push_back(weight_data_tm);
+    pipeline_data.push_back(weight_sgemm_data);
+    pipeline_data.push_back(weight_winograd23_data);
+    pipeline_data.push_back(weight_winograd43_data);
+    pipeline_data.push_back(weight_winograd63_data);
+#if NCNN_INT8
+    pipeline_data.push_back(scale_in_data);
+#else
+    pipeline_data.push_back(Mat());
+#endif
+
+    Mat tuned_algo_data(1, (size_t)4u);
+    ((int*)tuned_algo_data)[0] = tuned_algo;
+    pipeline_data.push_back(tuned_algo_data);
+
+    // the gemm data follows
+    if (gemm)
+        return gemm->save_pipeline(pipeline_data);
+
+    return 0;
+}
+
+int Convolution_x86::load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt)
+{
+    if (dynamic_weight || pipeline_data.size() < 7 || pipeline_data[6].total() != 1)
+        return -1;
+
+    activation = create_activation_layer(activation_type, activation_params, opt);
+    nT = opt.num_threads;
+
+    weight_data_tm = pipeline_data[0];
+    weight_sgemm_data = pipeline_data[1];
+    weight_winograd23_data = pipeline_data[2];
+    weight_winograd43_data = pipeline_data[3];
+    weight_winograd63_data = pipeline_data[4];
+#if NCNN_INT8
+    scale_in_data = pipeline_data[5];
+#endif
+    tuned_algo = ((const int*)pipeline_data[6])[0];
+
+    if (pipeline_data.size() > 7)
+    {
+        const int maxk = kernel_w * kernel_h;
+        const int num_input = weight_data_size / maxk / num_output;
+
+        gemm = create_gemm_layer(num_output, maxk * num_input, bias_term);
+
+        std::vector<Mat> gemm_data(pipeline_data.begin() + 7, pipeline_data.end());
+        int ret = gemm->load_pipeline(gemm_data, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (opt.lightmode)
+    {
+        weight_data.release();
+    }
+
+    return 0;
+}
+
+int Convolution_x86::get_tuned_algorithm() const
+{
+    return tuned_algo;
+}
+
+int Convolution_x86::set_tuned_algorithm(int algo)
+{
+    if (algo < -1 || algo > 4)
+        return -1;
+
+    tuned_algo = algo;
+
+    return 0;
+}
+
+bool Convolution_x86::is_algorithm_enabled(int algo, const Option& opt)
+{
+    if (algo == 1)
+        return opt.use_sgemm_convolution;
+    if (algo == 2)
+        return opt.use_winograd_convolution && opt.use_winograd23_convolution;
+    if (algo == 3)
+        return opt.use_winograd_convolution && opt.use_winograd43_convolution;
+    if (algo == 4)
+        return opt.use_winograd_convolution && opt.use_winograd63_convolution;
+
+    return true;
+}
+
+int Convolution_x86::tune_algorithm(const Option& opt)
+{
+#if NCNN_INT8
+    if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
+        return -1;
+#endif
+
+    // 1x1 always goes sgemm and the dilation fallback has no alternatives
+    if (kernel_w == 1 && kernel_h == 1)
+        return -1;
+
+    if (!opt.use_packing_layout && kernel_w == kernel_h && dilation_w != 1 && dilation_h == dilation_w && stride_w == 1 && stride_h == 1)
+        return -1;
+
+    if (bottom_shapes.empty() || bottom_shapes[0].dims != 3 || bottom_shapes[0].w == 0 || bottom_shapes[0].h == 0)
+        return -1;
+
+    const int maxk = kernel_w * kernel_h;
+    const int num_input = weight_data_size / maxk / num_output;
+
+    const Mat& shape = bottom_shapes[0];
+    if (shape.c != num_input)
+        return -1;
+
+    std::vector<int> candidates;
+    candidates.push_back(0);
+    if (opt.use_sgemm_convolution)
+        candidates.push_back(1);
+    if (opt.use_winograd_convolution && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
+    {
+        if (opt.use_winograd23_convolution)
+            candidates.push_back(2);
+        if (opt.use_winograd43_convolution)
+            candidates.push_back(3);
+        if (opt.use_winograd63_convolution)
+            candidates.push_back(4);
+    }
+
+    if (candidates.size() == 1)
+        return -1;
+
+    Option opt_tune = opt;
+    opt_tune.lightmode = false;
+    opt_tune.use_algorithm_tuning = false;
+    opt_tune.blob_allocator = 0;
+    opt_tune.workspace_allocator = 0;
+
+    Mat bottom_blob(shape.w, shape.h, shape.c);
+    if (bottom_blob.empty())
+        return -1;
+
+    for (int q = 0; q < shape.c; q++)
+    {
+        float* ptr = bottom_blob.channel(q);
+        for (int i = 0; i < shape.w * shape.h; i++)
+        {
+            ptr[i] = (float)((q + i) % 17) * 0.05f - 0.4f;
+        }
+    }
+
+    int elempack = 1;
+#if __SSE2__
+    if (opt.use_packing_layout)
+    {
+#if __AVX512F__
+        elempack = num_input % 16 == 0 ? 16 : num_input % 8 == 0 ? 8 : num_input % 4 == 0 ? 4 : 1;
+#elif __AVX__
+        elempack = num_input % 8 == 0 ? 8 : num_input % 4 == 0 ? 4 : 1;
+#else
+        elempack = num_input % 4 == 0 ? 4 : 1;
+#endif
+    }
+#endif // __SSE2__
+
+    if (elempack != 1)
+    {
+        Mat bottom_blob_packed;
+        convert_packing(bottom_blob, bottom_blob_packed, elempack, opt_tune);
+        bottom_blob = bottom_blob_packed;
+    }
+
+    int best_algo = -1;
+    double best_time = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        tuned_algo = candidates[i];
+
+        double time = 0;
+        if (create_pipeline(opt_tune) == 0)
+        {
+            // one warm up run, then keep the fastest of three
+            Mat top_blob;
+            int ret = forward(bottom_blob, top_blob, opt_tune);
+            for (int j = 0; ret == 0 && j < 3; j++)
+            {
+                double start = get_current_time();
+                ret = forward(bottom_blob, top_blob, opt_tune);
+                double end = get_current_time();
+
+                if (j == 0 || end - start < time)
+                    time = end - start;
+            }
+
+            if (ret == 0 && (best_algo == -1 || time < best_time))
+            {
+                best_algo = candidates[i];
+                best_time = time;
+            }
+        }
+
+        destroy_pipeline(opt_tune);
+
+        weight_data_tm.release();
+        weight_sgemm_data.release();
+        weight_winograd23_data.release();
+        weight_winograd43_data.release();
+        weight_winograd63_data.release();
+    }
+
+    tuned_algo = -1;
+
+    return best_algo;
+}
+
 int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_blob.elembits() == 16)
+        return bf16_whole_forward(this, bottom_blob, top_blob, opt);
+#endif
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
@@ -695,10 +959,10 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
 
     bool prefer_winograd = (opt.use_winograd23_convolution || opt.use_winograd43_convolution || opt.use_winograd63_convolution) && (num_input > 8 || num_output > 8);
 
-    if (opt.use_winograd_convolution && prefer_winograd && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
+    if ((tuned_algo == -1 ? opt.use_winograd_convolution && prefer_winograd : tuned_algo >= 2) && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
     {
-        bool prefer_winograd63 = test_prefer_winograd63(num_input, num_output, w, h);
-        bool prefer_winograd23 = test_prefer_winograd23(num_input, num_output, w, h);
+        bool prefer_winograd63 = tuned_algo == -1 ? test_prefer_winograd63(num_input, num_output, w, h) : tuned_algo == 4;
+        bool prefer_winograd23 = tuned_algo == -1 ? test_prefer_winograd23(num_input, num_output, w, h) : tuned_algo == 2;
         bool prefer_winograd43 = !prefer_winograd63 && !prefer_winograd23;
 
         if (prefer_winograd23 && (!opt.use_winograd23_convolution || weight_winograd23_data.empty()))
@@ -730,10 +994,11 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
         }
 
         int _nT = nT ? nT : opt.num_threads;
-        if (nT != 0 && opt.num_threads != nT)
+        if (nT != 0 && opt.num_threads != nT && !opt.use_branch_parallel)
         {
             // force num_threads the same as in create_pipeline
             // so we could use pre-packed A/B from the same tile config
+            // quiet for graph branches, which get a share of the threads on purpose
             NCNN_LOGE("opt.num_threads %d changed, convolution winograd will use load-time value %d", opt.num_threads, nT);
         }
 
@@ -764,7 +1029,7 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
     int l2_cache_size = get_cpu_level2_cache_size();
     bool prefer_sgemm = num_input * num_output * kernel_w * kernel_h * dilation_w * dilation_h * stride_w * stride_h * (int)sizeof(float) * 2 > l2_cache_size || (num_input > 16 || num_output > 16);
 
-    if ((opt.use_sgemm_convolution && prefer_sgemm) || (kernel_w == 1 && kernel_h == 1))
+    if ((tuned_algo == -1 ? opt.use_sgemm_convolution && prefer_sgemm : tuned_algo == 1) || (kernel_w == 1 && kernel_h == 1))
     {
         // im2col
         Mat bottom_im2col;
@@ -1164,6 +1429,11 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
 
 int Convolution_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && (bottom_blobs[0].elembits() == 16 || bottom_blobs[1].elembits() == 16))
+        return bf16_whole_forward(this, bottom_blobs, top_blobs, opt);
+#endif
+
     const Mat& bottom_blob = bottom_blobs[0];
     const Mat& _weight_data = bottom_blobs[1];
     Mat& top_blob = top_blobs[0];
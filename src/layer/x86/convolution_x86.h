@@ -27,6 +27,12 @@ public:
     virtual int create_pipeline(const Option& opt);
     virtual int destroy_pipeline(const Option& opt);
 
+    virtual int save_pipeline(std::vector<Mat>& pipeline_data) const;
+    virtual int load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt);
+
+    virtual int get_tuned_algorithm() const;
+    virtual int set_tuned_algorithm(int algo);
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
@@ -37,11 +43,17 @@ protected:
     int forward_int8_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 #endif
     int forwardDilation_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
+    int tune_algorithm(const Option& opt);
+    static bool is_algorithm_enabled(int algo, const Option& opt);
 
 public:
     Layer* activation;
 
     int nT;
+
+    // -1=heuristic 0=packed 1=sgemm 2=winograd23 3=winograd43 4=winograd63
+    int tuned_algo;
+
     Mat weight_data_tm;
     Mat weight_sgemm_data;
     Mat weight_winograd23_data;
@@ -24,6 +24,7 @@
 #include "x86_activation.h"
 #include "x86_usability.h"
 
+#include "cpu.h"
 #include "layer_type.h"
 
 namespace ncnn {
@@ -46,11 +47,19 @@ namespace ncnn {
 #include "convolutiondepthwise_3x3_int8.h"
 #endif // NCNN_INT8
 
+#if NCNN_BF16
+#include "cast_bf16.h"
+#include "bf16_chunk.h"
+#endif
+
 ConvolutionDepthWise_x86::ConvolutionDepthWise_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
     activation = 0;
 }
 
@@ -269,6 +278,11 @@ int ConvolutionDepthWise_x86::destroy_pipeline(const Option& opt)
 
 int ConvolutionDepthWise_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_blob.elembits() == 16)
+        return bf16_whole_forward(this, bottom_blob, top_blob, opt);
+#endif
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
@@ -748,6 +762,11 @@ int ConvolutionDepthWise_x86::forward(const Mat& bottom_blob, Mat& top_blob, con
 
 int ConvolutionDepthWise_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && (bottom_blobs[0].elembits() == 16 || bottom_blobs[1].elembits() == 16))
+        return bf16_whole_forward(this, bottom_blobs, top_blobs, opt);
+#endif
+
     const Mat& bottom_blob = bottom_blobs[0];
     const Mat& _weight_data = bottom_blobs[1];
     Mat& top_blob = top_blobs[0];
@@ -0,0 +1,118 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// detection_nms_sorted from detection_postprocess.h
+// each candidate is tested against 8 or 4 kept boxes per step, stopping at the first suppression
+static void detection_nms_sorted_sse(const float* xmin, const float* ymin, const float* xmax, const float* ymax, int n, float nms_threshold, std::vector<int>& picked, int max_keep = 0)
+{
+    picked.clear();
+
+    // the kept boxes packed together
+    std::vector<float> kxmin(n);
+    std::vector<float> kymin(n);
+    std::vector<float> kxmax(n);
+    std::vector<float> kymax(n);
+    std::vector<float> karea(n);
+
+    int nk = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const float ax0 = xmin[i];
+        const float ay0 = ymin[i];
+        const float ax1 = xmax[i];
+        const float ay1 = ymax[i];
+        const float area = (ax1 - ax0) * (ay1 - ay0);
+
+        // inter_area / union_area > nms_threshold without the division
+        int keep = 1;
+        int j = 0;
+#if __SSE2__
+#if __AVX__
+        {
+            __m256 _ax0 = _mm256_set1_ps(ax0);
+            __m256 _ay0 = _mm256_set1_ps(ay0);
+            __m256 _ax1 = _mm256_set1_ps(ax1);
+            __m256 _ay1 = _mm256_set1_ps(ay1);
+            __m256 _area = _mm256_set1_ps(area);
+            __m256 _thresh = _mm256_set1_ps(nms_threshold);
+            __m256 _zero = _mm256_setzero_ps();
+            for (; j + 7 < nk; j += 8)
+            {
+                __m256 _w = _mm256_sub_ps(_mm256_min_ps(_ax1, _mm256_loadu_ps(&kxmax[j])), _mm256_max_ps(_ax0, _mm256_loadu_ps(&kxmin[j])));
+                __m256 _h = _mm256_sub_ps(_mm256_min_ps(_ay1, _mm256_loadu_ps(&kymax[j])), _mm256_max_ps(_ay0, _mm256_loadu_ps(&kymin[j])));
+                __m256 _inter = _mm256_mul_ps(_mm256_max_ps(_w, _zero), _mm256_max_ps(_h, _zero));
+                __m256 _union = _mm256_sub_ps(_mm256_add_ps(_area, _mm256_loadu_ps(&karea[j])), _inter);
+                if (_mm256_movemask_ps(_mm256_cmp_ps(_inter, _mm256_mul_ps(_thresh, _union), _CMP_GT_OQ)))
+                {
+                    keep = 0;
+                    break;
+                }
+            }
+        }
+#endif // __AVX__
+        if (keep)
+        {
+            __m128 _ax0 = _mm_set1_ps(ax0);
+            __m128 _ay0 = _mm_set1_ps(ay0);
+            __m128 _ax1 = _mm_set1_ps(ax1);
+            __m128 _ay1 = _mm_set1_ps(ay1);
+            __m128 _area = _mm_set1_ps(area);
+            __m128 _thresh = _mm_set1_ps(nms_threshold);
+            __m128 _zero = _mm_setzero_ps();
+            for (; j + 3 < nk; j += 4)
+            {
+                __m128 _w = _mm_sub_ps(_mm_min_ps(_ax1, _mm_loadu_ps(&kxmax[j])), _mm_max_ps(_ax0, _mm_loadu_ps(&kxmin[j])));
+                __m128 _h = _mm_sub_ps(_mm_min_ps(_ay1, _mm_loadu_ps(&kymax[j])), _mm_max_ps(_ay0, _mm_loadu_ps(&kymin[j])));
+                __m128 _inter = _mm_mul_ps(_mm_max_ps(_w, _zero), _mm_max_ps(_h, _zero));
+                __m128 _union = _mm_sub_ps(_mm_add_ps(_area, _mm_loadu_ps(&karea[j])), _inter);
+                if (_mm_movemask_ps(_mm_cmpgt_ps(_inter, _mm_mul_ps(_thresh, _union))))
+                {
+                    keep = 0;
+                    break;
+                }
+            }
+        }
+#endif // __SSE2__
+        if (keep)
+        {
+            for (; j < nk; j++)
+            {
+                float w = std::min(ax1, kxmax[j]) - std::max(ax0, kxmin[j]);
+                float h = std::min(ay1, kymax[j]) - std::max(ay0, kymin[j]);
+                float inter = std::max(w, 0.f) * std::max(h, 0.f);
+                float union_area = area + karea[j] - inter;
+                if (inter > nms_threshold * union_area)
+                {
+                    keep = 0;
+                    break;
+                }
+            }
+        }
+
+        if (!keep)
+            continue;
+
+        kxmin[nk] = ax0;
+        kymin[nk] = ay0;
+        kxmax[nk] = ax1;
+        kymax[nk] = ay1;
+        karea[nk] = area;
+        nk++;
+
+        picked.push_back(i);
+
+        if (max_keep > 0 && nk == max_keep)
+            break;
+    }
+}
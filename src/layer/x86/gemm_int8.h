@@ -0,0 +1,435 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if NCNN_RUNTIME_CPU && NCNN_AVX512VNNI && __AVX512F__ && !__AVX512VNNI__
+void gemm_int8_sse_avx512vnni(const Mat& AT, const Mat& BT, const Mat& A_scales, const Mat& B_scales, const float* ptrC, int broadcast_type_C, float alpha, float beta, Mat& top_blob, int output_transpose, int K, const Option& opt);
+#endif
+
+#if NCNN_RUNTIME_CPU && NCNN_AVXVNNI && __AVX2__ && !__AVX512F__ && !__AVXVNNI__
+void gemm_int8_sse_avxvnni(const Mat& AT, const Mat& BT, const Mat& A_scales, const Mat& B_scales, const float* ptrC, int broadcast_type_C, float alpha, float beta, Mat& top_blob, int output_transpose, int K, const Option& opt);
+#endif
+
+#if NCNN_RUNTIME_CPU && NCNN_AVX2 && __AVX__ && !__AVX2__
+void gemm_int8_sse_avx2(const Mat& AT, const Mat& BT, const Mat& A_scales, const Mat& B_scales, const float* ptrC, int broadcast_type_C, float alpha, float beta, Mat& top_blob, int output_transpose, int K, const Option& opt);
+#endif
+
+// output columns per packed B panel
+static int gemm_int8_lanes()
+{
+#if __AVX512F__
+    return 16;
+#elif __AVX__
+    return 8;
+#else
+    return 4;
+#endif
+}
+
+// scale of logical row i of X, from the fixed scales or the absmax of the row
+static float gemm_int8_row_scale(const float* ptr, int K, int stride, const Mat& fixed_scales, int i)
+{
+    if (!fixed_scales.empty())
+        return fixed_scales[i];
+
+    float absmax = 0.f;
+    for (int k = 0; k < K; k++)
+    {
+        absmax = std::max(absmax, (float)fabs(ptr[k * stride]));
+    }
+
+    return absmax == 0.f ? 1.f : 127.f / absmax;
+}
+
+static int gemm_int8_pack_A(const Mat& A, int transA, const Mat& fixed_scales, Mat& AT, Mat& A_scales, Allocator* allocator, const Option& opt)
+{
+    // dst = M rows of int16 pairs, K padded to even
+    const int A_rows = A.dims == 3 ? A.c : A.h;
+    const int A_hstep = A.dims == 3 ? (int)A.cstep : A.w;
+
+    const int M = transA ? A.w : A_rows;
+    const int K = transA ? A_rows : A.w;
+    const int K2 = (K + 1) / 2 * 2;
+
+    AT.create(K2, M, (size_t)2u, allocator);
+    A_scales.create(M, (size_t)4u, allocator);
+    if (AT.empty() || A_scales.empty())
+        return -100;
+
+    // only the constant operands are int8, they come with their scales
+    if (A.elemsize == 1 && fixed_scales.empty())
+    {
+        NCNN_LOGE("gemm int8 operand has no scales");
+        return -1;
+    }
+
+    const int row_stride = transA ? 1 : A_hstep;
+    const int k_stride = transA ? A_hstep : 1;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < M; i++)
+    {
+        short* outptr = AT.row<short>(i);
+
+        if (A.elemsize == 1)
+        {
+            const signed char* ptr = (const signed char*)A + i * row_stride;
+            for (int k = 0; k < K; k++)
+            {
+                outptr[k] = ptr[k * k_stride];
+            }
+
+            A_scales[i] = fixed_scales[i];
+        }
+        else
+        {
+            const float* ptr = (const float*)A + i * row_stride;
+
+            const float scale = gemm_int8_row_scale(ptr, K, k_stride, fixed_scales, i);
+            for (int k = 0; k < K; k++)
+            {
+                outptr[k] = float2int8(ptr[k * k_stride] * scale);
+            }
+
+            A_scales[i] = scale;
+        }
+
+        if (K2 != K)
+            outptr[K] = 0;
+    }
+
+    return 0;
+}
+
+static int gemm_int8_pack_B(const Mat& B, int transB, const Mat& fixed_scales, Mat& BT, Mat& B_scales, Allocator* allocator, const Option& opt)
+{
+    // dst = panels of nr columns, k-pair major, 2 int8 per column
+    const int B_rows = B.dims == 3 ? B.c : B.h;
+    const int B_hstep = B.dims == 3 ? (int)B.cstep : B.w;
+
+    const int N = transB ? B_rows : B.w;
+    const int K = transB ? B.w : B_rows;
+    const int K2 = (K + 1) / 2 * 2;
+
+    const int nr = gemm_int8_lanes();
+    const int nn_N = (N + nr - 1) / nr;
+
+    BT.create(K2 * nr, nn_N, (size_t)1u, allocator);
+    B_scales.create(N, (size_t)4u, allocator);
+    if (BT.empty() || B_scales.empty())
+        return -100;
+
+    // only the constant operands are int8, they come with their scales
+    if (B.elemsize == 1 && fixed_scales.empty())
+    {
+        NCNN_LOGE("gemm int8 operand has no scales");
+        return -1;
+    }
+
+    // zero the padded columns and the odd k tail
+    memset(BT.data, 0, BT.total());
+
+    const int col_stride = transB ? B_hstep : 1;
+    const int k_stride = transB ? 1 : B_hstep;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int j = 0; j < N; j++)
+    {
+        signed char* outptr = BT.row<signed char>(j / nr) + (j % nr) * 2;
+
+        if (B.elemsize == 1)
+        {
+            const signed char* ptr = (const signed char*)B + j * col_stride;
+            for (int k = 0; k < K; k++)
+            {
+                outptr[(k / 2) * nr * 2 + (k % 2)] = ptr[k * k_stride];
+            }
+
+            B_scales[j] = fixed_scales[j];
+        }
+        else
+        {
+            const float* ptr = (const float*)B + j * col_stride;
+
+            const float scale = gemm_int8_row_scale(ptr, K, k_stride, fixed_scales, j);
+            for (int k = 0; k < K; k++)
+            {
+                outptr[(k / 2) * nr * 2 + (k % 2)] = float2int8(ptr[k * k_stride] * scale);
+            }
+
+            B_scales[j] = scale;
+        }
+    }
+
+    return 0;
+}
+
+// sums = rows x nr int32 dot products of int16-pair rows of A against one packed B panel
+static void gemm_int8_tile(const int* pA0, const int* pA1, const int* pA2, const int* pA3, int rows, const signed char* pB, int KP, int* sums)
+{
+#if __AVX512F__
+    __m512i _sum0 = _mm512_setzero_si512();
+    __m512i _sum1 = _mm512_setzero_si512();
+    __m512i _sum2 = _mm512_setzero_si512();
+    __m512i _sum3 = _mm512_setzero_si512();
+
+    if (rows == 4)
+    {
+        for (int kp = 0; kp < KP; kp++)
+        {
+            __m512i _w = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)pB));
+#if __AVX512VNNI__
+            _sum0 = _mm512_dpwssd_epi32(_sum0, _mm512_set1_epi32(pA0[kp]), _w);
+            _sum1 = _mm512_dpwssd_epi32(_sum1, _mm512_set1_epi32(pA1[kp]), _w);
+            _sum2 = _mm512_dpwssd_epi32(_sum2, _mm512_set1_epi32(pA2[kp]), _w);
+            _sum3 = _mm512_dpwssd_epi32(_sum3, _mm512_set1_epi32(pA3[kp]), _w);
+#else
+            _sum0 = _mm512_add_epi32(_sum0, _mm512_madd_epi16(_mm512_set1_epi32(pA0[kp]), _w));
+            _sum1 = _mm512_add_epi32(_sum1, _mm512_madd_epi16(_mm512_set1_epi32(pA1[kp]), _w));
+            _sum2 = _mm512_add_epi32(_sum2, _mm512_madd_epi16(_mm512_set1_epi32(pA2[kp]), _w));
+            _sum3 = _mm512_add_epi32(_sum3, _mm512_madd_epi16(_mm512_set1_epi32(pA3[kp]), _w));
+#endif
+            pB += 32;
+        }
+    }
+    else
+    {
+        for (int kp = 0; kp < KP; kp++)
+        {
+            __m512i _w = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)pB));
+#if __AVX512VNNI__
+            _sum0 = _mm512_dpwssd_epi32(_sum0, _mm512_set1_epi32(pA0[kp]), _w);
+#else
+            _sum0 = _mm512_add_epi32(_sum0, _mm512_madd_epi16(_mm512_set1_epi32(pA0[kp]), _w));
+#endif
+            pB += 32;
+        }
+    }
+
+    _mm512_storeu_si512((__m512i*)sums, _sum0);
+    _mm512_storeu_si512((__m512i*)(sums + 16), _sum1);
+    _mm512_storeu_si512((__m512i*)(sums + 32), _sum2);
+    _mm512_storeu_si512((__m512i*)(sums + 48), _sum3);
+#elif __AVX2__
+    __m256i _sum0 = _mm256_setzero_si256();
+    __m256i _sum1 = _mm256_setzero_si256();
+    __m256i _sum2 = _mm256_setzero_si256();
+    __m256i _sum3 = _mm256_setzero_si256();
+
+    if (rows == 4)
+    {
+        for (int kp = 0; kp < KP; kp++)
+        {
+            __m256i _w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)pB));
+#if __AVXVNNI__ || __AVX512VNNI__
+            _sum0 = _mm256_dpwssd_epi32(_sum0, _mm256_set1_epi32(pA0[kp]), _w);
+            _sum1 = _mm256_dpwssd_epi32(_sum1, _mm256_set1_epi32(pA1[kp]), _w);
+            _sum2 = _mm256_dpwssd_epi32(_sum2, _mm256_set1_epi32(pA2[kp]), _w);
+            _sum3 = _mm256_dpwssd_epi32(_sum3, _mm256_set1_epi32(pA3[kp]), _w);
+#else
+            _sum0 = _mm256_add_epi32(_sum0, _mm256_madd_epi16(_mm256_set1_epi32(pA0[kp]), _w));
+            _sum1 = _mm256_add_epi32(_sum1, _mm256_madd_epi16(_mm256_set1_epi32(pA1[kp]), _w));
+            _sum2 = _mm256_add_epi32(_sum2, _mm256_madd_epi16(_mm256_set1_epi32(pA2[kp]), _w));
+            _sum3 = _mm256_add_epi32(_sum3, _mm256_madd_epi16(_mm256_set1_epi32(pA3[kp]), _w));
+#endif
+            pB += 16;
+        }
+    }
+    else
+    {
+        for (int kp = 0; kp < KP; kp++)
+        {
+            __m256i _w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)pB));
+#if __AVXVNNI__ || __AVX512VNNI__
+            _sum0 = _mm256_dpwssd_epi32(_sum0, _mm256_set1_epi32(pA0[kp]), _w);
+#else
+            _sum0 = _mm256_add_epi32(_sum0, _mm256_madd_epi16(_mm256_set1_epi32(pA0[kp]), _w));
+#endif
+            pB += 16;
+        }
+    }
+
+    _mm256_storeu_si256((__m256i*)sums, _sum0);
+    _mm256_storeu_si256((__m256i*)(sums + 8), _sum1);
+    _mm256_storeu_si256((__m256i*)(sums + 16), _sum2);
+    _mm256_storeu_si256((__m256i*)(sums + 24), _sum3);
+#elif __SSE2__
+    // 8 lanes on avx without avx2, 4 lanes on sse2
+#if __AVX__
+    const int nr = 8;
+#else
+    const int nr = 4;
+#endif
+    for (int jj = 0; jj < nr; jj += 4)
+    {
+        const signed char* pBB = pB + jj * 2;
+
+        __m128i _sum0 = _mm_setzero_si128();
+        __m128i _sum1 = _mm_setzero_si128();
+        __m128i _sum2 = _mm_setzero_si128();
+        __m128i _sum3 = _mm_setzero_si128();
+
+        for (int kp = 0; kp < KP; kp++)
+        {
+            __m128i _w = _mm_loadl_epi64((const __m128i*)pBB);
+#if __SSE4_1__
+            _w = _mm_cvtepi8_epi16(_w);
+#else
+            _w = _mm_unpacklo_epi8(_w, _mm_cmpgt_epi8(_mm_setzero_si128(), _w));
+#endif
+            _sum0 = _mm_add_epi32(_sum0, _mm_madd_epi16(_mm_set1_epi32(pA0[kp]), _w));
+            if (rows == 4)
+            {
+                _sum1 = _mm_add_epi32(_sum1, _mm_madd_epi16(_mm_set1_epi32(pA1[kp]), _w));
+                _sum2 = _mm_add_epi32(_sum2, _mm_madd_epi16(_mm_set1_epi32(pA2[kp]), _w));
+                _sum3 = _mm_add_epi32(_sum3, _mm_madd_epi16(_mm_set1_epi32(pA3[kp]), _w));
+            }
+            pBB += nr * 2;
+        }
+
+        _mm_storeu_si128((__m128i*)(sums + jj), _sum0);
+        _mm_storeu_si128((__m128i*)(sums + nr + jj), _sum1);
+        _mm_storeu_si128((__m128i*)(sums + nr * 2 + jj), _sum2);
+        _mm_storeu_si128((__m128i*)(sums + nr * 3 + jj), _sum3);
+    }
+#else  // __SSE2__
+    const int nr = 4;
+    const int* pA[4] = {pA0, pA1, pA2, pA3};
+    for (int r = 0; r < rows; r++)
+    {
+        const short* ptrA = (const short*)pA[r];
+        for (int jj = 0; jj < nr; jj++)
+        {
+            int sum = 0;
+            for (int kp = 0; kp < KP; kp++)
+            {
+                sum += ptrA[kp * 2] * pB[kp * nr * 2 + jj * 2];
+                sum += ptrA[kp * 2 + 1] * pB[kp * nr * 2 + jj * 2 + 1];
+            }
+            sums[r * nr + jj] = sum;
+        }
+    }
+#endif // __SSE2__
+}
+
+static void gemm_int8_sse(const Mat& AT, const Mat& BT, const Mat& A_scales, const Mat& B_scales, const float* ptrC, int broadcast_type_C, float alpha, float beta, Mat& top_blob, int output_transpose, int K, const Option& opt)
+{
+#if NCNN_RUNTIME_CPU && NCNN_AVX512VNNI && __AVX512F__ && !__AVX512VNNI__
+    if (ncnn::cpu_support_x86_avx512_vnni())
+    {
+        gemm_int8_sse_avx512vnni(AT, BT, A_scales, B_scales, ptrC, broadcast_type_C, alpha, beta, top_blob, output_transpose, K, opt);
+        return;
+    }
+#endif
+
+// B panels packed by avx512 are 16 lanes wide, which the avxvnni kernel cannot consume
+#if NCNN_RUNTIME_CPU && NCNN_AVXVNNI && __AVX2__ && !__AVX512F__ && !__AVXVNNI__
+    if (ncnn::cpu_support_x86_avx_vnni())
+    {
+        gemm_int8_sse_avxvnni(AT, BT, A_scales, B_scales, ptrC, broadcast_type_C, alpha, beta, top_blob, output_transpose, K, opt);
+        return;
+    }
+#endif
+
+#if NCNN_RUNTIME_CPU && NCNN_AVX2 && __AVX__ && !__AVX2__
+    if (ncnn::cpu_support_x86_avx2())
+    {
+        gemm_int8_sse_avx2(AT, BT, A_scales, B_scales, ptrC, broadcast_type_C, alpha, beta, top_blob, output_transpose, K, opt);
+        return;
+    }
+#endif
+
+    const int M = A_scales.w;
+    const int N = B_scales.w;
+    const int KP = (K + 1) / 2;
+
+    const int nr = gemm_int8_lanes();
+    const int nn_N = (N + nr - 1) / nr;
+    const int nn_M = (M + 3) / 4;
+
+    const int out_hstep = top_blob.dims == 3 ? (int)top_blob.cstep : top_blob.w;
+
+    // neighbouring tiles share the same B panel
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int ppij = 0; ppij < nn_N * nn_M; ppij++)
+    {
+        const int ppj = ppij / nn_M;
+        const int ppi = ppij % nn_M;
+
+        const int i = ppi * 4;
+        const int j = ppj * nr;
+
+        const int max_ii = std::min(M - i, 4);
+        const int max_jj = std::min(N - j, nr);
+
+        const signed char* pB = BT.row<const signed char>(ppj);
+
+        int sums[4 * 16] = {0};
+
+        // full tiles take 4 rows at once, the tail goes row by row
+        const int rows = max_ii == 4 ? 4 : 1;
+
+        for (int ii = 0; ii < max_ii; ii += rows)
+        {
+            const int* pA0 = (const int*)AT.row<const short>(i + ii);
+            const int* pA1 = rows == 4 ? (const int*)AT.row<const short>(i + ii + 1) : pA0;
+            const int* pA2 = rows == 4 ? (const int*)AT.row<const short>(i + ii + 2) : pA0;
+            const int* pA3 = rows == 4 ? (const int*)AT.row<const short>(i + ii + 3) : pA0;
+
+            gemm_int8_tile(pA0, pA1, pA2, pA3, rows, pB, KP, sums);
+
+            for (int r = 0; r < rows; r++)
+            {
+                const int ir = i + ii + r;
+                const float scale_a = A_scales[ir];
+
+                for (int jj = 0; jj < max_jj; jj++)
+                {
+                    const int jr = j + jj;
+                    const float scale_b = B_scales[jr];
+
+                    // dequantize
+                    float descale;
+                    if (scale_a == 0.f || scale_b == 0.f)
+                        descale = 0.f;
+                    else
+                        descale = 1.f / (scale_a * scale_b);
+
+                    float sumfp32 = sums[r * nr + jj] * descale;
+
+                    if (ptrC)
+                    {
+                        float c = 0.f;
+                        if (broadcast_type_C == 0)
+                            c = ptrC[0];
+                        if (broadcast_type_C == 1 || broadcast_type_C == 2)
+                            c = ptrC[ir];
+                        if (broadcast_type_C == 3)
+                            c = ptrC[ir * N + jr];
+                        if (broadcast_type_C == 4)
+                            c = ptrC[jr];
+
+                        sumfp32 += c * beta;
+                    }
+
+                    sumfp32 *= alpha;
+
+                    if (output_transpose)
+                        top_blob[jr * out_hstep + ir] = sumfp32;
+                    else
+                        top_blob[ir * out_hstep + jr] = sumfp32;
+                }
+            }
+        }
+    }
+}
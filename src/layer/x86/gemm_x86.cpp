@@ -23,14 +23,30 @@
 #include "x86_usability.h"
 
 #include "cpu.h"
+#include "weight_quant.h"
 
 namespace ncnn {
 
+#if NCNN_INT8
+#include "gemm_int8.h"
+#endif
+
+#if NCNN_BF16
+#include "cast_bf16.h"
+#endif
+
+#if NCNN_F16C && __AVX__
+#include "cast_fp16.h"
+#endif
+
 Gemm_x86::Gemm_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 
     nT = 0;
 }
@@ -6848,6 +6864,9 @@ static int gemm_x86(const Mat& A, const Mat& B, const Mat& C, Mat& top_blob, int
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // graph branches run with a share of the threads, the tiles keep following the load-time count
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -6947,6 +6966,184 @@ static int gemm_x86(const Mat& A, const Mat& B, const Mat& C, Mat& top_blob, int
     return 0;
 }
 
+// dequantize rows i .. i + max_ii, values k .. k + max_kk of weight-only quantized X into tmp
+// tmp is laid out as a max_ii x max_kk row-major matrix that the regular tile packers accept
+static Mat gemm_dequantize_tile(const Mat& Xq, const Mat& scales, int bits, int group_size, int K, int i, int max_ii, int k, int max_kk, Mat& tmp)
+{
+    const int row_bytes = weight_quant_row_bytes(K, bits);
+    const int groups = weight_quant_group_count(K, group_size);
+
+    Mat X(max_kk, max_ii, (void*)tmp.data, 4u);
+
+    for (int ii = 0; ii < max_ii; ii++)
+    {
+        weight_quant_dequantize_row((const unsigned char*)Xq + row_bytes * (i + ii), (const float*)scales + groups * (i + ii), bits, group_size, k, max_kk, X.row(ii));
+    }
+
+    return X;
+}
+
+// A and / or B may be weight-only quantized, marked by non-empty scales
+// quantized A tiles are dequantized per thread right before packing, so they never exist in fp32 as a whole
+// quantized B is dequantized tile by tile into the packed BT workspace like a runtime B
+static int gemm_weight_quant_x86(const Mat& A, const Mat& A_scales, const Mat& B, const Mat& B_scales, const Mat& C, Mat& top_blob, int broadcast_type_C, int M, int N, int K, int transA, int transB, int bits, int group_size, int output_transpose, int constant_TILE_M, int constant_TILE_N, int constant_TILE_K, int nT, const Option& opt)
+{
+    int TILE_M, TILE_N, TILE_K;
+    get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
+
+    // graph branches run with a share of the threads, the tiles keep following the load-time count
+    nT = std::min(nT, opt.num_threads);
+
+    int nn_M = (M + TILE_M - 1) / TILE_M;
+    int nn_N = (N + TILE_N - 1) / TILE_N;
+    int nn_K = (K + TILE_K - 1) / TILE_K;
+
+    Mat ATX(TILE_K * TILE_M, (K + TILE_K - 1) / TILE_K, nT, 4u, opt.blob_allocator);
+    Mat BT(TILE_K * TILE_N, (K + TILE_K - 1) / TILE_K, (N + TILE_N - 1) / TILE_N, 4u, opt.blob_allocator);
+
+    Mat WQ(TILE_K * std::max(TILE_M, TILE_N), 1, nT, 4u, opt.workspace_allocator);
+
+    const int nn_NK = nn_N * nn_K;
+
+    // pack B
+    #pragma omp parallel for num_threads(nT)
+    for (int ppjk = 0; ppjk < nn_NK; ppjk++)
+    {
+        const int ppj = ppjk / nn_K;
+        const int ppk = ppjk % nn_K;
+
+        const int j = ppj * TILE_N;
+        const int k = ppk * TILE_K;
+
+        const int max_jj = std::min((N - j), TILE_N);
+        const int max_kk = std::min((K - k), TILE_K);
+
+        Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
+
+        if (!B_scales.empty())
+        {
+            Mat WQ_tile = WQ.channel(get_omp_thread_num());
+            Mat B_tile = gemm_dequantize_tile(B, B_scales, bits, group_size, K, j, max_jj, k, max_kk, WQ_tile);
+            pack_B_tile(B_tile, BT_tile, 0, max_jj, 0, max_kk);
+        }
+        else if (transB)
+        {
+            pack_B_tile(B, BT_tile, j, max_jj, k, max_kk);
+        }
+        else
+        {
+            transpose_pack_B_tile(B, BT_tile, j, max_jj, k, max_kk);
+        }
+    }
+
+    Mat topT;
+    if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
+        topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.blob_allocator);
+
+    #pragma omp parallel for num_threads(nT)
+    for (int ppi = 0; ppi < nn_M; ppi++)
+    {
+        const int i = ppi * TILE_M;
+
+        const int max_ii = std::min((M - i), TILE_M);
+
+        Mat topT_tile;
+        if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
+            topT_tile = topT.channel(get_omp_thread_num());
+
+        for (int j = 0; j < N; j += TILE_N)
+        {
+            const int max_jj = std::min((N - j), TILE_N);
+
+            if (broadcast_type_C == 3)
+            {
+                pack_A_tile(C, topT_tile, i, max_ii, j, max_jj);
+            }
+
+            const Mat& CT_tile = broadcast_type_C == 3 ? topT_tile : C;
+
+            for (int k = 0; k < K; k += TILE_K)
+            {
+                const int max_kk = std::min((K - k), TILE_K);
+
+                Mat AT_tile = ATX.channel(get_omp_thread_num()).row_range(k / TILE_K, 1);
+
+                Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
+
+                if (j == 0)
+                {
+                    if (!A_scales.empty())
+                    {
+                        Mat WQ_tile = WQ.channel(get_omp_thread_num());
+                        Mat A_tile = gemm_dequantize_tile(A, A_scales, bits, group_size, K, i, max_ii, k, max_kk, WQ_tile);
+                        pack_A_tile(A_tile, AT_tile, 0, max_ii, 0, max_kk);
+                    }
+                    else if (transA)
+                    {
+                        transpose_pack_A_tile(A, AT_tile, i, max_ii, k, max_kk);
+                    }
+                    else
+                    {
+                        pack_A_tile(A, AT_tile, i, max_ii, k, max_kk);
+                    }
+                }
+
+                bool k_end = !output_transpose && k + TILE_K >= K;
+
+                gemm_transB_packed_tile(AT_tile, BT_tile, CT_tile, topT_tile, top_blob, broadcast_type_C, i, max_ii, j, max_jj, k, max_kk, k_end);
+            }
+
+            if (output_transpose)
+            {
+                transpose_unpack_output_tile(topT_tile, top_blob, i, max_ii, j, max_jj);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// constant tiles stored in fp16 are widened into the per-thread scratch tile before the microkernel
+static Mat gemm_constant_tile(const Mat& tile, Mat& scratch_tile, const Option& opt)
+{
+#if NCNN_F16C && __AVX__
+    if (tile.elemsize == 2u)
+    {
+        cast_fp16_to_fp32_sse(tile, scratch_tile, opt);
+        return scratch_tile;
+    }
+#else
+    (void)(scratch_tile);
+    (void)(opt);
+#endif
+
+    return tile;
+}
+
+// packed constant tiles are kept in fp16 when the storage option allows
+// bf16 storage does not narrow them, only the activations are bf16
+static int gemm_narrow_constant(Mat& data, const Option& opt)
+{
+#if NCNN_F16C && __AVX__
+    if (cpu_support_x86_f16c() && opt.use_fp16_storage)
+    {
+        Mat data_fp16(data.w, data.h, data.c, (size_t)2u, opt.blob_allocator);
+        if (data_fp16.empty())
+            return -100;
+
+        cast_fp32_to_fp16_sse(data, data_fp16, opt);
+
+        data = data_fp16;
+        return 0;
+    }
+#endif
+
+    (void)(data);
+    (void)(opt);
+
+    return 0;
+}
+
 static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob, int broadcast_type_C, int M, int K, int transB, int output_transpose, int constant_TILE_M, int constant_TILE_N, int constant_TILE_K, int nT, const Option& opt)
 {
     const int N = transB ? (B.dims == 3 ? B.c : B.h) * B.elempack : B.w;
@@ -6956,6 +7153,9 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // graph branches run with a share of the threads, the tiles keep following the load-time count
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -6995,6 +7195,13 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.blob_allocator);
 
+    Mat ATf;
+    if (AT.elemsize == 2u)
+        ATf.create(TILE_K * TILE_M, 1, nT, 4u, opt.workspace_allocator);
+
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+
     #pragma omp parallel for num_threads(nT)
     for (int ppi = 0; ppi < nn_M; ppi++)
     {
@@ -7023,7 +7230,8 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
 
                 // NCNN_LOGE("max_ii/jj/kk = %d %d %d", max_ii, max_jj, max_kk);
 
-                Mat AT_tile = AT.channel(i / TILE_M).row_range(k / TILE_K, 1);
+                Mat ATf_tile = ATf.empty() ? Mat() : ATf.channel(get_omp_thread_num());
+                Mat AT_tile = gemm_constant_tile(AT.channel(i / TILE_M).row_range(k / TILE_K, 1), ATf_tile, opt_1);
 
                 Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
 
@@ -7051,6 +7259,9 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // graph branches run with a share of the threads, the tiles keep following the load-time count
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -7062,6 +7273,13 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.blob_allocator);
 
+    Mat BTf;
+    if (BT.elemsize == 2u)
+        BTf.create(TILE_K * TILE_N, 1, nT, 4u, opt.workspace_allocator);
+
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+
     #pragma omp parallel for num_threads(nT)
     for (int ppi = 0; ppi < nn_M; ppi++)
     {
@@ -7092,7 +7310,8 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
 
                 Mat AT_tile = ATX.channel(get_omp_thread_num()).row_range(k / TILE_K, 1);
 
-                Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
+                Mat BTf_tile = BTf.empty() ? Mat() : BTf.channel(get_omp_thread_num());
+                Mat BT_tile = gemm_constant_tile(BT.channel(j / TILE_N).row_range(k / TILE_K, 1), BTf_tile, opt_1);
 
                 if (j == 0)
                 {
@@ -7128,6 +7347,9 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // graph branches run with a share of the threads, the tiles keep following the load-time count
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -7137,6 +7359,17 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.blob_allocator);
 
+    Mat ATf;
+    if (AT.elemsize == 2u)
+        ATf.create(TILE_K * TILE_M, 1, nT, 4u, opt.workspace_allocator);
+
+    Mat BTf;
+    if (BT.elemsize == 2u)
+        BTf.create(TILE_K * TILE_N, 1, nT, 4u, opt.workspace_allocator);
+
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+
     #pragma omp parallel for num_threads(nT)
     for (int ppi = 0; ppi < nn_M; ppi++)
     {
@@ -7165,9 +7398,11 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
 
                 // NCNN_LOGE("max_ii/jj/kk = %d %d %d", max_ii, max_jj, max_kk);
 
-                Mat AT_tile = AT.channel(i / TILE_M).row_range(k / TILE_K, 1);
+                Mat ATf_tile = ATf.empty() ? Mat() : ATf.channel(get_omp_thread_num());
+                Mat AT_tile = gemm_constant_tile(AT.channel(i / TILE_M).row_range(k / TILE_K, 1), ATf_tile, opt_1);
 
-                Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
+                Mat BTf_tile = BTf.empty() ? Mat() : BTf.channel(get_omp_thread_num());
+                Mat BT_tile = gemm_constant_tile(BT.channel(j / TILE_N).row_range(k / TILE_K, 1), BTf_tile, opt_1);
 
                 bool k_end = !output_transpose && k + TILE_K >= K;
 
@@ -7186,7 +7421,19 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
 
 int Gemm_x86::create_pipeline(const Option& opt)
 {
-    if (constantA)
+#if NCNN_INT8
+    if (opt.use_int8_inference && int8_scale_term)
+    {
+        return create_pipeline_int8_x86(opt);
+    }
+#endif
+
+    if (constantA && weight_quant_bits)
+    {
+        // weight-only quantized A stays compressed, tiles are dequantized while packing
+        AT_data = A_data;
+    }
+    else if (constantA)
     {
         const int M = constantM;
         const int K = constantK;
@@ -7223,13 +7470,21 @@ int Gemm_x86::create_pipeline(const Option& opt)
             }
         }
 
+        int ret = gemm_narrow_constant(AT_data, opt);
+        if (ret != 0)
+            return ret;
+
         if (opt.lightmode)
         {
             A_data.release();
         }
     }
 
-    if (constantB)
+    if (constantB && weight_quant_bits)
+    {
+        BT_data = B_data;
+    }
+    else if (constantB)
     {
         const int N = constantN;
         const int K = constantK;
@@ -7270,6 +7525,10 @@ int Gemm_x86::create_pipeline(const Option& opt)
             }
         }
 
+        int ret = gemm_narrow_constant(BT_data, opt);
+        if (ret != 0)
+            return ret;
+
         if (opt.lightmode)
         {
             B_data.release();
@@ -7323,8 +7582,62 @@ int Gemm_x86::create_pipeline(const Option& opt)
     return 0;
 }
 
+int Gemm_x86::save_pipeline(std::vector<Mat>& pipeline_data) const
+{
+    pipeline_data.push_back(AT_data);
+    pipeline_data.push_back(BT_data);
+    pipeline_data.push_back(CT_data);
+
+    return 0;
+}
+
+int Gemm_x86::load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt)
+{
+    if (pipeline_data.size() != 3)
+        return -1;
+
+    AT_data = pipeline_data[0];
+    BT_data = pipeline_data[1];
+    CT_data = pipeline_data[2];
+
+    if (opt.lightmode)
+    {
+        if (constantA)
+            A_data.release();
+        if (constantB)
+            B_data.release();
+        if (constantC && constant_broadcast_type_C != -1)
+            C_data.release();
+    }
+
+    if (constantA || constantB || constantC)
+    {
+        nT = opt.num_threads;
+    }
+
+    return 0;
+}
+
 int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage)
+    {
+        for (size_t i = 0; i < bottom_blobs.size(); i++)
+        {
+            if (bottom_blobs[i].elembits() == 16)
+                return forward_bf16s(bottom_blobs, top_blobs, opt);
+        }
+    }
+#endif
+
+#if NCNN_INT8
+    if (opt.use_int8_inference && int8_scale_term)
+    {
+        return forward_int8_x86(bottom_blobs, top_blobs, opt);
+    }
+#endif
+
     int M;
     int N;
     if (constantA && constantB)
@@ -7466,15 +7779,23 @@ int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
         return -100;
 
     int _nT = nT ? nT : opt.num_threads;
-    if (nT != 0 && opt.num_threads != nT)
+    if (nT != 0 && opt.num_threads != nT && !opt.use_branch_parallel)
     {
         // force num_threads the same as in create_pipeline
         // so we could use pre-packed A/B from the same tile config
+        // quiet for graph branches, which get a share of the threads on purpose
         NCNN_LOGE("opt.num_threads %d changed, gemm will use load-time value %d", opt.num_threads, nT);
     }
 
     int ret = 0;
-    if (constantA && constantB)
+    if (weight_quant_bits)
+    {
+        const Mat& A = constantA ? AT_data : bottom_blobs[0];
+        const Mat& B = constantB ? BT_data : constantA ? bottom_blobs[0] : bottom_blobs[1];
+        const int K = constantA ? constantK : transA ? (A.dims == 3 ? A.c : A.h) * A.elempack : A.w;
+        ret = gemm_weight_quant_x86(A, constantA ? A_data_quant_scales : Mat(), B, constantB ? B_data_quant_scales : Mat(), C, top_blob, broadcast_type_C, M, N, K, transA, transB, weight_quant_bits, weight_quant_group_size, output_transpose, constant_TILE_M, constant_TILE_N, constant_TILE_K, _nT, opt);
+    }
+    else if (constantA && constantB)
     {
         ret = gemm_AT_BT_x86(AT_data, BT_data, C, top_blob, broadcast_type_C, constantM, constantN, constantK, output_transpose, constant_TILE_M, constant_TILE_N, constant_TILE_K, _nT, opt);
     }
@@ -7510,4 +7831,217 @@ int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     return ret;
 }
 
+#if NCNN_BF16
+int Gemm_x86::forward_bf16s(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    // the tile packing reads fp32, widen the bf16 operands once
+    std::vector<Mat> bottom_blobs_fp32(bottom_blobs.size());
+    for (size_t i = 0; i < bottom_blobs.size(); i++)
+    {
+        bottom_blobs_fp32[i] = bottom_blobs[i];
+        if (bottom_blobs[i].elembits() == 16)
+        {
+            cast_bfloat16_to_float32(bottom_blobs[i], bottom_blobs_fp32[i], opt_ws);
+            if (bottom_blobs_fp32[i].empty())
+                return -100;
+        }
+    }
+
+    std::vector<Mat> top_blobs_fp32(1);
+    int ret = forward(bottom_blobs_fp32, top_blobs_fp32, opt_ws);
+    if (ret != 0)
+        return ret;
+
+    const Mat& top_blob_fp32 = top_blobs_fp32[0];
+
+    // top_blob may be a view into the output of a batched matmul, create keeps it when the shape matches
+    Mat& top_blob = top_blobs[0];
+    const int out_elempack = top_blob_fp32.elempack;
+    if (top_blob_fp32.dims == 3)
+        top_blob.create(top_blob_fp32.w, top_blob_fp32.h, top_blob_fp32.c, 2u * out_elempack, out_elempack, opt.blob_allocator);
+    else
+        top_blob.create(top_blob_fp32.w, top_blob_fp32.h, 2u * out_elempack, out_elempack, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    cast_fp32_to_bf16_sse(top_blob_fp32, top_blob, opt);
+
+    return 0;
+}
+#endif // NCNN_BF16
+
+#if NCNN_INT8
+int Gemm_x86::create_pipeline_int8_x86(const Option& opt)
+{
+    // constant A / B are quantized with the scales from the model
+    if (constantA)
+    {
+        Mat A_scales;
+        int ret = gemm_int8_pack_A(A_data, transA, A_data_int8_scales, AT_data, A_scales, opt.blob_allocator, opt);
+        if (ret != 0)
+            return ret;
+
+        if (opt.lightmode)
+        {
+            A_data.release();
+        }
+    }
+
+    if (constantB)
+    {
+        Mat B_scales;
+        int ret = gemm_int8_pack_B(B_data, transB, B_data_int8_scales, BT_data, B_scales, opt.blob_allocator, opt);
+        if (ret != 0)
+            return ret;
+
+        if (opt.lightmode)
+        {
+            B_data.release();
+        }
+    }
+
+    if (constantC && constant_broadcast_type_C != -1)
+    {
+        CT_data = C_data;
+
+        if (opt.lightmode)
+        {
+            C_data.release();
+        }
+    }
+
+    if (constantA || constantB || constantC)
+    {
+        nT = opt.num_threads;
+    }
+
+    return 0;
+}
+
+int Gemm_x86::forward_int8_x86(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    // the int8 kernel works on unpacked matrices
+    std::vector<Mat> bottom_blobs_unpacked(bottom_blobs.size());
+    for (size_t i = 0; i < bottom_blobs.size(); i++)
+    {
+        bottom_blobs_unpacked[i] = bottom_blobs[i];
+        if (bottom_blobs[i].elempack != 1)
+        {
+            convert_packing(bottom_blobs[i], bottom_blobs_unpacked[i], 1, opt_ws);
+            if (bottom_blobs_unpacked[i].empty())
+                return -100;
+        }
+    }
+
+    int K;
+
+    Mat AT;
+    Mat A_scales;
+    if (constantA)
+    {
+        AT = AT_data;
+        A_scales = A_data_int8_scales;
+        K = constantK;
+    }
+    else
+    {
+        const Mat& A = bottom_blobs_unpacked[0];
+        int ret = gemm_int8_pack_A(A, transA, Mat(), AT, A_scales, opt.workspace_allocator, opt);
+        if (ret != 0)
+            return ret;
+
+        K = transA ? (A.dims == 3 ? A.c : A.h) : A.w;
+    }
+
+    Mat BT;
+    Mat B_scales;
+    if (constantB)
+    {
+        BT = BT_data;
+        B_scales = B_data_int8_scales;
+    }
+    else
+    {
+        const Mat& B = constantA ? bottom_blobs_unpacked[0] : bottom_blobs_unpacked[1];
+        int ret = gemm_int8_pack_B(B, transB, Mat(), BT, B_scales, opt.workspace_allocator, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    const int M = A_scales.w;
+    const int N = B_scales.w;
+
+    int broadcast_type_C = 0;
+    const float* ptrC = 0;
+    if (constantC)
+    {
+        ptrC = CT_data;
+        broadcast_type_C = constant_broadcast_type_C;
+    }
+    else
+    {
+        ptrC = resolve_C(bottom_blobs_unpacked, M, N, broadcast_type_C);
+    }
+
+    int out_elempack = 1;
+#if __SSE2__
+    if (opt.use_packing_layout)
+    {
+        int outh = output_transpose ? N : M;
+#if __AVX512F__
+        out_elempack = outh % 16 == 0 ? 16 : outh % 8 == 0 ? 8 : outh % 4 == 0 ? 4 : 1;
+#elif __AVX__
+        out_elempack = outh % 8 == 0 ? 8 : outh % 4 == 0 ? 4 : 1;
+#else
+        out_elempack = outh % 4 == 0 ? 4 : 1;
+#endif
+    }
+#endif // __SSE2__
+    if (output_elempack)
+        out_elempack = output_elempack;
+
+    Mat& top_blob = top_blobs[0];
+
+    Mat top_blob_unpacked;
+    Allocator* unpacked_allocator = out_elempack == 1 ? opt.blob_allocator : opt.workspace_allocator;
+    if (output_transpose)
+    {
+        if (output_N1M)
+            top_blob_unpacked.create(M, 1, N, 4u, unpacked_allocator);
+        else
+            top_blob_unpacked.create(M, N, 4u, unpacked_allocator);
+    }
+    else
+    {
+        if (output_N1M)
+            top_blob_unpacked.create(N, 1, M, 4u, unpacked_allocator);
+        else
+            top_blob_unpacked.create(N, M, 4u, unpacked_allocator);
+    }
+    if (top_blob_unpacked.empty())
+        return -100;
+
+    gemm_int8_sse(AT, BT, A_scales, B_scales, ptrC, broadcast_type_C, alpha, beta, top_blob_unpacked, output_transpose, K, opt);
+
+    if (out_elempack == 1)
+    {
+        top_blob = top_blob_unpacked;
+    }
+    else
+    {
+        convert_packing(top_blob_unpacked, top_blob, out_elempack, opt);
+        if (top_blob.empty())
+            return -100;
+    }
+
+    return 0;
+}
+#endif // NCNN_INT8
+
 } // namespace ncnn
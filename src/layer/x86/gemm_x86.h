@@ -26,8 +26,20 @@ public:
 
     virtual int create_pipeline(const Option& opt);
 
+    virtual int save_pipeline(std::vector<Mat>& pipeline_data) const;
+    virtual int load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt);
+
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
 
+protected:
+#if NCNN_BF16
+    int forward_bf16s(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
+#endif
+#if NCNN_INT8
+    int create_pipeline_int8_x86(const Option& opt);
+    int forward_int8_x86(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
+#endif
+
 public:
     int nT;
     Mat AT_data;
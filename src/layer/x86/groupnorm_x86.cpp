@@ -0,0 +1,156 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "groupnorm_x86.h"
+
+#include <math.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif // __AVX__
+#endif // __SSE2__
+
+#include "x86_usability.h"
+#include "x86_normalization.h"
+
+namespace ncnn {
+
+GroupNorm_x86::GroupNorm_x86()
+{
+#if __SSE2__
+    support_packing = true;
+#endif // __SSE2__
+}
+
+int GroupNorm_x86::forward_inplace(Mat& bottom_top_blob, const Option& opt) const
+{
+    const int dims = bottom_top_blob.dims;
+    const int elempack = bottom_top_blob.elempack;
+    const int channels_per_group = channels / group;
+
+    // channels run along w for 1d blobs, along h for 2d and along c otherwise
+    // and every lane of a packed element is one channel
+    int outc = bottom_top_blob.c;
+    int size = bottom_top_blob.w * bottom_top_blob.h * bottom_top_blob.d;
+    if (dims == 1)
+    {
+        outc = bottom_top_blob.w;
+        size = 1;
+    }
+    if (dims == 2)
+    {
+        outc = bottom_top_blob.h;
+        size = bottom_top_blob.w;
+    }
+
+    if (outc * elempack != channels)
+    {
+        // the reference only normalizes the leading channels
+        if (elempack == 1)
+            return GroupNorm::forward_inplace(bottom_top_blob, opt);
+
+        Mat bottom_top_blob_unpacked;
+        convert_packing(bottom_top_blob, bottom_top_blob_unpacked, 1, opt);
+        if (bottom_top_blob_unpacked.empty())
+            return -100;
+
+        int ret = GroupNorm::forward_inplace(bottom_top_blob_unpacked, opt);
+        if (ret != 0)
+            return ret;
+
+        convert_packing(bottom_top_blob_unpacked, bottom_top_blob, elempack, opt);
+        if (bottom_top_blob.empty())
+            return -100;
+
+        return 0;
+    }
+
+    const int elemcount = channels_per_group * size;
+
+    // the lanes of one packed element may belong to different groups
+    // so statistics are gathered per channel, divided by the group element count,
+    // and summed into their group afterwards
+    Mat channel_stats(channels, 4u, opt.workspace_allocator);
+    Mat group_mean(group, 4u, opt.workspace_allocator);
+    Mat group_var(group, 4u, opt.workspace_allocator);
+    if (channel_stats.empty() || group_mean.empty() || group_var.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < outc; q++)
+    {
+        const float* ptr = dims == 1 ? (const float*)bottom_top_blob + q * elempack : dims == 2 ? bottom_top_blob.row(q) : (const float*)bottom_top_blob.channel(q);
+
+        fast_mean(ptr, (float*)channel_stats + q * elempack, elempack, elemcount, size * elempack);
+    }
+
+    group_mean.fill(0.f);
+    for (int c = 0; c < channels; c++)
+    {
+        group_mean[c / channels_per_group] += channel_stats[c];
+    }
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < outc; q++)
+    {
+        const float* ptr = dims == 1 ? (const float*)bottom_top_blob + q * elempack : dims == 2 ? bottom_top_blob.row(q) : (const float*)bottom_top_blob.channel(q);
+
+        float mean[16] = {0.f};
+        for (int k = 0; k < elempack; k++)
+        {
+            mean[k] = group_mean[(q * elempack + k) / channels_per_group];
+        }
+
+        fast_var(ptr, (float*)channel_stats + q * elempack, mean, elempack, elemcount, size * elempack);
+    }
+
+    group_var.fill(0.f);
+    for (int c = 0; c < channels; c++)
+    {
+        group_var[c / channels_per_group] += channel_stats[c];
+    }
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < outc; q++)
+    {
+        float* ptr = dims == 1 ? (float*)bottom_top_blob + q * elempack : dims == 2 ? bottom_top_blob.row(q) : (float*)bottom_top_blob.channel(q);
+
+        float a[16] = {0.f};
+        float b[16] = {0.f};
+        for (int k = 0; k < elempack; k++)
+        {
+            const int c = q * elempack + k;
+            const int g = c / channels_per_group;
+
+            if (affine)
+            {
+                a[k] = (float)(gamma_data[c] / sqrt(group_var[g] + eps));
+                b[k] = -group_mean[g] * a[k] + beta_data[c];
+            }
+            else
+            {
+                a[k] = (float)(1.f / sqrt(group_var[g] + eps));
+                b[k] = -group_mean[g] * a[k];
+            }
+        }
+
+        fast_fmadd(ptr, a, b, elempack, size * elempack);
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
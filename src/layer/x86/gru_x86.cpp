@@ -0,0 +1,675 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+
+#include "gru_x86.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif
+#endif // __SSE2__
+
+#include "x86_activation.h"
+#include "x86_usability.h"
+
+#include <math.h>
+
+namespace ncnn {
+
+GRU_x86::GRU_x86()
+{
+    one_blob_only = false;
+    support_inplace = false;
+}
+
+int GRU_x86::create_pipeline(const Option& opt)
+{
+    // pack RUN
+    int num_directions = direction == 2 ? 2 : 1;
+    int size = weight_data_size / num_directions / num_output / 3;
+
+#if __SSE2__
+    weight_xc_data_packed.create(size * 12, num_output / 4 + num_output % 4, num_directions);
+    bias_c_data_packed.create(num_output, 1, num_directions, 16u, 4);
+    weight_hc_data_packed.create(num_output * 12, num_output / 4 + num_output % 4, num_directions);
+#else
+    weight_xc_data_packed.create(size * 3, num_output, num_directions);
+    bias_c_data_packed.create(num_output, 1, num_directions, 16u, 4);
+    weight_hc_data_packed.create(num_output * 3, num_output, num_directions);
+#endif
+    if (weight_xc_data_packed.empty() || bias_c_data_packed.empty() || weight_hc_data_packed.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int dr = 0; dr < num_directions; dr++)
+    {
+        const Mat weight_xc = weight_xc_data.channel(dr);
+        const Mat bias_c = bias_c_data.channel(dr);
+        const Mat weight_hc = weight_hc_data.channel(dr);
+
+        Mat weight_xc_data_packed_dr = weight_xc_data_packed.channel(dr);
+        Mat bias_c_data_packed_dr = bias_c_data_packed.channel(dr);
+        Mat weight_hc_data_packed_dr = weight_hc_data_packed.channel(dr);
+
+        const float* bias_c_R = bias_c.row(0);
+        const float* bias_c_U = bias_c.row(1);
+        const float* bias_c_WN = bias_c.row(2);
+        const float* bias_c_BN = bias_c.row(3);
+
+        float* bias_c_RUBNWN = bias_c_data_packed_dr.row(0);
+
+        int q = 0;
+#if __SSE2__
+        for (; q + 3 < num_output; q += 4)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                bias_c_RUBNWN[j] = bias_c_R[q + j];
+                bias_c_RUBNWN[4 + j] = bias_c_U[q + j];
+                bias_c_RUBNWN[8 + j] = bias_c_BN[q + j];
+                bias_c_RUBNWN[12 + j] = bias_c_WN[q + j];
+            }
+
+            bias_c_RUBNWN += 16;
+
+            float* weight_xc_RUN = weight_xc_data_packed_dr.row(q / 4);
+            float* weight_hc_RUN = weight_hc_data_packed_dr.row(q / 4);
+
+            // R0 R1 R2 R3 U0 U1 U2 U3 for every input, then N0 N1 N2 N3 for every input
+            for (int i = 0; i < size; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    weight_xc_RUN[j] = weight_xc.row(num_output * 0 + q + j)[i];
+                    weight_xc_RUN[4 + j] = weight_xc.row(num_output * 1 + q + j)[i];
+                }
+
+                weight_xc_RUN += 8;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    weight_hc_RUN[j] = weight_hc.row(num_output * 0 + q + j)[i];
+                    weight_hc_RUN[4 + j] = weight_hc.row(num_output * 1 + q + j)[i];
+                }
+
+                weight_hc_RUN += 8;
+            }
+
+            for (int i = 0; i < size; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    weight_xc_RUN[j] = weight_xc.row(num_output * 2 + q + j)[i];
+                }
+
+                weight_xc_RUN += 4;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    weight_hc_RUN[j] = weight_hc.row(num_output * 2 + q + j)[i];
+                }
+
+                weight_hc_RUN += 4;
+            }
+        }
+#endif // __SSE2__
+        for (; q < num_output; q++)
+        {
+            bias_c_RUBNWN[0] = bias_c_R[q];
+            bias_c_RUBNWN[1] = bias_c_U[q];
+            bias_c_RUBNWN[2] = bias_c_BN[q];
+            bias_c_RUBNWN[3] = bias_c_WN[q];
+
+            bias_c_RUBNWN += 4;
+
+            const float* weight_xc_R = weight_xc.row(num_output * 0 + q);
+            const float* weight_xc_U = weight_xc.row(num_output * 1 + q);
+            const float* weight_xc_N = weight_xc.row(num_output * 2 + q);
+
+            const float* weight_hc_R = weight_hc.row(num_output * 0 + q);
+            const float* weight_hc_U = weight_hc.row(num_output * 1 + q);
+            const float* weight_hc_N = weight_hc.row(num_output * 2 + q);
+
+#if __SSE2__
+            float* weight_xc_RUN = weight_xc_data_packed_dr.row(q / 4 + q % 4);
+            float* weight_hc_RUN = weight_hc_data_packed_dr.row(q / 4 + q % 4);
+#else
+            float* weight_xc_RUN = weight_xc_data_packed_dr.row(q);
+            float* weight_hc_RUN = weight_hc_data_packed_dr.row(q);
+#endif // __SSE2__
+
+            for (int i = 0; i < size; i++)
+            {
+                weight_xc_RUN[0] = weight_xc_R[i];
+                weight_xc_RUN[1] = weight_xc_U[i];
+
+                weight_xc_RUN += 2;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                weight_hc_RUN[0] = weight_hc_R[i];
+                weight_hc_RUN[1] = weight_hc_U[i];
+
+                weight_hc_RUN += 2;
+            }
+
+            for (int i = 0; i < size; i++)
+            {
+                weight_xc_RUN[0] = weight_xc_N[i];
+
+                weight_xc_RUN += 1;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                weight_hc_RUN[0] = weight_hc_N[i];
+
+                weight_hc_RUN += 1;
+            }
+        }
+    }
+
+    if (opt.lightmode)
+    {
+        weight_xc_data.release();
+        bias_c_data.release();
+        weight_hc_data.release();
+    }
+
+    return 0;
+}
+
+#if __SSE2__
+// accumulate gate R and U of 4 outputs over n inputs
+// kptr holds R0 R1 R2 R3 U0 U1 U2 U3 for every input and is advanced past them
+static NCNN_FORCEINLINE void gru_fmadd_RU_pack4(const float* x, const float*& kptr, int n, __m128& _R, __m128& _U)
+{
+    int i = 0;
+#if __AVX__
+    __m256 _RU = _mm256_setzero_ps();
+#if __AVX512F__
+    // two inputs per register
+    const __m512i _idx01 = _mm512_set_epi32(1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m512i _idx23 = _mm512_set_epi32(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2);
+    __m512 _sum0 = _mm512_setzero_ps();
+    __m512 _sum1 = _mm512_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        __m512 _xi = _mm512_castps128_ps512(_mm_loadu_ps(x + i));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr), _mm512_permutexvar_ps(_idx01, _xi), _sum0);
+        _sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr + 16), _mm512_permutexvar_ps(_idx23, _xi), _sum1);
+
+        kptr += 32;
+    }
+    _sum0 = _mm512_add_ps(_sum0, _sum1);
+    _RU = _mm256_add_ps(_mm512_castps512_ps256(_sum0), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sum0), 1)));
+#else  // __AVX512F__
+    __m256 _sum1 = _mm256_setzero_ps();
+    __m256 _sum2 = _mm256_setzero_ps();
+    __m256 _sum3 = _mm256_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        _RU = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr), _mm256_broadcast_ss(x + i), _RU);
+        _sum1 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr + 8), _mm256_broadcast_ss(x + i + 1), _sum1);
+        _sum2 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr + 16), _mm256_broadcast_ss(x + i + 2), _sum2);
+        _sum3 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr + 24), _mm256_broadcast_ss(x + i + 3), _sum3);
+
+        kptr += 32;
+    }
+    _RU = _mm256_add_ps(_mm256_add_ps(_RU, _sum1), _mm256_add_ps(_sum2, _sum3));
+#endif // __AVX512F__
+    for (; i < n; i++)
+    {
+        _RU = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr), _mm256_broadcast_ss(x + i), _RU);
+
+        kptr += 8;
+    }
+    _R = _mm_add_ps(_R, _mm256_castps256_ps128(_RU));
+    _U = _mm_add_ps(_U, _mm256_extractf128_ps(_RU, 1));
+#else  // __AVX__
+    __m128 _sum0 = _mm_setzero_ps();
+    __m128 _sum1 = _mm_setzero_ps();
+    for (; i + 1 < n; i += 2)
+    {
+        __m128 _xi0 = _mm_load1_ps(x + i);
+        __m128 _xi1 = _mm_load1_ps(x + i + 1);
+        _R = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _xi0, _R);
+        _U = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 4), _xi0, _U);
+        _sum0 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 8), _xi1, _sum0);
+        _sum1 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 12), _xi1, _sum1);
+
+        kptr += 16;
+    }
+    for (; i < n; i++)
+    {
+        __m128 _xi = _mm_load1_ps(x + i);
+        _R = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _xi, _R);
+        _U = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 4), _xi, _U);
+
+        kptr += 8;
+    }
+    _R = _mm_add_ps(_R, _sum0);
+    _U = _mm_add_ps(_U, _sum1);
+#endif // __AVX__
+}
+
+// accumulate gate N of 4 outputs over n inputs
+// kptr holds N0 N1 N2 N3 for every input and is advanced past them
+static NCNN_FORCEINLINE __m128 gru_fmadd_N_pack4(const float* x, const float*& kptr, int n, __m128 _N)
+{
+    int i = 0;
+#if __AVX512F__
+    // four inputs per register
+    const __m512i _idx = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    __m512 _sum0 = _mm512_setzero_ps();
+    __m512 _sum1 = _mm512_setzero_ps();
+    for (; i + 7 < n; i += 8)
+    {
+        __m512 _xi0 = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i)));
+        __m512 _xi1 = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i + 4)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr), _xi0, _sum0);
+        _sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr + 16), _xi1, _sum1);
+
+        kptr += 32;
+    }
+    for (; i + 3 < n; i += 4)
+    {
+        __m512 _xi = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr), _xi, _sum0);
+
+        kptr += 16;
+    }
+    _sum0 = _mm512_add_ps(_sum0, _sum1);
+    __m256 _sum = _mm256_add_ps(_mm512_castps512_ps256(_sum0), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sum0), 1)));
+    _N = _mm_add_ps(_N, _mm_add_ps(_mm256_castps256_ps128(_sum), _mm256_extractf128_ps(_sum, 1)));
+#elif __AVX__
+    // two inputs per register
+    __m256 _sum0 = _mm256_setzero_ps();
+    __m256 _sum1 = _mm256_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        __m256 _xi01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load1_ps(x + i)), _mm_load1_ps(x + i + 1), 1);
+        __m256 _xi23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load1_ps(x + i + 2)), _mm_load1_ps(x + i + 3), 1);
+        _sum0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr), _xi01, _sum0);
+        _sum1 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr + 8), _xi23, _sum1);
+
+        kptr += 16;
+    }
+    _sum0 = _mm256_add_ps(_sum0, _sum1);
+    _N = _mm_add_ps(_N, _mm_add_ps(_mm256_castps256_ps128(_sum0), _mm256_extractf128_ps(_sum0, 1)));
+#else
+    __m128 _sum1 = _mm_setzero_ps();
+    __m128 _sum2 = _mm_setzero_ps();
+    __m128 _sum3 = _mm_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        _N = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _mm_load1_ps(x + i), _N);
+        _sum1 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 4), _mm_load1_ps(x + i + 1), _sum1);
+        _sum2 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 8), _mm_load1_ps(x + i + 2), _sum2);
+        _sum3 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 12), _mm_load1_ps(x + i + 3), _sum3);
+
+        kptr += 16;
+    }
+    _N = _mm_add_ps(_mm_add_ps(_N, _sum1), _mm_add_ps(_sum2, _sum3));
+#endif
+    for (; i < n; i++)
+    {
+        _N = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _mm_load1_ps(x + i), _N);
+
+        kptr += 4;
+    }
+
+    return _N;
+}
+#endif // __SSE2__
+
+static int gru(const Mat& bottom_blob, Mat& top_blob, int reverse, const Mat& weight_xc, const Mat& bias_c, const Mat& weight_hc, Mat& hidden_state, const Option& opt)
+{
+    int size = bottom_blob.w;
+    int T = bottom_blob.h;
+
+    int num_output = top_blob.w;
+
+    // 2 x num_output
+#if __SSE2__
+    Mat gates(4 * 2, num_output / 4 + num_output % 4, 4u, opt.workspace_allocator);
+#else
+    Mat gates(2, num_output, 4u, opt.workspace_allocator);
+#endif
+    if (gates.empty())
+        return -100;
+
+    // unroll
+    for (int t = 0; t < T; t++)
+    {
+        int ti = reverse ? T - 1 - t : t;
+
+        int remain_num_output_start = 0;
+#if __SSE2__
+        int nn_num_output = num_output >> 2;
+        remain_num_output_start = nn_num_output << 2;
+
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int qq = 0; qq < nn_num_output; qq++)
+        {
+            int q = qq * 4;
+
+            const float* x = bottom_blob.row(ti);
+            const float* hidden_ptr = hidden_state;
+
+            // gate reset update
+            const float* bias_c_RUBNWN = (const float*)bias_c + q * 4;
+
+            const float* weight_xc_RUN = weight_xc.row(q / 4);
+            const float* weight_hc_RUN = weight_hc.row(q / 4);
+
+            __m128 _R = _mm_loadu_ps(bias_c_RUBNWN);
+            __m128 _U = _mm_loadu_ps(bias_c_RUBNWN + 4);
+
+            gru_fmadd_RU_pack4(x, weight_xc_RUN, size, _R, _U);
+            gru_fmadd_RU_pack4(hidden_ptr, weight_hc_RUN, num_output, _R, _U);
+
+            // sigmoid(R)
+            // sigmoid(U)
+            _R = sigmoid_sse(_R);
+            _U = sigmoid_sse(_U);
+
+            // gate new
+            __m128 _N = gru_fmadd_N_pack4(hidden_ptr, weight_hc_RUN, num_output, _mm_loadu_ps(bias_c_RUBNWN + 8));
+
+            _N = _mm_comp_fmadd_ps(_R, _N, _mm_loadu_ps(bias_c_RUBNWN + 12));
+
+            _N = gru_fmadd_N_pack4(x, weight_xc_RUN, size, _N);
+
+            // tanh(N)
+            _N = tanh_sse(_N);
+
+            float* gates_data = gates.row(q / 4);
+
+            _mm_storeu_ps(gates_data, _U);
+            _mm_storeu_ps(gates_data + 4, _N);
+        }
+#endif // __SSE2__
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int q = remain_num_output_start; q < num_output; q++)
+        {
+            const float* x = bottom_blob.row(ti);
+            const float* hidden_ptr = hidden_state;
+
+            // gate reset update
+            const float* bias_c_RUBNWN = (const float*)bias_c + q * 4;
+
+#if __SSE2__
+            const float* weight_xc_RUN = weight_xc.row(q / 4 + q % 4);
+            const float* weight_hc_RUN = weight_hc.row(q / 4 + q % 4);
+#else
+            const float* weight_xc_RUN = weight_xc.row(q);
+            const float* weight_hc_RUN = weight_hc.row(q);
+#endif
+
+            float R = bias_c_RUBNWN[0];
+            float U = bias_c_RUBNWN[1];
+
+            for (int i = 0; i < size; i++)
+            {
+                float xi = x[i];
+
+                R += weight_xc_RUN[0] * xi;
+                U += weight_xc_RUN[1] * xi;
+
+                weight_xc_RUN += 2;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                float h_cont = hidden_ptr[i];
+
+                R += weight_hc_RUN[0] * h_cont;
+                U += weight_hc_RUN[1] * h_cont;
+
+                weight_hc_RUN += 2;
+            }
+
+            // sigmoid(R)
+            // sigmoid(U)
+            R = 1.f / (1.f + exp(-R));
+            U = 1.f / (1.f + exp(-U));
+
+            // gate new
+            float N = bias_c_RUBNWN[2];
+
+            for (int i = 0; i < num_output; i++)
+            {
+                float h_cont = hidden_ptr[i];
+
+                N += weight_hc_RUN[0] * h_cont;
+
+                weight_hc_RUN += 1;
+            }
+
+            N = bias_c_RUBNWN[3] + R * N;
+
+            for (int i = 0; i < size; i++)
+            {
+                float xi = x[i];
+
+                N += weight_xc_RUN[0] * xi;
+
+                weight_xc_RUN += 1;
+            }
+
+            // tanh(N)
+            N = tanh(N);
+
+#if __SSE2__
+            float* gates_data = gates.row(q / 4 + q % 4);
+#else
+            float* gates_data = gates.row(q);
+#endif
+
+            gates_data[0] = U;
+            gates_data[1] = N;
+        }
+
+        // h_t := (1 - update) .* new + update .* h_{t-1}
+        float* output_data = top_blob.row(ti);
+
+        float* hidden_ptr = hidden_state;
+
+#if __SSE2__
+        nn_num_output = num_output >> 2;
+        remain_num_output_start = nn_num_output << 2;
+
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int qq = 0; qq < nn_num_output; qq++)
+        {
+            int q = qq * 4;
+
+            const float* gates_data = gates.row(q / 4);
+
+            __m128 _U = _mm_loadu_ps(gates_data);
+            __m128 _N = _mm_loadu_ps(gates_data + 4);
+
+            __m128 _H = _mm_comp_fmadd_ps(_U, _mm_sub_ps(_mm_loadu_ps(hidden_ptr + q), _N), _N);
+
+            _mm_storeu_ps(hidden_ptr + q, _H);
+            _mm_storeu_ps(output_data + q, _H);
+        }
+#endif // __SSE2__
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int q = remain_num_output_start; q < num_output; q++)
+        {
+#if __SSE2__
+            const float* gates_data = gates.row(q / 4 + q % 4);
+#else
+            const float* gates_data = gates.row(q);
+#endif
+
+            float U = gates_data[0];
+            float N = gates_data[1];
+
+            float H = (1 - U) * N + U * hidden_ptr[q];
+
+            hidden_ptr[q] = H;
+            output_data[q] = H;
+        }
+    }
+
+    return 0;
+}
+
+int GRU_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    int T = bottom_blob.h;
+
+    int num_directions = direction == 2 ? 2 : 1;
+
+    // initial hidden state
+    Mat hidden(num_output, 4u, opt.workspace_allocator);
+    if (hidden.empty())
+        return -100;
+    hidden.fill(0.f);
+
+    top_blob.create(num_output * num_directions, T, 4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    // Uni directional
+    if (direction == 0 || direction == 1)
+    {
+        int ret = gru(bottom_blob, top_blob, direction, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (direction == 2)
+    {
+        Mat top_blob_forward(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_forward.empty())
+            return -100;
+
+        Mat top_blob_reverse(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_reverse.empty())
+            return -100;
+
+        int ret0 = gru(bottom_blob, top_blob_forward, 0, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret0 != 0)
+            return ret0;
+
+        hidden.fill(0.0f);
+
+        int ret1 = gru(bottom_blob, top_blob_reverse, 1, weight_xc_data_packed.channel(1), bias_c_data_packed.channel(1), weight_hc_data_packed.channel(1), hidden, opt);
+        if (ret1 != 0)
+            return ret1;
+
+        // concat w
+        for (int i = 0; i < T; i++)
+        {
+            const float* pf = top_blob_forward.row(i);
+            const float* pr = top_blob_reverse.row(i);
+            float* ptr = top_blob.row(i);
+
+            memcpy(ptr, pf, num_output * sizeof(float));
+            memcpy(ptr + num_output, pr, num_output * sizeof(float));
+        }
+    }
+
+    return 0;
+}
+
+int GRU_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& bottom_blob = bottom_blobs[0];
+    int T = bottom_blob.h;
+    int num_directions = direction == 2 ? 2 : 1;
+
+    Mat hidden;
+    Allocator* hidden_allocator = top_blobs.size() == 2 ? opt.blob_allocator : opt.workspace_allocator;
+    if (bottom_blobs.size() == 2)
+    {
+        // a state top sharing its bottom is updated in place
+        const bool inplace = top_blobs.size() == 2 && top_blobs[1].data == bottom_blobs[1].data;
+        hidden = inplace ? bottom_blobs[1] : bottom_blobs[1].clone(hidden_allocator);
+    }
+    else
+    {
+        hidden.create(num_output, num_directions, 4u, hidden_allocator);
+        if (hidden.empty())
+            return -100;
+        hidden.fill(0.f);
+    }
+
+    Mat& top_blob = top_blobs[0];
+    top_blob.create(num_output * num_directions, T, 4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    // Uni directional
+    if (direction == 0 || direction == 1)
+    {
+        int ret = gru(bottom_blob, top_blob, direction, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (direction == 2)
+    {
+        Mat top_blob_forward(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_forward.empty())
+            return -100;
+
+        Mat top_blob_reverse(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_reverse.empty())
+            return -100;
+
+        Mat hidden0 = hidden.row_range(0, 1);
+        int ret0 = gru(bottom_blob, top_blob_forward, 0, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden0, opt);
+        if (ret0 != 0)
+            return ret0;
+
+        Mat hidden1 = hidden.row_range(1, 1);
+        int ret1 = gru(bottom_blob, top_blob_reverse, 1, weight_xc_data_packed.channel(1), bias_c_data_packed.channel(1), weight_hc_data_packed.channel(1), hidden1, opt);
+        if (ret1 != 0)
+            return ret1;
+
+        // concat w
+        for (int i = 0; i < T; i++)
+        {
+            const float* pf = top_blob_forward.row(i);
+            const float* pr = top_blob_reverse.row(i);
+            float* ptr = top_blob.row(i);
+
+            memcpy(ptr, pf, num_output * sizeof(float));
+            memcpy(ptr + num_output, pr, num_output * sizeof(float));
+        }
+    }
+
+    if (top_blobs.size() == 2)
+    {
+        top_blobs[1] = hidden;
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
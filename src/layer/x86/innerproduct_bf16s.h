@@ -0,0 +1,209 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if NCNN_RUNTIME_CPU && NCNN_AVX512BF16 && __AVX512F__ && !__AVX512BF16__
+void innerproduct_bf16s_sse_avx512bf16(const Mat& bottom_blob, Mat& top_blob, const Mat& weight_data_bf16, const Mat& bias_data, int activation_type, const Mat& activation_params, const Option& opt);
+#endif
+
+static void innerproduct_transform_kernel_bf16s_sse(const Mat& weight_data, Mat& weight_data_tm, int num_input, int num_output, const Option& opt)
+{
+    // src = inch-outch
+    // dst = inch-outch in bf16
+    Mat weight_data_r2 = weight_data.reshape(num_input, num_output);
+
+    weight_data_tm.create(num_input, num_output, (size_t)2u);
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int p = 0; p < num_output; p++)
+    {
+        const float* kptr = weight_data_r2.row(p);
+        unsigned short* g0 = weight_data_tm.row<unsigned short>(p);
+
+        for (int i = 0; i < num_input; i++)
+        {
+            g0[i] = float32_to_bfloat16(kptr[i]);
+        }
+    }
+}
+
+#if __AVX512BF16__
+static float innerproduct_dot_bf16s(const unsigned short* sptr, const unsigned short* kptr, int num_input)
+{
+    __m512 _sum0 = _mm512_setzero_ps();
+    __m512 _sum1 = _mm512_setzero_ps();
+
+    int i = 0;
+    for (; i + 63 < num_input; i += 64)
+    {
+        __m512i _val0 = _mm512_loadu_si512((const __m512i*)(sptr + i));
+        __m512i _val1 = _mm512_loadu_si512((const __m512i*)(sptr + i + 32));
+        __m512i _w0 = _mm512_loadu_si512((const __m512i*)(kptr + i));
+        __m512i _w1 = _mm512_loadu_si512((const __m512i*)(kptr + i + 32));
+        _sum0 = _mm512_dpbf16_ps(_sum0, (__m512bh)_val0, (__m512bh)_w0);
+        _sum1 = _mm512_dpbf16_ps(_sum1, (__m512bh)_val1, (__m512bh)_w1);
+    }
+    for (; i + 31 < num_input; i += 32)
+    {
+        __m512i _val = _mm512_loadu_si512((const __m512i*)(sptr + i));
+        __m512i _w = _mm512_loadu_si512((const __m512i*)(kptr + i));
+        _sum0 = _mm512_dpbf16_ps(_sum0, (__m512bh)_val, (__m512bh)_w);
+    }
+    __m256 _sum2 = _mm256_setzero_ps();
+    for (; i + 15 < num_input; i += 16)
+    {
+        __m256i _val = _mm256_loadu_si256((const __m256i*)(sptr + i));
+        __m256i _w = _mm256_loadu_si256((const __m256i*)(kptr + i));
+        _sum2 = _mm256_dpbf16_ps(_sum2, (__m256bh)_val, (__m256bh)_w);
+    }
+
+    float sum = _mm512_comp_reduce_add_ps(_mm512_add_ps(_sum0, _sum1)) + _mm256_reduce_add_ps(_sum2);
+    for (; i < num_input; i++)
+    {
+        sum += bfloat16_to_float32(sptr[i]) * bfloat16_to_float32(kptr[i]);
+    }
+
+    return sum;
+}
+#else  // __AVX512BF16__
+static float innerproduct_dot_bf16s(const float* sptr, const unsigned short* kptr, int num_input)
+{
+    float sum = 0.f;
+
+    int i = 0;
+#if __SSE2__
+#if __AVX__
+#if __AVX512F__
+    __m512 _sum0 = _mm512_setzero_ps();
+    __m512 _sum1 = _mm512_setzero_ps();
+    __m512 _sum2 = _mm512_setzero_ps();
+    __m512 _sum3 = _mm512_setzero_ps();
+    for (; i + 63 < num_input; i += 64)
+    {
+        __m512 _w0 = bfloat2float_avx512(_mm256_loadu_si256((const __m256i*)(kptr + i)));
+        __m512 _w1 = bfloat2float_avx512(_mm256_loadu_si256((const __m256i*)(kptr + i + 16)));
+        __m512 _w2 = bfloat2float_avx512(_mm256_loadu_si256((const __m256i*)(kptr + i + 32)));
+        __m512 _w3 = bfloat2float_avx512(_mm256_loadu_si256((const __m256i*)(kptr + i + 48)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + i), _w0, _sum0);
+        _sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + i + 16), _w1, _sum1);
+        _sum2 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + i + 32), _w2, _sum2);
+        _sum3 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + i + 48), _w3, _sum3);
+    }
+    _sum0 = _mm512_add_ps(_sum0, _sum2);
+    _sum1 = _mm512_add_ps(_sum1, _sum3);
+    for (; i + 15 < num_input; i += 16)
+    {
+        __m512 _w = bfloat2float_avx512(_mm256_loadu_si256((const __m256i*)(kptr + i)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + i), _w, _sum0);
+    }
+    sum += _mm512_comp_reduce_add_ps(_mm512_add_ps(_sum0, _sum1));
+#else  // __AVX512F__
+    __m256 _sum0 = _mm256_setzero_ps();
+    __m256 _sum1 = _mm256_setzero_ps();
+    for (; i + 15 < num_input; i += 16)
+    {
+        __m256 _w0 = bfloat2float_avx(_mm_loadu_si128((const __m128i*)(kptr + i)));
+        __m256 _w1 = bfloat2float_avx(_mm_loadu_si128((const __m128i*)(kptr + i + 8)));
+        _sum0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + i), _w0, _sum0);
+        _sum1 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + i + 8), _w1, _sum1);
+    }
+    for (; i + 7 < num_input; i += 8)
+    {
+        __m256 _w = bfloat2float_avx(_mm_loadu_si128((const __m128i*)(kptr + i)));
+        _sum0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + i), _w, _sum0);
+    }
+    sum += _mm256_reduce_add_ps(_mm256_add_ps(_sum0, _sum1));
+#endif // __AVX512F__
+#else  // __AVX__
+    __m128 _sum0 = _mm_setzero_ps();
+    __m128 _sum1 = _mm_setzero_ps();
+    for (; i + 7 < num_input; i += 8)
+    {
+        __m128i _w = _mm_loadu_si128((const __m128i*)(kptr + i));
+        _sum0 = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + i), bfloat2float_sse(_w), _sum0);
+        _sum1 = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + i + 4), bfloat2float_sse(_mm_unpackhi_epi64(_w, _w)), _sum1);
+    }
+    for (; i + 3 < num_input; i += 4)
+    {
+        __m128 _w = bfloat2float_sse(_mm_loadl_epi64((const __m128i*)(kptr + i)));
+        _sum0 = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + i), _w, _sum0);
+    }
+    sum += _mm_reduce_add_ps(_mm_add_ps(_sum0, _sum1));
+#endif // __AVX__
+#endif // __SSE2__
+    for (; i < num_input; i++)
+    {
+        sum += sptr[i] * bfloat16_to_float32(kptr[i]);
+    }
+
+    return sum;
+}
+#endif // __AVX512BF16__
+
+static void innerproduct_bf16s_sse(const Mat& bottom_blob, Mat& top_blob, const Mat& weight_data_bf16, const Mat& bias_data, int activation_type, const Mat& activation_params, const Option& opt)
+{
+#if NCNN_RUNTIME_CPU && NCNN_AVX512BF16 && __AVX512F__ && !__AVX512BF16__
+    if (ncnn::cpu_support_x86_avx512_bf16())
+    {
+        innerproduct_bf16s_sse_avx512bf16(bottom_blob, top_blob, weight_data_bf16, bias_data, activation_type, activation_params, opt);
+        return;
+    }
+#endif
+
+    // bottom_blob and top_blob are elempack 1
+    // one row per sample, 1-D blobs have a single row
+    const int num_input = bottom_blob.w;
+    const int num_output = top_blob.w;
+    const int h = bottom_blob.dims == 1 ? 1 : bottom_blob.h;
+
+    const float* bias_data_ptr = bias_data;
+
+#if __AVX512BF16__
+    const Mat& bottom_blob_tm = bottom_blob;
+#else
+    // widen the input once, every output reads all of it
+    Mat bottom_blob_tm;
+    {
+        Option opt_cast = opt;
+        opt_cast.blob_allocator = opt.workspace_allocator;
+
+        cast_bfloat16_to_float32(bottom_blob, bottom_blob_tm, opt_cast);
+        if (bottom_blob_tm.empty())
+            return;
+    }
+#endif
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int p = 0; p < num_output; p++)
+    {
+        const unsigned short* kptr = weight_data_bf16.row<unsigned short>(p);
+
+        const float bias = bias_data_ptr ? bias_data_ptr[p] : 0.f;
+
+        for (int j = 0; j < h; j++)
+        {
+#if __AVX512BF16__
+            const unsigned short* sptr = (const unsigned short*)bottom_blob_tm + j * num_input;
+#else
+            const float* sptr = (const float*)bottom_blob_tm + j * num_input;
+#endif
+            unsigned short* outptr = (unsigned short*)top_blob + j * top_blob.w;
+
+            float sum = bias + innerproduct_dot_bf16s(sptr, kptr, num_input);
+
+            sum = activation_ss(sum, activation_type, activation_params);
+
+            outptr[p] = float32_to_bfloat16(sum);
+        }
+    }
+}
@@ -0,0 +1,266 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if __SSE2__
+// acc += x[0..15] * w[0..15] with w as 16 int8, unscaled
+// acc0 += x[0..15] * low nibbles, acc1 += x[16..31] * high nibbles of 16 bytes, the nibbles taken as unsigned
+#if __AVX512F__
+static NCNN_FORCEINLINE __m512 weight_quant_dot16_int8(const float* sptr, const unsigned char* p, __m512 _acc)
+{
+    __m512 _w = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)p)));
+    return _mm512_fmadd_ps(_mm512_loadu_ps(sptr), _w, _acc);
+}
+
+static NCNN_FORCEINLINE void weight_quant_dot32_uint4(const float* sptr, const unsigned char* p, __m512& _acc0, __m512& _acc1)
+{
+    __m512i _b = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p));
+    __m512 _w0 = _mm512_cvtepi32_ps(_mm512_and_si512(_b, _mm512_set1_epi32(15)));
+    __m512 _w1 = _mm512_cvtepi32_ps(_mm512_srli_epi32(_b, 4));
+    _acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr), _w0, _acc0);
+    _acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(sptr + 16), _w1, _acc1);
+}
+#elif __AVX__
+static NCNN_FORCEINLINE __m256 weight_quant_dot16_int8(const float* sptr, const unsigned char* p, __m256 _acc)
+{
+    __m128i _w = _mm_loadu_si128((const __m128i*)p);
+#if __AVX2__
+    __m256 _w0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_w));
+    __m256 _w1 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_unpackhi_epi64(_w, _w)));
+#else
+    __m128i _w_hi = _mm_unpackhi_epi64(_w, _w);
+    __m256 _w0 = _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(_mm_cvtepi8_epi32(_w)), _mm_cvtepi8_epi32(_mm_srli_si128(_w, 4)), 1));
+    __m256 _w1 = _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(_mm_cvtepi8_epi32(_w_hi)), _mm_cvtepi8_epi32(_mm_srli_si128(_w_hi, 4)), 1));
+#endif
+    _acc = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr), _w0, _acc);
+    _acc = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + 8), _w1, _acc);
+    return _acc;
+}
+
+static NCNN_FORCEINLINE void weight_quant_dot32_uint4(const float* sptr, const unsigned char* p, __m256& _acc0, __m256& _acc1)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        // bytes 8i .. 8i + 7 hold values 8i .. 8i + 7 and 16 + 8i .. 16 + 8i + 7
+#if __AVX2__
+        __m256i _b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + i * 8)));
+        __m256 _w0 = _mm256_cvtepi32_ps(_mm256_and_si256(_b, _mm256_set1_epi32(15)));
+        __m256 _w1 = _mm256_cvtepi32_ps(_mm256_srli_epi32(_b, 4));
+#else
+        __m128i _q = _mm_loadl_epi64((const __m128i*)(p + i * 8));
+        __m128i _b0 = _mm_cvtepu8_epi32(_q);
+        __m128i _b1 = _mm_cvtepu8_epi32(_mm_srli_si128(_q, 4));
+        __m128i _mask = _mm_set1_epi32(15);
+        __m256 _w0 = _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(_mm_and_si128(_b0, _mask)), _mm_and_si128(_b1, _mask), 1));
+        __m256 _w1 = _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(_mm_srli_epi32(_b0, 4)), _mm_srli_epi32(_b1, 4), 1));
+#endif
+        _acc0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + i * 8), _w0, _acc0);
+        _acc1 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sptr + 16 + i * 8), _w1, _acc1);
+    }
+}
+#else
+static NCNN_FORCEINLINE __m128 weight_quant_dot16_int8(const float* sptr, const unsigned char* p, __m128 _acc)
+{
+    __m128i _w = _mm_loadu_si128((const __m128i*)p);
+    __m128i _w_lo16 = _mm_unpacklo_epi8(_w, _mm_cmpgt_epi8(_mm_setzero_si128(), _w));
+    __m128i _w_hi16 = _mm_unpackhi_epi8(_w, _mm_cmpgt_epi8(_mm_setzero_si128(), _w));
+    __m128 _w0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_w_lo16, _mm_cmpgt_epi16(_mm_setzero_si128(), _w_lo16)));
+    __m128 _w1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(_w_lo16, _mm_cmpgt_epi16(_mm_setzero_si128(), _w_lo16)));
+    __m128 _w2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_w_hi16, _mm_cmpgt_epi16(_mm_setzero_si128(), _w_hi16)));
+    __m128 _w3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(_w_hi16, _mm_cmpgt_epi16(_mm_setzero_si128(), _w_hi16)));
+    _acc = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr), _w0, _acc);
+    _acc = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + 4), _w1, _acc);
+    _acc = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + 8), _w2, _acc);
+    _acc = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + 12), _w3, _acc);
+    return _acc;
+}
+
+static NCNN_FORCEINLINE void weight_quant_dot32_uint4(const float* sptr, const unsigned char* p, __m128& _acc0, __m128& _acc1)
+{
+    __m128i _b = _mm_loadu_si128((const __m128i*)p);
+    __m128i _b_lo16 = _mm_unpacklo_epi8(_b, _mm_setzero_si128());
+    __m128i _b_hi16 = _mm_unpackhi_epi8(_b, _mm_setzero_si128());
+    __m128i _b32[4];
+    _b32[0] = _mm_unpacklo_epi16(_b_lo16, _mm_setzero_si128());
+    _b32[1] = _mm_unpackhi_epi16(_b_lo16, _mm_setzero_si128());
+    _b32[2] = _mm_unpacklo_epi16(_b_hi16, _mm_setzero_si128());
+    _b32[3] = _mm_unpackhi_epi16(_b_hi16, _mm_setzero_si128());
+    __m128i _mask = _mm_set1_epi32(15);
+    for (int i = 0; i < 4; i++)
+    {
+        _acc0 = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + i * 4), _mm_cvtepi32_ps(_mm_and_si128(_b32[i], _mask)), _acc0);
+        _acc1 = _mm_comp_fmadd_ps(_mm_loadu_ps(sptr + 16 + i * 4), _mm_cvtepi32_ps(_mm_srli_epi32(_b32[i], 4)), _acc1);
+    }
+}
+#endif
+#endif // __SSE2__
+
+// x * w is accumulated unscaled within a group and the group scale is applied once at its end
+// int4 nibbles are widened as unsigned, the offset of 8 is taken out with the group sums of x in xsums
+static float innerproduct_dot_weight_quant(const float* sptr, const float* xsums, const unsigned char* kptr, const float* scales, int bits, int group_size, int num_input)
+{
+    float sum = 0.f;
+
+    int k0 = 0;
+#if __SSE2__
+    // whole groups of int8 multiple of 16 or whole int4 blocks, the rest falls back to scalar
+    if (group_size % (bits == 4 ? 32 : 16) == 0)
+    {
+#if __AVX512F__
+        __m512 _sum = _mm512_setzero_ps();
+#elif __AVX__
+        __m256 _sum = _mm256_setzero_ps();
+#else
+        __m128 _sum = _mm_setzero_ps();
+#endif
+        float offset_sum = 0.f;
+
+        for (int g = 0; k0 + group_size <= num_input; k0 += group_size, g++)
+        {
+            const float* s = sptr + k0;
+#if __AVX512F__
+            __m512 _gsum0 = _mm512_setzero_ps();
+            __m512 _gsum1 = _mm512_setzero_ps();
+#elif __AVX__
+            __m256 _gsum0 = _mm256_setzero_ps();
+            __m256 _gsum1 = _mm256_setzero_ps();
+#else
+            __m128 _gsum0 = _mm_setzero_ps();
+            __m128 _gsum1 = _mm_setzero_ps();
+#endif
+
+            if (bits == 4)
+            {
+                const unsigned char* p = kptr + k0 / 2;
+                for (int kk = 0; kk < group_size; kk += 32)
+                {
+                    weight_quant_dot32_uint4(s + kk, p + kk / 2, _gsum0, _gsum1);
+                }
+
+                offset_sum += xsums[g] * scales[g];
+            }
+            else
+            {
+                const unsigned char* p = kptr + k0;
+                int kk = 0;
+                for (; kk + 31 < group_size; kk += 32)
+                {
+                    _gsum0 = weight_quant_dot16_int8(s + kk, p + kk, _gsum0);
+                    _gsum1 = weight_quant_dot16_int8(s + kk + 16, p + kk + 16, _gsum1);
+                }
+                for (; kk < group_size; kk += 16)
+                {
+                    _gsum0 = weight_quant_dot16_int8(s + kk, p + kk, _gsum0);
+                }
+            }
+
+#if __AVX512F__
+            _sum = _mm512_fmadd_ps(_mm512_add_ps(_gsum0, _gsum1), _mm512_set1_ps(scales[g]), _sum);
+#elif __AVX__
+            _sum = _mm256_comp_fmadd_ps(_mm256_add_ps(_gsum0, _gsum1), _mm256_set1_ps(scales[g]), _sum);
+#else
+            _sum = _mm_comp_fmadd_ps(_mm_add_ps(_gsum0, _gsum1), _mm_set1_ps(scales[g]), _sum);
+#endif
+        }
+
+#if __AVX512F__
+        sum += _mm512_comp_reduce_add_ps(_sum);
+#elif __AVX__
+        sum += _mm256_reduce_add_ps(_sum);
+#else
+        sum += _mm_reduce_add_ps(_sum);
+#endif
+        sum -= 8.f * offset_sum;
+    }
+#else
+    (void)(xsums);
+#endif // __SSE2__
+
+    for (; k0 < num_input; k0 += group_size)
+    {
+        const int max_kk = std::min(group_size, num_input - k0);
+
+        float gsum = 0.f;
+        for (int kk = 0; kk < max_kk; kk++)
+        {
+            gsum += sptr[k0 + kk] * weight_quant_value(kptr, bits, k0 + kk);
+        }
+        sum += gsum * scales[k0 / group_size];
+    }
+
+    return sum;
+}
+
+static int innerproduct_weight_quant_sse(const Mat& bottom_blob, Mat& top_blob, const Mat& weight_data, const Mat& weight_data_quant_scales, int bits, int group_size, const Mat& bias_data, int activation_type, const Mat& activation_params, const Option& opt)
+{
+    // bottom_blob and top_blob are fp32 elempack 1
+    // one row per sample, 1-D blobs have a single row
+    const int num_input = bottom_blob.w;
+    const int num_output = top_blob.w;
+    const int h = bottom_blob.dims == 1 ? 1 : bottom_blob.h;
+
+    const int row_bytes = weight_quant_row_bytes(num_input, bits);
+    const int groups = weight_quant_group_count(num_input, group_size);
+
+    // sum of x over every whole group, shared by all outputs of the int4 kernel
+    Mat xsums;
+#if __SSE2__
+    if (bits == 4 && group_size % 32 == 0)
+    {
+        xsums.create(groups, h, 4u, opt.workspace_allocator);
+        if (xsums.empty())
+            return -100;
+
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int j = 0; j < h; j++)
+        {
+            const float* sptr = (const float*)bottom_blob + j * num_input;
+            float* xsumptr = xsums.row(j);
+
+            for (int g = 0; (g + 1) * group_size <= num_input; g++)
+            {
+                float xsum = 0.f;
+                for (int kk = 0; kk < group_size; kk++)
+                {
+                    xsum += sptr[g * group_size + kk];
+                }
+                xsumptr[g] = xsum;
+            }
+        }
+    }
+#endif // __SSE2__
+
+    const float* bias_data_ptr = bias_data;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int p = 0; p < num_output; p++)
+    {
+        const unsigned char* kptr = (const unsigned char*)weight_data + row_bytes * p;
+        const float* scales = (const float*)weight_data_quant_scales + groups * p;
+
+        const float bias = bias_data_ptr ? bias_data_ptr[p] : 0.f;
+
+        for (int j = 0; j < h; j++)
+        {
+            const float* sptr = (const float*)bottom_blob + j * num_input;
+            const float* xsumptr = xsums.empty() ? 0 : xsums.row(j);
+            float* outptr = (float*)top_blob + j * num_output;
+
+            float sum = bias + innerproduct_dot_weight_quant(sptr, xsumptr, kptr, scales, bits, group_size, num_input);
+
+            outptr[p] = activation_ss(sum, activation_type, activation_params);
+        }
+    }
+
+    return 0;
+}
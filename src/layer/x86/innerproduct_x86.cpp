@@ -25,6 +25,7 @@
 #include "x86_usability.h"
 
 #include "layer_type.h"
+#include "weight_quant.h"
 
 #include "cpu.h"
 
@@ -40,11 +41,20 @@ namespace ncnn {
 #undef NCNN_IMPL_FP16S
 #endif
 
+#if NCNN_BF16
+#include "innerproduct_bf16s.h"
+#endif
+
+#include "innerproduct_weight_quant.h"
+
 InnerProduct_x86::InnerProduct_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 
     flatten = 0;
 }
@@ -62,6 +72,13 @@ int InnerProduct_x86::create_pipeline(const Option& opt)
         flatten->create_pipeline(opt);
     }
 
+    if (weight_quant_bits)
+    {
+        // weight-only quantized rows stay compressed, the kernel dequantizes them
+        weight_data_tm = weight_data;
+        return 0;
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -69,6 +86,13 @@ int InnerProduct_x86::create_pipeline(const Option& opt)
     }
 #endif
 
+#if NCNN_BF16
+    if (opt.use_bf16_storage)
+    {
+        return create_pipeline_bf16s(opt);
+    }
+#endif
+
 #if NCNN_F16C && __AVX__
     if (cpu_support_x86_f16c() && opt.use_fp16_storage)
     {
@@ -100,15 +124,80 @@ int InnerProduct_x86::destroy_pipeline(const Option& opt)
     return 0;
 }
 
+int InnerProduct_x86::save_pipeline(std::vector<Mat>& pipeline_data) const
+{
+    pipeline_data.push_back(weight_data_tm);
+#if NCNN_INT8
+    pipeline_data.push_back(scale_in_data);
+#else
+    pipeline_data.push_back(Mat());
+#endif
+
+    return 0;
+}
+
+int InnerProduct_x86::load_pipeline(const std::vector<Mat>& pipeline_data, const Option& opt)
+{
+    if (pipeline_data.size() != 2)
+        return -1;
+
+    {
+        flatten = ncnn::create_layer(ncnn::LayerType::Flatten);
+
+        ncnn::ParamDict pd;
+
+        flatten->load_param(pd);
+
+        flatten->create_pipeline(opt);
+    }
+
+    weight_data_tm = pipeline_data[0];
+#if NCNN_INT8
+    scale_in_data = pipeline_data[1];
+#endif
+
+    if (opt.lightmode)
+    {
+        weight_data.release();
+    }
+
+    return 0;
+}
+
 int InnerProduct_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return forward_weight_quant_x86(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
+#if NCNN_BF16
+        if (bottom_blob.elembits() == 16)
+        {
+            // bf16 storage hands us bf16 blobs, quantize from fp32
+            Mat bottom_blob_fp32;
+            cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            if (bottom_blob_fp32.empty())
+                return -100;
+
+            return forward_int8_x86(bottom_blob_fp32, top_blob, opt);
+        }
+#endif
+
         return forward_int8_x86(bottom_blob, top_blob, opt);
     }
 #endif
 
+#if NCNN_BF16
+    if (opt.use_bf16_storage)
+    {
+        return forward_bf16s(bottom_blob, top_blob, opt);
+    }
+#endif
+
 #if NCNN_F16C && __AVX__
     if (cpu_support_x86_f16c() && opt.use_fp16_storage)
     {
@@ -171,6 +260,128 @@ int InnerProduct_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Optio
     return 0;
 }
 
+int InnerProduct_x86::forward_weight_quant_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    const int num_input = weight_data_size / num_output;
+
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    Mat bottom_blob_fp32 = bottom_blob;
+#if NCNN_BF16
+    if (bottom_blob.elembits() == 16)
+    {
+        cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt_ws);
+        if (bottom_blob_fp32.empty())
+            return -100;
+    }
+#endif
+
+    // the weight-only kernel works on unpacked rows
+    Mat bottom_blob_unpacked = bottom_blob_fp32;
+    if (bottom_blob_fp32.elempack != 1)
+    {
+        convert_packing(bottom_blob_fp32, bottom_blob_unpacked, 1, opt_ws);
+        if (bottom_blob_unpacked.empty())
+            return -100;
+    }
+
+    if (bottom_blob_unpacked.dims == 2 && bottom_blob_unpacked.w == num_input && bottom_blob_unpacked.h > 1)
+    {
+        // gemm
+        top_blob.create(num_output, bottom_blob_unpacked.h, (size_t)4u, opt.blob_allocator);
+        if (top_blob.empty())
+            return -100;
+
+        return innerproduct_weight_quant_sse(bottom_blob_unpacked, top_blob, weight_data_tm, weight_data_quant_scales, weight_quant_bits, weight_quant_group_size, bias_data, activation_type, activation_params, opt);
+    }
+
+    // flatten
+    Mat bottom_blob_flattened = bottom_blob_unpacked;
+    if (bottom_blob_unpacked.dims != 1)
+    {
+        bottom_blob_flattened = bottom_blob_unpacked.reshape(num_input, opt.workspace_allocator);
+        if (bottom_blob_flattened.empty())
+            return -100;
+    }
+
+    top_blob.create(num_output, (size_t)4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    return innerproduct_weight_quant_sse(bottom_blob_flattened, top_blob, weight_data_tm, weight_data_quant_scales, weight_quant_bits, weight_quant_group_size, bias_data, activation_type, activation_params, opt);
+}
+
+#if NCNN_BF16
+int InnerProduct_x86::create_pipeline_bf16s(const Option& opt)
+{
+    const int num_input = weight_data_size / num_output;
+
+    innerproduct_transform_kernel_bf16s_sse(weight_data, weight_data_tm, num_input, num_output, opt);
+
+    if (opt.lightmode)
+    {
+        weight_data.release();
+    }
+
+    return 0;
+}
+
+int InnerProduct_x86::forward_bf16s(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    const int num_input = weight_data_size / num_output;
+
+    Option opt_ws = opt;
+    opt_ws.blob_allocator = opt.workspace_allocator;
+
+    Mat bottom_blob_bf16 = bottom_blob;
+    if (bottom_blob.elembits() == 32)
+    {
+        cast_float32_to_bfloat16(bottom_blob, bottom_blob_bf16, opt_ws);
+        if (bottom_blob_bf16.empty())
+            return -100;
+    }
+
+    // the bf16 kernel works on unpacked rows
+    Mat bottom_blob_unpacked = bottom_blob_bf16;
+    if (bottom_blob_bf16.elempack != 1)
+    {
+        convert_packing(bottom_blob_bf16, bottom_blob_unpacked, 1, opt_ws);
+        if (bottom_blob_unpacked.empty())
+            return -100;
+    }
+
+    if (bottom_blob_unpacked.dims == 2 && bottom_blob_unpacked.w == num_input && bottom_blob_unpacked.h > 1)
+    {
+        // gemm
+        top_blob.create(num_output, bottom_blob_unpacked.h, (size_t)2u, opt.blob_allocator);
+        if (top_blob.empty())
+            return -100;
+
+        innerproduct_bf16s_sse(bottom_blob_unpacked, top_blob, weight_data_tm, bias_data, activation_type, activation_params, opt);
+
+        return 0;
+    }
+
+    // flatten
+    Mat bottom_blob_flattened = bottom_blob_unpacked;
+    if (bottom_blob_unpacked.dims != 1)
+    {
+        bottom_blob_flattened = bottom_blob_unpacked.reshape(num_input, opt.workspace_allocator);
+        if (bottom_blob_flattened.empty())
+            return -100;
+    }
+
+    top_blob.create(num_output, (size_t)2u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    innerproduct_bf16s_sse(bottom_blob_flattened, top_blob, weight_data_tm, bias_data, activation_type, activation_params, opt);
+
+    return 0;
+}
+#endif // NCNN_BF16
+
 #if NCNN_F16C && __AVX__
 int InnerProduct_x86::create_pipeline_fp16s(const Option& opt)
 {
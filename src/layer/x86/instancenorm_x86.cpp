@@ -0,0 +1,84 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "instancenorm_x86.h"
+
+#include <math.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif // __AVX__
+#endif // __SSE2__
+
+#include "x86_usability.h"
+#include "x86_normalization.h"
+
+namespace ncnn {
+
+InstanceNorm_x86::InstanceNorm_x86()
+{
+#if __SSE2__
+    support_packing = true;
+#endif // __SSE2__
+}
+
+int InstanceNorm_x86::forward_inplace(Mat& bottom_top_blob, const Option& opt) const
+{
+    // x = (x - mean) / (sqrt(var + eps)) * gamma + beta
+
+    const int w = bottom_top_blob.w;
+    const int h = bottom_top_blob.h;
+    const int channels = bottom_top_blob.c;
+    const int elempack = bottom_top_blob.elempack;
+    const int size = w * h;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < channels; q++)
+    {
+        float* ptr = bottom_top_blob.channel(q);
+
+        // every lane is one channel
+        float mean[16] = {0.f};
+        float var[16] = {0.f};
+        fast_mean(ptr, mean, elempack, size, size * elempack);
+        fast_var(ptr, var, mean, elempack, size, size * elempack);
+
+        float a[16] = {0.f};
+        float b[16] = {0.f};
+        for (int k = 0; k < elempack; k++)
+        {
+            if (affine)
+            {
+                const float gamma = gamma_data[q * elempack + k];
+                const float beta = beta_data[q * elempack + k];
+
+                a[k] = (float)(gamma / sqrt(var[k] + eps));
+                b[k] = -mean[k] * a[k] + beta;
+            }
+            else
+            {
+                a[k] = (float)(1.f / sqrt(var[k] + eps));
+                b[k] = -mean[k] * a[k];
+            }
+        }
+
+        fast_fmadd(ptr, a, b, elempack, size * elempack);
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
@@ -14,6 +14,7 @@
 
 #include "layernorm_x86.h"
 #include "x86_usability.h"
+#include "x86_normalization.h"
 #include <math.h>
 #include <cpu.h>
 
@@ -26,266 +27,19 @@
 
 namespace ncnn {
 
+#if NCNN_BF16
+#include "cast_bf16.h"
+#include "bf16_chunk.h"
+#endif
+
 LayerNorm_x86::LayerNorm_x86()
 {
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
-}
-
-static NCNN_FORCEINLINE void fast_mean(float* ptr, float* mean, int elempack, int elemcount, int size)
-{
-    int i = 0;
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-    __m512 _sum_512 = _mm512_setzero_ps();
-    for (; i + 16 <= size; i += 16, ptr += 16)
-    {
-        __m512 _cur = _mm512_loadu_ps(ptr);
-        _sum_512 = _mm512_add_ps(_sum_512, _cur);
-    }
-#endif // __AVX512F__
-    __m256 _sum_256 = _mm256_setzero_ps();
-    for (; i + 8 <= size; i += 8, ptr += 8)
-    {
-        __m256 _cur = _mm256_loadu_ps(ptr);
-        _sum_256 = _mm256_add_ps(_sum_256, _cur);
-    }
-#endif // __AVX__
-    __m128 _sum_128 = _mm_setzero_ps();
-    for (; i + 4 <= size; i += 4, ptr += 4)
-    {
-        __m128 _cur = _mm_loadu_ps(ptr);
-        _sum_128 = _mm_add_ps(_sum_128, _cur);
-    }
-#endif // __SSE2__
-    float sum = 0.0f;
-    for (; i < size; ++i, ++ptr)
-    {
-        sum += *ptr;
-    }
-
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-    if (elempack == 16)
-    {
-        __m512 _mean = _mm512_div_ps(_sum_512, _mm512_set1_ps((float)elemcount));
-        _mm512_storeu_ps(mean, _mean);
-    }
-#endif // __AVX512F__
-
-    if (elempack == 8)
-    {
-#if __AVX512F__
-        {
-            __m256 _low = _mm512_castps512_ps256(_sum_512);
-            __m256 _high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sum_512), 1));
-            _sum_256 = _mm256_add_ps(_sum_256, _high);
-            _sum_256 = _mm256_add_ps(_sum_256, _low);
-        }
-#endif // __AVX512F__
-        __m256 _mean = _mm256_div_ps(_sum_256, _mm256_set1_ps((float)elemcount));
-        _mm256_storeu_ps(mean, _mean);
-    }
-#endif // __AVX__
-
-    if (elempack == 4)
-    {
-#if __AVX__
-#if __AVX512F__
-        {
-            __m256 _low = _mm512_castps512_ps256(_sum_512);
-            __m256 _high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sum_512), 1));
-            _sum_256 = _mm256_add_ps(_sum_256, _high);
-            _sum_256 = _mm256_add_ps(_sum_256, _low);
-        }
-#endif // __AVX512F__
-        {
-            __m128 _low = _mm256_castps256_ps128(_sum_256);
-            __m128 _high = _mm256_extractf128_ps(_sum_256, 1);
-            _sum_128 = _mm_add_ps(_sum_128, _low);
-            _sum_128 = _mm_add_ps(_sum_128, _high);
-        }
-#endif // __AVX__
-        __m128 _mean = _mm_div_ps(_sum_128, _mm_set1_ps((float)elemcount));
-        _mm_storeu_ps(mean, _mean);
-    }
-#endif // __SSE2__
-
-    if (elempack == 1)
-    {
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-        sum += _mm512_comp_reduce_add_ps(_sum_512);
-#endif // __AVX512F__
-        sum += _mm256_reduce_add_ps(_sum_256);
-#endif // __AVX__
-        sum += _mm_reduce_add_ps(_sum_128);
-#endif // __SSE2__
-        mean[0] = sum / elemcount;
-    }
-}
-
-static NCNN_FORCEINLINE void fast_var(float* ptr, float* var, const float* mean, int elempack, int elemcount, int size)
-{
-    const float _mean = mean[0];
-#if __SSE2__
-    __m128 _mean_128 = (elempack == 4) ? _mm_loadu_ps(mean) : _mm_set1_ps(_mean);
-#if __AVX__
-    __m256 _mean_256 = (elempack == 8) ? _mm256_loadu_ps(mean) : _mm256_insertf128_ps(_mm256_castps128_ps256(_mean_128), _mean_128, 1);
-#if __AVX512F__
-    __m512 _mean_512 = (elempack == 16) ? _mm512_loadu_ps(mean) : _mm512_insertf32x8(_mm512_castps256_ps512(_mean_256), _mean_256, 1);
-#endif // __AVX512F__
-#endif // __AVX__
-#endif // __SSE2__
-
-    int i = 0;
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-    __m512 _sq_sum_512 = _mm512_setzero_ps();
-    for (; i + 16 <= size; i += 16, ptr += 16)
-    {
-        __m512 _cur = _mm512_loadu_ps(ptr);
-        _cur = _mm512_sub_ps(_cur, _mean_512);
-        _sq_sum_512 = _mm512_fmadd_ps(_cur, _cur, _sq_sum_512);
-    }
-#endif // __AVX512F__
-    __m256 _sq_sum_256 = _mm256_setzero_ps();
-    for (; i + 8 <= size; i += 8, ptr += 8)
-    {
-        __m256 _cur = _mm256_loadu_ps(ptr);
-        _cur = _mm256_sub_ps(_cur, _mean_256);
-        _sq_sum_256 = _mm256_comp_fmadd_ps(_cur, _cur, _sq_sum_256);
-    }
-#endif // __AVX__
-    __m128 _sq_sum_128 = _mm_setzero_ps();
-    for (; i + 4 <= size; i += 4, ptr += 4)
-    {
-        __m128 _cur = _mm_loadu_ps(ptr);
-        _cur = _mm_sub_ps(_cur, _mean_128);
-        _sq_sum_128 = _mm_comp_fmadd_ps(_cur, _cur, _sq_sum_128);
-    }
-#endif // __SSE2__
-    float sq_sum = 0.0f;
-    for (; i < size; ++i, ++ptr)
-    {
-        float tmp = *ptr - _mean;
-        sq_sum += tmp * tmp;
-    }
-
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-    if (elempack == 16)
-    {
-        __m512 _var = _mm512_div_ps(_sq_sum_512, _mm512_set1_ps((float)elemcount));
-        _mm512_storeu_ps(var, _var);
-    }
-#endif // __AVX512F__
-
-    if (elempack == 8)
-    {
-#if __AVX512F__
-        {
-            __m256 _low = _mm512_castps512_ps256(_sq_sum_512);
-            __m256 _high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sq_sum_512), 1));
-            _sq_sum_256 = _mm256_add_ps(_sq_sum_256, _low);
-            _sq_sum_256 = _mm256_add_ps(_sq_sum_256, _high);
-        }
-#endif // __AVX512F__
-        __m256 _var = _mm256_div_ps(_sq_sum_256, _mm256_set1_ps((float)elemcount));
-        _mm256_storeu_ps(var, _var);
-    }
-#endif // __AVX__
-
-    if (elempack == 4)
-    {
-#if __AVX__
-#if __AVX512F__
-        {
-            __m256 _low = _mm512_castps512_ps256(_sq_sum_512);
-            __m256 _high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sq_sum_512), 1));
-            _sq_sum_256 = _mm256_add_ps(_sq_sum_256, _high);
-            _sq_sum_256 = _mm256_add_ps(_sq_sum_256, _low);
-        }
-#endif // __AVX512F__
-        {
-            __m128 _low = _mm256_castps256_ps128(_sq_sum_256);
-            __m128 _high = _mm256_extractf128_ps(_sq_sum_256, 1);
-            _sq_sum_128 = _mm_add_ps(_sq_sum_128, _low);
-            _sq_sum_128 = _mm_add_ps(_sq_sum_128, _high);
-        }
-#endif // __AVX__
-        __m128 _var = _mm_div_ps(_sq_sum_128, _mm_set1_ps((float)elemcount));
-        _mm_storeu_ps(var, _var);
-    }
-#endif // __SSE2__
-
-    if (elempack == 1)
-    {
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-        sq_sum += _mm512_comp_reduce_add_ps(_sq_sum_512);
-#endif // __AVX512F__
-        sq_sum += _mm256_reduce_add_ps(_sq_sum_256);
-#endif // __AVX__
-        sq_sum += _mm_reduce_add_ps(_sq_sum_128);
-#endif // __SSE2__
-        var[0] = sq_sum / elemcount;
-    }
-}
-
-static NCNN_FORCEINLINE void fast_fmadd(float* ptr, const float* a, const float* b, int elempack, int size)
-{
-    const float _a = a[0];
-    const float _b = b[0];
-#if __SSE2__
-    __m128 _a_128 = (elempack == 4) ? _mm_loadu_ps(a) : _mm_set1_ps(_a);
-    __m128 _b_128 = (elempack == 4) ? _mm_loadu_ps(b) : _mm_set1_ps(_b);
-#if __AVX__
-    __m256 _a_256 = (elempack == 8) ? _mm256_loadu_ps(a) : _mm256_insertf128_ps(_mm256_castps128_ps256(_a_128), _a_128, 1);
-    __m256 _b_256 = (elempack == 8) ? _mm256_loadu_ps(b) : _mm256_insertf128_ps(_mm256_castps128_ps256(_b_128), _b_128, 1);
-#if __AVX512F__
-    __m512 _a_512 = (elempack == 16) ? _mm512_loadu_ps(a) : _mm512_insertf32x8(_mm512_castps256_ps512(_a_256), _a_256, 1);
-    __m512 _b_512 = (elempack == 16) ? _mm512_loadu_ps(b) : _mm512_insertf32x8(_mm512_castps256_ps512(_b_256), _b_256, 1);
-#endif // __AVX512F__
-#endif // __AVX__
-#endif // __SSE2__
-
-    int i = 0;
-#if __SSE2__
-#if __AVX__
-#if __AVX512F__
-    for (; i + 16 <= size; i += 16, ptr += 16)
-    {
-        __m512 _cur = _mm512_loadu_ps(ptr);
-        _cur = _mm512_fmadd_ps(_cur, _a_512, _b_512);
-        _mm512_storeu_ps(ptr, _cur);
-    }
-#endif // __AVX512F__
-    for (; i + 8 <= size; i += 8, ptr += 8)
-    {
-        __m256 _cur = _mm256_loadu_ps(ptr);
-        _cur = _mm256_comp_fmadd_ps(_cur, _a_256, _b_256);
-        _mm256_storeu_ps(ptr, _cur);
-    }
-#endif // __AVX__
-    for (; i + 4 <= size; i += 4, ptr += 4)
-    {
-        __m128 _cur = _mm_loadu_ps(ptr);
-        _cur = _mm_comp_fmadd_ps(_cur, _a_128, _b_128);
-        _mm_storeu_ps(ptr, _cur);
-    }
-#endif // __SSE2__
-    for (; i < size; ++i, ++ptr)
-    {
-        *ptr = (*ptr) * _a + _b;
-    }
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 }
 
 static NCNN_FORCEINLINE void fast_fmadd_fmadd(float* ptr, const float* a, const float* b, const float* gamma, const float* beta, int elempack, int size)
@@ -536,6 +290,11 @@ static NCNN_FORCEINLINE void fast_1d_layer_norm(float* ptr, int elempack, int el
 
 int LayerNorm_x86::forward_inplace(Mat& bottom_top_blob, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_top_blob.elembits() == 16)
+        return forward_inplace_bf16s(bottom_top_blob, opt);
+#endif
+
     int dims = bottom_top_blob.dims;
     int elempack = bottom_top_blob.elempack;
     int w = bottom_top_blob.w;
@@ -591,4 +350,12 @@ int LayerNorm_x86::forward_inplace(Mat& bottom_top_blob, const Option& opt) cons
     return 0;
 }
 
+#if NCNN_BF16
+int LayerNorm_x86::forward_inplace_bf16s(Mat& bottom_top_blob, const Option& opt) const
+{
+    // rows and channels are normalized independently
+    return bf16_chunk_forward_inplace(this, bottom_top_blob, opt);
+}
+#endif // NCNN_BF16
+
 } // namespace ncnn
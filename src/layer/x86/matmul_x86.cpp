@@ -20,6 +20,10 @@ namespace ncnn {
 
 MatMul_x86::MatMul_x86()
 {
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
+
     gemm = 0;
 }
 
@@ -63,6 +67,29 @@ int MatMul_x86::destroy_pipeline(const Option& opt)
 
 int MatMul_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_blobs[0].elembits() != bottom_blobs[1].elembits())
+    {
+        // gemm writes bf16 into the batch views when either operand is bf16, so narrow the other one too
+        Option opt_ws = opt;
+        opt_ws.blob_allocator = opt.workspace_allocator;
+
+        std::vector<Mat> bottom_blobs_bf16(2);
+        for (int i = 0; i < 2; i++)
+        {
+            bottom_blobs_bf16[i] = bottom_blobs[i];
+            if (bottom_blobs[i].elembits() == 32)
+            {
+                cast_float32_to_bfloat16(bottom_blobs[i], bottom_blobs_bf16[i], opt_ws);
+                if (bottom_blobs_bf16[i].empty())
+                    return -100;
+            }
+        }
+
+        return forward(bottom_blobs_bf16, top_blobs, opt);
+    }
+#endif
+
     const Mat& A = bottom_blobs[0];
     const Mat& B = bottom_blobs[1];
     Mat& top_blob = top_blobs[0];
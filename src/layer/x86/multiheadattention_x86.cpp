@@ -14,6 +14,25 @@
 
 #include "multiheadattention_x86.h"
 
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "sse_mathfun.h"
+#if __AVX__
+#include <immintrin.h>
+#include "avx_mathfun.h"
+#if __AVX512F__
+#include "avx512_mathfun.h"
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+
+#include "x86_usability.h"
+
+#include "cpu.h"
 #include "layer_type.h"
 
 namespace ncnn {
@@ -28,11 +47,6 @@ MultiHeadAttention_x86::MultiHeadAttention_x86()
     k_gemm = 0;
     v_gemm = 0;
 
-    qk_gemm = 0;
-    qkv_gemm = 0;
-
-    qk_softmax = 0;
-
     o_gemm = 0;
 }
 
@@ -58,10 +72,14 @@ int MultiHeadAttention_x86::create_pipeline(const Option& opt)
         pd.set(11, 0);        // output_N1M
         pd.set(12, 1);        // output_elempack
         pd.set(14, 0);        // output_transpose
+        pd.set(18, int8_scale_term);
         q_gemm->load_param(pd);
-        Mat weights[2];
+        Mat weights[3];
         weights[0] = q_weight_data;
         weights[1] = q_bias_data;
+#if NCNN_INT8
+        weights[2] = q_weight_data_int8_scales;
+#endif
         q_gemm->load_model(ModelBinFromMatArray(weights));
         q_gemm->create_pipeline(opt);
 
@@ -87,10 +105,14 @@ int MultiHeadAttention_x86::create_pipeline(const Option& opt)
         pd.set(11, 0);        // output_N1M
         pd.set(12, 1);        // output_elempack
         pd.set(14, 0);        // output_transpose
+        pd.set(18, int8_scale_term);
         k_gemm->load_param(pd);
-        Mat weights[2];
+        Mat weights[3];
         weights[0] = k_weight_data;
         weights[1] = k_bias_data;
+#if NCNN_INT8
+        weights[2] = k_weight_data_int8_scales;
+#endif
         k_gemm->load_model(ModelBinFromMatArray(weights));
         k_gemm->create_pipeline(opt);
 
@@ -116,10 +138,14 @@ int MultiHeadAttention_x86::create_pipeline(const Option& opt)
         pd.set(11, 0);        // output_N1M
         pd.set(12, 1);        // output_elempack
         pd.set(14, 0);        // output_transpose
+        pd.set(18, int8_scale_term);
         v_gemm->load_param(pd);
-        Mat weights[2];
+        Mat weights[3];
         weights[0] = v_weight_data;
         weights[1] = v_bias_data;
+#if NCNN_INT8
+        weights[2] = v_weight_data_int8_scales;
+#endif
         v_gemm->load_model(ModelBinFromMatArray(weights));
         v_gemm->create_pipeline(opt);
 
@@ -130,58 +156,6 @@ int MultiHeadAttention_x86::create_pipeline(const Option& opt)
         }
     }
 
-    {
-        qk_gemm = ncnn::create_layer(ncnn::LayerType::Gemm);
-        ncnn::ParamDict pd;
-        pd.set(2, 1);   // transA
-        pd.set(3, 0);   // transB
-        pd.set(4, 0);   // constantA
-        pd.set(5, 0);   // constantB
-        pd.set(6, 1);   // constantC
-        pd.set(7, 0);   // M
-        pd.set(8, 0);   // N
-        pd.set(9, 0);   // K
-        pd.set(10, -1); // constant_broadcast_type_C
-        pd.set(11, 0);  // output_N1M
-        pd.set(12, 1);  // output_elempack
-        qk_gemm->load_param(pd);
-        qk_gemm->load_model(ModelBinFromMatArray(0));
-        Option opt1 = opt;
-        opt1.num_threads = 1;
-        qk_gemm->create_pipeline(opt1);
-    }
-    {
-        qkv_gemm = ncnn::create_layer(ncnn::LayerType::Gemm);
-        ncnn::ParamDict pd;
-        pd.set(2, 0);   // transA
-        pd.set(3, 1);   // transB
-        pd.set(4, 0);   // constantA
-        pd.set(5, 0);   // constantB
-        pd.set(6, 1);   // constantC
-        pd.set(7, 0);   // M
-        pd.set(8, 0);   // N
-        pd.set(9, 0);   // K
-        pd.set(10, -1); // constant_broadcast_type_C
-        pd.set(11, 0);  // output_N1M
-        pd.set(12, 1);  // output_elempack
-        pd.set(14, 1);  // output_transpose
-        qkv_gemm->load_param(pd);
-        qkv_gemm->load_model(ModelBinFromMatArray(0));
-        Option opt1 = opt;
-        opt1.num_threads = 1;
-        qkv_gemm->create_pipeline(opt1);
-    }
-
-    {
-        qk_softmax = ncnn::create_layer(ncnn::LayerType::Softmax);
-        ncnn::ParamDict pd;
-        pd.set(0, -1);
-        pd.set(1, 1);
-        qk_softmax->load_param(pd);
-        qk_softmax->load_model(ModelBinFromMatArray(0));
-        qk_softmax->create_pipeline(opt);
-    }
-
     {
         o_gemm = ncnn::create_layer(ncnn::LayerType::Gemm);
         ncnn::ParamDict pd;
@@ -195,10 +169,14 @@ int MultiHeadAttention_x86::create_pipeline(const Option& opt)
         pd.set(9, embed_dim); // K = maxk*inch
         pd.set(10, 4);        // constant_broadcast_type_C
         pd.set(11, 0);        // output_N1M
+        pd.set(18, int8_scale_term);
         o_gemm->load_param(pd);
-        Mat weights[2];
+        Mat weights[3];
         weights[0] = out_weight_data;
         weights[1] = out_bias_data;
+#if NCNN_INT8
+        weights[2] = out_weight_data_int8_scales;
+#endif
         o_gemm->load_model(ModelBinFromMatArray(weights));
         o_gemm->create_pipeline(opt);
 
@@ -235,45 +213,812 @@ int MultiHeadAttention_x86::destroy_pipeline(const Option& opt)
         v_gemm = 0;
     }
 
-    if (qk_gemm)
+    if (o_gemm)
+    {
+        o_gemm->destroy_pipeline(opt);
+        delete o_gemm;
+        o_gemm = 0;
+    }
+
+    return 0;
+}
+
+// prepend the cached tokens to the freshly projected ones
+// affine is (seqlen, embed_dim) with one feature per row, cache is (embed_dim, seqlen) with one token per row
+static int concat_kv_cache(const Mat& cache, Mat& affine, Mat& cache_out, const Option& opt)
+{
+    const int embed_dim = affine.h;
+    const int past_seqlen = cache.dims == 2 ? cache.h : 0;
+    const int cur_seqlen = affine.w;
+    const int dst_seqlen = past_seqlen + cur_seqlen;
+
+    cache_out.create(embed_dim, dst_seqlen, 4u, opt.blob_allocator);
+    if (cache_out.empty())
+        return -100;
+
+    Mat affine_all;
+    if (past_seqlen == 0)
     {
-        qk_gemm->destroy_pipeline(opt);
-        delete qk_gemm;
-        qk_gemm = 0;
+        affine_all = affine;
     }
-    if (qkv_gemm)
+    else
     {
-        qkv_gemm->destroy_pipeline(opt);
-        delete qkv_gemm;
-        qkv_gemm = 0;
+        affine_all.create(dst_seqlen, embed_dim, 4u, opt.workspace_allocator);
+        if (affine_all.empty())
+            return -100;
     }
 
-    if (qk_softmax)
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < past_seqlen; i++)
     {
-        qk_softmax->destroy_pipeline(opt);
-        delete qk_softmax;
-        qk_softmax = 0;
+        memcpy(cache_out.row(i), cache.row(i), embed_dim * sizeof(float));
     }
 
-    if (o_gemm)
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < embed_dim; i++)
     {
-        o_gemm->destroy_pipeline(opt);
-        delete o_gemm;
-        o_gemm = 0;
+        const float* ptr = affine.row(i);
+
+        if (past_seqlen > 0)
+        {
+            float* outptr = affine_all.row(i);
+            for (int j = 0; j < past_seqlen; j++)
+            {
+                outptr[j] = cache.row(j)[i];
+            }
+            memcpy(outptr + past_seqlen, ptr, cur_seqlen * sizeof(float));
+        }
+
+        for (int j = 0; j < cur_seqlen; j++)
+        {
+            cache_out.row(past_seqlen + j)[i] = ptr[j];
+        }
     }
 
+    affine = affine_all;
+
     return 0;
 }
 
+// keys per tile of the fused attention, the scores of a tile stay in l1
+#define FLASH_ATTENTION_TILE_K 64
+
+#if __AVX512F__
+// one head, queries i0 .. i0 + 16 in the lanes against every key
+// keys are visited in tiles of FLASH_ATTENTION_TILE_K with online softmax
+// so only 16 x FLASH_ATTENTION_TILE_K scores live at a time
+// q_head and v_head hold one feature per row, k_tokens one token per row starting at k_offset
+static void flash_attention_block_avx512(const Mat& q_head, const Mat& k_tokens, int k_offset, const Mat& v_head, const Mat& maskm, Mat& out_head, int i0, float* tmp)
+{
+    const int embed_dim_per_head = q_head.h;
+    const int src_seqlen = q_head.w;
+    const int dst_seqlen = v_head.w;
+    const int max_ii = std::min(16, src_seqlen - i0);
+
+    float* qb = tmp;
+    float* ob = qb + embed_dim_per_head * 16;
+    float* sb = ob + embed_dim_per_head * 16;
+
+    // queries interleaved into lanes, zero padded
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        const float* ptr = q_head.row(d) + i0;
+        for (int ii = 0; ii < 16; ii++)
+        {
+            qb[d * 16 + ii] = ii < max_ii ? ptr[ii] : 0.f;
+        }
+    }
+    memset(ob, 0, embed_dim_per_head * 16 * sizeof(float));
+
+    __m512 _max = _mm512_set1_ps(-FLT_MAX);
+    __m512 _sum = _mm512_setzero_ps();
+
+    for (int j0 = 0; j0 < dst_seqlen; j0 += FLASH_ATTENTION_TILE_K)
+    {
+        const int max_jj = std::min(FLASH_ATTENTION_TILE_K, dst_seqlen - j0);
+
+        // s = q k
+        int jj = 0;
+        for (; jj + 7 < max_jj; jj += 8)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+            const float* k1 = (const float*)k_tokens.row(j0 + jj + 1) + k_offset;
+            const float* k2 = (const float*)k_tokens.row(j0 + jj + 2) + k_offset;
+            const float* k3 = (const float*)k_tokens.row(j0 + jj + 3) + k_offset;
+            const float* k4 = (const float*)k_tokens.row(j0 + jj + 4) + k_offset;
+            const float* k5 = (const float*)k_tokens.row(j0 + jj + 5) + k_offset;
+            const float* k6 = (const float*)k_tokens.row(j0 + jj + 6) + k_offset;
+            const float* k7 = (const float*)k_tokens.row(j0 + jj + 7) + k_offset;
+
+            __m512 _s0 = _mm512_setzero_ps();
+            __m512 _s1 = _mm512_setzero_ps();
+            __m512 _s2 = _mm512_setzero_ps();
+            __m512 _s3 = _mm512_setzero_ps();
+            __m512 _s4 = _mm512_setzero_ps();
+            __m512 _s5 = _mm512_setzero_ps();
+            __m512 _s6 = _mm512_setzero_ps();
+            __m512 _s7 = _mm512_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                __m512 _q = _mm512_loadu_ps(qb + d * 16);
+                _s0 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k0[d]), _s0);
+                _s1 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k1[d]), _s1);
+                _s2 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k2[d]), _s2);
+                _s3 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k3[d]), _s3);
+                _s4 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k4[d]), _s4);
+                _s5 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k5[d]), _s5);
+                _s6 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k6[d]), _s6);
+                _s7 = _mm512_fmadd_ps(_q, _mm512_set1_ps(k7[d]), _s7);
+            }
+            _mm512_storeu_ps(sb + jj * 16, _s0);
+            _mm512_storeu_ps(sb + (jj + 1) * 16, _s1);
+            _mm512_storeu_ps(sb + (jj + 2) * 16, _s2);
+            _mm512_storeu_ps(sb + (jj + 3) * 16, _s3);
+            _mm512_storeu_ps(sb + (jj + 4) * 16, _s4);
+            _mm512_storeu_ps(sb + (jj + 5) * 16, _s5);
+            _mm512_storeu_ps(sb + (jj + 6) * 16, _s6);
+            _mm512_storeu_ps(sb + (jj + 7) * 16, _s7);
+        }
+        for (; jj < max_jj; jj++)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+
+            __m512 _s0 = _mm512_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                _s0 = _mm512_fmadd_ps(_mm512_loadu_ps(qb + d * 16), _mm512_set1_ps(k0[d]), _s0);
+            }
+            _mm512_storeu_ps(sb + jj * 16, _s0);
+        }
+
+        if (!maskm.empty())
+        {
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                const float* mptr = maskm.row(i0 + ii) + j0;
+                for (jj = 0; jj < max_jj; jj++)
+                {
+                    sb[jj * 16 + ii] += mptr[jj];
+                }
+            }
+        }
+
+        __m512 _tile_max = _max;
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            _tile_max = _mm512_max_ps(_tile_max, _mm512_loadu_ps(sb + jj * 16));
+        }
+
+        // rescale what was accumulated against the previous max
+        __m512 _scale = exp512_ps(_mm512_sub_ps(_max, _tile_max));
+        _max = _tile_max;
+        _sum = _mm512_mul_ps(_sum, _scale);
+        for (int d = 0; d < embed_dim_per_head; d++)
+        {
+            _mm512_storeu_ps(ob + d * 16, _mm512_mul_ps(_mm512_loadu_ps(ob + d * 16), _scale));
+        }
+
+        // p = exp(s - max)
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            __m512 _p = exp512_ps(_mm512_sub_ps(_mm512_loadu_ps(sb + jj * 16), _max));
+            _mm512_storeu_ps(sb + jj * 16, _p);
+            _sum = _mm512_add_ps(_sum, _p);
+        }
+
+        // o += p v
+        int d = 0;
+        for (; d + 7 < embed_dim_per_head; d += 8)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+            const float* v1 = (const float*)v_head.row(d + 1) + j0;
+            const float* v2 = (const float*)v_head.row(d + 2) + j0;
+            const float* v3 = (const float*)v_head.row(d + 3) + j0;
+            const float* v4 = (const float*)v_head.row(d + 4) + j0;
+            const float* v5 = (const float*)v_head.row(d + 5) + j0;
+            const float* v6 = (const float*)v_head.row(d + 6) + j0;
+            const float* v7 = (const float*)v_head.row(d + 7) + j0;
+
+            __m512 _o0 = _mm512_loadu_ps(ob + d * 16);
+            __m512 _o1 = _mm512_loadu_ps(ob + (d + 1) * 16);
+            __m512 _o2 = _mm512_loadu_ps(ob + (d + 2) * 16);
+            __m512 _o3 = _mm512_loadu_ps(ob + (d + 3) * 16);
+            __m512 _o4 = _mm512_loadu_ps(ob + (d + 4) * 16);
+            __m512 _o5 = _mm512_loadu_ps(ob + (d + 5) * 16);
+            __m512 _o6 = _mm512_loadu_ps(ob + (d + 6) * 16);
+            __m512 _o7 = _mm512_loadu_ps(ob + (d + 7) * 16);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                __m512 _p = _mm512_loadu_ps(sb + jj * 16);
+                _o0 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v0[jj]), _o0);
+                _o1 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v1[jj]), _o1);
+                _o2 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v2[jj]), _o2);
+                _o3 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v3[jj]), _o3);
+                _o4 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v4[jj]), _o4);
+                _o5 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v5[jj]), _o5);
+                _o6 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v6[jj]), _o6);
+                _o7 = _mm512_fmadd_ps(_p, _mm512_set1_ps(v7[jj]), _o7);
+            }
+            _mm512_storeu_ps(ob + d * 16, _o0);
+            _mm512_storeu_ps(ob + (d + 1) * 16, _o1);
+            _mm512_storeu_ps(ob + (d + 2) * 16, _o2);
+            _mm512_storeu_ps(ob + (d + 3) * 16, _o3);
+            _mm512_storeu_ps(ob + (d + 4) * 16, _o4);
+            _mm512_storeu_ps(ob + (d + 5) * 16, _o5);
+            _mm512_storeu_ps(ob + (d + 6) * 16, _o6);
+            _mm512_storeu_ps(ob + (d + 7) * 16, _o7);
+        }
+        for (; d < embed_dim_per_head; d++)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+
+            __m512 _o0 = _mm512_loadu_ps(ob + d * 16);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                _o0 = _mm512_fmadd_ps(_mm512_loadu_ps(sb + jj * 16), _mm512_set1_ps(v0[jj]), _o0);
+            }
+            _mm512_storeu_ps(ob + d * 16, _o0);
+        }
+    }
+
+    __m512 _inv_sum = _mm512_div_ps(_mm512_set1_ps(1.f), _sum);
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        float* outptr = (float*)out_head.row(d) + i0;
+
+        __m512 _o = _mm512_mul_ps(_mm512_loadu_ps(ob + d * 16), _inv_sum);
+        if (max_ii == 16)
+        {
+            _mm512_storeu_ps(outptr, _o);
+        }
+        else
+        {
+            _mm512_storeu_ps(sb, _o);
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                outptr[ii] = sb[ii];
+            }
+        }
+    }
+}
+#endif // __AVX512F__
+
+#if __AVX__
+// queries i0 .. i0 + 8 in the lanes
+static void flash_attention_block_avx(const Mat& q_head, const Mat& k_tokens, int k_offset, const Mat& v_head, const Mat& maskm, Mat& out_head, int i0, float* tmp)
+{
+    const int embed_dim_per_head = q_head.h;
+    const int src_seqlen = q_head.w;
+    const int dst_seqlen = v_head.w;
+    const int max_ii = std::min(8, src_seqlen - i0);
+
+    float* qb = tmp;
+    float* ob = qb + embed_dim_per_head * 8;
+    float* sb = ob + embed_dim_per_head * 8;
+
+    // queries interleaved into lanes, zero padded
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        const float* ptr = q_head.row(d) + i0;
+        for (int ii = 0; ii < 8; ii++)
+        {
+            qb[d * 8 + ii] = ii < max_ii ? ptr[ii] : 0.f;
+        }
+    }
+    memset(ob, 0, embed_dim_per_head * 8 * sizeof(float));
+
+    __m256 _max = _mm256_set1_ps(-FLT_MAX);
+    __m256 _sum = _mm256_setzero_ps();
+
+    for (int j0 = 0; j0 < dst_seqlen; j0 += FLASH_ATTENTION_TILE_K)
+    {
+        const int max_jj = std::min(FLASH_ATTENTION_TILE_K, dst_seqlen - j0);
+
+        // s = q k
+        int jj = 0;
+        for (; jj + 7 < max_jj; jj += 8)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+            const float* k1 = (const float*)k_tokens.row(j0 + jj + 1) + k_offset;
+            const float* k2 = (const float*)k_tokens.row(j0 + jj + 2) + k_offset;
+            const float* k3 = (const float*)k_tokens.row(j0 + jj + 3) + k_offset;
+            const float* k4 = (const float*)k_tokens.row(j0 + jj + 4) + k_offset;
+            const float* k5 = (const float*)k_tokens.row(j0 + jj + 5) + k_offset;
+            const float* k6 = (const float*)k_tokens.row(j0 + jj + 6) + k_offset;
+            const float* k7 = (const float*)k_tokens.row(j0 + jj + 7) + k_offset;
+
+            __m256 _s0 = _mm256_setzero_ps();
+            __m256 _s1 = _mm256_setzero_ps();
+            __m256 _s2 = _mm256_setzero_ps();
+            __m256 _s3 = _mm256_setzero_ps();
+            __m256 _s4 = _mm256_setzero_ps();
+            __m256 _s5 = _mm256_setzero_ps();
+            __m256 _s6 = _mm256_setzero_ps();
+            __m256 _s7 = _mm256_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                __m256 _q = _mm256_loadu_ps(qb + d * 8);
+                _s0 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k0[d]), _s0);
+                _s1 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k1[d]), _s1);
+                _s2 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k2[d]), _s2);
+                _s3 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k3[d]), _s3);
+                _s4 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k4[d]), _s4);
+                _s5 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k5[d]), _s5);
+                _s6 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k6[d]), _s6);
+                _s7 = _mm256_comp_fmadd_ps(_q, _mm256_set1_ps(k7[d]), _s7);
+            }
+            _mm256_storeu_ps(sb + jj * 8, _s0);
+            _mm256_storeu_ps(sb + (jj + 1) * 8, _s1);
+            _mm256_storeu_ps(sb + (jj + 2) * 8, _s2);
+            _mm256_storeu_ps(sb + (jj + 3) * 8, _s3);
+            _mm256_storeu_ps(sb + (jj + 4) * 8, _s4);
+            _mm256_storeu_ps(sb + (jj + 5) * 8, _s5);
+            _mm256_storeu_ps(sb + (jj + 6) * 8, _s6);
+            _mm256_storeu_ps(sb + (jj + 7) * 8, _s7);
+        }
+        for (; jj < max_jj; jj++)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+
+            __m256 _s0 = _mm256_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                _s0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(qb + d * 8), _mm256_set1_ps(k0[d]), _s0);
+            }
+            _mm256_storeu_ps(sb + jj * 8, _s0);
+        }
+
+        if (!maskm.empty())
+        {
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                const float* mptr = maskm.row(i0 + ii) + j0;
+                for (jj = 0; jj < max_jj; jj++)
+                {
+                    sb[jj * 8 + ii] += mptr[jj];
+                }
+            }
+        }
+
+        __m256 _tile_max = _max;
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            _tile_max = _mm256_max_ps(_tile_max, _mm256_loadu_ps(sb + jj * 8));
+        }
+
+        // rescale what was accumulated against the previous max
+        __m256 _scale = exp256_ps(_mm256_sub_ps(_max, _tile_max));
+        _max = _tile_max;
+        _sum = _mm256_mul_ps(_sum, _scale);
+        for (int d = 0; d < embed_dim_per_head; d++)
+        {
+            _mm256_storeu_ps(ob + d * 8, _mm256_mul_ps(_mm256_loadu_ps(ob + d * 8), _scale));
+        }
+
+        // p = exp(s - max)
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            __m256 _p = exp256_ps(_mm256_sub_ps(_mm256_loadu_ps(sb + jj * 8), _max));
+            _mm256_storeu_ps(sb + jj * 8, _p);
+            _sum = _mm256_add_ps(_sum, _p);
+        }
+
+        // o += p v
+        int d = 0;
+        for (; d + 7 < embed_dim_per_head; d += 8)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+            const float* v1 = (const float*)v_head.row(d + 1) + j0;
+            const float* v2 = (const float*)v_head.row(d + 2) + j0;
+            const float* v3 = (const float*)v_head.row(d + 3) + j0;
+            const float* v4 = (const float*)v_head.row(d + 4) + j0;
+            const float* v5 = (const float*)v_head.row(d + 5) + j0;
+            const float* v6 = (const float*)v_head.row(d + 6) + j0;
+            const float* v7 = (const float*)v_head.row(d + 7) + j0;
+
+            __m256 _o0 = _mm256_loadu_ps(ob + d * 8);
+            __m256 _o1 = _mm256_loadu_ps(ob + (d + 1) * 8);
+            __m256 _o2 = _mm256_loadu_ps(ob + (d + 2) * 8);
+            __m256 _o3 = _mm256_loadu_ps(ob + (d + 3) * 8);
+            __m256 _o4 = _mm256_loadu_ps(ob + (d + 4) * 8);
+            __m256 _o5 = _mm256_loadu_ps(ob + (d + 5) * 8);
+            __m256 _o6 = _mm256_loadu_ps(ob + (d + 6) * 8);
+            __m256 _o7 = _mm256_loadu_ps(ob + (d + 7) * 8);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                __m256 _p = _mm256_loadu_ps(sb + jj * 8);
+                _o0 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v0[jj]), _o0);
+                _o1 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v1[jj]), _o1);
+                _o2 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v2[jj]), _o2);
+                _o3 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v3[jj]), _o3);
+                _o4 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v4[jj]), _o4);
+                _o5 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v5[jj]), _o5);
+                _o6 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v6[jj]), _o6);
+                _o7 = _mm256_comp_fmadd_ps(_p, _mm256_set1_ps(v7[jj]), _o7);
+            }
+            _mm256_storeu_ps(ob + d * 8, _o0);
+            _mm256_storeu_ps(ob + (d + 1) * 8, _o1);
+            _mm256_storeu_ps(ob + (d + 2) * 8, _o2);
+            _mm256_storeu_ps(ob + (d + 3) * 8, _o3);
+            _mm256_storeu_ps(ob + (d + 4) * 8, _o4);
+            _mm256_storeu_ps(ob + (d + 5) * 8, _o5);
+            _mm256_storeu_ps(ob + (d + 6) * 8, _o6);
+            _mm256_storeu_ps(ob + (d + 7) * 8, _o7);
+        }
+        for (; d < embed_dim_per_head; d++)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+
+            __m256 _o0 = _mm256_loadu_ps(ob + d * 8);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                _o0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(sb + jj * 8), _mm256_set1_ps(v0[jj]), _o0);
+            }
+            _mm256_storeu_ps(ob + d * 8, _o0);
+        }
+    }
+
+    __m256 _inv_sum = _mm256_div_ps(_mm256_set1_ps(1.f), _sum);
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        float* outptr = (float*)out_head.row(d) + i0;
+
+        __m256 _o = _mm256_mul_ps(_mm256_loadu_ps(ob + d * 8), _inv_sum);
+        if (max_ii == 8)
+        {
+            _mm256_storeu_ps(outptr, _o);
+        }
+        else
+        {
+            _mm256_storeu_ps(sb, _o);
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                outptr[ii] = sb[ii];
+            }
+        }
+    }
+}
+#endif // __AVX__
+
+#if __SSE2__
+// queries i0 .. i0 + 4 in the lanes
+static void flash_attention_block_sse(const Mat& q_head, const Mat& k_tokens, int k_offset, const Mat& v_head, const Mat& maskm, Mat& out_head, int i0, float* tmp)
+{
+    const int embed_dim_per_head = q_head.h;
+    const int src_seqlen = q_head.w;
+    const int dst_seqlen = v_head.w;
+    const int max_ii = std::min(4, src_seqlen - i0);
+
+    float* qb = tmp;
+    float* ob = qb + embed_dim_per_head * 4;
+    float* sb = ob + embed_dim_per_head * 4;
+
+    // queries interleaved into lanes, zero padded
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        const float* ptr = q_head.row(d) + i0;
+        for (int ii = 0; ii < 4; ii++)
+        {
+            qb[d * 4 + ii] = ii < max_ii ? ptr[ii] : 0.f;
+        }
+    }
+    memset(ob, 0, embed_dim_per_head * 4 * sizeof(float));
+
+    __m128 _max = _mm_set1_ps(-FLT_MAX);
+    __m128 _sum = _mm_setzero_ps();
+
+    for (int j0 = 0; j0 < dst_seqlen; j0 += FLASH_ATTENTION_TILE_K)
+    {
+        const int max_jj = std::min(FLASH_ATTENTION_TILE_K, dst_seqlen - j0);
+
+        // s = q k
+        int jj = 0;
+        for (; jj + 7 < max_jj; jj += 8)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+            const float* k1 = (const float*)k_tokens.row(j0 + jj + 1) + k_offset;
+            const float* k2 = (const float*)k_tokens.row(j0 + jj + 2) + k_offset;
+            const float* k3 = (const float*)k_tokens.row(j0 + jj + 3) + k_offset;
+            const float* k4 = (const float*)k_tokens.row(j0 + jj + 4) + k_offset;
+            const float* k5 = (const float*)k_tokens.row(j0 + jj + 5) + k_offset;
+            const float* k6 = (const float*)k_tokens.row(j0 + jj + 6) + k_offset;
+            const float* k7 = (const float*)k_tokens.row(j0 + jj + 7) + k_offset;
+
+            __m128 _s0 = _mm_setzero_ps();
+            __m128 _s1 = _mm_setzero_ps();
+            __m128 _s2 = _mm_setzero_ps();
+            __m128 _s3 = _mm_setzero_ps();
+            __m128 _s4 = _mm_setzero_ps();
+            __m128 _s5 = _mm_setzero_ps();
+            __m128 _s6 = _mm_setzero_ps();
+            __m128 _s7 = _mm_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                __m128 _q = _mm_loadu_ps(qb + d * 4);
+                _s0 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k0[d]), _s0);
+                _s1 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k1[d]), _s1);
+                _s2 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k2[d]), _s2);
+                _s3 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k3[d]), _s3);
+                _s4 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k4[d]), _s4);
+                _s5 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k5[d]), _s5);
+                _s6 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k6[d]), _s6);
+                _s7 = _mm_comp_fmadd_ps(_q, _mm_set1_ps(k7[d]), _s7);
+            }
+            _mm_storeu_ps(sb + jj * 4, _s0);
+            _mm_storeu_ps(sb + (jj + 1) * 4, _s1);
+            _mm_storeu_ps(sb + (jj + 2) * 4, _s2);
+            _mm_storeu_ps(sb + (jj + 3) * 4, _s3);
+            _mm_storeu_ps(sb + (jj + 4) * 4, _s4);
+            _mm_storeu_ps(sb + (jj + 5) * 4, _s5);
+            _mm_storeu_ps(sb + (jj + 6) * 4, _s6);
+            _mm_storeu_ps(sb + (jj + 7) * 4, _s7);
+        }
+        for (; jj < max_jj; jj++)
+        {
+            const float* k0 = (const float*)k_tokens.row(j0 + jj) + k_offset;
+
+            __m128 _s0 = _mm_setzero_ps();
+            for (int d = 0; d < embed_dim_per_head; d++)
+            {
+                _s0 = _mm_comp_fmadd_ps(_mm_loadu_ps(qb + d * 4), _mm_set1_ps(k0[d]), _s0);
+            }
+            _mm_storeu_ps(sb + jj * 4, _s0);
+        }
+
+        if (!maskm.empty())
+        {
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                const float* mptr = maskm.row(i0 + ii) + j0;
+                for (jj = 0; jj < max_jj; jj++)
+                {
+                    sb[jj * 4 + ii] += mptr[jj];
+                }
+            }
+        }
+
+        __m128 _tile_max = _max;
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            _tile_max = _mm_max_ps(_tile_max, _mm_loadu_ps(sb + jj * 4));
+        }
+
+        // rescale what was accumulated against the previous max
+        __m128 _scale = exp_ps(_mm_sub_ps(_max, _tile_max));
+        _max = _tile_max;
+        _sum = _mm_mul_ps(_sum, _scale);
+        for (int d = 0; d < embed_dim_per_head; d++)
+        {
+            _mm_storeu_ps(ob + d * 4, _mm_mul_ps(_mm_loadu_ps(ob + d * 4), _scale));
+        }
+
+        // p = exp(s - max)
+        for (jj = 0; jj < max_jj; jj++)
+        {
+            __m128 _p = exp_ps(_mm_sub_ps(_mm_loadu_ps(sb + jj * 4), _max));
+            _mm_storeu_ps(sb + jj * 4, _p);
+            _sum = _mm_add_ps(_sum, _p);
+        }
+
+        // o += p v
+        int d = 0;
+        for (; d + 7 < embed_dim_per_head; d += 8)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+            const float* v1 = (const float*)v_head.row(d + 1) + j0;
+            const float* v2 = (const float*)v_head.row(d + 2) + j0;
+            const float* v3 = (const float*)v_head.row(d + 3) + j0;
+            const float* v4 = (const float*)v_head.row(d + 4) + j0;
+            const float* v5 = (const float*)v_head.row(d + 5) + j0;
+            const float* v6 = (const float*)v_head.row(d + 6) + j0;
+            const float* v7 = (const float*)v_head.row(d + 7) + j0;
+
+            __m128 _o0 = _mm_loadu_ps(ob + d * 4);
+            __m128 _o1 = _mm_loadu_ps(ob + (d + 1) * 4);
+            __m128 _o2 = _mm_loadu_ps(ob + (d + 2) * 4);
+            __m128 _o3 = _mm_loadu_ps(ob + (d + 3) * 4);
+            __m128 _o4 = _mm_loadu_ps(ob + (d + 4) * 4);
+            __m128 _o5 = _mm_loadu_ps(ob + (d + 5) * 4);
+            __m128 _o6 = _mm_loadu_ps(ob + (d + 6) * 4);
+            __m128 _o7 = _mm_loadu_ps(ob + (d + 7) * 4);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                __m128 _p = _mm_loadu_ps(sb + jj * 4);
+                _o0 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v0[jj]), _o0);
+                _o1 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v1[jj]), _o1);
+                _o2 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v2[jj]), _o2);
+                _o3 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v3[jj]), _o3);
+                _o4 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v4[jj]), _o4);
+                _o5 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v5[jj]), _o5);
+                _o6 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v6[jj]), _o6);
+                _o7 = _mm_comp_fmadd_ps(_p, _mm_set1_ps(v7[jj]), _o7);
+            }
+            _mm_storeu_ps(ob + d * 4, _o0);
+            _mm_storeu_ps(ob + (d + 1) * 4, _o1);
+            _mm_storeu_ps(ob + (d + 2) * 4, _o2);
+            _mm_storeu_ps(ob + (d + 3) * 4, _o3);
+            _mm_storeu_ps(ob + (d + 4) * 4, _o4);
+            _mm_storeu_ps(ob + (d + 5) * 4, _o5);
+            _mm_storeu_ps(ob + (d + 6) * 4, _o6);
+            _mm_storeu_ps(ob + (d + 7) * 4, _o7);
+        }
+        for (; d < embed_dim_per_head; d++)
+        {
+            const float* v0 = (const float*)v_head.row(d) + j0;
+
+            __m128 _o0 = _mm_loadu_ps(ob + d * 4);
+            for (jj = 0; jj < max_jj; jj++)
+            {
+                _o0 = _mm_comp_fmadd_ps(_mm_loadu_ps(sb + jj * 4), _mm_set1_ps(v0[jj]), _o0);
+            }
+            _mm_storeu_ps(ob + d * 4, _o0);
+        }
+    }
+
+    __m128 _inv_sum = _mm_div_ps(_mm_set1_ps(1.f), _sum);
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        float* outptr = (float*)out_head.row(d) + i0;
+
+        __m128 _o = _mm_mul_ps(_mm_loadu_ps(ob + d * 4), _inv_sum);
+        if (max_ii == 4)
+        {
+            _mm_storeu_ps(outptr, _o);
+        }
+        else
+        {
+            _mm_storeu_ps(sb, _o);
+            for (int ii = 0; ii < max_ii; ii++)
+            {
+                outptr[ii] = sb[ii];
+            }
+        }
+    }
+}
+#endif // __SSE2__
+
+static float flash_attention_dot(const float* a, const float* b, int size)
+{
+    float sum = 0.f;
+
+    int i = 0;
+#if __SSE2__
+#if __AVX__
+#if __AVX512F__
+    __m512 _sum512 = _mm512_setzero_ps();
+    for (; i + 15 < size; i += 16)
+    {
+        _sum512 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), _sum512);
+    }
+    sum += _mm512_comp_reduce_add_ps(_sum512);
+#endif // __AVX512F__
+    __m256 _sum256 = _mm256_setzero_ps();
+    for (; i + 7 < size; i += 8)
+    {
+        _sum256 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), _sum256);
+    }
+    sum += _mm256_reduce_add_ps(_sum256);
+#endif // __AVX__
+    __m128 _sum128 = _mm_setzero_ps();
+    for (; i + 3 < size; i += 4)
+    {
+        _sum128 = _mm_comp_fmadd_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i), _sum128);
+    }
+    sum += _mm_reduce_add_ps(_sum128);
+#endif // __SSE2__
+    for (; i < size; i++)
+    {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+// one head, query i against every key with the same online softmax as the blocks above
+// scores are dot products along the head features of k_tokens, outputs along the keys of v_head
+// this is the path for a handful of queries, such as decoding against a kv cache
+static void flash_attention_row(const Mat& q_head, const Mat& k_tokens, int k_offset, const Mat& v_head, const Mat& maskm, Mat& out_head, int i, float* tmp)
+{
+    const int embed_dim_per_head = q_head.h;
+    const int dst_seqlen = v_head.w;
+
+    float* qb = tmp;
+    float* ob = qb + embed_dim_per_head;
+    float* sb = ob + embed_dim_per_head;
+
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        qb[d] = q_head.row(d)[i];
+        ob[d] = 0.f;
+    }
+
+    const float* mptr = maskm.empty() ? 0 : maskm.row(i);
+
+    float max = -FLT_MAX;
+    float sum = 0.f;
+
+    for (int j0 = 0; j0 < dst_seqlen; j0 += FLASH_ATTENTION_TILE_K)
+    {
+        const int max_jj = std::min(FLASH_ATTENTION_TILE_K, dst_seqlen - j0);
+
+        float tile_max = max;
+        for (int jj = 0; jj < max_jj; jj++)
+        {
+            float s = flash_attention_dot(qb, (const float*)k_tokens.row(j0 + jj) + k_offset, embed_dim_per_head);
+            if (mptr)
+                s += mptr[j0 + jj];
+
+            sb[jj] = s;
+            tile_max = std::max(tile_max, s);
+        }
+
+        const float scale = expf(max - tile_max);
+        max = tile_max;
+        sum *= scale;
+
+        for (int jj = 0; jj < max_jj; jj++)
+        {
+            sb[jj] = expf(sb[jj] - max);
+            sum += sb[jj];
+        }
+
+        for (int d = 0; d < embed_dim_per_head; d++)
+        {
+            ob[d] = ob[d] * scale + flash_attention_dot(sb, (const float*)v_head.row(d) + j0, max_jj);
+        }
+    }
+
+    const float inv_sum = 1.f / sum;
+    for (int d = 0; d < embed_dim_per_head; d++)
+    {
+        out_head.row(d)[i] = ob[d] * inv_sum;
+    }
+}
+
 int MultiHeadAttention_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+    // bottoms are q [k] [v] [attn_mask] [cache_k cache_v]
+    const int qkv_count = (int)bottom_blobs.size() - (attn_mask ? 1 : 0) - (kv_cache ? 2 : 0);
+
     const Mat& q_blob = bottom_blobs[0];
-    const Mat& k_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs[1];
-    const Mat& v_blob = bottom_blobs.size() == 1 ? q_blob : bottom_blobs.size() == 2 ? k_blob : bottom_blobs[2];
+    const Mat& k_blob = qkv_count == 1 ? q_blob : bottom_blobs[1];
+    const Mat& v_blob = qkv_count == 1 ? q_blob : qkv_count == 2 ? k_blob : bottom_blobs[2];
+
+    Mat attn_mask_blob;
+    Mat cache_k_blob;
+    Mat cache_v_blob;
+    if (attn_mask)
+    {
+        attn_mask_blob = bottom_blobs[qkv_count];
+        if (attn_mask_blob.elempack != 1)
+        {
+            Mat attn_mask_blob_unpacked;
+            convert_packing(attn_mask_blob, attn_mask_blob_unpacked, 1, opt);
+            attn_mask_blob = attn_mask_blob_unpacked;
+        }
+    }
+    if (kv_cache)
+    {
+        cache_k_blob = bottom_blobs[bottom_blobs.size() - 2];
+        cache_v_blob = bottom_blobs[bottom_blobs.size() - 1];
+        if (cache_k_blob.elempack != 1)
+        {
+            Mat cache_k_blob_unpacked;
+            convert_packing(cache_k_blob, cache_k_blob_unpacked, 1, opt);
+            cache_k_blob = cache_k_blob_unpacked;
+        }
+        if (cache_v_blob.elempack != 1)
+        {
+            Mat cache_v_blob_unpacked;
+            convert_packing(cache_v_blob, cache_v_blob_unpacked, 1, opt);
+            cache_v_blob = cache_v_blob_unpacked;
+        }
+    }
 
     const int embed_dim_per_head = embed_dim / num_head;
     const int src_seqlen = q_blob.h * q_blob.elempack;
-    const int dst_seqlen = k_blob.h * k_blob.elempack;
+    const int past_seqlen = cache_k_blob.dims == 2 ? cache_k_blob.h : 0;
+    const int dst_seqlen = past_seqlen + k_blob.h * k_blob.elempack;
 
     Mat q_affine;
     q_gemm->forward(q_blob, q_affine, opt);
@@ -281,42 +1026,117 @@ int MultiHeadAttention_x86::forward(const std::vector<Mat>& bottom_blobs, std::v
     Mat k_affine;
     k_gemm->forward(k_blob, k_affine, opt);
 
-    Mat qk_cross(dst_seqlen, src_seqlen * num_head, 4u, opt.blob_allocator);
-    #pragma omp parallel for num_threads(opt.num_threads)
-    for (int i = 0; i < num_head; i++)
+    if (kv_cache)
     {
-        std::vector<Mat> qk_bottom_blobs(2);
-        qk_bottom_blobs[0] = q_affine.row_range(i * embed_dim_per_head, embed_dim_per_head);
-        qk_bottom_blobs[1] = k_affine.row_range(i * embed_dim_per_head, embed_dim_per_head);
-        std::vector<Mat> qk_top_blobs(1);
-        qk_top_blobs[0] = qk_cross.row_range(i * src_seqlen, src_seqlen);
-        Option opt1 = opt;
-        opt1.num_threads = 1;
-        qk_gemm->forward(qk_bottom_blobs, qk_top_blobs, opt1);
+        int ret = concat_kv_cache(cache_k_blob, k_affine, top_blobs[1], opt);
+        if (ret != 0)
+            return ret;
     }
 
-    q_affine.release();
-    k_affine.release();
+    // keys one token per row, the kv cache output is already laid out so
+    Mat k_tokens;
+    if (kv_cache)
+    {
+        k_tokens = top_blobs[1];
+    }
+    else
+    {
+        k_tokens.create(embed_dim, dst_seqlen, 4u, opt.workspace_allocator);
+        if (k_tokens.empty())
+            return -100;
 
-    qk_softmax->forward_inplace(qk_cross, opt);
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int j = 0; j < dst_seqlen; j++)
+        {
+            float* outptr = k_tokens.row(j);
+            for (int i = 0; i < embed_dim; i++)
+            {
+                outptr[i] = k_affine.row(i)[j];
+            }
+        }
+    }
+
+    k_affine.release();
 
     Mat v_affine;
     v_gemm->forward(v_blob, v_affine, opt);
 
+    if (kv_cache)
+    {
+        int ret = concat_kv_cache(cache_v_blob, v_affine, top_blobs[2], opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    // fused qk, mask, softmax and v per head and block of queries
+    // the src_seqlen x dst_seqlen attention matrix is never materialized
+    int block_size = 1;
+#if __SSE2__
+    if (src_seqlen >= 4)
+        block_size = 4;
+#if __AVX__
+    if (src_seqlen >= 8)
+        block_size = 8;
+#if __AVX512F__
+    if (src_seqlen >= 16)
+        block_size = 16;
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+
+    const int nn_block = (src_seqlen + block_size - 1) / block_size;
+    const int nn_job = num_head * nn_block;
+
     Mat qkv_cross(src_seqlen, embed_dim_per_head * num_head, 4u, opt.blob_allocator);
+    if (qkv_cross.empty())
+        return -100;
+
+    Mat tmp((embed_dim_per_head * 2 + FLASH_ATTENTION_TILE_K) * block_size, 1, opt.num_threads, 4u, opt.workspace_allocator);
+    if (tmp.empty())
+        return -100;
+
     #pragma omp parallel for num_threads(opt.num_threads)
-    for (int i = 0; i < num_head; i++)
+    for (int job = 0; job < nn_job; job++)
     {
-        std::vector<Mat> qkv_bottom_blobs(2);
-        qkv_bottom_blobs[0] = qk_cross.row_range(i * src_seqlen, src_seqlen);
-        qkv_bottom_blobs[1] = v_affine.row_range(i * embed_dim_per_head, embed_dim_per_head);
-        std::vector<Mat> qkv_top_blobs(1);
-        qkv_top_blobs[0] = qkv_cross.row_range(i * embed_dim_per_head, embed_dim_per_head);
-        Option opt1 = opt;
-        opt1.num_threads = 1;
-        qkv_gemm->forward(qkv_bottom_blobs, qkv_top_blobs, opt1);
+        const int i = job / nn_block;
+        const int i0 = job % nn_block * block_size;
+
+        const Mat q_head = q_affine.row_range(i * embed_dim_per_head, embed_dim_per_head);
+        const Mat v_head = v_affine.row_range(i * embed_dim_per_head, embed_dim_per_head);
+        Mat out_head = qkv_cross.row_range(i * embed_dim_per_head, embed_dim_per_head);
+
+        Mat maskm;
+        if (attn_mask)
+            maskm = attn_mask_blob.dims == 3 ? attn_mask_blob.channel(i) : attn_mask_blob;
+
+        float* tmpptr = tmp.channel(get_omp_thread_num());
+
+#if __AVX512F__
+        if (block_size == 16)
+        {
+            flash_attention_block_avx512(q_head, k_tokens, i * embed_dim_per_head, v_head, maskm, out_head, i0, tmpptr);
+            continue;
+        }
+#endif // __AVX512F__
+#if __AVX__
+        if (block_size == 8)
+        {
+            flash_attention_block_avx(q_head, k_tokens, i * embed_dim_per_head, v_head, maskm, out_head, i0, tmpptr);
+            continue;
+        }
+#endif // __AVX__
+#if __SSE2__
+        if (block_size == 4)
+        {
+            flash_attention_block_sse(q_head, k_tokens, i * embed_dim_per_head, v_head, maskm, out_head, i0, tmpptr);
+            continue;
+        }
+#endif // __SSE2__
+        flash_attention_row(q_head, k_tokens, i * embed_dim_per_head, v_head, maskm, out_head, i0, tmpptr);
     }
 
+    q_affine.release();
+    k_tokens.release();
     v_affine.release();
 
     o_gemm->forward(qkv_cross, top_blobs[0], opt);
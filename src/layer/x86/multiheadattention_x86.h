@@ -34,11 +34,6 @@ public:
     Layer* k_gemm;
     Layer* v_gemm;
     Layer* o_gemm;
-
-    Layer* qk_gemm;
-    Layer* qkv_gemm;
-
-    Layer* qk_softmax;
 };
 
 } // namespace ncnn
@@ -375,7 +375,8 @@ int Padding_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& op
             int outc = channels * elempack + front + behind;
 
 #if __AVX__
-            int out_elempack = outc % 8 == 0 ? 8 : outc % 4 == 0 ? 4 : 1;
+            // keep pack4 when no channel is padded, pooling and convolution read the bordered blob with the input packing
+            int out_elempack = outc % 8 == 0 && (front != 0 || behind != 0) ? 8 : outc % 4 == 0 ? 4 : 1;
 #else
             int out_elempack = outc % 4 == 0 ? 4 : 1;
 #endif
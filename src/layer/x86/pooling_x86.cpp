@@ -23,8 +23,17 @@
 
 #include <float.h>
 
+#include "x86_usability.h"
+
+#include "cpu.h"
+
 namespace ncnn {
 
+#if NCNN_BF16
+#include "cast_bf16.h"
+#include "bf16_chunk.h"
+#endif
+
 #if __SSE2__
 #include "pooling_2x2_pack4.h"
 #include "pooling_3x3_pack4.h"
@@ -44,6 +53,9 @@ Pooling_x86::Pooling_x86()
 #if __SSE2__
     support_packing = true;
 #endif // __SSE2__
+#if NCNN_BF16
+    support_bf16_storage = true;
+#endif
 }
 
 int Pooling_x86::create_pipeline(const Option& /*opt*/)
@@ -70,6 +82,11 @@ int Pooling_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& op
         return Pooling::forward(bottom_blob, top_blob, opt);
     }
 
+#if NCNN_BF16
+    if (opt.use_bf16_storage && bottom_blob.elembits() == 16)
+        return forward_bf16s(bottom_blob, top_blob, opt);
+#endif
+
 #if __SSE2__
     int elempack = bottom_blob.elempack;
     int w = bottom_blob.w;
@@ -826,4 +843,82 @@ int Pooling_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& op
 #endif
 }
 
+#if NCNN_BF16
+int Pooling_x86::forward_bf16s(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    // channels are pooled independently, stream them through fp32 in chunks
+    const int channels = bottom_blob.c;
+    const int step = bf16_chunk_outer_step(bottom_blob, opt.num_threads);
+    const int nn_channels = (channels + step - 1) / step;
+    const int nT = std::min(opt.num_threads, nn_channels);
+
+    Mat scratch;
+    bf16_chunk_create_scratch(bottom_blob, step, nT, scratch, opt.workspace_allocator);
+    if (scratch.empty())
+        return -100;
+
+    // chunks run concurrently, keep their allocations off the shared allocators
+    Option opt_1 = opt;
+    opt_1.num_threads = 1;
+    opt_1.blob_allocator = 0;
+    opt_1.workspace_allocator = 0;
+
+    // the first chunk tells the output shape
+    Mat top_chunk0_fp32;
+    {
+        const int n = std::min(step, channels);
+
+        Mat chunk_fp32 = scratch.channel_range(0, n);
+        cast_bf16_to_fp32_sse(bottom_blob.channel_range(0, n), chunk_fp32, opt_1);
+
+        int ret = forward(chunk_fp32, top_chunk0_fp32, opt_1);
+        if (ret != 0)
+            return ret;
+    }
+
+    const int out_elempack = top_chunk0_fp32.elempack;
+    const size_t out_elemsize = 2u * out_elempack;
+
+    // global pooling gives one value per channel
+    const bool top_is_1d = top_chunk0_fp32.dims == 1;
+    if (top_is_1d)
+        top_blob.create(channels, out_elemsize, out_elempack, opt.blob_allocator);
+    else
+        top_blob.create(top_chunk0_fp32.w, top_chunk0_fp32.h, channels, out_elemsize, out_elempack, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    {
+        const int n = std::min(step, channels);
+
+        Mat top_chunk = top_is_1d ? top_blob.range(0, n) : top_blob.channel_range(0, n);
+        cast_fp32_to_bf16_sse(top_chunk0_fp32, top_chunk, opt_1);
+    }
+
+    int ret = 0;
+
+    #pragma omp parallel for num_threads(nT)
+    for (int ii = 1; ii < nn_channels; ii++)
+    {
+        const int q = ii * step;
+        const int n = std::min(step, channels - q);
+
+        Mat chunk_fp32 = scratch.channel_range(get_omp_thread_num() * step, n);
+        cast_bf16_to_fp32_sse(bottom_blob.channel_range(q, n), chunk_fp32, opt_1);
+
+        Mat top_chunk_fp32;
+        if (forward(chunk_fp32, top_chunk_fp32, opt_1) != 0)
+        {
+            ret = -1;
+            continue;
+        }
+
+        Mat top_chunk = top_is_1d ? top_blob.range(q, n) : top_blob.channel_range(q, n);
+        cast_fp32_to_bf16_sse(top_chunk_fp32, top_chunk, opt_1);
+    }
+
+    return ret;
+}
+#endif // NCNN_BF16
+
 } // namespace ncnn
@@ -0,0 +1,734 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "reduction_x86.h"
+
+#include <float.h>
+#include <math.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "sse_mathfun.h"
+#if __AVX__
+#include <immintrin.h>
+#include "avx_mathfun.h"
+#if __AVX512F__
+#include "avx512_mathfun.h"
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+#include "x86_usability.h"
+#include "x86_activation.h"
+
+#include "cpu.h"
+
+namespace ncnn {
+
+Reduction_x86::Reduction_x86()
+{
+#if __SSE2__
+    support_packing = true;
+#endif // __SSE2__
+}
+
+// outptr[i] = op(outptr[i], ptr[i])
+template<typename Op>
+static void reduction_accumulate(const float* ptr, float* outptr, int size)
+{
+    Op op;
+
+    int i = 0;
+#if __SSE2__
+#if __AVX__
+#if __AVX512F__
+    for (; i + 15 < size; i += 16)
+    {
+        _mm512_storeu_ps(outptr + i, op.func_pack16(_mm512_loadu_ps(outptr + i), _mm512_loadu_ps(ptr + i)));
+    }
+#endif // __AVX512F__
+    for (; i + 7 < size; i += 8)
+    {
+        _mm256_storeu_ps(outptr + i, op.func_pack8(_mm256_loadu_ps(outptr + i), _mm256_loadu_ps(ptr + i)));
+    }
+#endif // __AVX__
+    for (; i + 3 < size; i += 4)
+    {
+        _mm_storeu_ps(outptr + i, op.func_pack4(_mm_loadu_ps(outptr + i), _mm_loadu_ps(ptr + i)));
+    }
+#endif // __SSE2__
+    for (; i < size; i++)
+    {
+        outptr[i] = op.func(outptr[i], ptr[i]);
+    }
+}
+
+// reduce size elements of elempack lanes into the elempack values at outptr
+// the partial result of the run is merged with op2
+template<typename Op, typename Op2>
+static void reduction_reduce(const float* ptr, float* outptr, int size, int elempack, float v0)
+{
+    Op op;
+    Op2 op2;
+
+#if __SSE2__
+#if __AVX__
+#if __AVX512F__
+    if (elempack == 16)
+    {
+        __m512 _sum = _mm512_set1_ps(v0);
+        for (int i = 0; i < size; i++)
+        {
+            _sum = op.func_pack16(_sum, _mm512_loadu_ps(ptr));
+            ptr += 16;
+        }
+        _mm512_storeu_ps(outptr, op2.func_pack16(_mm512_loadu_ps(outptr), _sum));
+        return;
+    }
+#endif // __AVX512F__
+    if (elempack == 8)
+    {
+        __m256 _sum = _mm256_set1_ps(v0);
+        for (int i = 0; i < size; i++)
+        {
+            _sum = op.func_pack8(_sum, _mm256_loadu_ps(ptr));
+            ptr += 8;
+        }
+        _mm256_storeu_ps(outptr, op2.func_pack8(_mm256_loadu_ps(outptr), _sum));
+        return;
+    }
+#endif // __AVX__
+    if (elempack == 4)
+    {
+        __m128 _sum = _mm_set1_ps(v0);
+        for (int i = 0; i < size; i++)
+        {
+            _sum = op.func_pack4(_sum, _mm_loadu_ps(ptr));
+            ptr += 4;
+        }
+        _mm_storeu_ps(outptr, op2.func_pack4(_mm_loadu_ps(outptr), _sum));
+        return;
+    }
+#endif // __SSE2__
+
+    // elempack == 1
+    float sum = v0;
+
+    int i = 0;
+#if __SSE2__
+    float tmp[16];
+#if __AVX__
+#if __AVX512F__
+    if (i + 15 < size)
+    {
+        __m512 _sum = _mm512_set1_ps(v0);
+        for (; i + 15 < size; i += 16)
+        {
+            _sum = op.func_pack16(_sum, _mm512_loadu_ps(ptr + i));
+        }
+        _mm512_storeu_ps(tmp, _sum);
+        for (int k = 0; k < 16; k++)
+        {
+            sum = op2.func(sum, tmp[k]);
+        }
+    }
+#endif // __AVX512F__
+    if (i + 7 < size)
+    {
+        __m256 _sum = _mm256_set1_ps(v0);
+        for (; i + 7 < size; i += 8)
+        {
+            _sum = op.func_pack8(_sum, _mm256_loadu_ps(ptr + i));
+        }
+        _mm256_storeu_ps(tmp, _sum);
+        for (int k = 0; k < 8; k++)
+        {
+            sum = op2.func(sum, tmp[k]);
+        }
+    }
+#endif // __AVX__
+    if (i + 3 < size)
+    {
+        __m128 _sum = _mm_set1_ps(v0);
+        for (; i + 3 < size; i += 4)
+        {
+            _sum = op.func_pack4(_sum, _mm_loadu_ps(ptr + i));
+        }
+        _mm_storeu_ps(tmp, _sum);
+        for (int k = 0; k < 4; k++)
+        {
+            sum = op2.func(sum, tmp[k]);
+        }
+    }
+#endif // __SSE2__
+    float sum1 = v0;
+    for (; i < size; i++)
+    {
+        sum1 = op.func(sum1, ptr[i]);
+    }
+
+    outptr[0] = op2.func(outptr[0], op2.func(sum, sum1));
+}
+
+// one channel of d x h x w elements merged into the d' x h' x w' elements at outptr
+template<typename Op, typename Op2>
+static void reduction_channel(const float* ptr, float* outptr, int w, int h, int d, int elempack, bool reduce_w, bool reduce_h, bool reduce_d, float v0)
+{
+    const int outw = reduce_w ? 1 : w;
+    const int outh = reduce_h ? 1 : h;
+
+    for (int z = 0; z < d; z++)
+    {
+        float* outptr_z = outptr + (reduce_d ? 0 : z) * outh * outw * elempack;
+
+        for (int y = 0; y < h; y++)
+        {
+            float* outrow = outptr_z + (reduce_h ? 0 : y) * outw * elempack;
+
+            if (reduce_w)
+                reduction_reduce<Op, Op2>(ptr, outrow, w, elempack, v0);
+            else
+                reduction_accumulate<Op>(ptr, outrow, w * elempack);
+
+            ptr += w * elempack;
+        }
+    }
+}
+
+template<typename Op, typename Op2>
+static int reduction_op(const Mat& a, Mat& b, float v0, bool reduce_w, bool reduce_h, bool reduce_d, bool reduce_c, int keepdims, const Option& opt)
+{
+    Op2 op2;
+
+    const int dims = a.dims;
+
+    // view the blob as channels of d x h x w elements with elempack lanes
+    // 2d blobs are channels of one row, 1d blobs a single unpacked channel
+    int elempack = a.elempack;
+    int w = a.w;
+    int h = a.h;
+    int d = a.d;
+    int channels = a.c;
+    size_t cstep = a.cstep * elempack;
+    if (dims == 1)
+    {
+        w = a.w * elempack;
+        elempack = 1;
+        cstep = w;
+    }
+    if (dims == 2)
+    {
+        channels = a.h;
+        h = 1;
+        cstep = w * elempack;
+        reduce_c = reduce_h;
+        reduce_h = false;
+    }
+
+    // output shape follows the reference, the channel axis keeps its packing
+    const int out_elempack = reduce_c ? 1 : elempack;
+    const size_t out_elemsize = out_elempack * 4u;
+    {
+        int extents[4] = {w, h, d, channels};
+        bool reduced[4] = {reduce_w, reduce_h, reduce_d, reduce_c};
+        if (dims == 2)
+        {
+            extents[1] = channels;
+            reduced[1] = reduce_c;
+        }
+        if (dims == 3)
+        {
+            extents[2] = channels;
+            reduced[2] = reduce_c;
+        }
+
+        int shape[4] = {1, 1, 1, 1};
+        int shape_dims = 0;
+        for (int i = 0; i < dims; i++)
+        {
+            if (keepdims)
+                shape[shape_dims++] = reduced[i] ? 1 : extents[i];
+            else if (!reduced[i])
+                shape[shape_dims++] = extents[i];
+        }
+
+        if (shape_dims <= 1)
+            b.create(shape[0], out_elemsize, out_elempack, opt.blob_allocator);
+        if (shape_dims == 2)
+            b.create(shape[0], shape[1], out_elemsize, out_elempack, opt.blob_allocator);
+        if (shape_dims == 3)
+            b.create(shape[0], shape[1], shape[2], out_elemsize, out_elempack, opt.blob_allocator);
+        if (shape_dims == 4)
+            b.create(shape[0], shape[1], shape[2], shape[3], out_elemsize, out_elempack, opt.blob_allocator);
+        if (b.empty())
+            return -100;
+    }
+
+    const int outw = reduce_w ? 1 : w;
+    const int outh = reduce_h ? 1 : h;
+    const int outd = reduce_d ? 1 : d;
+    const int outsize = outw * outh * outd;
+
+    // neighbouring axes reduced alike are one contiguous run
+    if (reduce_h == reduce_w)
+    {
+        w *= h;
+        h = 1;
+    }
+    if (h == 1 && reduce_d == reduce_w)
+    {
+        w *= d;
+        d = 1;
+    }
+
+    if (!reduce_c)
+    {
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int q = 0; q < channels; q++)
+        {
+            const float* ptr = (const float*)a + cstep * q;
+            float* outptr = b.dims == 1 ? (float*)b + q * elempack : b.dims == 2 ? b.row(q) : (float*)b.channel(q);
+
+            for (int i = 0; i < outsize * elempack; i++)
+            {
+                outptr[i] = v0;
+            }
+
+            reduction_channel<Op, Op2>(ptr, outptr, w, h, d, elempack, reduce_w, reduce_h, reduce_d, v0);
+        }
+
+        return 0;
+    }
+
+    // every thread merges its channels into its own partial result
+    Mat partials(outsize * elempack, 1, opt.num_threads, 4u, opt.workspace_allocator);
+    if (partials.empty())
+        return -100;
+
+    partials.fill(v0);
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < channels; q++)
+    {
+        const float* ptr = (const float*)a + cstep * q;
+        float* outptr = partials.channel(get_omp_thread_num());
+
+        reduction_channel<Op, Op2>(ptr, outptr, w, h, d, elempack, reduce_w, reduce_h, reduce_d, v0);
+    }
+
+    // merge the partials and then the lanes of each element
+    // a 3d output here is d planes of h x w, one per channel
+    for (int z = 0; z < outd; z++)
+    {
+        float* outptr = b.dims == 3 ? (float*)b.channel(z) : (float*)b + z * outw * outh;
+
+        for (int i = 0; i < outw * outh; i++)
+        {
+            const int j = (z * outw * outh + i) * elempack;
+
+            float sum = v0;
+            for (int t = 0; t < partials.c; t++)
+            {
+                const float* ptr = (const float*)partials.channel(t) + j;
+                for (int k = 0; k < elempack; k++)
+                {
+                    sum = op2.func(sum, ptr[k]);
+                }
+            }
+            outptr[i] = sum;
+        }
+    }
+
+    return 0;
+}
+
+template<typename MathOp>
+static void reduction_post_process(Mat& a, float coeff, const Option& opt)
+{
+    MathOp mathop;
+
+    const int channels = a.dims >= 3 ? a.c : 1;
+    const int size = (a.dims >= 3 ? a.w * a.h * a.d : a.w * a.h) * a.elempack;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int q = 0; q < channels; q++)
+    {
+        float* ptr = a.channel(q);
+        for (int i = 0; i < size; i++)
+        {
+            ptr[i] = mathop(ptr[i]) * coeff;
+        }
+    }
+}
+
+template<typename Op, typename Op2, typename Op3>
+static int reduction(const Mat& a, Mat& b, float v0, bool reduce_w, bool reduce_h, bool reduce_d, bool reduce_c, bool post_process, float coeff, int keepdims, const Option& opt)
+{
+    int ret = reduction_op<Op, Op2>(a, b, v0, reduce_w, reduce_h, reduce_d, reduce_c, keepdims, opt);
+    if (ret != 0)
+        return -100;
+
+    if (post_process || fabs(coeff - 1.f) > FLT_EPSILON)
+    {
+        reduction_post_process<Op3>(b, coeff, opt);
+    }
+
+    return 0;
+}
+
+namespace Reduction_x86_functor {
+
+struct reduction_op_add
+{
+    float func(const float& x, const float& y) const
+    {
+        return x + y;
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_add_ps(x, y);
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_add_ps(x, y);
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_add_ps(x, y);
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_mul
+{
+    float func(const float& x, const float& y) const
+    {
+        return x * y;
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_mul_ps(x, y);
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_mul_ps(x, y);
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_mul_ps(x, y);
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_asum
+{
+    float func(const float& x, const float& y) const
+    {
+        return (float)(x + fabs(y));
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_add_ps(x, abs_sse(y));
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_add_ps(x, abs_avx(y));
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_add_ps(x, abs_avx512(y));
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_sumsq
+{
+    float func(const float& x, const float& y) const
+    {
+        return x + y * y;
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_comp_fmadd_ps(y, y, x);
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_comp_fmadd_ps(y, y, x);
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_fmadd_ps(y, y, x);
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_sumsexp
+{
+    float func(const float& x, const float& y) const
+    {
+        return (float)(x + exp(y));
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_add_ps(x, exp_ps(y));
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_add_ps(x, exp256_ps(y));
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_add_ps(x, exp512_ps(y));
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_max
+{
+    float func(const float& x, const float& y) const
+    {
+        return std::max(x, y);
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_max_ps(x, y);
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_max_ps(x, y);
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_max_ps(x, y);
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct reduction_op_min
+{
+    float func(const float& x, const float& y) const
+    {
+        return std::min(x, y);
+    }
+#if __SSE2__
+    __m128 func_pack4(const __m128& x, const __m128& y) const
+    {
+        return _mm_min_ps(x, y);
+    }
+#if __AVX__
+    __m256 func_pack8(const __m256& x, const __m256& y) const
+    {
+        return _mm256_min_ps(x, y);
+    }
+#if __AVX512F__
+    __m512 func_pack16(const __m512& x, const __m512& y) const
+    {
+        return _mm512_min_ps(x, y);
+    }
+#endif // __AVX512F__
+#endif // __AVX__
+#endif // __SSE2__
+};
+
+struct post_process_identity
+{
+    float operator()(const float& x) const
+    {
+        return x;
+    }
+};
+
+struct post_process_sqrt
+{
+    float operator()(const float& x) const
+    {
+        return (float)sqrt(x);
+    }
+};
+
+struct post_process_log
+{
+    float operator()(const float& x) const
+    {
+        return (float)log(x);
+    }
+};
+
+} // namespace Reduction_x86_functor
+
+int Reduction_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    using namespace Reduction_x86_functor;
+
+    const int dims = bottom_blob.dims;
+    const int elempack = bottom_blob.elempack;
+
+    int axes_flag[4] = {0};
+    bool reduce_w = false;
+    bool reduce_h = false;
+    bool reduce_d = false;
+    bool reduce_c = false;
+
+    if (reduce_all)
+    {
+        reduce_w = true;
+        reduce_h = true;
+        reduce_d = true;
+        reduce_c = true;
+    }
+    else
+    {
+        const int* axes_ptr = axes;
+        int reduced_axes_num = axes.w;
+
+        for (int i = 0; i < reduced_axes_num; i++)
+        {
+            int axis = axes_ptr[i];
+            // handle negative axis
+            if (axis < 0)
+                axis += dims;
+            axes_flag[axis] = 1;
+        }
+
+        if (dims == 1)
+        {
+            reduce_w = true;
+        }
+        else if (dims == 2)
+        {
+            if (axes_flag[0] == 1) reduce_h = true;
+            if (axes_flag[1] == 1) reduce_w = true;
+        }
+        else if (dims == 3)
+        {
+            if (axes_flag[0] == 1) reduce_c = true;
+            if (axes_flag[1] == 1) reduce_h = true;
+            if (axes_flag[2] == 1) reduce_w = true;
+        }
+        else if (dims == 4)
+        {
+            if (axes_flag[0] == 1) reduce_c = true;
+            if (axes_flag[1] == 1) reduce_d = true;
+            if (axes_flag[2] == 1) reduce_h = true;
+            if (axes_flag[3] == 1) reduce_w = true;
+        }
+    }
+
+    // nothing reduced, the reference leaves top_blob untouched
+    if (!reduce_w && !reduce_h && !reduce_d && !reduce_c)
+        return 0;
+
+    if (dims == 1)
+    {
+        reduce_h = false;
+        reduce_d = false;
+        reduce_c = false;
+    }
+    if (dims == 2)
+    {
+        reduce_d = false;
+        reduce_c = false;
+    }
+    if (dims == 3)
+    {
+        reduce_d = false;
+    }
+
+    if (operation == ReductionOp_SUM)
+        return reduction<reduction_op_add, reduction_op_add, post_process_identity>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_ASUM)
+        return reduction<reduction_op_asum, reduction_op_add, post_process_identity>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_SUMSQ)
+        return reduction<reduction_op_sumsq, reduction_op_add, post_process_identity>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_MEAN)
+    {
+        int scale = 1;
+        if (dims == 1)
+        {
+            scale = bottom_blob.w * elempack;
+        }
+        else if (dims == 2)
+        {
+            if (reduce_w) scale *= bottom_blob.w;
+            if (reduce_h) scale *= bottom_blob.h * elempack;
+        }
+        else
+        {
+            if (reduce_w) scale *= bottom_blob.w;
+            if (reduce_h) scale *= bottom_blob.h;
+            if (reduce_d) scale *= bottom_blob.d;
+            if (reduce_c) scale *= bottom_blob.c * elempack;
+        }
+
+        float coeff_mean = coeff / scale;
+        return reduction<reduction_op_add, reduction_op_add, post_process_identity>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, true, coeff_mean, keepdims, opt);
+    }
+
+    if (operation == ReductionOp_MAX)
+        return reduction<reduction_op_max, reduction_op_max, post_process_identity>(bottom_blob, top_blob, -FLT_MAX, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_MIN)
+        return reduction<reduction_op_min, reduction_op_min, post_process_identity>(bottom_blob, top_blob, FLT_MAX, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_PROD)
+        return reduction<reduction_op_mul, reduction_op_mul, post_process_identity>(bottom_blob, top_blob, 1.f, reduce_w, reduce_h, reduce_d, reduce_c, false, coeff, keepdims, opt);
+
+    if (operation == ReductionOp_L1)
+        return reduction<reduction_op_asum, reduction_op_add, post_process_identity>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, false, 1.f, keepdims, opt);
+
+    if (operation == ReductionOp_L2)
+        return reduction<reduction_op_sumsq, reduction_op_add, post_process_sqrt>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, true, 1.f, keepdims, opt);
+
+    if (operation == ReductionOp_LogSum)
+        return reduction<reduction_op_add, reduction_op_add, post_process_log>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, true, 1.f, keepdims, opt);
+
+    if (operation == ReductionOp_LogSumExp)
+        return reduction<reduction_op_sumsexp, reduction_op_add, post_process_log>(bottom_blob, top_blob, 0.f, reduce_w, reduce_h, reduce_d, reduce_c, true, 1.f, keepdims, opt);
+
+    return 0;
+}
+
+} // namespace ncnn
@@ -0,0 +1,416 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+
+#include "rnn_x86.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif
+#endif // __SSE2__
+
+#include "x86_activation.h"
+#include "x86_usability.h"
+
+#include <math.h>
+
+namespace ncnn {
+
+RNN_x86::RNN_x86()
+{
+    one_blob_only = false;
+    support_inplace = false;
+}
+
+int RNN_x86::create_pipeline(const Option& opt)
+{
+    int num_directions = direction == 2 ? 2 : 1;
+    int size = weight_data_size / num_directions / num_output;
+
+#if __SSE2__
+    weight_xc_data_packed.create(size * 4, num_output / 4 + num_output % 4, num_directions);
+    bias_c_data_packed.create(num_output, 1, num_directions);
+    weight_hc_data_packed.create(num_output * 4, num_output / 4 + num_output % 4, num_directions);
+#else
+    weight_xc_data_packed.create(size, num_output, num_directions);
+    bias_c_data_packed.create(num_output, 1, num_directions);
+    weight_hc_data_packed.create(num_output, num_output, num_directions);
+#endif
+    if (weight_xc_data_packed.empty() || bias_c_data_packed.empty() || weight_hc_data_packed.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int dr = 0; dr < num_directions; dr++)
+    {
+        const Mat weight_xc = weight_xc_data.channel(dr);
+        const Mat bias_c = bias_c_data.channel(dr);
+        const Mat weight_hc = weight_hc_data.channel(dr);
+
+        Mat weight_xc_data_packed_dr = weight_xc_data_packed.channel(dr);
+        Mat bias_c_data_packed_dr = bias_c_data_packed.channel(dr);
+        Mat weight_hc_data_packed_dr = weight_hc_data_packed.channel(dr);
+
+        memcpy((float*)bias_c_data_packed_dr, (const float*)bias_c, num_output * sizeof(float));
+
+        int q = 0;
+#if __SSE2__
+        for (; q + 3 < num_output; q += 4)
+        {
+            const float* weight_xc_0 = weight_xc.row(q);
+            const float* weight_xc_1 = weight_xc.row(q + 1);
+            const float* weight_xc_2 = weight_xc.row(q + 2);
+            const float* weight_xc_3 = weight_xc.row(q + 3);
+
+            const float* weight_hc_0 = weight_hc.row(q);
+            const float* weight_hc_1 = weight_hc.row(q + 1);
+            const float* weight_hc_2 = weight_hc.row(q + 2);
+            const float* weight_hc_3 = weight_hc.row(q + 3);
+
+            float* weight_xc_ptr = weight_xc_data_packed_dr.row(q / 4);
+            float* weight_hc_ptr = weight_hc_data_packed_dr.row(q / 4);
+
+            for (int i = 0; i < size; i++)
+            {
+                weight_xc_ptr[0] = weight_xc_0[i];
+                weight_xc_ptr[1] = weight_xc_1[i];
+                weight_xc_ptr[2] = weight_xc_2[i];
+                weight_xc_ptr[3] = weight_xc_3[i];
+
+                weight_xc_ptr += 4;
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                weight_hc_ptr[0] = weight_hc_0[i];
+                weight_hc_ptr[1] = weight_hc_1[i];
+                weight_hc_ptr[2] = weight_hc_2[i];
+                weight_hc_ptr[3] = weight_hc_3[i];
+
+                weight_hc_ptr += 4;
+            }
+        }
+#endif // __SSE2__
+        for (; q < num_output; q++)
+        {
+#if __SSE2__
+            float* weight_xc_ptr = weight_xc_data_packed_dr.row(q / 4 + q % 4);
+            float* weight_hc_ptr = weight_hc_data_packed_dr.row(q / 4 + q % 4);
+#else
+            float* weight_xc_ptr = weight_xc_data_packed_dr.row(q);
+            float* weight_hc_ptr = weight_hc_data_packed_dr.row(q);
+#endif // __SSE2__
+
+            memcpy(weight_xc_ptr, weight_xc.row(q), size * sizeof(float));
+            memcpy(weight_hc_ptr, weight_hc.row(q), num_output * sizeof(float));
+        }
+    }
+
+    if (opt.lightmode)
+    {
+        weight_xc_data.release();
+        bias_c_data.release();
+        weight_hc_data.release();
+    }
+
+    return 0;
+}
+
+#if __SSE2__
+// accumulate 4 outputs over n inputs
+// kptr holds the weights of the 4 outputs for every input and is advanced past them
+static NCNN_FORCEINLINE __m128 rnn_fmadd_pack4(const float* x, const float*& kptr, int n, __m128 _H)
+{
+    int i = 0;
+#if __AVX512F__
+    // four inputs per register
+    const __m512i _idx = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    __m512 _sum0 = _mm512_setzero_ps();
+    __m512 _sum1 = _mm512_setzero_ps();
+    for (; i + 7 < n; i += 8)
+    {
+        __m512 _xi0 = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i)));
+        __m512 _xi1 = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i + 4)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr), _xi0, _sum0);
+        _sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr + 16), _xi1, _sum1);
+
+        kptr += 32;
+    }
+    for (; i + 3 < n; i += 4)
+    {
+        __m512 _xi = _mm512_permutexvar_ps(_idx, _mm512_castps128_ps512(_mm_loadu_ps(x + i)));
+        _sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(kptr), _xi, _sum0);
+
+        kptr += 16;
+    }
+    _sum0 = _mm512_add_ps(_sum0, _sum1);
+    __m256 _sum = _mm256_add_ps(_mm512_castps512_ps256(_sum0), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(_sum0), 1)));
+    _H = _mm_add_ps(_H, _mm_add_ps(_mm256_castps256_ps128(_sum), _mm256_extractf128_ps(_sum, 1)));
+#elif __AVX__
+    // two inputs per register
+    __m256 _sum0 = _mm256_setzero_ps();
+    __m256 _sum1 = _mm256_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        __m256 _xi01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load1_ps(x + i)), _mm_load1_ps(x + i + 1), 1);
+        __m256 _xi23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load1_ps(x + i + 2)), _mm_load1_ps(x + i + 3), 1);
+        _sum0 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr), _xi01, _sum0);
+        _sum1 = _mm256_comp_fmadd_ps(_mm256_loadu_ps(kptr + 8), _xi23, _sum1);
+
+        kptr += 16;
+    }
+    _sum0 = _mm256_add_ps(_sum0, _sum1);
+    _H = _mm_add_ps(_H, _mm_add_ps(_mm256_castps256_ps128(_sum0), _mm256_extractf128_ps(_sum0, 1)));
+#else
+    __m128 _sum1 = _mm_setzero_ps();
+    __m128 _sum2 = _mm_setzero_ps();
+    __m128 _sum3 = _mm_setzero_ps();
+    for (; i + 3 < n; i += 4)
+    {
+        _H = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _mm_load1_ps(x + i), _H);
+        _sum1 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 4), _mm_load1_ps(x + i + 1), _sum1);
+        _sum2 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 8), _mm_load1_ps(x + i + 2), _sum2);
+        _sum3 = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr + 12), _mm_load1_ps(x + i + 3), _sum3);
+
+        kptr += 16;
+    }
+    _H = _mm_add_ps(_mm_add_ps(_H, _sum1), _mm_add_ps(_sum2, _sum3));
+#endif
+    for (; i < n; i++)
+    {
+        _H = _mm_comp_fmadd_ps(_mm_loadu_ps(kptr), _mm_load1_ps(x + i), _H);
+
+        kptr += 4;
+    }
+
+    return _H;
+}
+#endif // __SSE2__
+
+static int rnn(const Mat& bottom_blob, Mat& top_blob, int reverse, const Mat& weight_xc, const Mat& bias_c, const Mat& weight_hc, Mat& hidden_state, const Option& opt)
+{
+    int size = bottom_blob.w;
+    int T = bottom_blob.h;
+
+    int num_output = top_blob.w;
+
+    // num_output
+    Mat gates(num_output, 4u, opt.workspace_allocator);
+    if (gates.empty())
+        return -100;
+
+    // unroll
+    for (int t = 0; t < T; t++)
+    {
+        int ti = reverse ? T - 1 - t : t;
+
+        const float* x = bottom_blob.row(ti);
+        const float* hidden_ptr = hidden_state;
+
+        int remain_num_output_start = 0;
+#if __SSE2__
+        int nn_num_output = num_output >> 2;
+        remain_num_output_start = nn_num_output << 2;
+
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int qq = 0; qq < nn_num_output; qq++)
+        {
+            int q = qq * 4;
+
+            const float* weight_xc_ptr = weight_xc.row(q / 4);
+            const float* weight_hc_ptr = weight_hc.row(q / 4);
+
+            __m128 _H = _mm_loadu_ps((const float*)bias_c + q);
+
+            _H = rnn_fmadd_pack4(x, weight_xc_ptr, size, _H);
+            _H = rnn_fmadd_pack4(hidden_ptr, weight_hc_ptr, num_output, _H);
+
+            _H = tanh_sse(_H);
+
+            _mm_storeu_ps((float*)gates + q, _H);
+        }
+#endif // __SSE2__
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int q = remain_num_output_start; q < num_output; q++)
+        {
+#if __SSE2__
+            const float* weight_xc_ptr = weight_xc.row(q / 4 + q % 4);
+            const float* weight_hc_ptr = weight_hc.row(q / 4 + q % 4);
+#else
+            const float* weight_xc_ptr = weight_xc.row(q);
+            const float* weight_hc_ptr = weight_hc.row(q);
+#endif
+
+            float H = bias_c[q];
+
+            for (int i = 0; i < size; i++)
+            {
+                H += weight_xc_ptr[i] * x[i];
+            }
+
+            for (int i = 0; i < num_output; i++)
+            {
+                H += weight_hc_ptr[i] * hidden_ptr[i];
+            }
+
+            H = tanh(H);
+
+            gates[q] = H;
+        }
+
+        float* output_data = top_blob.row(ti);
+
+        memcpy((float*)hidden_state, (const float*)gates, num_output * sizeof(float));
+        memcpy(output_data, (const float*)gates, num_output * sizeof(float));
+    }
+
+    return 0;
+}
+
+int RNN_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    int T = bottom_blob.h;
+
+    int num_directions = direction == 2 ? 2 : 1;
+
+    // initial hidden state
+    Mat hidden(num_output, 4u, opt.workspace_allocator);
+    if (hidden.empty())
+        return -100;
+    hidden.fill(0.f);
+
+    top_blob.create(num_output * num_directions, T, 4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    // Uni directional
+    if (direction == 0 || direction == 1)
+    {
+        int ret = rnn(bottom_blob, top_blob, direction, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (direction == 2)
+    {
+        Mat top_blob_forward(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_forward.empty())
+            return -100;
+
+        Mat top_blob_reverse(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_reverse.empty())
+            return -100;
+
+        int ret0 = rnn(bottom_blob, top_blob_forward, 0, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret0 != 0)
+            return ret0;
+
+        hidden.fill(0.0f);
+
+        int ret1 = rnn(bottom_blob, top_blob_reverse, 1, weight_xc_data_packed.channel(1), bias_c_data_packed.channel(1), weight_hc_data_packed.channel(1), hidden, opt);
+        if (ret1 != 0)
+            return ret1;
+
+        // concat w
+        for (int i = 0; i < T; i++)
+        {
+            const float* pf = top_blob_forward.row(i);
+            const float* pr = top_blob_reverse.row(i);
+            float* ptr = top_blob.row(i);
+
+            memcpy(ptr, pf, num_output * sizeof(float));
+            memcpy(ptr + num_output, pr, num_output * sizeof(float));
+        }
+    }
+
+    return 0;
+}
+
+int RNN_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& bottom_blob = bottom_blobs[0];
+    int T = bottom_blob.h;
+    int num_directions = direction == 2 ? 2 : 1;
+
+    Mat hidden;
+    Allocator* hidden_allocator = top_blobs.size() == 2 ? opt.blob_allocator : opt.workspace_allocator;
+    if (bottom_blobs.size() == 2)
+    {
+        // a state top sharing its bottom is updated in place
+        const bool inplace = top_blobs.size() == 2 && top_blobs[1].data == bottom_blobs[1].data;
+        hidden = inplace ? bottom_blobs[1] : bottom_blobs[1].clone(hidden_allocator);
+    }
+    else
+    {
+        hidden.create(num_output, num_directions, 4u, hidden_allocator);
+        if (hidden.empty())
+            return -100;
+        hidden.fill(0.f);
+    }
+
+    Mat& top_blob = top_blobs[0];
+    top_blob.create(num_output * num_directions, T, 4u, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    // Uni directional
+    if (direction == 0 || direction == 1)
+    {
+        int ret = rnn(bottom_blob, top_blob, direction, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (direction == 2)
+    {
+        Mat top_blob_forward(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_forward.empty())
+            return -100;
+
+        Mat top_blob_reverse(num_output, T, 4u, opt.workspace_allocator);
+        if (top_blob_reverse.empty())
+            return -100;
+
+        Mat hidden0 = hidden.row_range(0, 1);
+        int ret0 = rnn(bottom_blob, top_blob_forward, 0, weight_xc_data_packed.channel(0), bias_c_data_packed.channel(0), weight_hc_data_packed.channel(0), hidden0, opt);
+        if (ret0 != 0)
+            return ret0;
+
+        Mat hidden1 = hidden.row_range(1, 1);
+        int ret1 = rnn(bottom_blob, top_blob_reverse, 1, weight_xc_data_packed.channel(1), bias_c_data_packed.channel(1), weight_hc_data_packed.channel(1), hidden1, opt);
+        if (ret1 != 0)
+            return ret1;
+
+        // concat w
+        for (int i = 0; i < T; i++)
+        {
+            const float* pf = top_blob_forward.row(i);
+            const float* pr = top_blob_reverse.row(i);
+            float* ptr = top_blob.row(i);
+
+            memcpy(ptr, pf, num_output * sizeof(float));
+            memcpy(ptr + num_output, pr, num_output * sizeof(float));
+        }
+    }
+
+    if (top_blobs.size() == 2)
+    {
+        top_blobs[1] = hidden;
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
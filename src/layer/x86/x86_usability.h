@@ -537,6 +537,8 @@ static NCNN_FORCEINLINE __m256 bfloat2float_avx(const __m128i& v0)
 {
 #if __AVX512BF16__
     __m256 _v = _mm256_cvtpbh_ps((__m128bh)v0);
+#elif __AVX2__
+    __m256 _v = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(v0), 16));
 #else
     __m128i _zero = _mm_setzero_si128();
     __m128i _a = _mm_unpacklo_epi16(_zero, v0);
@@ -990,12 +992,7 @@ static NCNN_FORCEINLINE __m512 bfloat2float_avx512(const __m256i& v0)
 #if __AVX512BF16__
     __m512 _v = _mm512_cvtpbh_ps((__m256bh)v0);
 #else
-    __m256i _zero = _mm256_setzero_si256();
-    __m256i _a = _mm256_unpacklo_epi16(_zero, v0);
-    __m256i _b = _mm256_unpackhi_epi16(_zero, v0);
-    __m256i _c = _mm256_permute2x128_si256(_a, _b, _MM_SHUFFLE(0, 2, 0, 0));
-    __m256i _d = _mm256_permute2x128_si256(_a, _b, _MM_SHUFFLE(0, 3, 0, 1));
-    __m512 _v = _mm512_castsi512_ps(_mm512_inserti32x8(_mm512_castsi256_si512(_c), _d, 1));
+    __m512 _v = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(v0), 16));
 #endif
     return _v;
 }
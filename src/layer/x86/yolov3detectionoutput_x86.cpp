@@ -11,11 +11,20 @@
 // under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
 // CONDITIONS OF ANY KIND, either express or implied. See the License for the
 // specific language governing permissions and limitations under the License.
+
+#include "yolov3detectionoutput_x86.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "sse_mathfun.h"
 #if __AVX__
 #include <immintrin.h>
-#endif
+#include "avx_mathfun.h"
+#endif // __AVX__
+#endif // __SSE2__
 
-#include "yolov3detectionoutput_x86.h"
+#include "detection_postprocess.h"
+#include "detection_nms.h"
 
 #include <float.h>
 #include <math.h>
@@ -66,92 +75,102 @@ int Yolov3DetectionOutput_x86::forward(const std::vector<Mat>& bottom_blobs, std
             const float bias_w = biases[biases_index * 2];
             const float bias_h = biases[biases_index * 2 + 1];
             //printf("%f %f\n", bias_w, bias_h);
-            const float* xptr = bottom_top_blobs.channel(p);
-            const float* yptr = bottom_top_blobs.channel(p + 1);
-            const float* wptr = bottom_top_blobs.channel(p + 2);
-            const float* hptr = bottom_top_blobs.channel(p + 3);
-
-            const float* box_score_ptr = bottom_top_blobs.channel(p + 4);
 
             // softmax class scores
             Mat scores = bottom_top_blobs.channel_range(p + 5, num_class);
             //softmax->forward_inplace(scores, opt);
 
-            const int cs = scores.cstep;
-
-#if __AVX2__
-            const __m256i vi = _mm256_setr_epi32(
-                                   0, cs * 1, cs * 2, cs * 3, cs * 4, cs * 5, cs * 6, cs * 7);
-#endif
+            std::vector<float> row_confidence(w);
+            std::vector<int> row_class_index(w);
 
             for (int i = 0; i < h; i++)
             {
-                for (int j = 0; j < w; j++)
+                const float* xptr = bottom_top_blobs.channel(p).row(i);
+                const float* yptr = bottom_top_blobs.channel(p + 1).row(i);
+                const float* wptr = bottom_top_blobs.channel(p + 2).row(i);
+                const float* hptr = bottom_top_blobs.channel(p + 3).row(i);
+                const float* box_score_ptr = bottom_top_blobs.channel(p + 4).row(i);
+                const float* scoreptr = scores.row(i);
+
+                // find class index with max class score and the confidence of every position in the row
+                // the class scores of one row are contiguous so a vector of positions compares one class at a time
+                int j = 0;
+#if __SSE2__
+#if __AVX__
+                for (; j + 7 < w; j += 8)
                 {
-#if 0
-                    int class_index = 0;
-                    float class_score = -FLT_MAX;
-                    for (int q = 0; q < num_class; q++)
+                    __m256 _class_score = _mm256_loadu_ps(scoreptr + j);
+                    __m256 _class_index = _mm256_setzero_ps();
+                    for (int q = 1; q < num_class; q++)
                     {
-                        float score = scores.channel(q).row(i)[j];
-                        if (score > class_score)
-                        {
-                            class_index = q;
-                            class_score = score;
-                        }
+                        __m256 _score = _mm256_loadu_ps(scoreptr + scores.cstep * q + j);
+                        __m256 _gt = _mm256_cmp_ps(_score, _class_score, _CMP_GT_OQ);
+                        _class_score = _mm256_blendv_ps(_class_score, _score, _gt);
+                        _class_index = _mm256_blendv_ps(_class_index, _mm256_set1_ps((float)q), _gt);
                     }
-#else
-                    // find class index with max class score
+
+                    //sigmoid(box_score) * sigmoid(class_score)
+                    __m256 _one = _mm256_set1_ps(1.f);
+                    __m256 _box_exp = exp256_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(box_score_ptr + j)));
+                    __m256 _class_exp = exp256_ps(_mm256_sub_ps(_mm256_setzero_ps(), _class_score));
+                    __m256 _confidence = _mm256_div_ps(_one, _mm256_add_ps(_one, _mm256_mul_ps(_box_exp, _mm256_add_ps(_one, _class_exp))));
+
+                    _mm256_storeu_ps(&row_confidence[j], _confidence);
+                    _mm256_storeu_si256((__m256i*)&row_class_index[j], _mm256_cvttps_epi32(_class_index));
+                }
+#endif // __AVX__
+                for (; j + 3 < w; j += 4)
+                {
+                    __m128 _class_score = _mm_loadu_ps(scoreptr + j);
+                    __m128 _class_index = _mm_setzero_ps();
+                    for (int q = 1; q < num_class; q++)
+                    {
+                        __m128 _score = _mm_loadu_ps(scoreptr + scores.cstep * q + j);
+                        __m128 _gt = _mm_cmpgt_ps(_score, _class_score);
+                        _class_score = _mm_or_ps(_mm_and_ps(_gt, _score), _mm_andnot_ps(_gt, _class_score));
+                        _class_index = _mm_or_ps(_mm_and_ps(_gt, _mm_set1_ps((float)q)), _mm_andnot_ps(_gt, _class_index));
+                    }
+
+                    //sigmoid(box_score) * sigmoid(class_score)
+                    __m128 _one = _mm_set1_ps(1.f);
+                    __m128 _box_exp = exp_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(box_score_ptr + j)));
+                    __m128 _class_exp = exp_ps(_mm_sub_ps(_mm_setzero_ps(), _class_score));
+                    __m128 _confidence = _mm_div_ps(_one, _mm_add_ps(_one, _mm_mul_ps(_box_exp, _mm_add_ps(_one, _class_exp))));
+
+                    _mm_storeu_ps(&row_confidence[j], _confidence);
+                    _mm_storeu_si128((__m128i*)&row_class_index[j], _mm_cvttps_epi32(_class_index));
+                }
+#endif // __SSE2__
+                for (; j < w; j++)
+                {
                     int class_index = 0;
                     float class_score = -FLT_MAX;
-                    float* ptr = ((float*)scores.data) + i * w + j;
-                    float* end = ptr + num_class * cs;
-                    int q = 0;
-#if __AVX2__
-                    float* end8 = ptr + (num_class & -8) * cs;
-                    unsigned long index;
-
-                    for (; ptr < end8; ptr += 8 * cs, q += 8)
+                    for (int q = 0; q < num_class; q++)
                     {
-                        __m256 p = _mm256_i32gather_ps(ptr, vi, 4);
-                        __m256 t = _mm256_max_ps(p, _mm256_permute2f128_ps(p, p, 1));
-                        t = _mm256_max_ps(t, _mm256_permute_ps(t, 0x4e));
-                        t = _mm256_max_ps(t, _mm256_permute_ps(t, 0xb1));
-                        float score = _mm_cvtss_f32(_mm256_extractf128_ps(t, 0));
-
+                        float score = scoreptr[scores.cstep * q + j];
                         if (score > class_score)
                         {
-                            __m256 mi = _mm256_cmp_ps(p, t, _CMP_EQ_OQ);
-                            int mask = _mm256_movemask_ps(mi);
-#ifdef _MSC_VER
-                            BitScanForward(&index, mask);
-#else
-                            index = __builtin_ctz(mask);
-#endif
-                            class_index = q + index;
+                            class_index = q;
                             class_score = score;
                         }
                     }
-#endif
 
-                    for (; ptr < end; ptr += cs, q++)
-                    {
-                        if (*ptr > class_score)
-                        {
-                            class_index = q;
-                            class_score = *ptr;
-                        }
-                    }
-#endif
                     //sigmoid(box_score) * sigmoid(class_score)
-                    float confidence = 1.f / ((1.f + exp(-box_score_ptr[0]) * (1.f + exp(-class_score))));
+                    row_confidence[j] = 1.f / ((1.f + exp(-box_score_ptr[j]) * (1.f + exp(-class_score))));
+                    row_class_index[j] = class_index;
+                }
+
+                // only the boxes passing the threshold are decoded
+                for (j = 0; j < w; j++)
+                {
+                    float confidence = row_confidence[j];
                     if (confidence >= confidence_threshold)
                     {
                         // region box
-                        float bbox_cx = (j + sigmoid(xptr[0])) / w;
-                        float bbox_cy = (i + sigmoid(yptr[0])) / h;
-                        float bbox_w = static_cast<float>(exp(wptr[0]) * bias_w / net_w);
-                        float bbox_h = static_cast<float>(exp(hptr[0]) * bias_h / net_h);
+                        float bbox_cx = (j + sigmoid(xptr[j])) / w;
+                        float bbox_cy = (i + sigmoid(yptr[j])) / h;
+                        float bbox_w = static_cast<float>(exp(wptr[j]) * bias_w / net_w);
+                        float bbox_h = static_cast<float>(exp(hptr[j]) * bias_h / net_h);
 
                         float bbox_xmin = bbox_cx - bbox_w * 0.5f;
                         float bbox_ymin = bbox_cy - bbox_h * 0.5f;
@@ -160,16 +179,9 @@ int Yolov3DetectionOutput_x86::forward(const std::vector<Mat>& bottom_blobs, std
 
                         float area = bbox_w * bbox_h;
 
-                        BBoxRect c = {confidence, bbox_xmin, bbox_ymin, bbox_xmax, bbox_ymax, area, class_index};
+                        BBoxRect c = {confidence, bbox_xmin, bbox_ymin, bbox_xmax, bbox_ymax, area, row_class_index[j]};
                         all_box_bbox_rects[pp].push_back(c);
                     }
-
-                    xptr++;
-                    yptr++;
-                    wptr++;
-                    hptr++;
-
-                    box_score_ptr++;
                 }
             }
         }
@@ -182,19 +194,40 @@ int Yolov3DetectionOutput_x86::forward(const std::vector<Mat>& bottom_blobs, std
         }
     }
 
-    // global sort inplace
-    qsort_descent_inplace(all_bbox_rects);
+    // global sort
+    std::vector<float> all_bbox_scores(all_bbox_rects.size());
+    for (size_t i = 0; i < all_bbox_rects.size(); i++)
+    {
+        all_bbox_scores[i] = all_bbox_rects[i].score;
+    }
+
+    std::vector<int> order;
+    detection_topk(all_bbox_scores, 0, order);
+
+    const int n = (int)order.size();
+    std::vector<float> xmin(n);
+    std::vector<float> ymin(n);
+    std::vector<float> xmax(n);
+    std::vector<float> ymax(n);
+    for (int i = 0; i < n; i++)
+    {
+        const BBoxRect& r = all_bbox_rects[order[i]];
+        xmin[i] = r.xmin;
+        ymin[i] = r.ymin;
+        xmax[i] = r.xmax;
+        ymax[i] = r.ymax;
+    }
 
     // apply nms
-    std::vector<size_t> picked;
-    nms_sorted_bboxes(all_bbox_rects, picked, nms_threshold);
+    std::vector<int> picked;
+    detection_nms_sorted_sse(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked);
 
     // select
     std::vector<BBoxRect> bbox_rects;
 
     for (size_t i = 0; i < picked.size(); i++)
     {
-        size_t z = picked[i];
+        int z = order[picked[i]];
         bbox_rects.push_back(all_bbox_rects[z]);
     }
 
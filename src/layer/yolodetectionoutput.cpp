@@ -16,6 +16,8 @@
 
 #include "layer_type.h"
 
+#include "detection_postprocess.h"
+
 #include <math.h>
 
 namespace ncnn {
@@ -24,6 +26,8 @@ YoloDetectionOutput::YoloDetectionOutput()
 {
     one_blob_only = false;
     support_inplace = true;
+
+    nms_sorted = detection_nms_sorted;
 }
 
 int YoloDetectionOutput::load_param(const ParamDict& pd)
@@ -74,101 +78,6 @@ struct BBoxRect
     int label;
 };
 
-static inline float intersection_area(const BBoxRect& a, const BBoxRect& b)
-{
-    if (a.xmin > b.xmax || a.xmax < b.xmin || a.ymin > b.ymax || a.ymax < b.ymin)
-    {
-        // no intersection
-        return 0.f;
-    }
-
-    float inter_width = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
-    float inter_height = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
-
-    return inter_width * inter_height;
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores, int left, int right)
-{
-    int i = left;
-    int j = right;
-    float p = scores[(left + right) / 2];
-
-    while (i <= j)
-    {
-        while (scores[i] > p)
-            i++;
-
-        while (scores[j] < p)
-            j--;
-
-        if (i <= j)
-        {
-            // swap
-            std::swap(datas[i], datas[j]);
-            std::swap(scores[i], scores[j]);
-
-            i++;
-            j--;
-        }
-    }
-
-    if (left < j)
-        qsort_descent_inplace(datas, scores, left, j);
-
-    if (i < right)
-        qsort_descent_inplace(datas, scores, i, right);
-}
-
-template<typename T>
-static void qsort_descent_inplace(std::vector<T>& datas, std::vector<float>& scores)
-{
-    if (datas.empty() || scores.empty())
-        return;
-
-    qsort_descent_inplace(datas, scores, 0, static_cast<int>(scores.size() - 1));
-}
-
-static void nms_sorted_bboxes(const std::vector<BBoxRect>& bboxes, std::vector<size_t>& picked, float nms_threshold)
-{
-    picked.clear();
-
-    const size_t n = bboxes.size();
-
-    std::vector<float> areas(n);
-    for (size_t i = 0; i < n; i++)
-    {
-        const BBoxRect& r = bboxes[i];
-
-        float width = r.xmax - r.xmin;
-        float height = r.ymax - r.ymin;
-
-        areas[i] = width * height;
-    }
-
-    for (size_t i = 0; i < n; i++)
-    {
-        const BBoxRect& a = bboxes[i];
-
-        int keep = 1;
-        for (int j = 0; j < (int)picked.size(); j++)
-        {
-            const BBoxRect& b = bboxes[picked[j]];
-
-            // intersection over union
-            float inter_area = intersection_area(a, b);
-            float union_area = areas[i] + areas[picked[j]] - inter_area;
-            //             float IoU = inter_area / union_area
-            if (inter_area / union_area > nms_threshold)
-                keep = 0;
-        }
-
-        if (keep)
-            picked.push_back(i);
-    }
-}
-
 static inline float sigmoid(float x)
 {
     return static_cast<float>(1.f / (1.f + exp(-x)));
@@ -279,12 +188,27 @@ int YoloDetectionOutput::forward_inplace(std::vector<Mat>& bottom_top_blobs, con
         }
     }
 
-    // global sort inplace
-    qsort_descent_inplace(all_bbox_rects, all_bbox_scores);
+    // global sort
+    std::vector<int> order;
+    detection_topk(all_bbox_scores, 0, order);
+
+    const int n = (int)order.size();
+    std::vector<float> xmin(n);
+    std::vector<float> ymin(n);
+    std::vector<float> xmax(n);
+    std::vector<float> ymax(n);
+    for (int i = 0; i < n; i++)
+    {
+        const BBoxRect& r = all_bbox_rects[order[i]];
+        xmin[i] = r.xmin;
+        ymin[i] = r.ymin;
+        xmax[i] = r.xmax;
+        ymax[i] = r.ymax;
+    }
 
     // apply nms
-    std::vector<size_t> picked;
-    nms_sorted_bboxes(all_bbox_rects, picked, nms_threshold);
+    std::vector<int> picked;
+    nms_sorted(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked, 0);
 
     // select
     std::vector<BBoxRect> bbox_rects;
@@ -292,7 +216,7 @@ int YoloDetectionOutput::forward_inplace(std::vector<Mat>& bottom_top_blobs, con
 
     for (size_t i = 0; i < picked.size(); i++)
     {
-        size_t z = picked[i];
+        int z = order[picked[i]];
         bbox_rects.push_back(all_bbox_rects[z]);
         bbox_scores.push_back(all_bbox_scores[z]);
     }
@@ -16,6 +16,8 @@
 
 #include "layer_type.h"
 
+#include "detection_postprocess.h"
+
 #include <float.h>
 #include <math.h>
 
@@ -52,90 +54,6 @@ int Yolov3DetectionOutput::load_param(const ParamDict& pd)
     return 0;
 }
 
-static inline float intersection_area(const Yolov3DetectionOutput::BBoxRect& a, const Yolov3DetectionOutput::BBoxRect& b)
-{
-    if (a.xmin > b.xmax || a.xmax < b.xmin || a.ymin > b.ymax || a.ymax < b.ymin)
-    {
-        // no intersection
-        return 0.f;
-    }
-
-    float inter_width = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
-    float inter_height = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
-
-    return inter_width * inter_height;
-}
-
-void Yolov3DetectionOutput::qsort_descent_inplace(std::vector<BBoxRect>& datas, int left, int right) const
-{
-    int i = left;
-    int j = right;
-    float p = datas[(left + right) / 2].score;
-
-    while (i <= j)
-    {
-        while (datas[i].score > p)
-            i++;
-
-        while (datas[j].score < p)
-            j--;
-
-        if (i <= j)
-        {
-            // swap
-            std::swap(datas[i], datas[j]);
-
-            i++;
-            j--;
-        }
-    }
-
-    if (left < j)
-        qsort_descent_inplace(datas, left, j);
-
-    if (i < right)
-        qsort_descent_inplace(datas, i, right);
-}
-
-void Yolov3DetectionOutput::qsort_descent_inplace(std::vector<BBoxRect>& datas) const
-{
-    if (datas.empty())
-        return;
-
-    qsort_descent_inplace(datas, 0, static_cast<int>(datas.size() - 1));
-}
-
-void Yolov3DetectionOutput::nms_sorted_bboxes(std::vector<BBoxRect>& bboxes, std::vector<size_t>& picked, float nms_threshold) const
-{
-    picked.clear();
-
-    const size_t n = bboxes.size();
-
-    for (size_t i = 0; i < n; i++)
-    {
-        const BBoxRect& a = bboxes[i];
-
-        int keep = 1;
-        for (int j = 0; j < (int)picked.size(); j++)
-        {
-            const BBoxRect& b = bboxes[picked[j]];
-
-            // intersection over union
-            float inter_area = intersection_area(a, b);
-            float union_area = a.area + b.area - inter_area;
-            // float IoU = inter_area / union_area
-            if (inter_area > nms_threshold * union_area)
-            {
-                keep = 0;
-                break;
-            }
-        }
-
-        if (keep)
-            picked.push_back(i);
-    }
-}
-
 static inline float sigmoid(float x)
 {
     return static_cast<float>(1.f / (1.f + exp(-x)));
@@ -243,19 +161,40 @@ int Yolov3DetectionOutput::forward(const std::vector<Mat>& bottom_blobs, std::ve
         }
     }
 
-    // global sort inplace
-    qsort_descent_inplace(all_bbox_rects);
+    // global sort
+    std::vector<float> all_bbox_scores(all_bbox_rects.size());
+    for (size_t i = 0; i < all_bbox_rects.size(); i++)
+    {
+        all_bbox_scores[i] = all_bbox_rects[i].score;
+    }
+
+    std::vector<int> order;
+    detection_topk(all_bbox_scores, 0, order);
+
+    const int n = (int)order.size();
+    std::vector<float> xmin(n);
+    std::vector<float> ymin(n);
+    std::vector<float> xmax(n);
+    std::vector<float> ymax(n);
+    for (int i = 0; i < n; i++)
+    {
+        const BBoxRect& r = all_bbox_rects[order[i]];
+        xmin[i] = r.xmin;
+        ymin[i] = r.ymin;
+        xmax[i] = r.xmax;
+        ymax[i] = r.ymax;
+    }
 
     // apply nms
-    std::vector<size_t> picked;
-    nms_sorted_bboxes(all_bbox_rects, picked, nms_threshold);
+    std::vector<int> picked;
+    detection_nms_sorted(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked);
 
     // select
     std::vector<BBoxRect> bbox_rects;
 
     for (size_t i = 0; i < picked.size(); i++)
     {
-        size_t z = picked[i];
+        int z = order[picked[i]];
         bbox_rects.push_back(all_bbox_rects[z]);
     }
 
@@ -51,10 +51,6 @@ public:
         float area;
         int label;
     };
-
-    void qsort_descent_inplace(std::vector<BBoxRect>& datas, int left, int right) const;
-    void qsort_descent_inplace(std::vector<BBoxRect>& datas) const;
-    void nms_sorted_bboxes(std::vector<BBoxRect>& bboxes, std::vector<size_t>& picked, float nms_threshold) const;
 };
 
 } // namespace ncnn
@@ -280,6 +280,11 @@ public:
     static Mat from_pixels_roi_resize(const unsigned char* pixels, int type, int w, int h, int roix, int roiy, int roiw, int roih, int target_width, int target_height, Allocator* allocator = 0);
     // convenient construct from pixel data roi and resize to specific size with stride(bytes-per-row) parameter
     static Mat from_pixels_roi_resize(const unsigned char* pixels, int type, int w, int h, int stride, int roix, int roiy, int roiw, int roih, int target_width, int target_height, Allocator* allocator = 0);
+    // convenient construct from pixel data roi, resize, substract mean and normalize, then pack and cast in a single pass
+    // the result equals from_pixels_roi_resize + substract_mean_normalize + convert_packing + cast
+    // elempack must divide the channel count, cast_type 1=float32 2=float16 3=int8 4=bfloat16 as in the Cast layer
+    // opt.num_threads and opt.blob_allocator are used
+    static Mat from_pixels_roi_resize_normalize(const unsigned char* pixels, int type, int w, int h, int stride, int roix, int roiy, int roiw, int roih, int target_width, int target_height, const float* mean_vals, const float* norm_vals, int elempack = 1, int cast_type = 1, const Option& opt = Option());
 
     // convenient export to pixel data
     void to_pixels(unsigned char* pixels, int type) const;
@@ -19,11 +19,121 @@
 #if __ARM_NEON
 #include <arm_neon.h>
 #endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 #include "platform.h"
 
 namespace ncnn {
 
 #if NCNN_PIXEL
+#if __SSE2__
+static NCNN_FORCEINLINE void loadu_ps16(const float* ptr, __m128 _v[4])
+{
+    _v[0] = _mm_loadu_ps(ptr);
+    _v[1] = _mm_loadu_ps(ptr + 4);
+    _v[2] = _mm_loadu_ps(ptr + 8);
+    _v[3] = _mm_loadu_ps(ptr + 12);
+}
+
+static NCNN_FORCEINLINE void storeu_ps16(float* ptr, const __m128 _v[4])
+{
+    _mm_storeu_ps(ptr, _v[0]);
+    _mm_storeu_ps(ptr + 4, _v[1]);
+    _mm_storeu_ps(ptr + 8, _v[2]);
+    _mm_storeu_ps(ptr + 12, _v[3]);
+}
+
+static NCNN_FORCEINLINE void cvt_u8x16_ps(__m128i _v, __m128 _f[4])
+{
+    __m128i _zero = _mm_setzero_si128();
+    __m128i _lo = _mm_unpacklo_epi8(_v, _zero);
+    __m128i _hi = _mm_unpackhi_epi8(_v, _zero);
+    _f[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_lo, _zero));
+    _f[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(_lo, _zero));
+    _f[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_hi, _zero));
+    _f[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(_hi, _zero));
+}
+
+// truncate and saturate the same way as SATURATE_CAST_UCHAR
+static NCNN_FORCEINLINE __m128i cvt_ps_u8x16(const __m128 _f[4])
+{
+    __m128i _lo = _mm_packs_epi32(_mm_cvttps_epi32(_f[0]), _mm_cvttps_epi32(_f[1]));
+    __m128i _hi = _mm_packs_epi32(_mm_cvttps_epi32(_f[2]), _mm_cvttps_epi32(_f[3]));
+    return _mm_packus_epi16(_lo, _hi);
+}
+
+static NCNN_FORCEINLINE void load_u8x16_ps(const unsigned char* ptr, __m128 _f[4])
+{
+    cvt_u8x16_ps(_mm_loadu_si128((const __m128i*)ptr), _f);
+}
+
+static NCNN_FORCEINLINE void store_ps_u8x16(unsigned char* ptr, const __m128 _f[4])
+{
+    _mm_storeu_si128((__m128i*)ptr, cvt_ps_u8x16(_f));
+}
+
+// 16 pixels of 3 interleaved channels
+static NCNN_FORCEINLINE void load_u8x16c3_ps(const unsigned char* ptr, __m128 _c0[4], __m128 _c1[4], __m128 _c2[4])
+{
+    __m128 _p[12];
+    load_u8x16_ps(ptr, _p);
+    load_u8x16_ps(ptr + 16, _p + 4);
+    load_u8x16_ps(ptr + 32, _p + 8);
+
+    for (int k = 0; k < 4; k++)
+    {
+        // a b c = c0 c1 c2 c0 | c1 c2 c0 c1 | c2 c0 c1 c2
+        __m128 _a = _p[k * 3];
+        __m128 _b = _p[k * 3 + 1];
+        __m128 _c = _p[k * 3 + 2];
+        _c0[k] = _mm_shuffle_ps(_a, _mm_shuffle_ps(_b, _c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        _c1[k] = _mm_shuffle_ps(_mm_shuffle_ps(_a, _b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(_b, _c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        _c2[k] = _mm_shuffle_ps(_mm_shuffle_ps(_a, _b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(_c, _c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+}
+
+static NCNN_FORCEINLINE void store_ps_u8x16c3(unsigned char* ptr, const __m128 _c0[4], const __m128 _c1[4], const __m128 _c2[4])
+{
+    __m128 _p[12];
+    for (int k = 0; k < 4; k++)
+    {
+        _p[k * 3] = _mm_shuffle_ps(_mm_shuffle_ps(_c0[k], _c1[k], _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(_c2[k], _c0[k], _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        _p[k * 3 + 1] = _mm_shuffle_ps(_mm_shuffle_ps(_c1[k], _c2[k], _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(_c0[k], _c1[k], _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        _p[k * 3 + 2] = _mm_shuffle_ps(_mm_shuffle_ps(_c2[k], _c0[k], _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(_c1[k], _c2[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    store_ps_u8x16(ptr, _p);
+    store_ps_u8x16(ptr + 16, _p + 4);
+    store_ps_u8x16(ptr + 32, _p + 8);
+}
+
+// 16 pixels of 4 interleaved channels
+static NCNN_FORCEINLINE void load_u8x16c4_ps(const unsigned char* ptr, __m128 _c0[4], __m128 _c1[4], __m128 _c2[4], __m128 _c3[4])
+{
+    for (int k = 0; k < 4; k++)
+    {
+        __m128 _p[4];
+        load_u8x16_ps(ptr + k * 16, _p);
+        _MM_TRANSPOSE4_PS(_p[0], _p[1], _p[2], _p[3]);
+        _c0[k] = _p[0];
+        _c1[k] = _p[1];
+        _c2[k] = _p[2];
+        _c3[k] = _p[3];
+    }
+}
+
+static NCNN_FORCEINLINE void store_ps_u8x16c4(unsigned char* ptr, const __m128 _c0[4], const __m128 _c1[4], const __m128 _c2[4], const __m128 _c3[4])
+{
+    for (int k = 0; k < 4; k++)
+    {
+        __m128 _p[4] = {_c0[k], _c1[k], _c2[k], _c3[k]};
+        _MM_TRANSPOSE4_PS(_p[0], _p[1], _p[2], _p[3]);
+        store_ps_u8x16(ptr + k * 16, _p);
+    }
+}
+#endif // __SSE2__
+
 static int from_rgb(const unsigned char* rgb, int w, int h, int stride, Mat& m, Allocator* allocator)
 {
     m.create(w, h, 3, 4u, allocator);
@@ -46,6 +156,9 @@ static int from_rgb(const unsigned char* rgb, int w, int h, int stride, Mat& m,
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -118,6 +231,20 @@ static int from_rgb(const unsigned char* rgb, int w, int h, int stride, Mat& m,
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9", "q10");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4];
+            load_u8x16c3_ps(rgb, _r, _g, _b);
+            storeu_ps16(ptr0, _r);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _b);
+
+            rgb += 3 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -160,6 +287,9 @@ static void to_rgb(const Mat& m, unsigned char* rgb, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -190,6 +320,20 @@ static void to_rgb(const Mat& m, unsigned char* rgb, int stride)
             ptr1 += 8;
             ptr2 += 8;
         }
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4];
+            loadu_ps16(ptr0, _r);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _b);
+            store_ps_u8x16c3(rgb, _r, _g, _b);
+
+            rgb += 3 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -228,6 +372,9 @@ static int from_gray(const unsigned char* gray, int w, int h, int stride, Mat& m
 #if __ARM_NEON
         int nn = w >> 4;
         int remain = w - (nn << 4);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -283,6 +430,16 @@ static int from_gray(const unsigned char* gray, int w, int h, int stride, Mat& m
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _gray[4];
+            load_u8x16_ps(gray, _gray);
+            storeu_ps16(ptr, _gray);
+
+            gray += 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -319,6 +476,9 @@ static void to_gray(const Mat& m, unsigned char* gray, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -338,6 +498,16 @@ static void to_gray(const Mat& m, unsigned char* gray, int stride)
             gray += 8;
             ptr += 8;
         }
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _gray[4];
+            loadu_ps16(ptr, _gray);
+            store_ps_u8x16(gray, _gray);
+
+            gray += 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -375,6 +545,9 @@ static int from_rgba(const unsigned char* rgba, int w, int h, int stride, Mat& m
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -461,6 +634,22 @@ static int from_rgba(const unsigned char* rgba, int w, int h, int stride, Mat& m
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            load_u8x16c4_ps(rgba, _r, _g, _b, _a);
+            storeu_ps16(ptr0, _r);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _b);
+            storeu_ps16(ptr3, _a);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+            ptr3 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -506,6 +695,9 @@ static void to_rgba(const Mat& m, unsigned char* rgba, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -541,6 +733,22 @@ static void to_rgba(const Mat& m, unsigned char* rgba, int stride)
             ptr2 += 8;
             ptr3 += 8;
         }
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            loadu_ps16(ptr0, _r);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _b);
+            loadu_ps16(ptr3, _a);
+            store_ps_u8x16c4(rgba, _r, _g, _b, _a);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+            ptr3 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -583,6 +791,9 @@ static int from_rgb2bgr(const unsigned char* rgb, int w, int h, int stride, Mat&
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -655,6 +866,20 @@ static int from_rgb2bgr(const unsigned char* rgb, int w, int h, int stride, Mat&
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9", "q10");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4];
+            load_u8x16c3_ps(rgb, _r, _g, _b);
+            storeu_ps16(ptr0, _b);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _r);
+
+            rgb += 3 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -697,6 +922,9 @@ static void to_bgr2rgb(const Mat& m, unsigned char* rgb, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -727,6 +955,20 @@ static void to_bgr2rgb(const Mat& m, unsigned char* rgb, int stride)
             ptr1 += 8;
             ptr2 += 8;
         }
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _b[4], _g[4], _r[4];
+            loadu_ps16(ptr0, _b);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _r);
+            store_ps_u8x16c3(rgb, _r, _g, _b);
+
+            rgb += 3 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -771,6 +1013,9 @@ static int from_rgb2gray(const unsigned char* rgb, int w, int h, int stride, Mat
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -831,6 +1076,23 @@ static int from_rgb2gray(const unsigned char* rgb, int w, int h, int stride, Mat
                 : "cc", "memory", "q0", "q1", "q2", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128 _R2Y = _mm_set1_ps(R2Y);
+        __m128 _G2Y = _mm_set1_ps(G2Y);
+        __m128 _B2Y = _mm_set1_ps(B2Y);
+        for (; nn > 0; nn--)
+        {
+            __m128 _c0[4], _c1[4], _c2[4];
+            load_u8x16c3_ps(rgb, _c0, _c1, _c2);
+            for (int k = 0; k < 4; k++)
+            {
+                __m128 _y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_c0[k], _R2Y), _mm_mul_ps(_c1[k], _G2Y)), _mm_mul_ps(_c2[k], _B2Y));
+                _mm_storeu_ps(ptr + k * 4, _mm_cvtepi32_ps(_mm_srli_epi32(_mm_cvttps_epi32(_y), Y_shift)));
+            }
+
+            rgb += 3 * 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -884,6 +1146,9 @@ static void to_rgb2rgba(const Mat& m, unsigned char* rgba, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -916,6 +1181,22 @@ static void to_rgb2rgba(const Mat& m, unsigned char* rgba, int stride)
             ptr1 += 8;
             ptr2 += 8;
         }
+#elif __SSE2__
+        __m128 _alpha[4];
+        _alpha[0] = _alpha[1] = _alpha[2] = _alpha[3] = _mm_set1_ps(255.f);
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4];
+            loadu_ps16(ptr0, _r);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _b);
+            store_ps_u8x16c4(rgba, _r, _g, _b, _alpha);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -961,6 +1242,9 @@ static int from_bgr2gray(const unsigned char* bgr, int w, int h, int stride, Mat
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1021,6 +1305,23 @@ static int from_bgr2gray(const unsigned char* bgr, int w, int h, int stride, Mat
                 : "cc", "memory", "q0", "q1", "q2", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128 _R2Y = _mm_set1_ps(R2Y);
+        __m128 _G2Y = _mm_set1_ps(G2Y);
+        __m128 _B2Y = _mm_set1_ps(B2Y);
+        for (; nn > 0; nn--)
+        {
+            __m128 _c0[4], _c1[4], _c2[4];
+            load_u8x16c3_ps(bgr, _c0, _c1, _c2);
+            for (int k = 0; k < 4; k++)
+            {
+                __m128 _y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_c2[k], _R2Y), _mm_mul_ps(_c1[k], _G2Y)), _mm_mul_ps(_c0[k], _B2Y));
+                _mm_storeu_ps(ptr + k * 4, _mm_cvtepi32_ps(_mm_srli_epi32(_mm_cvttps_epi32(_y), Y_shift)));
+            }
+
+            bgr += 3 * 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1074,6 +1375,9 @@ static void to_bgr2rgba(const Mat& m, unsigned char* rgba, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1106,6 +1410,22 @@ static void to_bgr2rgba(const Mat& m, unsigned char* rgba, int stride)
             ptr1 += 8;
             ptr2 += 8;
         }
+#elif __SSE2__
+        __m128 _alpha[4];
+        _alpha[0] = _alpha[1] = _alpha[2] = _alpha[3] = _mm_set1_ps(255.f);
+        for (; nn > 0; nn--)
+        {
+            __m128 _b[4], _g[4], _r[4];
+            loadu_ps16(ptr0, _b);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _r);
+            store_ps_u8x16c4(rgba, _r, _g, _b, _alpha);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1147,6 +1467,9 @@ static int from_gray2rgb(const unsigned char* gray, int w, int h, int stride, Ma
 #if __ARM_NEON
         int nn = w >> 4;
         int remain = w - (nn << 4);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1222,6 +1545,20 @@ static int from_gray2rgb(const unsigned char* gray, int w, int h, int stride, Ma
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _gray[4];
+            load_u8x16_ps(gray, _gray);
+            storeu_ps16(ptr0, _gray);
+            storeu_ps16(ptr1, _gray);
+            storeu_ps16(ptr2, _gray);
+
+            gray += 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1277,6 +1614,9 @@ static void to_gray2rgba(const Mat& m, unsigned char* rgba, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1303,6 +1643,25 @@ static void to_gray2rgba(const Mat& m, unsigned char* rgba, int stride)
             rgba += 4 * 8;
             ptr += 8;
         }
+#elif __SSE2__
+        __m128i _alpha = _mm_set1_epi8(-1);
+        for (; nn > 0; nn--)
+        {
+            __m128 _gray[4];
+            loadu_ps16(ptr, _gray);
+            __m128i _g = cvt_ps_u8x16(_gray);
+            __m128i _gg0 = _mm_unpacklo_epi8(_g, _g);
+            __m128i _gg1 = _mm_unpackhi_epi8(_g, _g);
+            __m128i _ga0 = _mm_unpacklo_epi8(_g, _alpha);
+            __m128i _ga1 = _mm_unpackhi_epi8(_g, _alpha);
+            _mm_storeu_si128((__m128i*)rgba, _mm_unpacklo_epi16(_gg0, _ga0));
+            _mm_storeu_si128((__m128i*)(rgba + 16), _mm_unpackhi_epi16(_gg0, _ga0));
+            _mm_storeu_si128((__m128i*)(rgba + 32), _mm_unpacklo_epi16(_gg1, _ga1));
+            _mm_storeu_si128((__m128i*)(rgba + 48), _mm_unpackhi_epi16(_gg1, _ga1));
+
+            rgba += 4 * 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1343,6 +1702,9 @@ static int from_rgba2rgb(const unsigned char* rgba, int w, int h, int stride, Ma
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1415,6 +1777,20 @@ static int from_rgba2rgb(const unsigned char* rgba, int w, int h, int stride, Ma
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            load_u8x16c4_ps(rgba, _r, _g, _b, _a);
+            storeu_ps16(ptr0, _r);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _b);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1456,6 +1832,9 @@ static int from_rgba2bgr(const unsigned char* rgba, int w, int h, int stride, Ma
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1528,6 +1907,20 @@ static int from_rgba2bgr(const unsigned char* rgba, int w, int h, int stride, Ma
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9", "q10");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            load_u8x16c4_ps(rgba, _r, _g, _b, _a);
+            storeu_ps16(ptr0, _b);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _r);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1573,6 +1966,9 @@ static int from_rgba2gray(const unsigned char* rgba, int w, int h, int stride, M
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1633,6 +2029,23 @@ static int from_rgba2gray(const unsigned char* rgba, int w, int h, int stride, M
                 : "cc", "memory", "q0", "q1", "q2", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128 _R2Y = _mm_set1_ps(R2Y);
+        __m128 _G2Y = _mm_set1_ps(G2Y);
+        __m128 _B2Y = _mm_set1_ps(B2Y);
+        for (; nn > 0; nn--)
+        {
+            __m128 _c0[4], _c1[4], _c2[4], _c3[4];
+            load_u8x16c4_ps(rgba, _c0, _c1, _c2, _c3);
+            for (int k = 0; k < 4; k++)
+            {
+                __m128 _y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_c0[k], _R2Y), _mm_mul_ps(_c1[k], _G2Y)), _mm_mul_ps(_c2[k], _B2Y));
+                _mm_storeu_ps(ptr + k * 4, _mm_cvtepi32_ps(_mm_srli_epi32(_mm_cvttps_epi32(_y), Y_shift)));
+            }
+
+            rgba += 4 * 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1671,6 +2084,9 @@ static int from_rgba2bgra(const unsigned char* rgba, int w, int h, int stride, M
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1757,6 +2173,22 @@ static int from_rgba2bgra(const unsigned char* rgba, int w, int h, int stride, M
                 : "cc", "memory", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            load_u8x16c4_ps(rgba, _r, _g, _b, _a);
+            storeu_ps16(ptr0, _b);
+            storeu_ps16(ptr1, _g);
+            storeu_ps16(ptr2, _r);
+            storeu_ps16(ptr3, _a);
+
+            rgba += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+            ptr3 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1802,6 +2234,9 @@ static void to_rgba2bgra(const Mat& m, unsigned char* bgra, int stride)
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1837,6 +2272,22 @@ static void to_rgba2bgra(const Mat& m, unsigned char* bgra, int stride)
             ptr2 += 8;
             ptr3 += 8;
         }
+#elif __SSE2__
+        for (; nn > 0; nn--)
+        {
+            __m128 _r[4], _g[4], _b[4], _a[4];
+            loadu_ps16(ptr0, _r);
+            loadu_ps16(ptr1, _g);
+            loadu_ps16(ptr2, _b);
+            loadu_ps16(ptr3, _a);
+            store_ps_u8x16c4(bgra, _b, _g, _r, _a);
+
+            bgra += 4 * 16;
+            ptr0 += 16;
+            ptr1 += 16;
+            ptr2 += 16;
+            ptr3 += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -1883,6 +2334,9 @@ static int from_bgra2gray(const unsigned char* bgra, int w, int h, int stride, M
 #if __ARM_NEON
         int nn = w >> 3;
         int remain = w - (nn << 3);
+#elif __SSE2__
+        int nn = w >> 4;
+        int remain = w - (nn << 4);
 #else
         int remain = w;
 #endif // __ARM_NEON
@@ -1943,6 +2397,23 @@ static int from_bgra2gray(const unsigned char* bgra, int w, int h, int stride, M
                 : "cc", "memory", "q0", "q1", "q2", "q8", "q9");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128 _R2Y = _mm_set1_ps(R2Y);
+        __m128 _G2Y = _mm_set1_ps(G2Y);
+        __m128 _B2Y = _mm_set1_ps(B2Y);
+        for (; nn > 0; nn--)
+        {
+            __m128 _c0[4], _c1[4], _c2[4], _c3[4];
+            load_u8x16c4_ps(bgra, _c0, _c1, _c2, _c3);
+            for (int k = 0; k < 4; k++)
+            {
+                __m128 _y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_c2[k], _R2Y), _mm_mul_ps(_c1[k], _G2Y)), _mm_mul_ps(_c0[k], _B2Y));
+                _mm_storeu_ps(ptr + k * 4, _mm_cvtepi32_ps(_mm_srli_epi32(_mm_cvttps_epi32(_y), Y_shift)));
+            }
+
+            bgra += 4 * 16;
+            ptr += 16;
+        }
 #endif // __ARM_NEON
         for (; remain > 0; remain--)
         {
@@ -2700,6 +3171,494 @@ Mat Mat::from_pixels_roi_resize(const unsigned char* pixels, int type, int w, in
     return Mat();
 }
 
+// round to nearest as the Cast layer does
+static signed char pixel_float32_to_int8(float value)
+{
+    float tmp;
+    if (value >= 0.f)
+        tmp = value + 0.5f;
+    else
+        tmp = value - 0.5f;
+
+    if (tmp > 127)
+        return 127;
+    if (tmp < -128)
+        return -128;
+
+    return static_cast<signed char>(tmp);
+}
+
+// one horizontal bilinear pass as in resize_bilinear_c*, srcc is a literal at every call site
+static NCNN_FORCEINLINE void pixel_resize_hline_cn(const unsigned char* S, short* rows, const int* xofs, const short* ialpha, int w, int srcc)
+{
+    for (int dx = 0; dx < w; dx++)
+    {
+        const unsigned char* Sp = S + xofs[dx];
+        short a0 = ialpha[dx * 2];
+        short a1 = ialpha[dx * 2 + 1];
+        for (int k = 0; k < srcc; k++)
+        {
+            rows[k] = (Sp[k] * a0 + Sp[srcc + k] * a1) >> 4;
+        }
+        rows += srcc;
+    }
+}
+
+static void pixel_resize_hline(const unsigned char* S, short* rows, const int* xofs, const short* ialpha, int w, int srcc)
+{
+    if (srcc == 1)
+        pixel_resize_hline_cn(S, rows, xofs, ialpha, w, 1);
+    if (srcc == 3)
+        pixel_resize_hline_cn(S, rows, xofs, ialpha, w, 3);
+    if (srcc == 4)
+        pixel_resize_hline_cn(S, rows, xofs, ialpha, w, 4);
+}
+
+// source channel count and the pixel byte every output channel reads
+// byte 4 is the constant alpha 255 and byte 5 is the gray value mixed from the rgb bytes
+static int get_pixel_convert_layout(int type, int& srcc, int& outc, int channel_map[4], int rgb_map[3])
+{
+    static const int rgb[3] = {0, 1, 2};
+    static const int bgr[3] = {2, 1, 0};
+    const int* gray_from = 0;
+
+    switch (type)
+    {
+    case Mat::PIXEL_RGB:
+    case Mat::PIXEL_BGR:
+        srcc = 3, outc = 3, channel_map[0] = 0, channel_map[1] = 1, channel_map[2] = 2;
+        break;
+    case Mat::PIXEL_GRAY:
+        srcc = 1, outc = 1, channel_map[0] = 0;
+        break;
+    case Mat::PIXEL_RGBA:
+    case Mat::PIXEL_BGRA:
+        srcc = 4, outc = 4, channel_map[0] = 0, channel_map[1] = 1, channel_map[2] = 2, channel_map[3] = 3;
+        break;
+    case Mat::PIXEL_RGB2BGR:
+    case Mat::PIXEL_BGR2RGB:
+        srcc = 3, outc = 3, channel_map[0] = 2, channel_map[1] = 1, channel_map[2] = 0;
+        break;
+    case Mat::PIXEL_RGB2GRAY:
+        srcc = 3, outc = 1, channel_map[0] = 5, gray_from = rgb;
+        break;
+    case Mat::PIXEL_BGR2GRAY:
+        srcc = 3, outc = 1, channel_map[0] = 5, gray_from = bgr;
+        break;
+    case Mat::PIXEL_RGB2RGBA:
+    case Mat::PIXEL_BGR2BGRA:
+        srcc = 3, outc = 4, channel_map[0] = 0, channel_map[1] = 1, channel_map[2] = 2, channel_map[3] = 4;
+        break;
+    case Mat::PIXEL_BGR2RGBA:
+    case Mat::PIXEL_RGB2BGRA:
+        srcc = 3, outc = 4, channel_map[0] = 2, channel_map[1] = 1, channel_map[2] = 0, channel_map[3] = 4;
+        break;
+    case Mat::PIXEL_GRAY2RGB:
+    case Mat::PIXEL_GRAY2BGR:
+        srcc = 1, outc = 3, channel_map[0] = 0, channel_map[1] = 0, channel_map[2] = 0;
+        break;
+    case Mat::PIXEL_GRAY2RGBA:
+    case Mat::PIXEL_GRAY2BGRA:
+        srcc = 1, outc = 4, channel_map[0] = 0, channel_map[1] = 0, channel_map[2] = 0, channel_map[3] = 4;
+        break;
+    case Mat::PIXEL_RGBA2RGB:
+    case Mat::PIXEL_BGRA2BGR:
+        srcc = 4, outc = 3, channel_map[0] = 0, channel_map[1] = 1, channel_map[2] = 2;
+        break;
+    case Mat::PIXEL_RGBA2BGR:
+    case Mat::PIXEL_BGRA2RGB:
+        srcc = 4, outc = 3, channel_map[0] = 2, channel_map[1] = 1, channel_map[2] = 0;
+        break;
+    case Mat::PIXEL_RGBA2GRAY:
+        srcc = 4, outc = 1, channel_map[0] = 5, gray_from = rgb;
+        break;
+    case Mat::PIXEL_BGRA2GRAY:
+        srcc = 4, outc = 1, channel_map[0] = 5, gray_from = bgr;
+        break;
+    case Mat::PIXEL_RGBA2BGRA:
+    case Mat::PIXEL_BGRA2RGBA:
+        srcc = 4, outc = 4, channel_map[0] = 2, channel_map[1] = 1, channel_map[2] = 0, channel_map[3] = 3;
+        break;
+    default:
+        return -1;
+    }
+
+    if (gray_from)
+    {
+        rgb_map[0] = gray_from[0];
+        rgb_map[1] = gray_from[1];
+        rgb_map[2] = gray_from[2];
+    }
+
+    return 0;
+}
+
+Mat Mat::from_pixels_roi_resize_normalize(const unsigned char* pixels, int type, int w, int h, int stride, int roix, int roiy, int roiw, int roih, int target_width, int target_height, const float* mean_vals, const float* norm_vals, int elempack, int cast_type, const Option& opt)
+{
+    if (roix < 0 || roiy < 0 || roiw <= 0 || roih <= 0 || roix + roiw > w || roiy + roih > h)
+    {
+        NCNN_LOGE("roi %d %d %d %d out of image %d %d", roix, roiy, roiw, roih, w, h);
+        return Mat();
+    }
+
+    int srcc = 0;
+    int outc = 0;
+    int channel_map[4] = {0, 0, 0, 0};
+    int rgb_map[3] = {0, 1, 2};
+    if (get_pixel_convert_layout(type, srcc, outc, channel_map, rgb_map) != 0)
+    {
+        NCNN_LOGE("unknown convert type %d", type);
+        return Mat();
+    }
+
+    if ((elempack != 1 && elempack != 4 && elempack != 8 && elempack != 16) || outc % elempack != 0)
+    {
+        NCNN_LOGE("elempack %d does not fit %d channels", elempack, outc);
+        return Mat();
+    }
+
+    size_t elemsize;
+    if (cast_type == 1)
+        elemsize = 4u;
+    else if (cast_type == 2 || cast_type == 4)
+        elemsize = 2u;
+    else if (cast_type == 3)
+        elemsize = 1u;
+    else
+    {
+        NCNN_LOGE("unsupported cast type %d", cast_type);
+        return Mat();
+    }
+
+    Mat m(target_width, target_height, outc / elempack, elemsize * elempack, elempack, opt.blob_allocator);
+    if (m.empty())
+        return m;
+
+    const unsigned char* src = pixels + roiy * stride + roix * srcc;
+
+    // the same affine the substract_mean_normalize layers apply
+    float scale[4];
+    float bias[4];
+    for (int q = 0; q < outc; q++)
+    {
+        scale[q] = norm_vals ? norm_vals[q] : 1.f;
+        bias[q] = mean_vals ? (norm_vals ? -mean_vals[q] * norm_vals[q] : -mean_vals[q]) : 0.f;
+    }
+
+    // coeffs for r g b = 0.299f, 0.587f, 0.114f
+    const unsigned char Y_shift = 8; //14
+    const unsigned char R2Y = 77;
+    const unsigned char G2Y = 150;
+    const unsigned char B2Y = 29;
+    const bool to_gray = channel_map[0] == 5;
+
+    // bilinear coefficients identical to resize_bilinear_c*
+    const bool resize = roiw != target_width || roih != target_height;
+
+    const int INTER_RESIZE_COEF_BITS = 11;
+    const int INTER_RESIZE_COEF_SCALE = 1 << INTER_RESIZE_COEF_BITS;
+
+    const int rowsize = target_width * srcc;
+
+    std::vector<int> xofs(resize ? target_width : 0);
+    std::vector<int> yofs(resize ? target_height : 0);
+    std::vector<short> ialpha(resize ? target_width * 2 : 0);
+    std::vector<short> ibeta(resize ? target_height * 2 : 0);
+
+    if (resize)
+    {
+        double scale_x = (double)roiw / target_width;
+        double scale_y = (double)roih / target_height;
+
+#define SATURATE_CAST_SHORT(X) (short)::std::min(::std::max((int)(X + (X >= 0.f ? 0.5f : -0.5f)), SHRT_MIN), SHRT_MAX);
+
+        for (int dx = 0; dx < target_width; dx++)
+        {
+            float fx = (float)((dx + 0.5) * scale_x - 0.5);
+            int sx = static_cast<int>(floor(fx));
+            fx -= sx;
+
+            if (sx < 0)
+            {
+                sx = 0;
+                fx = 0.f;
+            }
+            if (sx >= roiw - 1)
+            {
+                sx = roiw - 2;
+                fx = 1.f;
+            }
+
+            float a0 = (1.f - fx) * INTER_RESIZE_COEF_SCALE;
+            float a1 = fx * INTER_RESIZE_COEF_SCALE;
+
+            short ia0 = SATURATE_CAST_SHORT(a0);
+            short ia1 = SATURATE_CAST_SHORT(a1);
+
+            xofs[dx] = sx * srcc;
+            ialpha[dx * 2] = ia0;
+            ialpha[dx * 2 + 1] = ia1;
+        }
+
+        for (int dy = 0; dy < target_height; dy++)
+        {
+            float fy = (float)((dy + 0.5) * scale_y - 0.5);
+            int sy = static_cast<int>(floor(fy));
+            fy -= sy;
+
+            if (sy < 0)
+            {
+                sy = 0;
+                fy = 0.f;
+            }
+            if (sy >= roih - 1)
+            {
+                sy = roih - 2;
+                fy = 1.f;
+            }
+
+            yofs[dy] = sy;
+
+            float b0 = (1.f - fy) * INTER_RESIZE_COEF_SCALE;
+            float b1 = fy * INTER_RESIZE_COEF_SCALE;
+
+            ibeta[dy * 2] = SATURATE_CAST_SHORT(b0);
+            ibeta[dy * 2 + 1] = SATURATE_CAST_SHORT(b1);
+        }
+
+#undef SATURATE_CAST_SHORT
+    }
+
+    // every thread owns a contiguous band of output rows so the horizontal pass of a source row is reused
+    const int nn_band = std::max(std::min(opt.num_threads, target_height), 1);
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int band = 0; band < nn_band; band++)
+    {
+        const int dy_start = target_height * band / nn_band;
+        const int dy_end = target_height * (band + 1) / nn_band;
+
+        std::vector<short> rowsbuf0(resize ? rowsize : 0);
+        std::vector<short> rowsbuf1(resize ? rowsize : 0);
+        std::vector<unsigned char> pixelrow(resize ? rowsize : 0);
+        std::vector<unsigned char> grayrow(to_gray ? target_width : 0);
+        std::vector<float> outrows(cast_type == 1 && elempack == 1 ? 0 : outc * target_width);
+
+        short* rows0 = rowsbuf0.data();
+        short* rows1 = rowsbuf1.data();
+
+        int prev_sy1 = -3;
+
+        for (int dy = dy_start; dy < dy_end; dy++)
+        {
+            const unsigned char* pixelptr = src + stride * dy;
+
+            if (resize)
+            {
+                int sy = yofs[dy];
+
+                if (sy == prev_sy1)
+                {
+                    // reuse all rows
+                }
+                else if (sy == prev_sy1 + 1)
+                {
+                    // hresize one row
+                    std::swap(rows0, rows1);
+                    const unsigned char* S1 = src + stride * (sy + 1);
+
+                    pixel_resize_hline(S1, rows1, xofs.data(), ialpha.data(), target_width, srcc);
+                }
+                else
+                {
+                    // hresize two rows
+                    const unsigned char* S0 = src + stride * (sy);
+                    const unsigned char* S1 = src + stride * (sy + 1);
+
+                    pixel_resize_hline(S0, rows0, xofs.data(), ialpha.data(), target_width, srcc);
+                    pixel_resize_hline(S1, rows1, xofs.data(), ialpha.data(), target_width, srcc);
+                }
+
+                prev_sy1 = sy;
+
+                // vresize
+                short b0 = ibeta[dy * 2];
+                short b1 = ibeta[dy * 2 + 1];
+
+                unsigned char* Dp = pixelrow.data();
+                int i = 0;
+#if __SSE2__
+                __m128i _b0 = _mm_set1_epi16(b0);
+                __m128i _b1 = _mm_set1_epi16(b1);
+                __m128i _v2 = _mm_set1_epi16(2);
+                for (; i + 7 < rowsize; i += 8)
+                {
+                    __m128i _rows0 = _mm_loadu_si128((const __m128i*)(rows0 + i));
+                    __m128i _rows1 = _mm_loadu_si128((const __m128i*)(rows1 + i));
+
+                    __m128i _acc = _mm_add_epi16(_mm_mulhi_epi16(_rows0, _b0), _mm_mulhi_epi16(_rows1, _b1));
+                    _acc = _mm_srai_epi16(_mm_add_epi16(_acc, _v2), 2);
+
+                    _mm_storel_epi64((__m128i*)(Dp + i), _mm_packus_epi16(_acc, _acc));
+                }
+#endif // __SSE2__
+                for (; i < rowsize; i++)
+                {
+                    Dp[i] = (unsigned char)(((short)((b0 * (short)rows0[i]) >> 16) + (short)((b1 * (short)rows1[i]) >> 16) + 2) >> 2);
+                }
+
+                pixelptr = Dp;
+            }
+
+            if (to_gray)
+            {
+                for (int dx = 0; dx < target_width; dx++)
+                {
+                    const unsigned char* p = pixelptr + dx * srcc;
+                    grayrow[dx] = (unsigned char)((p[rgb_map[0]] * R2Y + p[rgb_map[1]] * G2Y + p[rgb_map[2]] * B2Y) >> Y_shift);
+                }
+            }
+
+            // the gray row is a one channel source for everything below
+            const unsigned char* rowptr = to_gray ? grayrow.data() : pixelptr;
+            const int rowc = to_gray ? 1 : srcc;
+
+            // fp32 without packing goes straight into the output rows
+            const bool direct = cast_type == 1 && elempack == 1;
+
+            float* outptrs[4];
+            for (int q = 0; q < outc; q++)
+            {
+                outptrs[q] = direct ? m.channel(q).row(dy) : outrows.data() + target_width * q;
+            }
+
+            // convert, substract mean and normalize
+            int dx = 0;
+#if __SSE2__
+            for (; dx + 15 < target_width; dx += 16)
+            {
+                __m128 _c[4][4];
+                if (rowc == 1)
+                    load_u8x16_ps(rowptr + dx, _c[0]);
+                if (rowc == 3)
+                    load_u8x16c3_ps(rowptr + dx * 3, _c[0], _c[1], _c[2]);
+                if (rowc == 4)
+                    load_u8x16c4_ps(rowptr + dx * 4, _c[0], _c[1], _c[2], _c[3]);
+
+                for (int q = 0; q < outc; q++)
+                {
+                    const int ch = to_gray ? 0 : channel_map[q];
+                    __m128 _scale = _mm_set1_ps(scale[q]);
+                    __m128 _bias = _mm_set1_ps(bias[q]);
+                    float* outptr = outptrs[q] + dx;
+                    for (int k = 0; k < 4; k++)
+                    {
+                        __m128 _v = ch == 4 ? _mm_set1_ps(255.f) : _c[ch][k];
+                        _mm_storeu_ps(outptr + k * 4, _mm_add_ps(_mm_mul_ps(_v, _scale), _bias));
+                    }
+                }
+            }
+#endif // __SSE2__
+            for (int q = 0; q < outc; q++)
+            {
+                const int ch = to_gray ? 0 : channel_map[q];
+                float* outptr = outptrs[q];
+                if (ch == 4)
+                {
+                    const float alpha = 255.f * scale[q] + bias[q];
+                    for (int j = dx; j < target_width; j++)
+                    {
+                        outptr[j] = alpha;
+                    }
+                }
+                else
+                {
+                    const unsigned char* p = rowptr + ch;
+                    for (int j = dx; j < target_width; j++)
+                    {
+                        outptr[j] = p[j * rowc] * scale[q] + bias[q];
+                    }
+                }
+            }
+
+            if (direct)
+                continue;
+
+            // pack and cast, channel q lands in lane q % elempack of packed channel q / elempack
+            for (int g = 0; g < outc / elempack; g++)
+            {
+                const float* p0 = outrows.data() + target_width * g * elempack;
+
+                if (cast_type == 1)
+                {
+                    float* outptr = m.channel(g).row(dy);
+
+                    int j = 0;
+#if __SSE2__
+                    if (elempack == 4)
+                    {
+                        for (; j + 3 < target_width; j += 4)
+                        {
+                            __m128 _r0 = _mm_loadu_ps(p0 + j);
+                            __m128 _r1 = _mm_loadu_ps(p0 + target_width + j);
+                            __m128 _r2 = _mm_loadu_ps(p0 + target_width * 2 + j);
+                            __m128 _r3 = _mm_loadu_ps(p0 + target_width * 3 + j);
+                            _MM_TRANSPOSE4_PS(_r0, _r1, _r2, _r3);
+                            _mm_storeu_ps(outptr + j * 4, _r0);
+                            _mm_storeu_ps(outptr + j * 4 + 4, _r1);
+                            _mm_storeu_ps(outptr + j * 4 + 8, _r2);
+                            _mm_storeu_ps(outptr + j * 4 + 12, _r3);
+                        }
+                    }
+#endif // __SSE2__
+                    for (; j < target_width; j++)
+                    {
+                        for (int k = 0; k < elempack; k++)
+                        {
+                            outptr[j * elempack + k] = p0[target_width * k + j];
+                        }
+                    }
+                }
+                if (cast_type == 2)
+                {
+                    unsigned short* outptr = m.channel(g).row<unsigned short>(dy);
+                    for (int j = 0; j < target_width; j++)
+                    {
+                        for (int k = 0; k < elempack; k++)
+                        {
+                            outptr[j * elempack + k] = float32_to_float16(p0[target_width * k + j]);
+                        }
+                    }
+                }
+                if (cast_type == 3)
+                {
+                    signed char* outptr = m.channel(g).row<signed char>(dy);
+                    for (int j = 0; j < target_width; j++)
+                    {
+                        for (int k = 0; k < elempack; k++)
+                        {
+                            outptr[j * elempack + k] = pixel_float32_to_int8(p0[target_width * k + j]);
+                        }
+                    }
+                }
+                if (cast_type == 4)
+                {
+                    unsigned short* outptr = m.channel(g).row<unsigned short>(dy);
+                    for (int j = 0; j < target_width; j++)
+                    {
+                        for (int k = 0; k < elempack; k++)
+                        {
+                            outptr[j * elempack + k] = float32_to_bfloat16(p0[target_width * k + j]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return m;
+}
+
 void Mat::to_pixels(unsigned char* pixels, int type) const
 {
     int type_to = (type & PIXEL_CONVERT_MASK) ? (type >> PIXEL_CONVERT_SHIFT) : (type & PIXEL_FORMAT_MASK);
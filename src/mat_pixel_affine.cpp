@@ -16,6 +16,9 @@
 #if __ARM_NEON
 #include <arm_neon.h>
 #endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 #include <limits.h>
 #include <math.h>
 #include "platform.h"
@@ -298,6 +301,56 @@ void warpaffine_bilinear_c1(const unsigned char* src, int srcw, int srch, int sr
 
                 vst1_u8(dst0, _dst);
 
+#elif __SSE2__
+                __m128i _Xl = _mm_add_epi32(_mm_set1_epi32(X0), _mm_loadu_si128((const __m128i*)(adelta.data() + x)));
+                __m128i _Xh = _mm_add_epi32(_mm_set1_epi32(X0), _mm_loadu_si128((const __m128i*)(adelta.data() + x + 4)));
+                __m128i _Yl = _mm_add_epi32(_mm_set1_epi32(Y0), _mm_loadu_si128((const __m128i*)(bdelta.data() + x)));
+                __m128i _Yh = _mm_add_epi32(_mm_set1_epi32(Y0), _mm_loadu_si128((const __m128i*)(bdelta.data() + x + 4)));
+
+                // all inside, so the integer parts need no saturation
+                int sx[8];
+                int sy[8];
+                _mm_storeu_si128((__m128i*)sx, _mm_srai_epi32(_Xl, 10));
+                _mm_storeu_si128((__m128i*)(sx + 4), _mm_srai_epi32(_Xh, 10));
+                _mm_storeu_si128((__m128i*)sy, _mm_srai_epi32(_Yl, 10));
+                _mm_storeu_si128((__m128i*)(sy + 4), _mm_srai_epi32(_Yh, 10));
+
+                // weight pairs as alpha0 | alpha1 << 16 and beta0 | beta1 << 16
+                __m128i _v1023 = _mm_set1_epi32((1 << 10) - 1);
+                __m128i _v1024 = _mm_set1_epi32(1 << 10);
+                __m128i _fxl = _mm_and_si128(_Xl, _v1023);
+                __m128i _fxh = _mm_and_si128(_Xh, _v1023);
+                __m128i _fyl = _mm_and_si128(_Yl, _v1023);
+                __m128i _fyh = _mm_and_si128(_Yh, _v1023);
+                __m128i _alphal = _mm_or_si128(_mm_sub_epi32(_v1024, _fxl), _mm_slli_epi32(_fxl, 16));
+                __m128i _alphah = _mm_or_si128(_mm_sub_epi32(_v1024, _fxh), _mm_slli_epi32(_fxh, 16));
+                __m128i _betal = _mm_or_si128(_mm_sub_epi32(_v1024, _fyl), _mm_slli_epi32(_fyl, 16));
+                __m128i _betah = _mm_or_si128(_mm_sub_epi32(_v1024, _fyh), _mm_slli_epi32(_fyh, 16));
+
+                short a01[16];
+                short b01[16];
+                for (int xi = 0; xi < 8; xi++)
+                {
+                    const unsigned char* a0 = src0 + srcstride * sy[xi] + sx[xi];
+                    const unsigned char* b0 = a0 + srcstride;
+
+                    a01[xi * 2] = a0[0];
+                    a01[xi * 2 + 1] = a0[1];
+                    b01[xi * 2] = b0[0];
+                    b01[xi * 2 + 1] = b0[1];
+                }
+
+                __m128i _a00l = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)a01), _alphal), 5);
+                __m128i _a00h = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(a01 + 8)), _alphah), 5);
+                __m128i _b00l = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)b01), _alphal), 5);
+                __m128i _b00h = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(b01 + 8)), _alphah), 5);
+
+                __m128i _dstl = _mm_srai_epi32(_mm_madd_epi16(_mm_or_si128(_a00l, _mm_slli_epi32(_b00l, 16)), _betal), 15);
+                __m128i _dsth = _mm_srai_epi32(_mm_madd_epi16(_mm_or_si128(_a00h, _mm_slli_epi32(_b00h, 16)), _betah), 15);
+
+                __m128i _dst = _mm_packs_epi32(_dstl, _dsth);
+                _mm_storel_epi64((__m128i*)dst0, _mm_packus_epi16(_dst, _dst));
+
                 dst0 += 8;
 #else
                 for (int xi = 0; xi < 8; xi++)
@@ -1378,6 +1431,63 @@ void warpaffine_bilinear_c4(const unsigned char* src, int srcw, int srch, int sr
 
                 vst4_u8(dst0, _dst);
 
+#elif __SSE2__
+                __m128i _Xl = _mm_add_epi32(_mm_set1_epi32(X0), _mm_loadu_si128((const __m128i*)(adelta.data() + x)));
+                __m128i _Xh = _mm_add_epi32(_mm_set1_epi32(X0), _mm_loadu_si128((const __m128i*)(adelta.data() + x + 4)));
+                __m128i _Yl = _mm_add_epi32(_mm_set1_epi32(Y0), _mm_loadu_si128((const __m128i*)(bdelta.data() + x)));
+                __m128i _Yh = _mm_add_epi32(_mm_set1_epi32(Y0), _mm_loadu_si128((const __m128i*)(bdelta.data() + x + 4)));
+
+                // all inside, so the integer parts need no saturation
+                int sx[8];
+                int sy[8];
+                _mm_storeu_si128((__m128i*)sx, _mm_srai_epi32(_Xl, 10));
+                _mm_storeu_si128((__m128i*)(sx + 4), _mm_srai_epi32(_Xh, 10));
+                _mm_storeu_si128((__m128i*)sy, _mm_srai_epi32(_Yl, 10));
+                _mm_storeu_si128((__m128i*)(sy + 4), _mm_srai_epi32(_Yh, 10));
+
+                // weight pairs as alpha0 | alpha1 << 16 and beta0 | beta1 << 16
+                __m128i _v1023 = _mm_set1_epi32((1 << 10) - 1);
+                __m128i _v1024 = _mm_set1_epi32(1 << 10);
+                __m128i _fxl = _mm_and_si128(_Xl, _v1023);
+                __m128i _fxh = _mm_and_si128(_Xh, _v1023);
+                __m128i _fyl = _mm_and_si128(_Yl, _v1023);
+                __m128i _fyh = _mm_and_si128(_Yh, _v1023);
+                __m128i _alphal = _mm_or_si128(_mm_sub_epi32(_v1024, _fxl), _mm_slli_epi32(_fxl, 16));
+                __m128i _alphah = _mm_or_si128(_mm_sub_epi32(_v1024, _fxh), _mm_slli_epi32(_fxh, 16));
+                __m128i _betal = _mm_or_si128(_mm_sub_epi32(_v1024, _fyl), _mm_slli_epi32(_fyl, 16));
+                __m128i _betah = _mm_or_si128(_mm_sub_epi32(_v1024, _fyh), _mm_slli_epi32(_fyh, 16));
+
+                int alpha[8];
+                int beta[8];
+                _mm_storeu_si128((__m128i*)alpha, _alphal);
+                _mm_storeu_si128((__m128i*)(alpha + 4), _alphah);
+                _mm_storeu_si128((__m128i*)beta, _betal);
+                _mm_storeu_si128((__m128i*)(beta + 4), _betah);
+
+                __m128i _d[8];
+                for (int xi = 0; xi < 8; xi++)
+                {
+                    const unsigned char* a0 = src0 + srcstride * sy[xi] + sx[xi] * 4;
+                    const unsigned char* b0 = a0 + srcstride;
+
+                    // a0 and a1 are adjacent, pair up their channels
+                    __m128i _a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)a0), _mm_setzero_si128());
+                    __m128i _b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)b0), _mm_setzero_si128());
+                    _a = _mm_unpacklo_epi16(_a, _mm_unpackhi_epi64(_a, _a));
+                    _b = _mm_unpacklo_epi16(_b, _mm_unpackhi_epi64(_b, _b));
+
+                    __m128i _alpha = _mm_set1_epi32(alpha[xi]);
+                    __m128i _a00 = _mm_srai_epi32(_mm_madd_epi16(_a, _alpha), 5);
+                    __m128i _b00 = _mm_srai_epi32(_mm_madd_epi16(_b, _alpha), 5);
+
+                    _d[xi] = _mm_srai_epi32(_mm_madd_epi16(_mm_or_si128(_a00, _mm_slli_epi32(_b00, 16)), _mm_set1_epi32(beta[xi])), 15);
+                }
+
+                __m128i _dst0 = _mm_packus_epi16(_mm_packs_epi32(_d[0], _d[1]), _mm_packs_epi32(_d[2], _d[3]));
+                __m128i _dst1 = _mm_packus_epi16(_mm_packs_epi32(_d[4], _d[5]), _mm_packs_epi32(_d[6], _d[7]));
+                _mm_storeu_si128((__m128i*)dst0, _dst0);
+                _mm_storeu_si128((__m128i*)(dst0 + 16), _dst1);
+
                 dst0 += 4 * 8;
 #else
                 for (int xi = 0; xi < 8; xi++)
@@ -19,6 +19,9 @@
 #if __ARM_NEON
 #include <arm_neon.h>
 #endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 #include "platform.h"
 
 namespace ncnn {
@@ -196,6 +199,8 @@ void resize_bilinear_c1(const unsigned char* src, int srcw, int srch, int srcstr
 
 #if __ARM_NEON
         int nn = w >> 3;
+#elif __SSE2__
+        int nn = w >> 3;
 #else
         int nn = 0;
 #endif
@@ -285,6 +290,25 @@ void resize_bilinear_c1(const unsigned char* src, int srcw, int srch, int srcstr
                 : "cc", "memory", "r4", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11", "q12");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128i _b0 = _mm_set1_epi16(b0);
+        __m128i _b1 = _mm_set1_epi16(b1);
+        __m128i _v2 = _mm_set1_epi16(2);
+        for (; nn > 0; nn--)
+        {
+            __m128i _rows0 = _mm_loadu_si128((const __m128i*)rows0p);
+            __m128i _rows1 = _mm_loadu_si128((const __m128i*)rows1p);
+
+            // the sum of both halves never exceeds 16 bits
+            __m128i _acc = _mm_add_epi16(_mm_mulhi_epi16(_rows0, _b0), _mm_mulhi_epi16(_rows1, _b1));
+            _acc = _mm_srai_epi16(_mm_add_epi16(_acc, _v2), 2);
+
+            _mm_storel_epi64((__m128i*)Dp, _mm_packus_epi16(_acc, _acc));
+
+            Dp += 8;
+            rows0p += 8;
+            rows1p += 8;
+        }
 #endif // __ARM_NEON
         for (; remain; --remain)
         {
@@ -505,6 +529,8 @@ void resize_bilinear_c2(const unsigned char* src, int srcw, int srch, int srcstr
 
 #if __ARM_NEON
         int nn = (w * 2) >> 3;
+#elif __SSE2__
+        int nn = (w * 2) >> 3;
 #else
         int nn = 0;
 #endif
@@ -594,6 +620,25 @@ void resize_bilinear_c2(const unsigned char* src, int srcw, int srch, int srcstr
                 : "cc", "memory", "r4", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11", "q12");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128i _b0 = _mm_set1_epi16(b0);
+        __m128i _b1 = _mm_set1_epi16(b1);
+        __m128i _v2 = _mm_set1_epi16(2);
+        for (; nn > 0; nn--)
+        {
+            __m128i _rows0 = _mm_loadu_si128((const __m128i*)rows0p);
+            __m128i _rows1 = _mm_loadu_si128((const __m128i*)rows1p);
+
+            // the sum of both halves never exceeds 16 bits
+            __m128i _acc = _mm_add_epi16(_mm_mulhi_epi16(_rows0, _b0), _mm_mulhi_epi16(_rows1, _b1));
+            _acc = _mm_srai_epi16(_mm_add_epi16(_acc, _v2), 2);
+
+            _mm_storel_epi64((__m128i*)Dp, _mm_packus_epi16(_acc, _acc));
+
+            Dp += 8;
+            rows0p += 8;
+            rows1p += 8;
+        }
 #endif // __ARM_NEON
         for (; remain; --remain)
         {
@@ -825,6 +870,8 @@ void resize_bilinear_c3(const unsigned char* src, int srcw, int srch, int srcstr
 
 #if __ARM_NEON
         int nn = (w * 3) >> 3;
+#elif __SSE2__
+        int nn = (w * 3) >> 3;
 #else
         int nn = 0;
 #endif
@@ -914,6 +961,25 @@ void resize_bilinear_c3(const unsigned char* src, int srcw, int srch, int srcstr
                 : "cc", "memory", "r4", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11", "q12");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128i _b0 = _mm_set1_epi16(b0);
+        __m128i _b1 = _mm_set1_epi16(b1);
+        __m128i _v2 = _mm_set1_epi16(2);
+        for (; nn > 0; nn--)
+        {
+            __m128i _rows0 = _mm_loadu_si128((const __m128i*)rows0p);
+            __m128i _rows1 = _mm_loadu_si128((const __m128i*)rows1p);
+
+            // the sum of both halves never exceeds 16 bits
+            __m128i _acc = _mm_add_epi16(_mm_mulhi_epi16(_rows0, _b0), _mm_mulhi_epi16(_rows1, _b1));
+            _acc = _mm_srai_epi16(_mm_add_epi16(_acc, _v2), 2);
+
+            _mm_storel_epi64((__m128i*)Dp, _mm_packus_epi16(_acc, _acc));
+
+            Dp += 8;
+            rows0p += 8;
+            rows1p += 8;
+        }
 #endif // __ARM_NEON
         for (; remain; --remain)
         {
@@ -1125,6 +1191,8 @@ void resize_bilinear_c4(const unsigned char* src, int srcw, int srch, int srcstr
 
 #if __ARM_NEON
         int nn = (w * 4) >> 3;
+#elif __SSE2__
+        int nn = (w * 4) >> 3;
 #else
         int nn = 0;
 #endif
@@ -1214,6 +1282,25 @@ void resize_bilinear_c4(const unsigned char* src, int srcw, int srch, int srcstr
                 : "cc", "memory", "r4", "q0", "q1", "q2", "q3", "q8", "q9", "q10", "q11", "q12");
         }
 #endif // __aarch64__
+#elif __SSE2__
+        __m128i _b0 = _mm_set1_epi16(b0);
+        __m128i _b1 = _mm_set1_epi16(b1);
+        __m128i _v2 = _mm_set1_epi16(2);
+        for (; nn > 0; nn--)
+        {
+            __m128i _rows0 = _mm_loadu_si128((const __m128i*)rows0p);
+            __m128i _rows1 = _mm_loadu_si128((const __m128i*)rows1p);
+
+            // the sum of both halves never exceeds 16 bits
+            __m128i _acc = _mm_add_epi16(_mm_mulhi_epi16(_rows0, _b0), _mm_mulhi_epi16(_rows1, _b1));
+            _acc = _mm_srai_epi16(_mm_add_epi16(_acc, _v2), 2);
+
+            _mm_storel_epi64((__m128i*)Dp, _mm_packus_epi16(_acc, _acc));
+
+            Dp += 8;
+            rows0p += 8;
+            rows1p += 8;
+        }
 #endif // __ARM_NEON
         for (; remain; --remain)
         {
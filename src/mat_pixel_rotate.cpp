@@ -16,6 +16,9 @@
 #if __ARM_NEON
 #include <arm_neon.h>
 #endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 #include "platform.h"
 
 namespace ncnn {
@@ -25,6 +28,70 @@ namespace ncnn {
 // but we shall ask the original art author for permission first ...
 // https://www.reddit.com/r/anime/comments/5uxjn4/i_recreated_the_kanna_ascii_art_from_kobayashisan/
 
+#if __SSE2__
+static NCNN_FORCEINLINE __m128i reverse_u8x16_sse(__m128i _v)
+{
+    _v = _mm_or_si128(_mm_slli_epi16(_v, 8), _mm_srli_epi16(_v, 8));
+    _v = _mm_shufflelo_epi16(_v, _MM_SHUFFLE(0, 1, 2, 3));
+    _v = _mm_shufflehi_epi16(_v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(_v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+// row k of the 8x8 block at s becomes column k of the block at d
+// a negative sstep walks the rows upwards and mirrors the columns of d
+static NCNN_FORCEINLINE void transpose_u8_8x8_sse(const unsigned char* s, int sstep, unsigned char* d, int dstep)
+{
+    __m128i _r0 = _mm_loadl_epi64((const __m128i*)s);
+    __m128i _r1 = _mm_loadl_epi64((const __m128i*)(s + sstep));
+    __m128i _r2 = _mm_loadl_epi64((const __m128i*)(s + sstep * 2));
+    __m128i _r3 = _mm_loadl_epi64((const __m128i*)(s + sstep * 3));
+    __m128i _r4 = _mm_loadl_epi64((const __m128i*)(s + sstep * 4));
+    __m128i _r5 = _mm_loadl_epi64((const __m128i*)(s + sstep * 5));
+    __m128i _r6 = _mm_loadl_epi64((const __m128i*)(s + sstep * 6));
+    __m128i _r7 = _mm_loadl_epi64((const __m128i*)(s + sstep * 7));
+
+    __m128i _t0 = _mm_unpacklo_epi8(_r0, _r1);
+    __m128i _t1 = _mm_unpacklo_epi8(_r2, _r3);
+    __m128i _t2 = _mm_unpacklo_epi8(_r4, _r5);
+    __m128i _t3 = _mm_unpacklo_epi8(_r6, _r7);
+
+    __m128i _u0 = _mm_unpacklo_epi16(_t0, _t1);
+    __m128i _u1 = _mm_unpackhi_epi16(_t0, _t1);
+    __m128i _u2 = _mm_unpacklo_epi16(_t2, _t3);
+    __m128i _u3 = _mm_unpackhi_epi16(_t2, _t3);
+
+    __m128i _d01 = _mm_unpacklo_epi32(_u0, _u2);
+    __m128i _d23 = _mm_unpackhi_epi32(_u0, _u2);
+    __m128i _d45 = _mm_unpacklo_epi32(_u1, _u3);
+    __m128i _d67 = _mm_unpackhi_epi32(_u1, _u3);
+
+    _mm_storel_epi64((__m128i*)d, _d01);
+    _mm_storel_epi64((__m128i*)(d + dstep), _mm_unpackhi_epi64(_d01, _d01));
+    _mm_storel_epi64((__m128i*)(d + dstep * 2), _d23);
+    _mm_storel_epi64((__m128i*)(d + dstep * 3), _mm_unpackhi_epi64(_d23, _d23));
+    _mm_storel_epi64((__m128i*)(d + dstep * 4), _d45);
+    _mm_storel_epi64((__m128i*)(d + dstep * 5), _mm_unpackhi_epi64(_d45, _d45));
+    _mm_storel_epi64((__m128i*)(d + dstep * 6), _d67);
+    _mm_storel_epi64((__m128i*)(d + dstep * 7), _mm_unpackhi_epi64(_d67, _d67));
+}
+
+// the same for a 4x4 block of 4 channel pixels
+static NCNN_FORCEINLINE void transpose_u32_4x4_sse(const unsigned char* s, int sstep, unsigned char* d, int dstep)
+{
+    __m128 _r0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)s));
+    __m128 _r1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(s + sstep)));
+    __m128 _r2 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(s + sstep * 2)));
+    __m128 _r3 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(s + sstep * 3)));
+
+    _MM_TRANSPOSE4_PS(_r0, _r1, _r2, _r3);
+
+    _mm_storeu_si128((__m128i*)d, _mm_castps_si128(_r0));
+    _mm_storeu_si128((__m128i*)(d + dstep), _mm_castps_si128(_r1));
+    _mm_storeu_si128((__m128i*)(d + dstep * 2), _mm_castps_si128(_r2));
+    _mm_storeu_si128((__m128i*)(d + dstep * 3), _mm_castps_si128(_r3));
+}
+#endif // __SSE2__
+
 static void kanna_rotate_1_c1(const unsigned char* src, int srcw, int srch, int srcstride, unsigned char* dst, int w, int /*h*/, int stride)
 {
     const int srcwgap = srcstride - srcw;
@@ -586,6 +653,22 @@ static void kanna_rotate_2_c1(const unsigned char* src, int srcw, int srch, int
         }
 #endif // __aarch64__
 
+        dst0 += 15;
+#elif __SSE2__
+        dst0 -= 15;
+
+        int nn = srcw >> 4;
+        int remain = srcw - (nn << 4);
+
+        for (; nn > 0; nn--)
+        {
+            __m128i _src = _mm_loadu_si128((const __m128i*)src0);
+            _mm_storeu_si128((__m128i*)dst0, reverse_u8x16_sse(_src));
+
+            src0 += 16;
+            dst0 -= 16;
+        }
+
         dst0 += 15;
 #else
         int remain = srcw;
@@ -845,6 +928,22 @@ static void kanna_rotate_2_c4(const unsigned char* src, int srcw, int srch, int
 #endif // __aarch64__
 
         dst0 += 7 * 4;
+#elif __SSE2__
+        dst0 -= 3 * 4;
+
+        int nn = srcw >> 2;
+        int remain = srcw - (nn << 2);
+
+        for (; nn > 0; nn--)
+        {
+            __m128i _src = _mm_loadu_si128((const __m128i*)src0);
+            _mm_storeu_si128((__m128i*)dst0, _mm_shuffle_epi32(_src, _MM_SHUFFLE(0, 1, 2, 3)));
+
+            src0 += 4 * 4;
+            dst0 -= 4 * 4;
+        }
+
+        dst0 += 3 * 4;
 #else
         int remain = srcw;
 #endif // __ARM_NEON
@@ -923,6 +1022,22 @@ static void kanna_rotate_3_c1(const unsigned char* src, int srcw, int srch, int
         }
 #endif // __aarch64__
 
+        dst0 += 15;
+#elif __SSE2__
+        dst0 -= 15;
+
+        int nn = srcw >> 4;
+        int remain = srcw - (nn << 4);
+
+        for (; nn > 0; nn--)
+        {
+            __m128i _src = _mm_loadu_si128((const __m128i*)src0);
+            _mm_storeu_si128((__m128i*)dst0, reverse_u8x16_sse(_src));
+
+            src0 += 16;
+            dst0 -= 16;
+        }
+
         dst0 += 15;
 #else
         int remain = srcw;
@@ -1191,6 +1306,22 @@ static void kanna_rotate_3_c4(const unsigned char* src, int srcw, int srch, int
 #endif // __aarch64__
 
         dst0 += 7 * 4;
+#elif __SSE2__
+        dst0 -= 3 * 4;
+
+        int nn = srcw >> 2;
+        int remain = srcw - (nn << 2);
+
+        for (; nn > 0; nn--)
+        {
+            __m128i _src = _mm_loadu_si128((const __m128i*)src0);
+            _mm_storeu_si128((__m128i*)dst0, _mm_shuffle_epi32(_src, _MM_SHUFFLE(0, 1, 2, 3)));
+
+            src0 += 4 * 4;
+            dst0 -= 4 * 4;
+        }
+
+        dst0 += 3 * 4;
 #else
         int remain = srcw;
 #endif // __ARM_NEON
@@ -1903,6 +2034,34 @@ static void kanna_rotate_5_c1(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 7 < srch; y += 8)
+    {
+        const unsigned char* s0 = src0;
+        const int sstep = srcstride;
+        const int dstep = stride;
+
+        unsigned char* dst0 = dst + y;
+
+        int x = 0;
+        for (; x + 7 < srcw; x += 8)
+        {
+            transpose_u8_8x8_sse(s0 + x, sstep, dst0, dstep);
+
+            dst0 += 8 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                dst0[k] = s0[x + k * sstep];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 8 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -2749,6 +2908,37 @@ static void kanna_rotate_5_c4(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 3 < srch; y += 4)
+    {
+        const unsigned char* s0 = src0;
+        const int sstep = srcstride;
+        const int dstep = stride;
+
+        unsigned char* dst0 = dst + y * 4;
+
+        int x = 0;
+        for (; x + 3 < srcw; x += 4)
+        {
+            transpose_u32_4x4_sse(s0 + x * 4, sstep, dst0, dstep);
+
+            dst0 += 4 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                dst0[k * 4] = s0[x * 4 + k * sstep];
+                dst0[k * 4 + 1] = s0[x * 4 + k * sstep + 1];
+                dst0[k * 4 + 2] = s0[x * 4 + k * sstep + 2];
+                dst0[k * 4 + 3] = s0[x * 4 + k * sstep + 3];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 4 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -2947,6 +3137,34 @@ static void kanna_rotate_6_c1(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 7 < srch; y += 8)
+    {
+        const unsigned char* s0 = src0 + 7 * srcstride;
+        const int sstep = -srcstride;
+        const int dstep = stride;
+
+        unsigned char* dst0 = dstend - y - 8;
+
+        int x = 0;
+        for (; x + 7 < srcw; x += 8)
+        {
+            transpose_u8_8x8_sse(s0 + x, sstep, dst0, dstep);
+
+            dst0 += 8 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                dst0[k] = s0[x + k * sstep];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 8 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -3802,6 +4020,37 @@ static void kanna_rotate_6_c4(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 3 < srch; y += 4)
+    {
+        const unsigned char* s0 = src0 + 3 * srcstride;
+        const int sstep = -srcstride;
+        const int dstep = stride;
+
+        unsigned char* dst0 = dstend - y * 4 - 4 * 4;
+
+        int x = 0;
+        for (; x + 3 < srcw; x += 4)
+        {
+            transpose_u32_4x4_sse(s0 + x * 4, sstep, dst0, dstep);
+
+            dst0 += 4 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                dst0[k * 4] = s0[x * 4 + k * sstep];
+                dst0[k * 4 + 1] = s0[x * 4 + k * sstep + 1];
+                dst0[k * 4 + 2] = s0[x * 4 + k * sstep + 2];
+                dst0[k * 4 + 3] = s0[x * 4 + k * sstep + 3];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 4 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -4000,6 +4249,34 @@ static void kanna_rotate_7_c1(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 7 < srch; y += 8)
+    {
+        const unsigned char* s0 = src0 + 7 * srcstride;
+        const int sstep = -srcstride;
+        const int dstep = -stride;
+
+        unsigned char* dst0 = dstend - y - 8;
+
+        int x = 0;
+        for (; x + 7 < srcw; x += 8)
+        {
+            transpose_u8_8x8_sse(s0 + x, sstep, dst0, dstep);
+
+            dst0 += 8 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                dst0[k] = s0[x + k * sstep];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 8 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -4855,6 +5132,37 @@ static void kanna_rotate_7_c4(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 3 < srch; y += 4)
+    {
+        const unsigned char* s0 = src0 + 3 * srcstride;
+        const int sstep = -srcstride;
+        const int dstep = -stride;
+
+        unsigned char* dst0 = dstend - y * 4 - 4 * 4;
+
+        int x = 0;
+        for (; x + 3 < srcw; x += 4)
+        {
+            transpose_u32_4x4_sse(s0 + x * 4, sstep, dst0, dstep);
+
+            dst0 += 4 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                dst0[k * 4] = s0[x * 4 + k * sstep];
+                dst0[k * 4 + 1] = s0[x * 4 + k * sstep + 1];
+                dst0[k * 4 + 2] = s0[x * 4 + k * sstep + 2];
+                dst0[k * 4 + 3] = s0[x * 4 + k * sstep + 3];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 4 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -5053,6 +5361,34 @@ static void kanna_rotate_8_c1(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 7 < srch; y += 8)
+    {
+        const unsigned char* s0 = src0;
+        const int sstep = srcstride;
+        const int dstep = -stride;
+
+        unsigned char* dst0 = dstend + y;
+
+        int x = 0;
+        for (; x + 7 < srcw; x += 8)
+        {
+            transpose_u8_8x8_sse(s0 + x, sstep, dst0, dstep);
+
+            dst0 += 8 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                dst0[k] = s0[x + k * sstep];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 8 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -5908,6 +6244,37 @@ static void kanna_rotate_8_c4(const unsigned char* src, int srcw, int srch, int
 
         src0 += srcwgap + 7 * srcstride;
     }
+#elif __SSE2__
+    for (; y + 3 < srch; y += 4)
+    {
+        const unsigned char* s0 = src0;
+        const int sstep = srcstride;
+        const int dstep = -stride;
+
+        unsigned char* dst0 = dstend + y * 4;
+
+        int x = 0;
+        for (; x + 3 < srcw; x += 4)
+        {
+            transpose_u32_4x4_sse(s0 + x * 4, sstep, dst0, dstep);
+
+            dst0 += 4 * dstep;
+        }
+        for (; x < srcw; x++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                dst0[k * 4] = s0[x * 4 + k * sstep];
+                dst0[k * 4 + 1] = s0[x * 4 + k * sstep + 1];
+                dst0[k * 4 + 2] = s0[x * 4 + k * sstep + 2];
+                dst0[k * 4 + 3] = s0[x * 4 + k * sstep + 3];
+            }
+
+            dst0 += dstep;
+        }
+
+        src0 += 4 * srcstride;
+    }
 #endif // __ARM_NEON
     for (; y < srch; y++)
     {
@@ -26,9 +26,21 @@
 
 #define MIN(a,b) (a)>(b)?(b):(a)
 
-#if NCNN_BENCHMARK
 #include "benchmark.h"
-#endif // NCNN_BENCHMARK
+
+#include "layer/batchnorm.h"
+#include "layer/binaryop.h"
+#include "layer/clip.h"
+#include "layer/convolution.h"
+#include "layer/convolutiondepthwise.h"
+#include "layer/deconvolution.h"
+#include "layer/deconvolutiondepthwise.h"
+#include "layer/eltwise.h"
+#include "layer/gemm.h"
+#include "layer/hardswish.h"
+#include "layer/innerproduct.h"
+#include "layer/layernorm.h"
+#include "layer/relu.h"
 
 #if NCNN_VULKAN
 #include "command.h"
@@ -37,6 +49,39 @@
 
 namespace ncnn {
 
+// per-layer pipeline flags are read without locking once set
+#if NCNN_THREADS && (defined __GNUC__ || defined __clang__)
+static NCNN_FORCEINLINE int atomic_load_flag(const int* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static NCNN_FORCEINLINE void atomic_store_flag(int* p, int v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#elif NCNN_THREADS && defined _MSC_VER
+static NCNN_FORCEINLINE int atomic_load_flag(const int* p)
+{
+    return InterlockedCompareExchange((long volatile*)p, 0, 0);
+}
+
+static NCNN_FORCEINLINE void atomic_store_flag(int* p, int v)
+{
+    InterlockedExchange((long volatile*)p, v);
+}
+#else
+static NCNN_FORCEINLINE int atomic_load_flag(const int* p)
+{
+    return *p;
+}
+
+static NCNN_FORCEINLINE void atomic_store_flag(int* p, int v)
+{
+    *p = v;
+}
+#endif
+
 class NetPrivate
 {
 public:
@@ -51,7 +96,33 @@ public:
 #endif // NCNN_VULKAN
 
     friend class Extractor;
-    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const;
+    // layer runs are appended to profiles unless it is null
+    // recurrent layer states are read from and kept in states unless it is null, one entry per layer
+    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const;
+
+    // run the layers required for blob_index following execution_order
+    int forward_plan(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const;
+
+    // run the planned layers wave by wave, layers within one wave are independent
+    int forward_plan_parallel(const std::vector<int>& plan, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const;
+
+    // run a single layer whose bottom blobs are all available
+    int run_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const;
+
+    // create_pipeline for one layer with the load-time option
+    int create_layer_pipeline(int layer_index) const;
+
+#if NCNN_STDIO
+    // restore the pipelines found in the weight cache file
+    // return 0 if the file matches model_hash and the current cpu and option
+    int load_weight_cache(uint64_t model_hash);
+    int save_weight_cache(uint64_t model_hash) const;
+
+    // hand the kernel variants found in the tuning file to the layers
+    // return 0 if the file matches the current cpu, thread count and layers
+    int load_tuning_file();
+    int save_tuning_file() const;
+#endif // NCNN_STDIO
 
 #if NCNN_VULKAN
     int forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const;
@@ -60,11 +131,11 @@ public:
 
     int convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const;
 
-#ifdef PRINT_MYJ_LOG
     int do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt, int layer_index) const;
-#else
-	int do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const;
-#endif
+
+    // forward a single input recurrent layer continuing from the hidden and cell state in states
+    // states is updated in place with the state after the last step
+    int do_forward_recurrent_layer(const Layer* layer, std::vector<Mat>& blob_mats, std::vector<Mat>& states, const Option& opt) const;
 
 #if NCNN_VULKAN
     int do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const;
@@ -75,10 +146,39 @@ public:
 #if NCNN_STRING
     void update_input_output_names();
 #endif // NCNN_STRING
+    void update_execution_order();
+
+    // delete a builtin layer or hand a custom layer to its registered destroyer
+    void destroy_layer(Layer* layer) const;
+
+    // fold batchnorm, scalar binaryop, activation and layernorm affine into the neighbouring layers
+    // and merge elementwise chains, the fused layers are left unconnected
+    // new layers are created through net the way load_param creates them
+    void fuse_layers(Net* net);
 
     std::vector<Blob> blobs;
     std::vector<Layer*> layers;
 
+    // blobs still produced but holding values changed by the layer fusion, empty without fusion
+    std::vector<unsigned char> blob_fused;
+
+    // topologically sorted layer indexes, built once after loading param
+    std::vector<int> execution_order;
+    // position of each layer in execution_order
+    std::vector<int> execution_rank;
+
+    // layers required for blob_index in execution order, given the blobs available when it was planned
+    struct forward_plan_entry
+    {
+        int blob_index;
+        std::vector<unsigned char> blob_available;
+        std::vector<int> layer_indexes;
+    };
+
+    // plans reused by later extractions, dropped when execution_order changes
+    mutable Mutex plan_lock;
+    mutable std::vector<forward_plan_entry> plan_cache;
+
     std::vector<int> input_blob_indexes;
     std::vector<int> output_blob_indexes;
 #if NCNN_STRING
@@ -88,9 +188,31 @@ public:
 
     std::vector<custom_layer_registry_entry> custom_layer_registry;
 
+    // option passed to create_pipeline, captured in load_model
+    Option pipeline_opt;
+    // pipelines are created when layers first run, guarded by pipeline_lock
+    bool lazy_pipeline;
+    mutable Mutex pipeline_lock;
+    // layers whose create_pipeline has succeeded
+    // set with release order so that a layer seen as created is fully created
+    mutable std::vector<int> pipeline_created;
+
     PoolAllocator* local_blob_allocator;
     PoolAllocator* local_workspace_allocator;
 
+#if NCNN_STDIO
+    // mapped model file referenced by layer weights
+    DataReaderFromMmap* model_mmap;
+
+    // transformed weights cache file, empty if disabled
+    std::string weight_cache_path;
+    // hash of every layer param, set in load_param
+    uint64_t param_hash;
+
+    // tuned kernel variants file, empty if disabled
+    std::string tuning_file_path;
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     const VulkanDevice* vkdev;
 
@@ -107,6 +229,13 @@ NetPrivate::NetPrivate(Option& _opt)
     local_blob_allocator = 0;
     local_workspace_allocator = 0;
 
+    lazy_pipeline = false;
+
+#if NCNN_STDIO
+    model_mmap = 0;
+    param_hash = 0;
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     vkdev = 0;
     weight_vkallocator = 0;
@@ -154,7 +283,7 @@ int NetPrivate::upload_model()
 }
 #endif // NCNN_VULKAN
 
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const
 {
     const Layer* layer = layers[layer_index];
 	//MYJ_LOGE("%s layer_index=%d\n", __FUNCTION__, layer_index);
@@ -168,7 +297,7 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
 
         if (blob_mats[bottom_blob_index].dims == 0)
         {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt);
+            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt, profiles, states);
             if (ret != 0)
                 return ret;
         }
@@ -183,13 +312,218 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
 
             if (blob_mats[bottom_blob_index].dims == 0)
             {
-                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt);
+                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt, profiles, states);
                 if (ret != 0)
                     return ret;
             }
         }
     }
 
+    return run_layer(layer_index, blob_mats, opt, profiles, states);
+}
+
+int NetPrivate::forward_plan(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const
+{
+    const int producer = blobs[blob_index].producer;
+
+    if (execution_rank.size() != layers.size() || producer < 0)
+    {
+        // graph changed after loading or has no valid order, resolve dependencies recursively
+        return forward_layer(producer, blob_mats, opt, profiles, states);
+    }
+
+    // the marked layers depend only on the target and on which blobs are already available,
+    // either fed as input or kept from previous extraction
+    std::vector<unsigned char> blob_available(blobs.size(), 0);
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        blob_available[i] = blob_mats[i].dims != 0;
+    }
+
+    std::vector<int> plan;
+    bool planned = false;
+
+    plan_lock.lock();
+    for (size_t i = 0; i < plan_cache.size(); i++)
+    {
+        const forward_plan_entry& entry = plan_cache[i];
+        if (entry.blob_index == blob_index && entry.blob_available == blob_available)
+        {
+            plan = entry.layer_indexes;
+            planned = true;
+            break;
+        }
+    }
+    plan_lock.unlock();
+
+    if (!planned)
+    {
+        const int last = execution_rank[producer];
+
+        // walk the plan backwards and mark the layers required for blob_index
+        // stop at any blob that is already available
+        std::vector<unsigned char> blob_needed(blobs.size(), 0);
+        std::vector<unsigned char> layer_needed(last + 1, 0);
+
+        blob_needed[blob_index] = 1;
+        for (int i = last; i >= 0; i--)
+        {
+            const Layer* layer = layers[execution_order[i]];
+
+            bool needed = false;
+            for (size_t j = 0; j < layer->tops.size(); j++)
+            {
+                if (blob_needed[layer->tops[j]])
+                {
+                    needed = true;
+                    break;
+                }
+            }
+            if (!needed)
+                continue;
+
+            layer_needed[i] = 1;
+
+            for (size_t j = 0; j < layer->bottoms.size(); j++)
+            {
+                int bottom_blob_index = layer->bottoms[j];
+                if (!blob_available[bottom_blob_index])
+                    blob_needed[bottom_blob_index] = 1;
+            }
+        }
+
+        for (int i = 0; i <= last; i++)
+        {
+            if (layer_needed[i])
+                plan.push_back(execution_order[i]);
+        }
+
+        forward_plan_entry entry;
+        entry.blob_index = blob_index;
+        entry.blob_available = blob_available;
+        entry.layer_indexes = plan;
+
+        plan_lock.lock();
+        // a handful of outputs and input sets per net, keep the most recent ones
+        if (plan_cache.size() >= 16)
+            plan_cache.erase(plan_cache.begin());
+        plan_cache.push_back(entry);
+        plan_lock.unlock();
+    }
+
+    if (opt.use_branch_parallel && opt.num_threads > 1)
+    {
+        return forward_plan_parallel(plan, blob_mats, opt, profiles, states);
+    }
+
+    for (size_t i = 0; i < plan.size(); i++)
+    {
+        int ret = run_layer(plan[i], blob_mats, opt, profiles, states);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int NetPrivate::forward_plan_parallel(const std::vector<int>& plan, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const
+{
+    // assign every planned layer to the earliest wave where all its bottoms are ready
+    // blobs available before this run are ready at wave 0
+    std::vector<int> blob_wave(blobs.size(), 0);
+    std::vector<std::vector<int> > waves;
+    for (size_t i = 0; i < plan.size(); i++)
+    {
+        const int layer_index = plan[i];
+        const Layer* layer = layers[layer_index];
+
+        int wave = 0;
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
+        {
+            wave = std::max(wave, blob_wave[layer->bottoms[j]]);
+        }
+        for (size_t j = 0; j < layer->tops.size(); j++)
+        {
+            blob_wave[layer->tops[j]] = wave + 1;
+        }
+
+        if ((int)waves.size() <= wave)
+            waves.resize(wave + 1);
+
+        waves[wave].push_back(layer_index);
+    }
+
+    for (size_t i = 0; i < waves.size(); i++)
+    {
+        const std::vector<int>& wave = waves[i];
+        const int wave_size = (int)wave.size();
+
+        if (wave_size == 1)
+        {
+            int ret = run_layer(wave[0], blob_mats, opt, profiles, states);
+            if (ret != 0)
+                return ret;
+
+            continue;
+        }
+
+        // split the thread budget among independent branches
+        // every branch opens its own nested parallel regions with its share of the threads
+        const int num_threads = std::min(opt.num_threads, wave_size);
+
+        Option opt_branch = opt;
+        opt_branch.num_threads = std::max(1, opt.num_threads / wave_size);
+
+        std::vector<int> rets(wave_size, 0);
+
+        // branches record into their own slot, appended in plan order after the wave
+        std::vector<std::vector<LayerProfile> > wave_profiles(profiles ? wave_size : 0);
+
+        #pragma omp parallel for num_threads(num_threads)
+        for (int j = 0; j < wave_size; j++)
+        {
+            rets[j] = run_layer(wave[j], blob_mats, opt_branch, profiles ? &wave_profiles[j] : 0, states);
+        }
+
+        for (size_t j = 0; j < wave_profiles.size(); j++)
+        {
+            profiles->insert(profiles->end(), wave_profiles[j].begin(), wave_profiles[j].end());
+        }
+
+        for (int j = 0; j < wave_size; j++)
+        {
+            if (rets[j] != 0)
+                return rets[j];
+        }
+    }
+
+    return 0;
+}
+
+// lstm, gru and rnn wired with a single input and output keep their state across extract calls in streaming mode
+// layers with explicit state blobs are left to the graph
+static bool is_streaming_recurrent_layer(const Layer* layer)
+{
+    if (layer->typeindex != LayerType::LSTM && layer->typeindex != LayerType::GRU && layer->typeindex != LayerType::RNN)
+        return false;
+
+    return layer->bottoms.size() == 1 && layer->tops.size() == 1;
+}
+
+int NetPrivate::run_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, std::vector<LayerProfile>* profiles, std::vector<std::vector<Mat> >* states) const
+{
+    const Layer* layer = layers[layer_index];
+
+    // double-checked, the lock is only taken until the pipeline exists
+    if (lazy_pipeline && !atomic_load_flag(&pipeline_created[layer_index]))
+    {
+        pipeline_lock.lock();
+        int cret = pipeline_created[layer_index] ? 0 : create_layer_pipeline(layer_index);
+        pipeline_lock.unlock();
+        if (cret != 0)
+            return cret;
+    }
+
 #if NCNN_BENCHMARK
     double start = get_current_time();
     Mat bottom_blob;
@@ -204,22 +538,32 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
         bottom_blob.elemsize = blob_mats[bottom_blob_index].elemsize;
     }
 #endif
-#ifdef PRINT_MYJ_LOG
-    int ret = do_forward_layer(layer, blob_mats, opt, layer_index);
-#else
-	int ret = do_forward_layer(layer, blob_mats, opt);
-#endif
-	//MYJ_LOGE("%s do_forward_layer done layer_index=%d\n", __FUNCTION__, layer_index);
-
-	//if (layer->one_blob_only) {
-	//	int idx_bot = layer->bottoms[0];
-	//	int idx_top = layer->tops[0];
-	//	Mat bot = blob_mats[idx_bot];
-	//	if (bot.dims!=0) {
-	//		printf("layer_index=%d\n", layer_index);
-	//	}
-	//}
-
+    // shapes are taken before forward, light mode may release the bottom blobs
+    LayerProfile profile;
+    if (profiles)
+    {
+        profile.layer = layer;
+        profile.layer_index = layer_index;
+        profile.num_threads = opt.num_threads;
+        profile.thread_index = get_omp_thread_num();
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            profile.bottom_shapes.push_back(blob_mats[layer->bottoms[i]].shape());
+        }
+        profile.start = get_current_time();
+    }
+    int ret = states && is_streaming_recurrent_layer(layer) ? do_forward_recurrent_layer(layer, blob_mats, (*states)[layer_index], opt) : do_forward_layer(layer, blob_mats, opt, layer_index);
+    if (profiles)
+    {
+        profile.end = get_current_time();
+        for (size_t i = 0; i < layer->tops.size(); i++)
+        {
+            const Mat& top_blob = blob_mats[layer->tops[i]];
+            profile.top_shapes.push_back(top_blob.shape());
+            profile.top_blob_bytes += top_blob.total() * top_blob.elemsize;
+        }
+        profiles->push_back(profile);
+    }
 #if NCNN_BENCHMARK
     double end = get_current_time();
     if (layer->one_blob_only)
@@ -242,84 +586,568 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
     return 0;
 }
 
+int NetPrivate::create_layer_pipeline(int layer_index) const
+{
+    Layer* layer = layers[layer_index];
+
+    Option opt1 = pipeline_opt;
 #if NCNN_VULKAN
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+    if (pipeline_opt.use_vulkan_compute)
+    {
+        if (!layer->support_image_storage) opt1.use_image_storage = false;
+    }
+#endif // NCNN_VULKAN
+
+    int cret = layer->create_pipeline(opt1);
+    if (cret != 0)
+    {
+#if NCNN_STRING
+        NCNN_LOGE("layer create_pipeline %d %s failed", layer_index, layer->name.c_str());
+#else
+        NCNN_LOGE("layer create_pipeline %d failed", layer_index);
+#endif
+        return cret;
+    }
+
+    atomic_store_flag(&pipeline_created[layer_index], 1);
+
+    return 0;
+}
+
+#if NCNN_STDIO
+// fnv-1a over 64-bit words
+static uint64_t fnv1a_update(uint64_t hash, const void* buf, size_t size)
 {
-    const Layer* layer = layers[layer_index];
+    const unsigned char* p = (const unsigned char*)buf;
 
-    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
+    size_t i = 0;
+    for (; i + 7 < size; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        hash = (hash ^ v) * 0x100000001b3ULL;
+    }
+    for (; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
 
-    bool cmd_submit_and_wait = false;
+    return hash;
+}
 
-    if (layer->one_blob_only)
+// hash the type and parsed value of every param, so text and binary params hash alike
+static uint64_t param_dict_hash(uint64_t hash, int typeindex, const ParamDict& pd)
+{
+    hash = fnv1a_update(hash, &typeindex, sizeof(int));
+
+    for (int id = 0; id < NCNN_MAX_PARAM_COUNT; id++)
     {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
+        const int type = pd.type(id);
+        if (type == 0)
+            continue;
 
-        if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-        {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
-            if (ret != 0)
-                return ret;
-        }
+        hash = fnv1a_update(hash, &id, sizeof(int));
+        hash = fnv1a_update(hash, &type, sizeof(int));
 
-        if (layer->support_vulkan)
+        if (type == 4 || type == 5 || type == 6)
         {
-            if (blob_mats_gpu[bottom_blob_index].dims == 0)
-            {
-                // host to buffer
-                cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
-
-                if (opt.lightmode)
-                {
-                    // delete after taken in light mode
-                    blob_mats[bottom_blob_index].release();
-                }
-            }
+            Mat v = pd.get(id, Mat());
+            hash = fnv1a_update(hash, v.data, v.total() * v.elemsize);
         }
         else
         {
-            if (blob_mats[bottom_blob_index].dims == 0)
-            {
-                Option opt_download = opt;
-                opt_download.use_packing_layout = layer->support_packing;
+            // int and float share the storage
+            const int i = pd.get(id, 0);
+            hash = fnv1a_update(hash, &i, sizeof(int));
+        }
+    }
 
-                // buffer to host
-                cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt_download);
+    return hash;
+}
 
-                if (opt.lightmode)
-                {
-                    // delete after taken in light mode
-                    blob_mats_gpu[bottom_blob_index].release();
-                }
+// passes through another reader and hashes every byte read or referenced
+class DataReaderWithHash : public DataReader
+{
+public:
+    DataReaderWithHash(const DataReader& _dr, uint64_t _hash)
+        : dr(_dr), hash(_hash)
+    {
+    }
 
-                cmd_submit_and_wait = true;
-            }
-        }
+    virtual size_t read(void* buf, size_t size) const
+    {
+        size_t nread = dr.read(buf, size);
+        update(buf, nread);
+        return nread;
     }
-    else
+
+    virtual size_t reference(size_t size, const void** buf) const
     {
-        // load bottom blobs
-        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
-        {
-            int bottom_blob_index = layer->bottoms[i];
+        size_t nread = dr.reference(size, buf);
+        if (nread)
+            update(*buf, nread);
+        return nread;
+    }
 
-            if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-            {
-                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
-                if (ret != 0)
-                    return ret;
-            }
+    void update(const void* buf, size_t size) const
+    {
+        hash = fnv1a_update(hash, buf, size);
+    }
 
-            if (layer->support_vulkan)
-            {
-                if (blob_mats_gpu[bottom_blob_index].dims == 0)
-                {
-                    // host to buffer
-                    cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+    const DataReader& dr;
+    mutable uint64_t hash;
+};
 
-                    if (opt.lightmode)
+struct weight_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t model_hash;
+    uint64_t library_hash;
+    uint32_t cpu_features;
+    uint32_t option_bits;
+    int32_t l2_cache_size;
+    int32_t num_threads;
+    int32_t layer_count;
+    int32_t reserved;
+};
+
+// the isa level decides which layer implementation and packing are used
+static uint32_t get_cpu_feature_bits()
+{
+    return (cpu_support_x86_avx() << 0)
+           | (cpu_support_x86_fma() << 1)
+           | (cpu_support_x86_xop() << 2)
+           | (cpu_support_x86_f16c() << 3)
+           | (cpu_support_x86_avx2() << 4)
+           | (cpu_support_x86_avx_vnni() << 5)
+           | (cpu_support_x86_avx512() << 6)
+           | (cpu_support_x86_avx512_vnni() << 7)
+           | (cpu_support_x86_avx512_bf16() << 8)
+           | (cpu_support_x86_avx512_fp16() << 9);
+}
+
+// every option affecting the algorithm choice and the transformed weight layout
+static uint32_t get_option_bits(const Option& opt)
+{
+    return (opt.use_packing_layout << 0)
+           | (opt.use_winograd_convolution << 1)
+           | (opt.use_sgemm_convolution << 2)
+           | (opt.use_int8_inference << 3)
+           | (opt.use_bf16_storage << 4)
+           | (opt.use_fp16_packed << 5)
+           | (opt.use_fp16_storage << 6)
+           | (opt.use_fp16_arithmetic << 7)
+           | (opt.use_int8_packed << 8)
+           | (opt.use_int8_storage << 9)
+           | (opt.use_int8_arithmetic << 10)
+           | (opt.use_winograd23_convolution << 11)
+           | (opt.use_winograd43_convolution << 12)
+           | (opt.use_winograd63_convolution << 13)
+           | (opt.use_layer_fusion << 14)
+           | (opt.use_algorithm_tuning << 15);
+}
+
+static void get_weight_cache_header(weight_cache_header& header, uint64_t model_hash, const Option& opt, int layer_count)
+{
+    memset(&header, 0, sizeof(header));
+
+    header.magic = 0x4357434e; // NCWC
+    header.version = 4;
+    header.model_hash = model_hash;
+
+    // weights transformed by another ncnn build may follow another layout
+    static const char build_id[] = NCNN_VERSION_STRING " " __DATE__ " " __TIME__;
+    header.library_hash = fnv1a_update(0xcbf29ce484222325ULL, build_id, sizeof(build_id) - 1);
+
+    header.cpu_features = get_cpu_feature_bits();
+
+    header.option_bits = get_option_bits(opt);
+
+    // sgemm selection and gemm tiling
+    header.l2_cache_size = get_cpu_level2_cache_size();
+    header.num_threads = opt.num_threads;
+    header.layer_count = layer_count;
+}
+
+// at most remaining bytes of mat data may follow in the file
+static int read_weight_cache_mat(FILE* fp, size_t remaining, Mat& m)
+{
+    int32_t shape[7];
+    if (fread(shape, sizeof(int32_t), 7, fp) != 7)
+        return -1;
+
+    const int dims = shape[0];
+    const int w = shape[1];
+    const int h = shape[2];
+    const int d = shape[3];
+    const int c = shape[4];
+    const int elemsize = shape[5];
+    const int elempack = shape[6];
+
+    if (dims == 0)
+    {
+        m.release();
+        return 0;
+    }
+
+    // reject a corrupted shape before allocating anything
+    if (dims < 0 || dims > 4 || w <= 0 || h <= 0 || d <= 0 || c <= 0)
+        return -1;
+    if ((dims < 2 && h != 1) || (dims < 3 && c != 1) || (dims < 4 && d != 1))
+        return -1;
+    if (elempack <= 0 || elemsize <= 0 || elemsize % elempack != 0)
+        return -1;
+
+    const int elembytes = elemsize / elempack;
+    if (elembytes != 1 && elembytes != 2 && elembytes != 4)
+        return -1;
+
+    size_t size = (size_t)elemsize;
+    const int shape_dims[4] = {w, h, d, c};
+    for (int i = 0; i < 4; i++)
+    {
+        if ((size_t)shape_dims[i] > remaining / size)
+            return -1;
+
+        size *= shape_dims[i];
+    }
+
+    if (dims == 1) m.create(w, (size_t)elemsize, elempack);
+    if (dims == 2) m.create(w, h, (size_t)elemsize, elempack);
+    if (dims == 3) m.create(w, h, c, (size_t)elemsize, elempack);
+    if (dims == 4) m.create(w, h, d, c, (size_t)elemsize, elempack);
+    if (m.empty())
+        return -1;
+
+    const size_t channel_size = (size_t)w * h * d * elemsize;
+    for (int q = 0; q < c; q++)
+    {
+        if (fread((unsigned char*)m.data + m.cstep * q * elemsize, 1, channel_size, fp) != channel_size)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int write_weight_cache_mat(FILE* fp, const Mat& m)
+{
+    int32_t shape[7] = {m.dims, m.w, m.h, m.d, m.c, (int32_t)m.elemsize, m.elempack};
+    if (m.empty())
+        memset(shape, 0, sizeof(shape));
+
+    if (fwrite(shape, sizeof(int32_t), 7, fp) != 7)
+        return -1;
+
+    const size_t size = (size_t)m.w * m.h * m.d * m.elemsize;
+    for (int q = 0; q < shape[4]; q++)
+    {
+        if (fwrite((const unsigned char*)m.data + m.cstep * q * m.elemsize, 1, size, fp) != size)
+            return -1;
+    }
+
+    return 0;
+}
+
+int NetPrivate::load_weight_cache(uint64_t model_hash)
+{
+    FILE* fp = fopen(weight_cache_path.c_str(), "rb");
+    if (!fp)
+        return -1;
+
+    const int layer_count = (int)layers.size();
+
+    weight_cache_header header;
+    get_weight_cache_header(header, model_hash, pipeline_opt, layer_count);
+
+    weight_cache_header file_header;
+    if (fread(&file_header, sizeof(file_header), 1, fp) != 1 || memcmp(&header, &file_header, sizeof(header)) != 0)
+    {
+        // stale cache from another model, cpu, option or ncnn build
+        fclose(fp);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long file_size = ftell(fp);
+    fseek(fp, (long)sizeof(file_header), SEEK_SET);
+
+    // read everything before touching any layer, so a truncated file changes nothing
+    std::vector<std::vector<Mat> > pipeline_data(layer_count);
+    std::vector<unsigned char> cached(layer_count, 0);
+    for (int i = 0; i < layer_count; i++)
+    {
+        int32_t mat_count;
+        if (fread(&mat_count, sizeof(int32_t), 1, fp) != 1)
+        {
+            fclose(fp);
+            return -1;
+        }
+
+        if (mat_count < 0)
+            continue;
+
+        // every mat starts with its shape
+        if ((size_t)mat_count > (size_t)file_size / (sizeof(int32_t) * 7))
+        {
+            NCNN_LOGE("weight cache %s corrupted", weight_cache_path.c_str());
+            fclose(fp);
+            return -1;
+        }
+
+        pipeline_data[i].resize(mat_count);
+        for (int j = 0; j < mat_count; j++)
+        {
+            const long offset = ftell(fp);
+            const size_t remaining = file_size > offset ? (size_t)(file_size - offset) : 0;
+            if (read_weight_cache_mat(fp, remaining, pipeline_data[i][j]) != 0)
+            {
+                NCNN_LOGE("weight cache %s truncated or corrupted", weight_cache_path.c_str());
+                fclose(fp);
+                return -1;
+            }
+        }
+
+        cached[i] = 1;
+    }
+
+    fclose(fp);
+
+    for (int i = 0; i < layer_count; i++)
+    {
+        if (!cached[i])
+            continue;
+
+        int lret = layers[i]->load_pipeline(pipeline_data[i], pipeline_opt);
+        if (lret != 0)
+        {
+            // leave it to create_pipeline
+            layers[i]->destroy_pipeline(pipeline_opt);
+            continue;
+        }
+
+        pipeline_created[i] = 1;
+    }
+
+    return 0;
+}
+
+int NetPrivate::save_weight_cache(uint64_t model_hash) const
+{
+    FILE* fp = fopen(weight_cache_path.c_str(), "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", weight_cache_path.c_str());
+        return -1;
+    }
+
+    const int layer_count = (int)layers.size();
+
+    weight_cache_header header;
+    get_weight_cache_header(header, model_hash, pipeline_opt, layer_count);
+
+    int ret = fwrite(&header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+    for (int i = 0; i < layer_count && ret == 0; i++)
+    {
+        std::vector<Mat> pipeline_data;
+        int32_t mat_count = -1;
+        if (pipeline_created[i] && layers[i]->save_pipeline(pipeline_data) == 0)
+        {
+            mat_count = (int32_t)pipeline_data.size();
+        }
+
+        if (fwrite(&mat_count, sizeof(int32_t), 1, fp) != 1)
+        {
+            ret = -1;
+            break;
+        }
+
+        for (int j = 0; j < mat_count; j++)
+        {
+            if (write_weight_cache_mat(fp, pipeline_data[j]) != 0)
+            {
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    if (ret != 0)
+    {
+        NCNN_LOGE("write weight cache %s failed", weight_cache_path.c_str());
+        remove(weight_cache_path.c_str());
+    }
+
+    return ret;
+}
+
+int NetPrivate::load_tuning_file()
+{
+    FILE* fp = fopen(tuning_file_path.c_str(), "rb");
+    if (!fp)
+        return -1;
+
+    const int layer_count = (int)layers.size();
+
+    // header
+    // ncnn-tuning version cpu_features option_bits num_threads layer_count
+    int version = 0;
+    unsigned int cpu_features = 0;
+    unsigned int option_bits = 0;
+    int num_threads = 0;
+    int file_layer_count = 0;
+    int nscan = fscanf(fp, "ncnn-tuning %d %u %u %d %d", &version, &cpu_features, &option_bits, &num_threads, &file_layer_count);
+    if (nscan != 5 || version != 2 || cpu_features != get_cpu_feature_bits() || option_bits != get_option_bits(pipeline_opt) || num_threads != pipeline_opt.num_threads || file_layer_count != layer_count)
+    {
+        // stale file from another cpu, option, thread count or model
+        fclose(fp);
+        return -1;
+    }
+
+    // one line per tuned layer
+    // layer_index typeindex w h c algo
+    for (;;)
+    {
+        int layer_index = 0;
+        int typeindex = 0;
+        int w = 0;
+        int h = 0;
+        int c = 0;
+        int algo = -1;
+        nscan = fscanf(fp, "%d %d %d %d %d %d", &layer_index, &typeindex, &w, &h, &c, &algo);
+        if (nscan != 6)
+            break;
+
+        if (layer_index < 0 || layer_index >= layer_count)
+            continue;
+
+        Layer* layer = layers[layer_index];
+        if (layer->typeindex != typeindex || layer->bottom_shapes.empty())
+            continue;
+
+        const Mat& shape = layer->bottom_shapes[0];
+        if (shape.w != w || shape.h != h || shape.c != c)
+            continue;
+
+        layer->set_tuned_algorithm(algo);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+int NetPrivate::save_tuning_file() const
+{
+    FILE* fp = fopen(tuning_file_path.c_str(), "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", tuning_file_path.c_str());
+        return -1;
+    }
+
+    const int layer_count = (int)layers.size();
+
+    fprintf(fp, "ncnn-tuning %d %u %u %d %d\n", 2, get_cpu_feature_bits(), get_option_bits(pipeline_opt), pipeline_opt.num_threads, layer_count);
+
+    for (int i = 0; i < layer_count; i++)
+    {
+        const Layer* layer = layers[i];
+
+        const int algo = layer->get_tuned_algorithm();
+        if (algo == -1 || layer->bottom_shapes.empty())
+            continue;
+
+        const Mat& shape = layer->bottom_shapes[0];
+        fprintf(fp, "%d %d %d %d %d %d\n", i, layer->typeindex, shape.w, shape.h, shape.c, algo);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+#if NCNN_VULKAN
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+{
+    const Layer* layer = layers[layer_index];
+
+    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
+
+    bool cmd_submit_and_wait = false;
+
+    if (layer->one_blob_only)
+    {
+        // load bottom blob
+        int bottom_blob_index = layer->bottoms[0];
+
+        if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
+        {
+            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
+            if (ret != 0)
+                return ret;
+        }
+
+        if (layer->support_vulkan)
+        {
+            if (blob_mats_gpu[bottom_blob_index].dims == 0)
+            {
+                // host to buffer
+                cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+
+                if (opt.lightmode)
+                {
+                    // delete after taken in light mode
+                    blob_mats[bottom_blob_index].release();
+                }
+            }
+        }
+        else
+        {
+            if (blob_mats[bottom_blob_index].dims == 0)
+            {
+                Option opt_download = opt;
+                opt_download.use_packing_layout = layer->support_packing;
+
+                // buffer to host
+                cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt_download);
+
+                if (opt.lightmode)
+                {
+                    // delete after taken in light mode
+                    blob_mats_gpu[bottom_blob_index].release();
+                }
+
+                cmd_submit_and_wait = true;
+            }
+        }
+    }
+    else
+    {
+        // load bottom blobs
+        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
+            {
+                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
+                if (ret != 0)
+                    return ret;
+            }
+
+            if (layer->support_vulkan)
+            {
+                if (blob_mats_gpu[bottom_blob_index].dims == 0)
+                {
+                    // host to buffer
+                    cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+
+                    if (opt.lightmode)
                     {
                         // delete after taken in light mode
                         blob_mats[bottom_blob_index].release();
@@ -392,7 +1220,7 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std:
             bottom_blob = blob_mats[bottom_blob_index].shape();
         }
 #endif
-        ret = do_forward_layer(layer, blob_mats, opt);
+        ret = do_forward_layer(layer, blob_mats, opt, layer_index);
 #if NCNN_BENCHMARK
         double end = get_current_time();
         if (layer->one_blob_only)
@@ -727,7 +1555,7 @@ IMAGE_ALLOCATION_FAILED:
             bottom_blob = blob_mats[bottom_blob_index].shape();
         }
 #endif
-        ret = do_forward_layer(layer, blob_mats, opt);
+        ret = do_forward_layer(layer, blob_mats, opt, layer_index);
 #if NCNN_BENCHMARK
         double end = get_current_time();
         if (layer->one_blob_only)
@@ -949,11 +1777,7 @@ int input_output_show(Mat blob,int bot_top,int idx,int n_all,int layer_index)
 #endif
 };
 
-#ifdef PRINT_MYJ_LOG
 int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt, int layer_index) const
-#else
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const
-#endif
 {
 	MYJ_LOGE("#----------------------%s layer_index=%d, type=%s-----------------------#\n", __FUNCTION__,layer_index,layer->type.c_str());
     if (layer->one_blob_only)
@@ -1025,24 +1849,211 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
                 return ret;
 
             // store top blob
-            blob_mats[top_blob_index] = top_blob;
+            blob_mats[top_blob_index] = top_blob;
+        }
+		input_output_show(blob_mats[top_blob_index],1,0,1, layer_index);
+
+        if (opt.lightmode)
+        {
+            // delete after taken in light mode
+            blob_mats[bottom_blob_index].release();
+        }
+    }
+    else
+    {
+        std::vector<Mat> bottom_blobs(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
+            bottom_blobs[i].release();
+
+            if (opt.lightmode)
+            {
+                // deep copy for inplace forward if data is shared
+                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+                {
+                    bottom_blobs[i] = bottom_blob_ref.clone(opt.blob_allocator);
+                }
+            }
+            if (bottom_blobs[i].dims == 0)
+            {
+                bottom_blobs[i] = bottom_blob_ref;
+            }
+
+            convert_layout(bottom_blobs[i], layer, opt);
+        }
+
+        // forward
+		for (int i = 0; i < layer->bottoms.size(); i++) {
+			input_output_show(bottom_blobs[i], 0, i,layer->bottoms.size(),layer_index);
+		}
+
+        if (opt.lightmode && layer->support_inplace)
+        {
+            std::vector<Mat>& bottom_top_blobs = bottom_blobs;
+            int ret = layer->forward_inplace(bottom_top_blobs, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats[top_blob_index] = bottom_top_blobs[i];
+            }
+        }
+        else
+        {
+            std::vector<Mat> top_blobs(layer->tops.size());
+            int ret = layer->forward(bottom_blobs, top_blobs, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats[top_blob_index] = top_blobs[i];
+            }
+        }
+		for (int i = 0; i < layer->tops.size(); i++) {
+			int top_blob_index = layer->tops[i];
+			input_output_show(blob_mats[top_blob_index], 1,i,layer->tops.size(), layer_index);
+		}
+
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            if (opt.lightmode)
+            {
+                // delete after taken in light mode
+                blob_mats[bottom_blob_index].release();
+            }
+        }
+    }
+
+    return 0;
+}
+
+int NetPrivate::do_forward_recurrent_layer(const Layer* layer, std::vector<Mat>& blob_mats, std::vector<Mat>& states, const Option& opt) const
+{
+    const size_t state_count = layer->typeindex == LayerType::LSTM ? 2 : 1;
+
+    int bottom_blob_index = layer->bottoms[0];
+    int top_blob_index = layer->tops[0];
+
+    // the layer starts from zero state on the first run
+    const bool has_states = states.size() == state_count;
+
+    std::vector<Mat> bottom_blobs(has_states ? 1 + state_count : 1);
+    std::vector<Mat> top_blobs(1 + state_count);
+
+    bottom_blobs[0] = blob_mats[bottom_blob_index];
+    convert_layout(bottom_blobs[0], layer, opt);
+
+    if (has_states)
+    {
+        // same mat as bottom and top, the layer advances the state in place without allocation
+        for (size_t i = 0; i < state_count; i++)
+        {
+            bottom_blobs[1 + i] = states[i];
+            top_blobs[1 + i] = states[i];
+        }
+    }
+
+    int ret = layer->forward(bottom_blobs, top_blobs, opt);
+    if (ret != 0)
+        return ret;
+
+    blob_mats[top_blob_index] = top_blobs[0];
+
+    for (size_t i = 0; i < state_count; i++)
+    {
+        if (has_states && top_blobs[1 + i].data == states[i].data)
+            continue;
+
+        // detach the state from the blob allocator so it outlives this extraction
+        states.resize(state_count);
+        states[i] = top_blobs[1 + i].clone();
+    }
+
+    if (opt.lightmode)
+    {
+        // delete after taken in light mode
+        blob_mats[bottom_blob_index].release();
+    }
+
+    return 0;
+}
+
+#if NCNN_VULKAN
+int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+{
+    if (layer->one_blob_only)
+    {
+        // load bottom blob
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+
+        VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
+        VkMat bottom_blob;
+
+        if (opt.lightmode)
+        {
+            // deep copy for inplace forward if data is shared
+            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            {
+                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
+                //                     NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+            }
+        }
+        if (bottom_blob.dims == 0)
+        {
+            bottom_blob = bottom_blob_ref;
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            VkMat& bottom_top_blob = bottom_blob;
+            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu[top_blob_index] = bottom_top_blob;
+        }
+        else
+        {
+            VkMat top_blob;
+            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu[top_blob_index] = top_blob;
         }
-		input_output_show(blob_mats[top_blob_index],1,0,1, layer_index);
 
         if (opt.lightmode)
         {
             // delete after taken in light mode
-            blob_mats[bottom_blob_index].release();
+            blob_mats_gpu[bottom_blob_index].release();
         }
     }
     else
     {
-        std::vector<Mat> bottom_blobs(layer->bottoms.size());
+        // load bottom blobs
+        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
         for (size_t i = 0; i < layer->bottoms.size(); i++)
         {
             int bottom_blob_index = layer->bottoms[i];
 
-            Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
+            VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
             bottom_blobs[i].release();
 
             if (opt.lightmode)
@@ -1050,26 +2061,21 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
                 // deep copy for inplace forward if data is shared
                 if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
                 {
-                    bottom_blobs[i] = bottom_blob_ref.clone(opt.blob_allocator);
+                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
+                    //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
                 }
             }
             if (bottom_blobs[i].dims == 0)
             {
                 bottom_blobs[i] = bottom_blob_ref;
             }
-
-            convert_layout(bottom_blobs[i], layer, opt);
         }
 
         // forward
-		for (int i = 0; i < layer->bottoms.size(); i++) {
-			input_output_show(bottom_blobs[i], 0, i,layer->bottoms.size(),layer_index);
-		}
-
         if (opt.lightmode && layer->support_inplace)
         {
-            std::vector<Mat>& bottom_top_blobs = bottom_blobs;
-            int ret = layer->forward_inplace(bottom_top_blobs, opt);
+            std::vector<VkMat>& bottom_top_blobs = bottom_blobs;
+            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
             if (ret != 0)
                 return ret;
 
@@ -1078,13 +2084,13 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
             {
                 int top_blob_index = layer->tops[i];
 
-                blob_mats[top_blob_index] = bottom_top_blobs[i];
+                blob_mats_gpu[top_blob_index] = bottom_top_blobs[i];
             }
         }
         else
         {
-            std::vector<Mat> top_blobs(layer->tops.size());
-            int ret = layer->forward(bottom_blobs, top_blobs, opt);
+            std::vector<VkMat> top_blobs(layer->tops.size());
+            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
             if (ret != 0)
                 return ret;
 
@@ -1093,13 +2099,9 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
             {
                 int top_blob_index = layer->tops[i];
 
-                blob_mats[top_blob_index] = top_blobs[i];
+                blob_mats_gpu[top_blob_index] = top_blobs[i];
             }
         }
-		for (int i = 0; i < layer->tops.size(); i++) {
-			int top_blob_index = layer->tops[i];
-			input_output_show(blob_mats[top_blob_index], 1,i,layer->tops.size(), layer_index);
-		}
 
         for (size_t i = 0; i < layer->bottoms.size(); i++)
         {
@@ -1108,7 +2110,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
             if (opt.lightmode)
             {
                 // delete after taken in light mode
-                blob_mats[bottom_blob_index].release();
+                blob_mats_gpu[bottom_blob_index].release();
             }
         }
     }
@@ -1116,8 +2118,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats
     return 0;
 }
 
-#if NCNN_VULKAN
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
 {
     if (layer->one_blob_only)
     {
@@ -1125,8 +2126,8 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
         int bottom_blob_index = layer->bottoms[0];
         int top_blob_index = layer->tops[0];
 
-        VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
-        VkMat bottom_blob;
+        VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
+        VkImageMat bottom_blob;
 
         if (opt.lightmode)
         {
@@ -1134,7 +2135,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
             if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
             {
                 cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
-                //                     NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+                //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
             }
         }
         if (bottom_blob.dims == 0)
@@ -1145,41 +2146,40 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
         // forward
         if (opt.lightmode && layer->support_inplace)
         {
-            VkMat& bottom_top_blob = bottom_blob;
+            VkImageMat& bottom_top_blob = bottom_blob;
             int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
             if (ret != 0)
                 return ret;
 
             // store top blob
-            blob_mats_gpu[top_blob_index] = bottom_top_blob;
+            blob_mats_gpu_image[top_blob_index] = bottom_top_blob;
         }
         else
         {
-            VkMat top_blob;
+            VkImageMat top_blob;
             int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
             if (ret != 0)
                 return ret;
 
             // store top blob
-            blob_mats_gpu[top_blob_index] = top_blob;
+            blob_mats_gpu_image[top_blob_index] = top_blob;
         }
 
         if (opt.lightmode)
         {
             // delete after taken in light mode
-            blob_mats_gpu[bottom_blob_index].release();
+            blob_mats_gpu_image[bottom_blob_index].release();
         }
     }
     else
     {
         // load bottom blobs
-        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
+        std::vector<VkImageMat> bottom_blobs(layer->bottoms.size());
         for (size_t i = 0; i < layer->bottoms.size(); i++)
         {
             int bottom_blob_index = layer->bottoms[i];
 
-            VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
-            bottom_blobs[i].release();
+            VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
 
             if (opt.lightmode)
             {
@@ -1187,7 +2187,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
                 if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
                 {
                     cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
-                    //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
+                    //                             NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
                 }
             }
             if (bottom_blobs[i].dims == 0)
@@ -1199,7 +2199,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
         // forward
         if (opt.lightmode && layer->support_inplace)
         {
-            std::vector<VkMat>& bottom_top_blobs = bottom_blobs;
+            std::vector<VkImageMat>& bottom_top_blobs = bottom_blobs;
             int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
             if (ret != 0)
                 return ret;
@@ -1209,12 +2209,12 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
             {
                 int top_blob_index = layer->tops[i];
 
-                blob_mats_gpu[top_blob_index] = bottom_top_blobs[i];
+                blob_mats_gpu_image[top_blob_index] = bottom_top_blobs[i];
             }
         }
         else
         {
-            std::vector<VkMat> top_blobs(layer->tops.size());
+            std::vector<VkImageMat> top_blobs(layer->tops.size());
             int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
             if (ret != 0)
                 return ret;
@@ -1224,7 +2224,7 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
             {
                 int top_blob_index = layer->tops[i];
 
-                blob_mats_gpu[top_blob_index] = top_blobs[i];
+                blob_mats_gpu_image[top_blob_index] = top_blobs[i];
             }
         }
 
@@ -1235,160 +2235,705 @@ int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_ma
             if (opt.lightmode)
             {
                 // delete after taken in light mode
-                blob_mats_gpu[bottom_blob_index].release();
+                blob_mats_gpu_image[bottom_blob_index].release();
             }
         }
     }
 
     return 0;
 }
+#endif // NCNN_VULKAN
 
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
+void NetPrivate::update_input_output_indexes()
 {
-    if (layer->one_blob_only)
+    input_blob_indexes.clear();
+    output_blob_indexes.clear();
+
+    for (size_t i = 0; i < layers.size(); i++)
     {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
-        int top_blob_index = layer->tops[0];
+        if (layers[i]->typeindex == LayerType::Input)
+        {
+            int blob_index = layers[i]->tops[0];
+            input_blob_indexes.push_back(blob_index);
+        }
+    }
 
-        VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
-        VkImageMat bottom_blob;
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        if (blobs[i].producer != -1 && blobs[i].consumer == -1)
+        {
+            output_blob_indexes.push_back(i);
+        }
+    }
+}
 
-        if (opt.lightmode)
+void NetPrivate::update_execution_order()
+{
+    execution_order.clear();
+    execution_rank.clear();
+    plan_cache.clear();
+
+    const int layer_count = (int)layers.size();
+
+    // kahn topological sort, sweep layers in index order and emit every ready one
+    // so that an already sorted param file keeps its original order in a single sweep
+    std::vector<int> pending(layer_count, 0);
+    std::vector<std::vector<int> > dependents(layer_count);
+    for (int i = 0; i < layer_count; i++)
+    {
+        const Layer* layer = layers[i];
+        if (!layer)
+            return;
+
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
         {
-            // deep copy for inplace forward if data is shared
-            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            int producer = blobs[layer->bottoms[j]].producer;
+            if (producer < 0 || producer >= layer_count)
+                return;
+
+            pending[i]++;
+            dependents[producer].push_back(i);
+        }
+    }
+
+    std::vector<unsigned char> emitted(layer_count, 0);
+    execution_order.reserve(layer_count);
+    for (;;)
+    {
+        size_t emitted_count = execution_order.size();
+
+        for (int i = 0; i < layer_count; i++)
+        {
+            if (emitted[i] || pending[i] != 0)
+                continue;
+
+            emitted[i] = 1;
+            execution_order.push_back(i);
+
+            for (size_t j = 0; j < dependents[i].size(); j++)
             {
-                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
-                //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+                pending[dependents[i][j]]--;
             }
         }
-        if (bottom_blob.dims == 0)
+
+        if (execution_order.size() == emitted_count)
+            break;
+    }
+
+    if ((int)execution_order.size() != layer_count)
+    {
+        NCNN_LOGE("network graph has cycle, fallback to recursive forward");
+        execution_order.clear();
+        return;
+    }
+
+    execution_rank.resize(layer_count);
+    for (int i = 0; i < layer_count; i++)
+    {
+        execution_rank[execution_order[i]] = i;
+    }
+}
+
+// layers holding one row of weights per output channel, with optional bias and fused activation
+struct FusableLayer
+{
+    int num_output;
+    int* bias_term;
+    Mat* weight_data;
+    Mat* bias_data;
+    // per-group scales of weight-only quantized rows, scaled in place of the weights
+    Mat* weight_quant_scales;
+    int* activation_type;
+    Mat* activation_params;
+    // deconvolution implements relu, clip and sigmoid only
+    int max_activation_type;
+};
+
+template<typename T>
+static void init_fusable_layer(T* layer, FusableLayer& fl)
+{
+    fl.num_output = layer->num_output;
+    fl.bias_term = &layer->bias_term;
+    fl.weight_data = &layer->weight_data;
+    fl.bias_data = &layer->bias_data;
+    fl.weight_quant_scales = 0;
+    fl.activation_type = &layer->activation_type;
+    fl.activation_params = &layer->activation_params;
+    fl.max_activation_type = 6;
+}
+
+static bool get_fusable_layer(Layer* layer, FusableLayer& fl)
+{
+    switch (layer->typeindex)
+    {
+    case LayerType::Convolution:
+    {
+        Convolution* convolution = (Convolution*)layer;
+        if (convolution->int8_scale_term || convolution->dynamic_weight)
+            return false;
+        init_fusable_layer(convolution, fl);
+        break;
+    }
+    case LayerType::ConvolutionDepthWise:
+    {
+        ConvolutionDepthWise* convolutiondepthwise = (ConvolutionDepthWise*)layer;
+        if (convolutiondepthwise->int8_scale_term || convolutiondepthwise->dynamic_weight)
+            return false;
+        init_fusable_layer(convolutiondepthwise, fl);
+        break;
+    }
+    case LayerType::Deconvolution:
+    {
+        init_fusable_layer((Deconvolution*)layer, fl);
+        fl.max_activation_type = 4;
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise:
+    {
+        init_fusable_layer((DeconvolutionDepthWise*)layer, fl);
+        fl.max_activation_type = 4;
+        break;
+    }
+    case LayerType::InnerProduct:
+    {
+        InnerProduct* innerproduct = (InnerProduct*)layer;
+        if (innerproduct->int8_scale_term)
+            return false;
+        init_fusable_layer(innerproduct, fl);
+        if (innerproduct->weight_quant_bits)
+            fl.weight_quant_scales = &innerproduct->weight_data_quant_scales;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    const Mat& rows = fl.weight_quant_scales ? *fl.weight_quant_scales : *fl.weight_data;
+    return layer->tops.size() == 1 && fl.num_output > 0 && !rows.empty() && rows.total() % fl.num_output == 0;
+}
+
+// output channel p becomes value * scale[p] + bias[p], either pointer may be null
+static void fuse_channel_affine(FusableLayer& fl, const float* scale, const float* bias)
+{
+    const int num_output = fl.num_output;
+
+    if (scale)
+    {
+        // weights may reference the model memory, never modify them in place
+        Mat& rows = fl.weight_quant_scales ? *fl.weight_quant_scales : *fl.weight_data;
+        rows = rows.clone();
+
+        const int row_size = (int)(rows.total() / num_output);
+        for (int p = 0; p < num_output; p++)
+        {
+            float* ptr = (float*)rows + row_size * p;
+            for (int k = 0; k < row_size; k++)
+            {
+                ptr[k] *= scale[p];
+            }
+        }
+    }
+
+    if (*fl.bias_term == 0)
+    {
+        if (!bias)
+            return;
+
+        *fl.bias_term = 1;
+        fl.bias_data->create(num_output);
+        fl.bias_data->fill(0.f);
+    }
+    else
+    {
+        *fl.bias_data = fl.bias_data->clone();
+    }
+
+    float* bptr = *fl.bias_data;
+    for (int p = 0; p < num_output; p++)
+    {
+        bptr[p] = bptr[p] * (scale ? scale[p] : 1.f) + (bias ? bias[p] : 0.f);
+    }
+}
+
+static bool fuse_channel_scalar(FusableLayer& fl, const BinaryOp* binaryop)
+{
+    const float b = binaryop->b;
+
+    std::vector<float> scale(fl.num_output, 1.f);
+    std::vector<float> bias(fl.num_output, 0.f);
+    switch (binaryop->op_type)
+    {
+    case BinaryOp::Operation_ADD:
+        std::fill(bias.begin(), bias.end(), b);
+        fuse_channel_affine(fl, 0, &bias[0]);
+        return true;
+    case BinaryOp::Operation_SUB:
+        std::fill(bias.begin(), bias.end(), -b);
+        fuse_channel_affine(fl, 0, &bias[0]);
+        return true;
+    case BinaryOp::Operation_MUL:
+        std::fill(scale.begin(), scale.end(), b);
+        fuse_channel_affine(fl, &scale[0], 0);
+        return true;
+    case BinaryOp::Operation_DIV:
+        if (b == 0.f)
+            return false;
+        std::fill(scale.begin(), scale.end(), 1.f / b);
+        fuse_channel_affine(fl, &scale[0], 0);
+        return true;
+    case BinaryOp::Operation_RSUB:
+        std::fill(scale.begin(), scale.end(), -1.f);
+        std::fill(bias.begin(), bias.end(), b);
+        fuse_channel_affine(fl, &scale[0], &bias[0]);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool fuse_activation(const Layer* activation, int max_activation_type, int& activation_type, Mat& activation_params)
+{
+    switch (activation->typeindex)
+    {
+    case LayerType::ReLU:
+    {
+        const float slope = ((const ReLU*)activation)->slope;
+        if (slope == 0.f)
+        {
+            activation_type = 1;
+            activation_params = Mat();
+        }
+        else
+        {
+            activation_type = 2;
+            activation_params.create(1);
+            activation_params[0] = slope;
+        }
+        return true;
+    }
+    case LayerType::Clip:
+    {
+        const Clip* clip = (const Clip*)activation;
+        activation_type = 3;
+        activation_params.create(2);
+        activation_params[0] = clip->min;
+        activation_params[1] = clip->max;
+        return true;
+    }
+    case LayerType::Sigmoid:
+        activation_type = 4;
+        activation_params = Mat();
+        return true;
+    case LayerType::Mish:
+        if (max_activation_type < 5)
+            return false;
+        activation_type = 5;
+        activation_params = Mat();
+        return true;
+    case LayerType::HardSwish:
+    {
+        if (max_activation_type < 6)
+            return false;
+        const HardSwish* hardswish = (const HardSwish*)activation;
+        activation_type = 6;
+        activation_params.create(2);
+        activation_params[0] = hardswish->alpha;
+        activation_params[1] = hardswish->beta;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// x op0 b0 op1 b1 as a single x op b for two additive or two multiplicative scalar ops
+static bool merge_scalar_binaryop(BinaryOp* binaryop, const BinaryOp* next)
+{
+    const int op0 = binaryop->op_type;
+    const int op1 = next->op_type;
+    const float b0 = binaryop->b;
+    const float b1 = next->b;
+
+    const bool additive0 = op0 == BinaryOp::Operation_ADD || op0 == BinaryOp::Operation_SUB;
+    const bool additive1 = op1 == BinaryOp::Operation_ADD || op1 == BinaryOp::Operation_SUB;
+    if (additive0 && additive1)
+    {
+        binaryop->op_type = BinaryOp::Operation_ADD;
+        binaryop->b = (op0 == BinaryOp::Operation_SUB ? -b0 : b0) + (op1 == BinaryOp::Operation_SUB ? -b1 : b1);
+        return true;
+    }
+
+    const bool multiplicative0 = op0 == BinaryOp::Operation_MUL || (op0 == BinaryOp::Operation_DIV && b0 != 0.f);
+    const bool multiplicative1 = op1 == BinaryOp::Operation_MUL || (op1 == BinaryOp::Operation_DIV && b1 != 0.f);
+    if (multiplicative0 && multiplicative1)
+    {
+        binaryop->op_type = BinaryOp::Operation_MUL;
+        binaryop->b = (op0 == BinaryOp::Operation_DIV ? 1.f / b0 : b0) * (op1 == BinaryOp::Operation_DIV ? 1.f / b1 : b1);
+        return true;
+    }
+
+    return false;
+}
+
+// layernorm affine folded into the rows of the following innerproduct
+// w'[p][k] = w[p][k] * gamma[k]   bias'[p] = bias[p] + sum(w[p][k] * beta[k])
+static bool fuse_layernorm_innerproduct(const LayerNorm* layernorm, InnerProduct* innerproduct)
+{
+    if (innerproduct->int8_scale_term || innerproduct->weight_quant_bits)
+        return false;
+
+    const int affine_size = layernorm->affine_size;
+    const int num_output = innerproduct->num_output;
+    if (affine_size <= 0 || num_output <= 0 || innerproduct->weight_data.total() % num_output != 0)
+        return false;
+
+    // flattened inputs repeat the normalized rows
+    const int num_input = (int)(innerproduct->weight_data.total() / num_output);
+    if (num_input % affine_size != 0)
+        return false;
+
+    const float* gamma = layernorm->gamma_data;
+    const float* beta = layernorm->beta_data;
+
+    Mat weight_data = innerproduct->weight_data.clone();
+    Mat bias_data(num_output);
+    for (int p = 0; p < num_output; p++)
+    {
+        float* w = (float*)weight_data + num_input * p;
+
+        float sum = innerproduct->bias_term ? innerproduct->bias_data[p] : 0.f;
+        for (int k = 0; k < num_input; k++)
+        {
+            sum += w[k] * beta[k % affine_size];
+            w[k] *= gamma[k % affine_size];
+        }
+        bias_data[p] = sum;
+    }
+
+    innerproduct->bias_term = 1;
+    innerproduct->weight_data = weight_data;
+    innerproduct->bias_data = bias_data;
+
+    return true;
+}
+
+// layernorm affine folded into constant B and C of the following gemm as its epilogue
+// A is the normalized input, alpha * ((A * gamma + beta) * B + beta_C * C)
+static bool fuse_layernorm_gemm(const LayerNorm* layernorm, Gemm* gemm)
+{
+    if (gemm->constantA || !gemm->constantB || gemm->transA || gemm->int8_scale_term || gemm->weight_quant_bits)
+        return false;
+
+    const int N = gemm->constantN;
+    const int K = gemm->constantK;
+    if (layernorm->affine_size != K)
+        return false;
+
+    const bool has_C = gemm->constantC && gemm->constant_broadcast_type_C != -1 && gemm->beta != 0.f;
+    if (has_C && gemm->constant_broadcast_type_C != 0 && gemm->constant_broadcast_type_C != 3 && gemm->constant_broadcast_type_C != 4)
+        return false;
+
+    const float* gamma = layernorm->gamma_data;
+    const float* beta = layernorm->beta_data;
+
+    Mat B_data = gemm->B_data.clone();
+    std::vector<float> shift(N, 0.f);
+    for (int k = 0; k < K; k++)
+    {
+        for (int n = 0; n < N; n++)
+        {
+            float& b = gemm->transB ? B_data.row(n)[k] : B_data.row(k)[n];
+            shift[n] += beta[k] * b;
+            b *= gamma[k];
+        }
+    }
+
+    Mat C_data;
+    if (!has_C)
+    {
+        C_data.create(N, 1);
+        for (int n = 0; n < N; n++)
+        {
+            C_data[n] = shift[n];
+        }
+
+        gemm->beta = 1.f;
+        gemm->constant_broadcast_type_C = 4;
+    }
+    else
+    {
+        const float scale = 1.f / gemm->beta;
+
+        if (gemm->constant_broadcast_type_C == 0)
+        {
+            C_data.create(N, 1);
+            C_data.fill(gemm->C_data[0]);
+            gemm->constant_broadcast_type_C = 4;
+        }
+        else
         {
-            bottom_blob = bottom_blob_ref;
+            C_data = gemm->C_data.clone();
         }
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
+        for (int m = 0; m < C_data.h; m++)
         {
-            VkImageMat& bottom_top_blob = bottom_blob;
-            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
+            float* ptr = C_data.row(m);
+            for (int n = 0; n < N; n++)
+            {
+                ptr[n] += scale * shift[n];
+            }
+        }
+    }
 
-            // store top blob
-            blob_mats_gpu_image[top_blob_index] = bottom_top_blob;
+    gemm->constantC = 1;
+    gemm->B_data = B_data;
+    gemm->C_data = C_data;
+
+    // constant B and C leave A as the only input
+    gemm->one_blob_only = true;
+
+    return true;
+}
+
+void NetPrivate::destroy_layer(Layer* layer) const
+{
+    if (layer->typeindex & ncnn::LayerType::CustomBit)
+    {
+        int custom_index = layer->typeindex & ~ncnn::LayerType::CustomBit;
+        if (custom_layer_registry[custom_index].destroyer)
+        {
+            custom_layer_registry[custom_index].destroyer(layer, custom_layer_registry[custom_index].userdata);
         }
         else
         {
-            VkImageMat top_blob;
-            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
-
-            // store top blob
-            blob_mats_gpu_image[top_blob_index] = top_blob;
+            delete layer;
         }
+    }
+    else
+    {
+        delete layer;
+    }
+}
 
-        if (opt.lightmode)
+void NetPrivate::fuse_layers(Net* net)
+{
+    const int layer_count = (int)layers.size();
+
+    blob_fused.assign(blobs.size(), 0);
+
+    std::vector<int> consumer_count(blobs.size(), 0);
+    for (int i = 0; i < layer_count; i++)
+    {
+        const Layer* layer = layers[i];
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
         {
-            // delete after taken in light mode
-            blob_mats_gpu_image[bottom_blob_index].release();
+            consumer_count[layer->bottoms[j]]++;
         }
     }
-    else
+
+    // layer j that is the only reader of the single top blob of layer i, or -1
+    std::vector<int> sole_consumer(layer_count, -1);
+    for (int i = 0; i < layer_count; i++)
     {
-        // load bottom blobs
-        std::vector<VkImageMat> bottom_blobs(layer->bottoms.size());
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        const Layer* layer = layers[i];
+        if (layer->tops.size() != 1 || consumer_count[layer->tops[0]] != 1)
+            continue;
+
+        const int j = blobs[layer->tops[0]].consumer;
+        if (j < 0 || j >= layer_count)
+            continue;
+
+        const Layer* next = layers[j];
+        if (next->bottoms.size() != 1 || next->tops.size() != 1)
+            continue;
+
+        sole_consumer[i] = j;
+    }
+
+    for (int i = 0; i < layer_count; i++)
+    {
+        Layer* layer = layers[i];
+
+        FusableLayer fl;
+        const bool fusable = get_fusable_layer(layer, fl);
+        const bool scalar_binaryop = layer->typeindex == LayerType::BinaryOp && ((const BinaryOp*)layer)->with_scalar;
+        const bool affine_layernorm = layer->typeindex == LayerType::LayerNorm && ((const LayerNorm*)layer)->affine;
+        if (!fusable && !scalar_binaryop && !affine_layernorm)
+            continue;
+
+        for (;;)
         {
-            int bottom_blob_index = layer->bottoms[i];
+            const int j = sole_consumer[i];
+            if (j == -1)
+                break;
 
-            VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
+            Layer* next = layers[j];
 
-            if (opt.lightmode)
+            bool fused = false;
+            if (fusable)
             {
-                // deep copy for inplace forward if data is shared
-                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+                // channel affine ops stay in front of the activation
+                if (*fl.activation_type != 0)
+                    break;
+
+                if (next->typeindex == LayerType::BatchNorm)
                 {
-                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
-                    //                             NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
+                    // batchnorm on the rows of a 2-dim innerproduct output normalizes per row instead
+                    const BatchNorm* batchnorm = (const BatchNorm*)next;
+                    const bool per_output = layer->typeindex != LayerType::InnerProduct || blobs[layer->tops[0]].shape.dims == 1;
+                    if (batchnorm->channels == fl.num_output && per_output)
+                    {
+                        fuse_channel_affine(fl, batchnorm->b_data, batchnorm->a_data);
+                        fused = true;
+                    }
+                }
+                else if (next->typeindex == LayerType::BinaryOp && ((const BinaryOp*)next)->with_scalar)
+                {
+                    fused = fuse_channel_scalar(fl, (const BinaryOp*)next);
+                }
+                else
+                {
+                    fused = fuse_activation(next, fl.max_activation_type, *fl.activation_type, *fl.activation_params);
                 }
             }
-            if (bottom_blobs[i].dims == 0)
+            else if (scalar_binaryop)
             {
-                bottom_blobs[i] = bottom_blob_ref;
+                if (next->typeindex == LayerType::BinaryOp && ((const BinaryOp*)next)->with_scalar)
+                    fused = merge_scalar_binaryop((BinaryOp*)layer, (const BinaryOp*)next);
             }
-        }
+            else // if (affine_layernorm)
+            {
+                LayerNorm* layernorm = (LayerNorm*)layer;
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
-        {
-            std::vector<VkImageMat>& bottom_top_blobs = bottom_blobs;
-            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
+                if (next->typeindex == LayerType::InnerProduct)
+                    fused = fuse_layernorm_innerproduct(layernorm, (InnerProduct*)next);
+                if (next->typeindex == LayerType::Gemm)
+                    fused = fuse_layernorm_gemm(layernorm, (Gemm*)next);
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+                if (fused)
+                {
+                    layernorm->affine = 0;
+                    layernorm->gamma_data.release();
+                    layernorm->beta_data.release();
 
-                blob_mats_gpu_image[top_blob_index] = bottom_top_blobs[i];
+                    // the output lacks the affine now, refuse to hand it out
+                    blob_fused[layer->tops[0]] = 1;
+                }
+
+                // the consumer stays in the graph
+                break;
             }
+
+            if (!fused)
+                break;
+
+            // layer i takes over the top blob of layer j, which is left unconnected
+            const int mid = layer->tops[0];
+            const int top = next->tops[0];
+            layer->tops[0] = top;
+            layer->top_shapes = next->top_shapes;
+            blobs[top].producer = i;
+            blobs[mid].producer = -1;
+            blobs[mid].consumer = -1;
+            next->bottoms.clear();
+            next->tops.clear();
+
+            sole_consumer[i] = sole_consumer[j];
+            sole_consumer[j] = -1;
         }
-        else
-        {
-            std::vector<VkImageMat> top_blobs(layer->tops.size());
-            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
+    }
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+    // BinaryOp add / sub of two scalar muls becomes a weighted Eltwise sum
+    for (int i = 0; i < layer_count; i++)
+    {
+        const Layer* layer = layers[i];
+        if (layer->typeindex != LayerType::BinaryOp || layer->bottoms.size() != 2 || layer->tops.size() != 1)
+            continue;
 
-                blob_mats_gpu_image[top_blob_index] = top_blobs[i];
-            }
-        }
+        const BinaryOp* binaryop = (const BinaryOp*)layer;
+        if (binaryop->with_scalar || (binaryop->op_type != BinaryOp::Operation_ADD && binaryop->op_type != BinaryOp::Operation_SUB))
+            continue;
 
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        // eltwise does not broadcast, both shapes must be known from the shape hints
+        const Mat& shape0 = blobs[layer->bottoms[0]].shape;
+        const Mat& shape1 = blobs[layer->bottoms[1]].shape;
+        if (shape0.dims == 0 || shape0.dims != shape1.dims || shape0.w != shape1.w || shape0.h != shape1.h || shape0.c != shape1.c)
+            continue;
+
+        int muls[2] = {-1, -1};
+        for (int q = 0; q < 2; q++)
         {
-            int bottom_blob_index = layer->bottoms[i];
+            const int k = blobs[layer->bottoms[q]].producer;
+            if (k < 0 || consumer_count[layer->bottoms[q]] != 1)
+                continue;
 
-            if (opt.lightmode)
-            {
-                // delete after taken in light mode
-                blob_mats_gpu_image[bottom_blob_index].release();
-            }
+            const Layer* producer = layers[k];
+            if (producer->bottoms.size() != 1)
+                continue;
+
+            if (producer->typeindex == LayerType::BinaryOp && ((const BinaryOp*)producer)->with_scalar && ((const BinaryOp*)producer)->op_type == BinaryOp::Operation_MUL)
+                muls[q] = k;
         }
-    }
 
-    return 0;
-}
-#endif // NCNN_VULKAN
+        if (muls[0] == -1 && muls[1] == -1)
+            continue;
 
-void NetPrivate::update_input_output_indexes()
-{
-    input_blob_indexes.clear();
-    output_blob_indexes.clear();
+        Mat coeffs(2);
+        coeffs[0] = muls[0] == -1 ? 1.f : ((const BinaryOp*)layers[muls[0]])->b;
+        coeffs[1] = muls[1] == -1 ? 1.f : ((const BinaryOp*)layers[muls[1]])->b;
+        if (binaryop->op_type == BinaryOp::Operation_SUB)
+            coeffs[1] = -coeffs[1];
 
-    for (size_t i = 0; i < layers.size(); i++)
-    {
-        if (layers[i]->typeindex == LayerType::Input)
+        // the same factory path as load_param
+        Layer* eltwise = create_layer(LayerType::Eltwise);
+#if NCNN_STRING
+        if (!eltwise)
+            eltwise = net->create_custom_layer("Eltwise");
+#endif // NCNN_STRING
+        if (!eltwise)
+            continue;
+
+#if NCNN_VULKAN
+        if (opt.use_vulkan_compute)
+            eltwise->vkdev = vkdev;
+#endif // NCNN_VULKAN
+
+        ParamDict pd;
+        pd.set(0, (int)Eltwise::Operation_SUM);
+        pd.set(1, coeffs);
+        if (eltwise->load_param(pd) != 0)
         {
-            int blob_index = layers[i]->tops[0];
-            input_blob_indexes.push_back(blob_index);
+            destroy_layer(eltwise);
+            continue;
         }
-    }
 
-    for (size_t i = 0; i < blobs.size(); i++)
-    {
-        if (blobs[i].producer != -1 && blobs[i].consumer == -1)
+#if NCNN_STRING
+        eltwise->type = "Eltwise";
+        eltwise->name = layer->name;
+#endif // NCNN_STRING
+        eltwise->bottoms = layer->bottoms;
+        eltwise->tops = layer->tops;
+        eltwise->bottom_shapes = layer->bottom_shapes;
+        eltwise->top_shapes = layer->top_shapes;
+
+        for (int q = 0; q < 2; q++)
         {
-            output_blob_indexes.push_back(i);
+            if (muls[q] == -1)
+                continue;
+
+            Layer* mul = layers[muls[q]];
+            const int mid = mul->tops[0];
+            eltwise->bottoms[q] = mul->bottoms[0];
+            eltwise->bottom_shapes[q] = mul->bottom_shapes.empty() ? Mat() : mul->bottom_shapes[0];
+            blobs[mul->bottoms[0]].consumer = i;
+            blobs[mid].producer = -1;
+            blobs[mid].consumer = -1;
+            mul->bottoms.clear();
+            mul->tops.clear();
         }
+
+        destroy_layer(layers[i]);
+        layers[i] = eltwise;
     }
 }
 
@@ -1525,6 +3070,10 @@ int Net::load_param(const DataReader& dr)
     d->layers.resize((size_t)layer_count);
     d->blobs.resize((size_t)blob_count);
 
+#if NCNN_STDIO
+    d->param_hash = 0xcbf29ce484222325ULL;
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     // TODO enable gpu when bf16 conversion implemented
     if (opt.use_bf16_storage)
@@ -1694,6 +3243,11 @@ int Net::load_param(const DataReader& dr)
             layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
         }
 
+#if NCNN_STDIO
+        // params decide the transformed weight layout as much as the weights do
+        d->param_hash = param_dict_hash(d->param_hash, layer->typeindex, pd);
+#endif // NCNN_STDIO
+
         int lr = layer->load_param(pd);
         if (lr != 0)
         {
@@ -1706,6 +3260,7 @@ int Net::load_param(const DataReader& dr)
 
     d->update_input_output_indexes();
     d->update_input_output_names();
+    d->update_execution_order();
 
 #undef SCAN_VALUE
     return 0;
@@ -1742,6 +3297,10 @@ int Net::load_param_bin(const DataReader& dr)
     d->layers.resize(layer_count);
     d->blobs.resize(blob_count);
 
+#if NCNN_STDIO
+    d->param_hash = 0xcbf29ce484222325ULL;
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     // TODO enable gpu when bf16 conversion implemented
     if (opt.use_bf16_storage)
@@ -1897,6 +3456,11 @@ int Net::load_param_bin(const DataReader& dr)
             layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
         }
 
+#if NCNN_STDIO
+        // params decide the transformed weight layout as much as the weights do
+        d->param_hash = param_dict_hash(d->param_hash, layer->typeindex, pd);
+#endif // NCNN_STDIO
+
         int lr = layer->load_param(pd);
         if (lr != 0)
         {
@@ -1912,6 +3476,7 @@ int Net::load_param_bin(const DataReader& dr)
     }
 
     d->update_input_output_indexes();
+    d->update_execution_order();
 
 #undef READ_VALUE
     return 0;
@@ -1930,7 +3495,15 @@ int Net::load_model(const DataReader& dr)
     // load file
     int ret = 0;
 
+#if NCNN_STDIO
+    // hash the weights on top of the layer types and params to validate the weight cache
+    const bool use_weight_cache = !d->weight_cache_path.empty() && !opt.use_vulkan_compute;
+    DataReaderWithHash hdr(dr, d->param_hash);
+
+    ModelBinFromDataReader mb(use_weight_cache ? (const DataReader&)hdr : dr);
+#else
     ModelBinFromDataReader mb(dr);
+#endif // NCNN_STDIO
     for (int i = 0; i < layer_count; i++)
     {
         Layer* layer = d->layers[i];
@@ -1962,6 +3535,12 @@ int Net::load_model(const DataReader& dr)
         }
     }
 
+    if (ret == 0 && opt.use_layer_fusion)
+    {
+        d->fuse_layers(this);
+        d->update_execution_order();
+    }
+
 #if NCNN_VULKAN
     if (opt.use_vulkan_compute)
     {
@@ -1974,31 +3553,86 @@ int Net::load_model(const DataReader& dr)
     }
 #endif // NCNN_VULKAN
 
-    for (int i = 0; i < layer_count; i++)
+    if (ret == 0 && opt.use_branch_parallel && opt.num_threads > 1 && get_omp_max_active_levels() < 2)
     {
-        Layer* layer = d->layers[i];
+        // branches open nested parallel regions with their share of the threads
+        // the setting is process-wide, enable it once here rather than around every wave
+        set_omp_max_active_levels(2);
+    }
 
-        Option opt1 = opt;
-#if NCNN_VULKAN
-        if (opt.use_vulkan_compute)
+    d->pipeline_opt = opt;
+    d->pipeline_created.assign(layer_count, 0);
+    d->lazy_pipeline = false;
+
+#if NCNN_STDIO
+    // tuned variants first, cached pipelines carry their own
+    const bool use_tuning_file = !d->tuning_file_path.empty() && !opt.use_vulkan_compute;
+    const bool tuning_file_valid = ret == 0 && use_tuning_file && d->load_tuning_file() == 0;
+    const bool weight_cache_valid = ret == 0 && use_weight_cache && d->load_weight_cache(hdr.hash) == 0;
+#else
+    const bool tuning_file_valid = false;
+#endif // NCNN_STDIO
+
+    // concurrent pipelines would disturb the timing of each other
+    const bool timing_pipeline = opt.use_algorithm_tuning && !tuning_file_valid;
+
+    if (ret == 0 && opt.use_lazy_pipeline_creation && !opt.use_vulkan_compute)
+    {
+        // create_pipeline happens in run_layer
+        d->lazy_pipeline = true;
+    }
+    else if (ret == 0 && opt.use_parallel_pipeline_creation && opt.num_threads > 1 && !opt.use_vulkan_compute && !timing_pipeline)
+    {
+        // opt.num_threads is passed through unchanged as gemm and winograd weights are tiled for it,
+        // the parallel regions inside each layer run on the thread owning that layer
+        std::vector<int> crets(layer_count, 0);
+
+        #pragma omp parallel for schedule(dynamic) num_threads(opt.num_threads)
+        for (int i = 0; i < layer_count; i++)
         {
-            if (!layer->support_image_storage) opt1.use_image_storage = false;
+            if (d->pipeline_created[i])
+                continue;
+
+            crets[i] = d->create_layer_pipeline(i);
         }
-#endif // NCNN_VULKAN
 
-        int cret = layer->create_pipeline(opt1);
-        if (cret != 0)
+        for (int i = 0; i < layer_count; i++)
         {
-#if NCNN_STRING
-            NCNN_LOGE("layer create_pipeline %d %s failed", i, layer->name.c_str());
-#else
-            NCNN_LOGE("layer create_pipeline %d failed", i);
-#endif
-            ret = -1;
-            break;
+            if (crets[i] != 0)
+            {
+                ret = -1;
+                break;
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < layer_count; i++)
+        {
+            if (d->pipeline_created[i])
+                continue;
+
+            int cret = d->create_layer_pipeline(i);
+            if (cret != 0)
+            {
+                ret = -1;
+                break;
+            }
         }
     }
 
+#if NCNN_STDIO
+    if (ret == 0 && use_weight_cache && !weight_cache_valid && !d->lazy_pipeline)
+    {
+        d->save_weight_cache(hdr.hash);
+    }
+
+    if (ret == 0 && use_tuning_file && timing_pipeline && !d->lazy_pipeline)
+    {
+        d->save_tuning_file();
+    }
+#endif // NCNN_STDIO
+
     if (opt.use_local_pool_allocator)
     {
         if (opt.blob_allocator == 0)
@@ -2098,6 +3732,34 @@ int Net::load_model(const char* modelpath)
     fclose(fp);
     return ret;
 }
+
+void Net::set_weight_cache(const char* cachepath)
+{
+    d->weight_cache_path = cachepath ? cachepath : "";
+}
+
+void Net::set_tuning_file(const char* tuningpath)
+{
+    d->tuning_file_path = tuningpath ? tuningpath : "";
+}
+
+int Net::load_model_mmap(const char* modelpath)
+{
+    DataReaderFromMmap* dr = new DataReaderFromMmap(modelpath);
+    if (dr->empty())
+    {
+        delete dr;
+        return -1;
+    }
+
+    int ret = load_model(*dr);
+
+    // keep the mapping alive as long as the layers reference it
+    delete d->model_mmap;
+    d->model_mmap = dr;
+
+    return ret;
+}
 #endif // NCNN_STDIO
 
 int Net::load_param(const unsigned char* _mem)
@@ -2185,41 +3847,43 @@ int Net::load_model(AAssetManager* mgr, const char* assetpath)
 void Net::clear()
 {
     d->blobs.clear();
+    d->execution_order.clear();
+    d->execution_rank.clear();
+    d->plan_cache.clear();
     for (size_t i = 0; i < d->layers.size(); i++)
     {
         Layer* layer = d->layers[i];
 
+        // skip pipelines never created
+        const bool pipeline_created = i >= d->pipeline_created.size() || d->pipeline_created[i];
+
         Option opt1 = opt;
         if (!layer->support_image_storage)
         {
             opt1.use_image_storage = false;
         }
 
-        int dret = layer->destroy_pipeline(opt1);
+        int dret = pipeline_created ? layer->destroy_pipeline(opt1) : 0;
         if (dret != 0)
         {
             NCNN_LOGE("layer destroy_pipeline failed");
             // ignore anyway
         }
 
-        if (layer->typeindex & ncnn::LayerType::CustomBit)
-        {
-            int custom_index = layer->typeindex & ~ncnn::LayerType::CustomBit;
-            if (d->custom_layer_registry[custom_index].destroyer)
-            {
-                d->custom_layer_registry[custom_index].destroyer(layer, d->custom_layer_registry[custom_index].userdata);
-            }
-            else
-            {
-                delete layer;
-            }
-        }
-        else
-        {
-            delete layer;
-        }
+        d->destroy_layer(layer);
+    }
+    d->layers.clear();
+    d->blob_fused.clear();
+    d->pipeline_created.clear();
+    d->lazy_pipeline = false;
+
+#if NCNN_STDIO
+    if (d->model_mmap)
+    {
+        delete d->model_mmap;
+        d->model_mmap = 0;
     }
-    d->layers.clear();
+#endif // NCNN_STDIO
 
     if (d->local_blob_allocator)
     {
@@ -2388,13 +4052,25 @@ class ExtractorPrivate
 {
 public:
     ExtractorPrivate(const Net* _net)
-        : net(_net)
+        : net(_net), profiling(false), streaming(false), chunk_extracted(false)
     {
     }
     const Net* net;
     std::vector<Mat> blob_mats;
     Option opt;
 
+    bool profiling;
+    std::vector<LayerProfile> profiles;
+
+    // recurrent layer states kept across extract calls, indexed by layer
+    bool streaming;
+    std::vector<std::vector<Mat> > layer_states;
+    // set by extract, the next input starts a new chunk
+    bool chunk_extracted;
+
+    std::vector<int> batch_blob_indexes;
+    std::vector<std::vector<Mat> > batch_blob_mats;
+
 #if NCNN_VULKAN
     VkAllocator* local_blob_vkallocator;
     VkAllocator* local_staging_vkallocator;
@@ -2404,6 +4080,173 @@ public:
 #endif // NCNN_VULKAN
 };
 
+// whether the layer computes every row of a 2-dim blob independently of the others
+// rows_are_samples is set when each batch sample contributes exactly one row
+static bool is_row_independent_layer(const Layer* layer, bool rows_are_samples)
+{
+    switch (layer->typeindex)
+    {
+    case LayerType::AbsVal:
+    case LayerType::BNLL:
+    case LayerType::Clip:
+    case LayerType::Dropout:
+    case LayerType::ELU:
+    case LayerType::Eltwise:
+    case LayerType::Exp:
+    case LayerType::GELU:
+    case LayerType::HardSigmoid:
+    case LayerType::HardSwish:
+    case LayerType::InnerProduct:
+    case LayerType::LayerNorm:
+    case LayerType::Log:
+    case LayerType::Mish:
+    case LayerType::Noop:
+    case LayerType::Power:
+    case LayerType::ReLU:
+    case LayerType::SELU:
+    case LayerType::Sigmoid:
+    case LayerType::Softplus:
+    case LayerType::Split:
+    case LayerType::Swish:
+    case LayerType::TanH:
+    case LayerType::UnaryOp:
+        return true;
+    case LayerType::BinaryOp:
+        return ((const BinaryOp*)layer)->with_scalar == 1;
+    case LayerType::Gemm:
+    {
+        // A rows map to output rows only with a dynamic untransposed A and a constant B
+        // gemm on 1-dim input yields a 2-dim output, which single row splitting would not restore
+        const Gemm* gemm = (const Gemm*)layer;
+        if (rows_are_samples || layer->bottoms.size() != 1)
+            return false;
+        if (gemm->constantA || !gemm->constantB || gemm->transA || gemm->output_transpose || gemm->output_N1M)
+            return false;
+        if (gemm->constantC && gemm->constant_broadcast_type_C != -1 && gemm->constant_broadcast_type_C != 0 && gemm->constant_broadcast_type_C != 4)
+            return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// row width of the output of a row independent layer, -1 if the bottoms do not fit it
+// innerproduct flattens and gemm rejects rows of any other width than the weights expect
+static int batch_row_width(const Layer* layer, const std::vector<int>& bottom_widths)
+{
+    for (size_t i = 1; i < bottom_widths.size(); i++)
+    {
+        if (bottom_widths[i] != bottom_widths[0])
+            return -1;
+    }
+
+    const int w = bottom_widths[0];
+
+    if (layer->typeindex == LayerType::InnerProduct)
+    {
+        const InnerProduct* innerproduct = (const InnerProduct*)layer;
+        return w == innerproduct->weight_data_size / innerproduct->num_output ? innerproduct->num_output : -1;
+    }
+
+    if (layer->typeindex == LayerType::Gemm)
+    {
+        const Gemm* gemm = (const Gemm*)layer;
+        return w == gemm->constantK ? gemm->constantN : -1;
+    }
+
+    return w;
+}
+
+// whether blob_index can be computed from the stacked batch inputs in one pass
+static bool is_batch_stackable(const Net* net, const std::vector<int>& execution_order, int blob_index, const std::vector<int>& batch_blob_indexes, const std::vector<int>& batch_widths, const std::vector<Mat>& blob_mats, bool rows_are_samples)
+{
+    const std::vector<Blob>& blobs = net->blobs();
+    const std::vector<Layer*>& layers = net->layers();
+
+    std::vector<int> blob_width(blobs.size(), -1);
+    for (size_t i = 0; i < batch_blob_indexes.size(); i++)
+    {
+        blob_width[batch_blob_indexes[i]] = batch_widths[i];
+    }
+
+    std::vector<unsigned char> visited(blobs.size(), 0);
+    std::vector<unsigned char> layer_visited(layers.size(), 0);
+    std::vector<int> blob_stack(1, blob_index);
+    while (!blob_stack.empty())
+    {
+        int bi = blob_stack.back();
+        blob_stack.pop_back();
+
+        if (visited[bi])
+            continue;
+
+        visited[bi] = 1;
+
+        if (blob_width[bi] != -1)
+            continue;
+
+        // anything not derived from the batch inputs would be shared by all samples
+        if (blob_mats[bi].dims != 0 || blobs[bi].producer == -1)
+            return false;
+
+        const Layer* layer = layers[blobs[bi].producer];
+        if (layer->bottoms.empty() || !is_row_independent_layer(layer, rows_are_samples))
+            return false;
+
+        layer_visited[blobs[bi].producer] = 1;
+
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            blob_stack.push_back(layer->bottoms[i]);
+        }
+    }
+
+    // follow the row width from the batch inputs, the layers must keep seeing rows of the width they expect
+    if (execution_order.size() != layers.size())
+        return false;
+
+    for (size_t i = 0; i < execution_order.size(); i++)
+    {
+        const int layer_index = execution_order[i];
+        if (!layer_visited[layer_index])
+            continue;
+
+        const Layer* layer = layers[layer_index];
+
+        std::vector<int> bottom_widths(layer->bottoms.size());
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
+        {
+            bottom_widths[j] = blob_width[layer->bottoms[j]];
+        }
+
+        const int w = batch_row_width(layer, bottom_widths);
+        if (w == -1)
+            return false;
+
+        for (size_t j = 0; j < layer->tops.size(); j++)
+        {
+            blob_width[layer->tops[j]] = w;
+        }
+    }
+
+    return blob_width[blob_index] != -1;
+}
+
+// deep copy, the states are advanced in place and must not be shared between extractors
+static void clone_states(const std::vector<std::vector<Mat> >& src, std::vector<std::vector<Mat> >& dst)
+{
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i++)
+    {
+        dst[i].resize(src[i].size());
+        for (size_t j = 0; j < src[i].size(); j++)
+        {
+            dst[i][j] = src[i][j].clone();
+        }
+    }
+}
+
 Extractor::Extractor(const Net* _net, size_t blob_count)
     : d(new ExtractorPrivate(_net))
 {
@@ -2435,6 +4278,13 @@ Extractor::Extractor(const Extractor& rhs)
     d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
     d->opt = rhs.d->opt;
+    d->profiling = rhs.d->profiling;
+    d->profiles = rhs.d->profiles;
+    d->streaming = rhs.d->streaming;
+    clone_states(rhs.d->layer_states, d->layer_states);
+    d->chunk_extracted = rhs.d->chunk_extracted;
+    d->batch_blob_indexes = rhs.d->batch_blob_indexes;
+    d->batch_blob_mats = rhs.d->batch_blob_mats;
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2453,6 +4303,13 @@ Extractor& Extractor::operator=(const Extractor& rhs)
     d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
     d->opt = rhs.d->opt;
+    d->profiling = rhs.d->profiling;
+    d->profiles = rhs.d->profiles;
+    d->streaming = rhs.d->streaming;
+    clone_states(rhs.d->layer_states, d->layer_states);
+    d->chunk_extracted = rhs.d->chunk_extracted;
+    d->batch_blob_indexes = rhs.d->batch_blob_indexes;
+    d->batch_blob_mats = rhs.d->batch_blob_mats;
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2468,6 +4325,8 @@ Extractor& Extractor::operator=(const Extractor& rhs)
 void Extractor::clear()
 {
     d->blob_mats.clear();
+    d->batch_blob_indexes.clear();
+    d->batch_blob_mats.clear();
 
 #if NCNN_VULKAN
     if (d->opt.use_vulkan_compute)
@@ -2507,6 +4366,72 @@ void Extractor::set_workspace_allocator(Allocator* allocator)
     d->opt.workspace_allocator = allocator;
 }
 
+void Extractor::set_profiling(bool enable)
+{
+    d->profiling = enable;
+}
+
+const std::vector<LayerProfile>& Extractor::layer_profiles() const
+{
+    return d->profiles;
+}
+
+void Extractor::clear_layer_profiles()
+{
+    d->profiles.clear();
+}
+
+void Extractor::set_streaming(bool enable)
+{
+    d->streaming = enable;
+
+    if (enable)
+    {
+        d->layer_states.resize(d->net->layers().size());
+    }
+    else
+    {
+        d->layer_states.clear();
+    }
+}
+
+void Extractor::reset_states()
+{
+    // zero in place so the next chunk reuses the storage
+    for (size_t i = 0; i < d->layer_states.size(); i++)
+    {
+        for (size_t j = 0; j < d->layer_states[i].size(); j++)
+        {
+            Mat& state = d->layer_states[i][j];
+            memset(state.data, 0, state.total() * state.elemsize);
+        }
+    }
+}
+
+void Extractor::snapshot_states(std::vector<std::vector<Mat> >& states) const
+{
+    clone_states(d->layer_states, states);
+}
+
+int Extractor::restore_states(const std::vector<std::vector<Mat> >& states)
+{
+    if (!d->streaming)
+    {
+        NCNN_LOGE("restore_states requires streaming mode");
+        return -1;
+    }
+
+    if (states.size() != d->net->layers().size())
+    {
+        NCNN_LOGE("restore_states got %d entries but the net has %d layers", (int)states.size(), (int)d->net->layers().size());
+        return -1;
+    }
+
+    clone_states(states, d->layer_states);
+
+    return 0;
+}
+
 #if NCNN_VULKAN
 void Extractor::set_vulkan_compute(bool enable)
 {
@@ -2579,6 +4504,21 @@ int Extractor::input(int blob_index, const Mat& in)
     if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
         return -1;
 
+    if (d->streaming && d->chunk_extracted)
+    {
+        // the first input after an extract starts a new chunk, drop everything computed from the previous one
+        // inputs of the same chunk, including intermediate blobs fed directly, are kept
+        d->chunk_extracted = false;
+
+        const std::vector<Blob>& blobs = d->net->blobs();
+        const std::vector<Layer*>& layers = d->net->layers();
+        for (size_t i = 0; i < d->blob_mats.size(); i++)
+        {
+            if (blobs[i].producer >= 0 && layers[blobs[i].producer]->typeindex != LayerType::Input)
+                d->blob_mats[i].release();
+        }
+    }
+
     d->blob_mats[blob_index] = in;
 
     return 0;
@@ -2589,6 +4529,22 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
     if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
         return -1;
 
+    if (d->blob_mats[blob_index].dims == 0 && d->net->blobs()[blob_index].producer == -1)
+    {
+        // not fed and not produced, the layer fusion may have folded it away
+        NCNN_LOGE("blob %d has no producer", blob_index);
+        return -1;
+    }
+
+    if (!d->net->d->blob_fused.empty() && d->net->d->blob_fused[blob_index])
+    {
+        // a layernorm whose affine was folded into the following layer
+        NCNN_LOGE("blob %d was changed by the layer fusion", blob_index);
+        return -1;
+    }
+
+    d->chunk_extracted = true;
+
     int old_blocktime = get_kmp_blocktime();
     set_kmp_blocktime(d->opt.openmp_blocktime);
 
@@ -2599,8 +4555,6 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
 
     if (d->blob_mats[blob_index].dims == 0)
     {
-        int layer_index = d->net->blobs()[blob_index].producer;
-
         // use local allocator
         if (d->opt.use_local_pool_allocator)
         {
@@ -2696,10 +4650,10 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
         }
         else
         {
-            ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+            ret = d->net->d->forward_plan(blob_index, d->blob_mats, d->opt, d->profiling ? &d->profiles : 0, d->streaming ? &d->layer_states : 0);
         }
 #else
-        ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+        ret = d->net->d->forward_plan(blob_index, d->blob_mats, d->opt, d->profiling ? &d->profiles : 0, d->streaming ? &d->layer_states : 0);
 #endif // NCNN_VULKAN
     }
 
@@ -2760,6 +4714,201 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
     return ret;
 }
 
+#if NCNN_STRING
+int Extractor::input_batch(const char* blob_name, const std::vector<Mat>& ins)
+{
+    int blob_index = d->net->find_blob_index_by_name(blob_name);
+    if (blob_index == -1)
+    {
+        NCNN_LOGE("Try");
+        const std::vector<const char*>& input_names = d->net->input_names();
+        for (size_t i = 0; i < input_names.size(); i++)
+        {
+            NCNN_LOGE("    ex.input_batch(\"%s\", in%d);", input_names[i], (int)i);
+        }
+
+        return -1;
+    }
+
+    return input_batch(blob_index, ins);
+}
+
+int Extractor::extract_batch(const char* blob_name, std::vector<Mat>& feats, int type)
+{
+    int blob_index = d->net->find_blob_index_by_name(blob_name);
+    if (blob_index == -1)
+    {
+        NCNN_LOGE("Try");
+        const std::vector<const char*>& output_names = d->net->output_names();
+        for (size_t i = 0; i < output_names.size(); i++)
+        {
+            NCNN_LOGE("    ex.extract_batch(\"%s\", out%d);", output_names[i], (int)i);
+        }
+
+        return -1;
+    }
+
+    return extract_batch(blob_index, feats, type);
+}
+#endif // NCNN_STRING
+
+int Extractor::input_batch(int blob_index, const std::vector<Mat>& ins)
+{
+    if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
+        return -1;
+
+    if (ins.empty())
+        return -1;
+
+    for (size_t i = 0; i < d->batch_blob_indexes.size(); i++)
+    {
+        if (d->batch_blob_indexes[i] == blob_index)
+        {
+            d->batch_blob_mats[i] = ins;
+            return 0;
+        }
+    }
+
+    d->batch_blob_indexes.push_back(blob_index);
+    d->batch_blob_mats.push_back(ins);
+
+    return 0;
+}
+
+int Extractor::extract_batch(int blob_index, std::vector<Mat>& feats, int type)
+{
+    if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
+        return -1;
+
+    if (d->batch_blob_indexes.empty())
+        return -1;
+
+    const int batch = (int)d->batch_blob_mats[0].size();
+    for (size_t i = 1; i < d->batch_blob_mats.size(); i++)
+    {
+        if ((int)d->batch_blob_mats[i].size() != batch)
+        {
+            NCNN_LOGE("input_batch sample count mismatch %d vs %d", (int)d->batch_blob_mats[i].size(), batch);
+            return -1;
+        }
+    }
+
+    // samples stack along h when every input is a fp32 1-dim or multi-row 2-dim blob of one shape per input
+    bool stackable = batch > 1 && type == 0;
+    int sample_dims = d->batch_blob_mats[0][0].dims;
+    for (size_t i = 0; stackable && i < d->batch_blob_mats.size(); i++)
+    {
+        const Mat& m0 = d->batch_blob_mats[i][0];
+        if (m0.dims != sample_dims || (m0.dims != 1 && (m0.dims != 2 || m0.h == 1)) || m0.elemsize != 4u || m0.elempack != 1)
+            stackable = false;
+
+        for (int j = 1; stackable && j < batch; j++)
+        {
+            const Mat& m = d->batch_blob_mats[i][j];
+            if (m.dims != m0.dims || m.w != m0.w || m.h != m0.h || m.elemsize != m0.elemsize || m.elempack != m0.elempack)
+                stackable = false;
+        }
+    }
+
+#if NCNN_VULKAN
+    if (d->opt.use_vulkan_compute)
+        stackable = false;
+#endif // NCNN_VULKAN
+
+    const bool rows_are_samples = sample_dims == 1;
+
+    // eltwise joins the stacked inputs row by row
+    for (size_t i = 1; stackable && i < d->batch_blob_mats.size(); i++)
+    {
+        if (d->batch_blob_mats[i][0].h != d->batch_blob_mats[0][0].h)
+            stackable = false;
+    }
+
+    if (stackable)
+    {
+        std::vector<int> batch_widths(d->batch_blob_mats.size());
+        for (size_t i = 0; i < d->batch_blob_mats.size(); i++)
+        {
+            batch_widths[i] = d->batch_blob_mats[i][0].w;
+        }
+
+        stackable = is_batch_stackable(d->net, d->net->d->execution_order, blob_index, d->batch_blob_indexes, batch_widths, d->blob_mats, rows_are_samples);
+    }
+
+    // keep the non-batch inputs for every pass
+    std::vector<Mat> base_blob_mats = d->blob_mats;
+
+    int ret = 0;
+
+    if (stackable)
+    {
+        for (size_t i = 0; i < d->batch_blob_indexes.size(); i++)
+        {
+            const std::vector<Mat>& ins = d->batch_blob_mats[i];
+            const int rows = rows_are_samples ? 1 : ins[0].h;
+
+            Mat stacked(ins[0].w, rows * batch, 4u, d->opt.blob_allocator);
+            if (stacked.empty())
+            {
+                d->blob_mats = base_blob_mats;
+                return -100;
+            }
+
+            for (int j = 0; j < batch; j++)
+            {
+                memcpy(stacked.row(j * rows), ins[j].data, ins[0].w * rows * sizeof(float));
+            }
+
+            d->blob_mats[d->batch_blob_indexes[i]] = stacked;
+        }
+
+        Mat feat;
+        ret = extract(blob_index, feat, type);
+
+        d->blob_mats = base_blob_mats;
+
+        if (ret != 0)
+            return ret;
+
+        if (feat.dims == 2 && feat.elempack == 1 && feat.elemsize == 4u && feat.h % batch == 0 && (!rows_are_samples || feat.h == batch))
+        {
+            const int rows = feat.h / batch;
+
+            feats.resize(batch);
+            for (int j = 0; j < batch; j++)
+            {
+                Mat sample = rows_are_samples ? Mat(feat.w, feat.row(j), 4u) : feat.row_range(j * rows, rows);
+                feats[j] = sample.clone();
+                if (feats[j].empty())
+                    return -100;
+            }
+
+            return 0;
+        }
+
+        // unexpected output layout, redo one sample at a time
+    }
+
+    feats.resize(batch);
+    for (int j = 0; j < batch; j++)
+    {
+        d->blob_mats = base_blob_mats;
+
+        for (size_t i = 0; i < d->batch_blob_indexes.size(); i++)
+        {
+            d->blob_mats[d->batch_blob_indexes[i]] = d->batch_blob_mats[i][j];
+        }
+
+        ret = extract(blob_index, feats[j], type);
+        if (ret != 0)
+            break;
+    }
+
+    d->blob_mats = base_blob_mats;
+
+    return ret;
+}
+
 #if NCNN_VULKAN
 #if NCNN_STRING
 int Extractor::input(const char* blob_name, const VkMat& in)
@@ -2850,6 +4999,22 @@ int Extractor::extract(int blob_index, VkMat& feat, VkCompute& cmd)
     if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
         return -1;
 
+    if (d->blob_mats_gpu[blob_index].dims == 0 && d->blob_mats_gpu_image[blob_index].dims == 0 && d->net->blobs()[blob_index].producer == -1)
+    {
+        // not fed and not produced, the layer fusion may have folded it away
+        NCNN_LOGE("blob %d has no producer", blob_index);
+        return -1;
+    }
+
+    if (!d->net->d->blob_fused.empty() && d->net->d->blob_fused[blob_index])
+    {
+        // a layernorm whose affine was folded into the following layer
+        NCNN_LOGE("blob %d was changed by the layer fusion", blob_index);
+        return -1;
+    }
+
+    d->chunk_extracted = true;
+
     int old_blocktime = get_kmp_blocktime();
     set_kmp_blocktime(d->opt.openmp_blocktime);
 
@@ -2900,6 +5065,15 @@ int Extractor::extract(int blob_index, VkImageMat& feat, VkCompute& cmd)
     if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
         return -1;
 
+    if (!d->net->d->blob_fused.empty() && d->net->d->blob_fused[blob_index])
+    {
+        // a layernorm whose affine was folded into the following layer
+        NCNN_LOGE("blob %d was changed by the layer fusion", blob_index);
+        return -1;
+    }
+
+    d->chunk_extracted = true;
+
     int old_blocktime = get_kmp_blocktime();
     set_kmp_blocktime(d->opt.openmp_blocktime);
 
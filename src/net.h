@@ -15,6 +15,7 @@
 #ifndef NCNN_NET_H
 #define NCNN_NET_H
 
+#include "benchmark.h"
 #include "blob.h"
 #include "layer.h"
 #include "mat.h"
@@ -92,6 +93,25 @@ public:
     // return 0 if success
     int load_model(FILE* fp);
     int load_model(const char* modelpath);
+
+    // map network weight data from model file
+    // weight data is referenced from the mapped pages instead of copied
+    // the mapping is retained until clear()
+    // return 0 if success
+    int load_model_mmap(const char* modelpath);
+
+    // cache the weights transformed by create_pipeline in a file
+    // load_model restores them from the file when the params, weights, cpu features, option and ncnn build match,
+    // and rewrites the file otherwise
+    // must be set before load_model, pass null to disable
+    void set_weight_cache(const char* cachepath);
+
+    // keep the kernel variants picked by opt.use_algorithm_tuning in a text file
+    // load_model hands them to the layers without timing when cpu features, options, thread count and layers match,
+    // and rewrites the file after timing otherwise
+    // a variant disabled in opt, such as winograd with use_winograd_convolution off, is never used
+    // must be set before load_model, pass null to disable
+    void set_tuning_file(const char* tuningpath);
 #endif // NCNN_STDIO
 
     // load network structure from external memory
@@ -145,6 +165,7 @@ public:
 
 protected:
     friend class Extractor;
+    friend class NetPrivate;
 #if NCNN_STRING
     int find_blob_index_by_name(const char* name) const;
     int find_layer_index_by_name(const char* name) const;
@@ -191,6 +212,37 @@ public:
     // set workspace memory allocator
     void set_workspace_allocator(Allocator* allocator);
 
+    // record every cpu layer run by the following extract calls
+    // wall time, blob shapes, output bytes and thread count are kept per layer
+    // disabled by default
+    void set_profiling(bool enable);
+
+    // layer runs recorded so far, in execution order
+    // save_chrome_trace() exports them for viewing
+    const std::vector<LayerProfile>& layer_profiles() const;
+
+    // drop the recorded layer runs
+    void clear_layer_profiles();
+
+    // keep the hidden and cell state of lstm, gru and rnn layers across extract calls
+    // so that a long sequence can be fed chunk by chunk, each extract continues where the last one stopped
+    // setting an input starts a new chunk and drops the blobs computed from the previous one
+    // applies to recurrent layers with a single input and output run on cpu, the state is updated in place
+    // disabling drops the kept state
+    // disabled by default
+    void set_streaming(bool enable);
+
+    // zero the kept state, the next extract starts a new sequence
+    void reset_states();
+
+    // deep copy of the kept state, one entry per layer
+    // holding hidden, and cell for lstm, of every recurrent layer run so far
+    void snapshot_states(std::vector<std::vector<Mat> >& states) const;
+
+    // continue from a state taken by snapshot_states on an extractor of the same net
+    // return 0 if success
+    int restore_states(const std::vector<std::vector<Mat> >& states);
+
 #if NCNN_VULKAN
     void set_vulkan_compute(bool enable);
 
@@ -223,6 +275,29 @@ public:
     // type = 1, do not convert fp16/bf16 or / and packing
     int extract(int blob_index, Mat& feat, int type = 0);
 
+    // batched extraction, one Mat per sample for every batch input
+    // same-shaped 1-dim or 2-dim fp32 samples are stacked along h and run in one pass
+    // when every layer up to the output treats rows independently, so that
+    // innerproduct and gemm see one larger matrix, otherwise one pass per sample
+    // inputs set with input() are shared by all samples
+#if NCNN_STRING
+    // set batch input by blob name
+    // return 0 if success
+    int input_batch(const char* blob_name, const std::vector<Mat>& ins);
+
+    // get batch result by blob name
+    // return 0 if success
+    int extract_batch(const char* blob_name, std::vector<Mat>& feats, int type = 0);
+#endif // NCNN_STRING
+
+    // set batch input by blob index
+    // return 0 if success
+    int input_batch(int blob_index, const std::vector<Mat>& ins);
+
+    // get batch result by blob index
+    // return 0 if success
+    int extract_batch(int blob_index, std::vector<Mat>& feats, int type = 0);
+
 #if NCNN_VULKAN
 #if NCNN_STRING
     // set input by blob name
@@ -72,6 +72,14 @@ Option::Option()
     use_winograd23_convolution = true;
     use_winograd43_convolution = true;
     use_winograd63_convolution = true;
+
+    use_branch_parallel = false;
+
+    use_parallel_pipeline_creation = false;
+    use_lazy_pipeline_creation = false;
+    use_algorithm_tuning = false;
+
+    use_layer_fusion = false;
 }
 
 } // namespace ncnn
@@ -140,11 +140,36 @@ public:
     bool use_winograd43_convolution;
     bool use_winograd63_convolution;
 
-    bool use_reserved_6;
-    bool use_reserved_7;
-    bool use_reserved_8;
-    bool use_reserved_9;
-    bool use_reserved_10;
+    // run independent branches of the graph concurrently
+    // the thread budget is split among the layers that are ready at the same time
+    // gemm and winograd layers keep their load-time tiles and run with the share of the branch
+    // nested openmp parallelism is enabled once in load_model
+    // blob and workspace allocators must be thread-safe when enabled
+    // disabled by default
+    bool use_branch_parallel;
+
+    // run create_pipeline of all layers concurrently when loading model
+    // weight repacking of each layer then runs on the thread owning that layer
+    // disabled by default
+    bool use_parallel_pipeline_creation;
+
+    // defer create_pipeline of each layer until it is first executed
+    // ignored for vulkan compute
+    // disabled by default
+    bool use_lazy_pipeline_creation;
+
+    // time the candidate kernels of each layer in create_pipeline and keep the fastest
+    // needs input shape hints in the param file
+    // disabled by default
+    bool use_algorithm_tuning;
+
+    // fold batchnorm, scalar binaryop and activation into convolution and innerproduct,
+    // layernorm affine into the following innerproduct or gemm, and merge elementwise chains when loading model
+    // the intermediate blobs folded away and the layernorm outputs whose affine went into the consumer
+    // can no longer be extracted, extract returns -1 for them
+    // disabled by default
+    bool use_layer_fusion;
+
     bool use_reserved_11;
 };
 
@@ -0,0 +1,341 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "layer.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// the input shape hint lets conv0 time sgemm and the winograd variants
+static const char* tuning_param = "7767517\n"
+                                  "3 3\n"
+                                  "Input        in    0 1 in -23330=4,3,12,12,16\n"
+                                  "Convolution  conv0 1 1 in c0 0=16 1=3 4=1 5=1 6=2304\n"
+                                  "Convolution  conv1 1 1 c0 out 0=16 1=1 5=1 6=256\n";
+
+static const int tuned_layer_index = 1;
+
+static const char* tuning_path = "test_algorithm_tuning.txt";
+
+static int load_tuning_net(ncnn::Net& net, bool use_algorithm_tuning, bool use_winograd_convolution, const char* tuningpath)
+{
+    net.opt.num_threads = 1;
+    net.opt.use_fp16_storage = false;
+    net.opt.use_algorithm_tuning = use_algorithm_tuning;
+    net.opt.use_winograd_convolution = use_winograd_convolution;
+    net.set_tuning_file(tuningpath);
+
+    int ret = net.load_param_mem(tuning_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int run_tuning_net(const ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("in", in);
+    return ex.extract("out", out);
+}
+
+static int read_file(const char* path, std::string& text)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    text.clear();
+    char buf[4096];
+    size_t nread;
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+        text.append(buf, nread);
+    fclose(fp);
+    return 0;
+}
+
+static int write_file(const char* path, const std::string& text)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+
+    fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+    return 0;
+}
+
+// replace the algorithm recorded for layer_index, keep every other line
+static int rewrite_tuned_algorithm(const std::string& text, int layer_index, int algo, std::string& rewritten)
+{
+    rewritten.clear();
+
+    bool found = false;
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        int index = 0;
+        int typeindex = 0;
+        int w = 0;
+        int h = 0;
+        int c = 0;
+        int old_algo = 0;
+        if (sscanf(line.c_str(), "%d %d %d %d %d %d", &index, &typeindex, &w, &h, &c, &old_algo) == 6 && index == layer_index)
+        {
+            char buf[256];
+            sprintf(buf, "%d %d %d %d %d %d", index, typeindex, w, h, c, algo);
+            line = buf;
+            found = true;
+        }
+
+        rewritten += line;
+        rewritten += '\n';
+    }
+
+    return found ? 0 : -1;
+}
+
+static int test_algorithm_tuning_0()
+{
+    ncnn::Mat in = RandomMat(12, 12, 16);
+
+    ncnn::Net net_ref;
+    ncnn::Mat out_ref;
+    if (load_tuning_net(net_ref, false, true, 0) != 0 || run_tuning_net(net_ref, in, out_ref) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_0 reference failed\n");
+        return -1;
+    }
+
+    remove(tuning_path);
+
+    // the first load times the variants and writes the file
+    int tuned_algo = -1;
+    {
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_tuning_net(net, true, true, tuning_path) != 0 || run_tuning_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 tuning failed\n");
+            remove(tuning_path);
+            return -1;
+        }
+
+        tuned_algo = net.layers()[tuned_layer_index]->get_tuned_algorithm();
+        if (tuned_algo < 0 || tuned_algo > 4)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 conv0 not tuned, got %d\n", tuned_algo);
+            remove(tuning_path);
+            return -1;
+        }
+
+        if (CompareMat(out_ref, out, 0.001) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 tuned output mismatch\n");
+            remove(tuning_path);
+            return -1;
+        }
+    }
+
+    std::string text;
+    if (read_file(tuning_path, text) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_0 %s not written\n", tuning_path);
+        return -1;
+    }
+
+    // a variant the timing did not pick, so that only the file can bring it in
+    const int forced_algo = tuned_algo == 3 ? 2 : 3;
+
+    std::string forced_text;
+    if (rewrite_tuned_algorithm(text, tuned_layer_index, forced_algo, forced_text) != 0 || write_file(tuning_path, forced_text) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_0 conv0 not found in %s\n%s\n", tuning_path, text.c_str());
+        remove(tuning_path);
+        return -1;
+    }
+
+    // the second load takes the variant from the file without timing and keeps the file
+    {
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_tuning_net(net, true, true, tuning_path) != 0 || run_tuning_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 reload failed\n");
+            remove(tuning_path);
+            return -1;
+        }
+
+        const int algo = net.layers()[tuned_layer_index]->get_tuned_algorithm();
+        if (algo != forced_algo)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 expect algorithm %d from the file but got %d\n", forced_algo, algo);
+            remove(tuning_path);
+            return -1;
+        }
+
+        std::string reloaded_text;
+        if (read_file(tuning_path, reloaded_text) != 0 || reloaded_text != forced_text)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 valid %s rewritten\n", tuning_path);
+            remove(tuning_path);
+            return -1;
+        }
+
+        if (CompareMat(out_ref, out, 0.001) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 reloaded output mismatch\n");
+            remove(tuning_path);
+            return -1;
+        }
+    }
+
+    // winograd off never runs a winograd variant from the file
+    {
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_tuning_net(net, true, false, tuning_path) != 0 || run_tuning_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 load without winograd failed\n");
+            remove(tuning_path);
+            return -1;
+        }
+
+        const int algo = net.layers()[tuned_layer_index]->get_tuned_algorithm();
+        if (algo >= 2)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 disabled winograd variant %d used\n", algo);
+            remove(tuning_path);
+            return -1;
+        }
+
+        if (CompareMat(out_ref, out, 0.001) != 0)
+        {
+            fprintf(stderr, "test_algorithm_tuning_0 output without winograd mismatch\n");
+            remove(tuning_path);
+            return -1;
+        }
+    }
+
+    remove(tuning_path);
+
+    return 0;
+}
+
+// a variant handed to the layer directly is dropped when its algorithm is disabled
+static int test_algorithm_tuning_1()
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    net.opt.use_fp16_storage = false;
+    net.opt.use_winograd_convolution = false;
+    if (net.load_param_mem(tuning_param) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_1 load param failed\n");
+        return -1;
+    }
+
+    ncnn::Layer* conv0 = net.mutable_layers()[tuned_layer_index];
+    if (conv0->set_tuned_algorithm(3) != 0)
+    {
+        // no tunable variants on this platform
+        return 0;
+    }
+
+    DataReaderFromRandom dr(7767517);
+    if (net.load_model(dr) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_1 load model failed\n");
+        return -1;
+    }
+
+    if (conv0->get_tuned_algorithm() != -1)
+    {
+        fprintf(stderr, "test_algorithm_tuning_1 disabled winograd variant %d kept\n", conv0->get_tuned_algorithm());
+        return -1;
+    }
+
+    ncnn::Net net_ref;
+    net_ref.opt.num_threads = 1;
+    net_ref.opt.use_fp16_storage = false;
+    net_ref.opt.use_winograd_convolution = false;
+    DataReaderFromRandom dr_ref(7767517);
+    if (net_ref.load_param_mem(tuning_param) != 0 || net_ref.load_model(dr_ref) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_1 reference load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(12, 12, 16);
+    ncnn::Mat out;
+    ncnn::Mat out_ref;
+    if (run_tuning_net(net, in, out) != 0 || run_tuning_net(net_ref, in, out_ref) != 0 || CompareMat(out_ref, out, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_algorithm_tuning_1 output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_algorithm_tuning_0()
+           || test_algorithm_tuning_1();
+}
@@ -0,0 +1,416 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "allocator.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const size_t test_sizes[] = {1, 16, 64, 65, 100, 200, 1000, 4096, 5000, 65536, 100000};
+static const int test_size_count = sizeof(test_sizes) / sizeof(test_sizes[0]);
+
+static int check_fill(const void* ptr, size_t size, unsigned char v)
+{
+    const unsigned char* p = (const unsigned char*)ptr;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (p[i] != v)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int test_sizeclass_pool_0()
+{
+    ncnn::SizeClassPoolAllocator allocator;
+
+    void* ptrs[test_size_count];
+    for (int i = 0; i < test_size_count; i++)
+    {
+        ptrs[i] = allocator.fastMalloc(test_sizes[i]);
+        if (!ptrs[i] || (size_t)ptrs[i] % NCNN_MALLOC_ALIGN != 0)
+        {
+            fprintf(stderr, "test_sizeclass_pool_0 malloc %d failed\n", (int)test_sizes[i]);
+            return -1;
+        }
+
+        memset(ptrs[i], i, test_sizes[i]);
+    }
+
+    for (int i = 0; i < test_size_count; i++)
+    {
+        if (check_fill(ptrs[i], test_sizes[i], (unsigned char)i) != 0)
+        {
+            fprintf(stderr, "test_sizeclass_pool_0 block %d corrupted\n", (int)test_sizes[i]);
+            return -1;
+        }
+
+        allocator.fastFree(ptrs[i]);
+    }
+
+    if (allocator.bytes_held() == 0)
+    {
+        fprintf(stderr, "test_sizeclass_pool_0 freed blocks not cached\n");
+        return -1;
+    }
+
+    // the same sizes are served from the cache
+    const size_t hit_count = allocator.hit_count();
+    for (int i = 0; i < test_size_count; i++)
+    {
+        ptrs[i] = allocator.fastMalloc(test_sizes[i]);
+    }
+
+    if (allocator.hit_count() != hit_count + test_size_count)
+    {
+        fprintf(stderr, "test_sizeclass_pool_0 hit_count %d expected %d\n", (int)allocator.hit_count(), (int)(hit_count + test_size_count));
+        return -1;
+    }
+
+    for (int i = 0; i < test_size_count; i++)
+    {
+        allocator.fastFree(ptrs[i]);
+    }
+
+    allocator.clear();
+
+    if (allocator.bytes_held() != 0)
+    {
+        fprintf(stderr, "test_sizeclass_pool_0 bytes_held %d after clear\n", (int)allocator.bytes_held());
+        return -1;
+    }
+
+    return 0;
+}
+
+#if NCNN_THREADS
+#define TEST_THREAD_COUNT      4
+#define TEST_BLOCKS_PER_THREAD 200
+
+struct sizeclass_pool_worker
+{
+    ncnn::SizeClassPoolAllocator* allocator;
+    int thread_id;
+    int phase;
+    void* ptrs[TEST_BLOCKS_PER_THREAD];
+    int ret;
+};
+
+static sizeclass_pool_worker workers[TEST_THREAD_COUNT];
+
+static void* sizeclass_pool_worker_run(void* args)
+{
+    sizeclass_pool_worker* w = (sizeclass_pool_worker*)args;
+
+    if (w->phase == 0)
+    {
+        // churn blocks owned by this thread
+        for (int r = 0; r < 50; r++)
+        {
+            for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+            {
+                const size_t size = test_sizes[(i + r) % test_size_count];
+                w->ptrs[i] = w->allocator->fastMalloc(size);
+                memset(w->ptrs[i], w->thread_id, size);
+            }
+
+            for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+            {
+                const size_t size = test_sizes[(i + r) % test_size_count];
+                if (check_fill(w->ptrs[i], size, (unsigned char)w->thread_id) != 0)
+                    w->ret = -1;
+
+                w->allocator->fastFree(w->ptrs[i]);
+            }
+        }
+
+        // leave blocks for the next thread to free
+        for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+        {
+            const size_t size = test_sizes[i % test_size_count];
+            w->ptrs[i] = w->allocator->fastMalloc(size);
+            memset(w->ptrs[i], w->thread_id, size);
+        }
+    }
+    else
+    {
+        // free the blocks allocated by another thread
+        const sizeclass_pool_worker* other = &workers[(w->thread_id + 1) % TEST_THREAD_COUNT];
+        for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+        {
+            const size_t size = test_sizes[i % test_size_count];
+            if (check_fill(other->ptrs[i], size, (unsigned char)other->thread_id) != 0)
+                w->ret = -1;
+
+            w->allocator->fastFree(other->ptrs[i]);
+        }
+    }
+
+    return 0;
+}
+
+static int run_sizeclass_pool_workers(ncnn::SizeClassPoolAllocator* allocator, int phase)
+{
+    ncnn::Thread* threads[TEST_THREAD_COUNT];
+    for (int t = 0; t < TEST_THREAD_COUNT; t++)
+    {
+        workers[t].allocator = allocator;
+        workers[t].thread_id = t;
+        workers[t].phase = phase;
+        workers[t].ret = 0;
+        threads[t] = new ncnn::Thread(sizeclass_pool_worker_run, &workers[t]);
+    }
+
+    int ret = 0;
+    for (int t = 0; t < TEST_THREAD_COUNT; t++)
+    {
+        threads[t]->join();
+        delete threads[t];
+
+        if (workers[t].ret != 0)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+static int test_sizeclass_pool_1()
+{
+    ncnn::SizeClassPoolAllocator allocator;
+
+    if (run_sizeclass_pool_workers(&allocator, 0) != 0)
+    {
+        fprintf(stderr, "test_sizeclass_pool_1 block corrupted in churn\n");
+        return -1;
+    }
+
+    // blocks cached after the churn, the cross-thread frees add to them
+    const size_t bytes_held = allocator.bytes_held();
+
+    if (run_sizeclass_pool_workers(&allocator, 1) != 0)
+    {
+        fprintf(stderr, "test_sizeclass_pool_1 block corrupted across threads\n");
+        return -1;
+    }
+
+    if (allocator.bytes_held() <= bytes_held)
+    {
+        fprintf(stderr, "test_sizeclass_pool_1 blocks freed across threads not cached\n");
+        return -1;
+    }
+
+    // blocks freed by worker threads are picked up from the shared lists by this thread
+    const size_t hit_count = allocator.hit_count();
+    void* ptrs[TEST_BLOCKS_PER_THREAD];
+    for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+    {
+        ptrs[i] = allocator.fastMalloc(test_sizes[i % test_size_count]);
+    }
+
+    if (allocator.hit_count() == hit_count)
+    {
+        fprintf(stderr, "test_sizeclass_pool_1 shared blocks not reused\n");
+        return -1;
+    }
+
+    for (int i = 0; i < TEST_BLOCKS_PER_THREAD; i++)
+    {
+        allocator.fastFree(ptrs[i]);
+    }
+
+    // the caches of the exited worker threads are released too
+    allocator.clear();
+
+    if (allocator.bytes_held() != 0)
+    {
+        fprintf(stderr, "test_sizeclass_pool_1 bytes_held %d after clear\n", (int)allocator.bytes_held());
+        return -1;
+    }
+
+    return 0;
+}
+#else
+static int test_sizeclass_pool_1()
+{
+    return 0;
+}
+#endif // NCNN_THREADS
+
+static int test_arena_0()
+{
+    ncnn::ArenaAllocator allocator;
+
+    // a -> b -> c chain where a and c never live at the same time
+    const size_t size_a = 1000;
+    const size_t size_b = 2000;
+    const size_t size_c = 1000;
+
+    for (int run = 0; run < 3; run++)
+    {
+        void* a = allocator.fastMalloc(size_a);
+        memset(a, 1, size_a);
+
+        void* b = allocator.fastMalloc(size_b);
+        memset(b, 2, size_b);
+
+        if (check_fill(a, size_a, 1) != 0)
+        {
+            fprintf(stderr, "test_arena_0 run %d a corrupted\n", run);
+            return -1;
+        }
+
+        allocator.fastFree(a);
+
+        void* c = allocator.fastMalloc(size_c);
+        memset(c, 3, size_c);
+
+        if (check_fill(b, size_b, 2) != 0)
+        {
+            fprintf(stderr, "test_arena_0 run %d b corrupted\n", run);
+            return -1;
+        }
+
+        allocator.fastFree(b);
+        allocator.fastFree(c);
+
+        if (run == 0)
+        {
+            const size_t peak = allocator.plan();
+            if (peak == 0 || peak >= size_a + size_b + size_c)
+            {
+                fprintf(stderr, "test_arena_0 planned peak %d does not share a and c\n", (int)peak);
+                return -1;
+            }
+        }
+    }
+
+    if (allocator.arena_hit_count() != 6 || allocator.heap_fallback_count() != 0)
+    {
+        fprintf(stderr, "test_arena_0 arena hit %d fallback %d\n", (int)allocator.arena_hit_count(), (int)allocator.heap_fallback_count());
+        return -1;
+    }
+
+    // unplanned sizes fall back to heap
+    void* x = allocator.fastMalloc(12345);
+    memset(x, 4, 12345);
+    allocator.fastFree(x);
+
+    if (allocator.heap_fallback_count() != 1)
+    {
+        fprintf(stderr, "test_arena_0 fallback %d expected 1\n", (int)allocator.heap_fallback_count());
+        return -1;
+    }
+
+    allocator.clear();
+
+    if (allocator.planned_peak() != 0)
+    {
+        fprintf(stderr, "test_arena_0 plan kept after clear\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_arena_1()
+{
+    ncnn::ArenaAllocator allocator;
+
+    // out stays with the user when planning, a is a temporary
+    void* a = allocator.fastMalloc(1000);
+    void* out = allocator.fastMalloc(500);
+    allocator.fastFree(a);
+    allocator.plan();
+
+    void* a1 = allocator.fastMalloc(1000);
+    void* out1 = allocator.fastMalloc(500);
+    memset(out1, 5, 500);
+    allocator.fastFree(a1);
+
+    // out1 is still held, the next output goes to heap instead of its bytes
+    void* a2 = allocator.fastMalloc(1000);
+    void* out2 = allocator.fastMalloc(500);
+    memset(out2, 6, 500);
+    memset(a2, 7, 1000);
+    if (check_fill(out1, 500, 5) != 0)
+    {
+        fprintf(stderr, "test_arena_1 held output corrupted\n");
+        return -1;
+    }
+    allocator.fastFree(a2);
+    allocator.fastFree(out2);
+    allocator.fastFree(out1);
+    allocator.fastFree(out);
+
+    if (allocator.arena_hit_count() != 3 || allocator.heap_fallback_count() != 1)
+    {
+        fprintf(stderr, "test_arena_1 arena hit %d fallback %d\n", (int)allocator.arena_hit_count(), (int)allocator.heap_fallback_count());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_arena_2()
+{
+    ncnn::ArenaAllocator allocator;
+
+    // c reuses the bytes of a
+    void* a = allocator.fastMalloc(1000);
+    void* b = allocator.fastMalloc(1000);
+    allocator.fastFree(a);
+    allocator.fastFree(b);
+    void* c = allocator.fastMalloc(1000);
+    allocator.fastFree(c);
+    allocator.plan();
+
+    // b freed before a leaves the recorded order, c must not land on a
+    a = allocator.fastMalloc(1000);
+    memset(a, 1, 1000);
+    b = allocator.fastMalloc(1000);
+    allocator.fastFree(b);
+    c = allocator.fastMalloc(1000);
+    memset(c, 3, 1000);
+    if (check_fill(a, 1000, 1) != 0)
+    {
+        fprintf(stderr, "test_arena_2 out of order free corrupted a\n");
+        return -1;
+    }
+    allocator.fastFree(a);
+    allocator.fastFree(c);
+
+    // back in the arena once every shared block is released
+    a = allocator.fastMalloc(1000);
+    allocator.fastFree(a);
+
+    if (allocator.arena_hit_count() != 3 || allocator.heap_fallback_count() != 1)
+    {
+        fprintf(stderr, "test_arena_2 arena hit %d fallback %d\n", (int)allocator.arena_hit_count(), (int)allocator.heap_fallback_count());
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    return 0
+           || test_sizeclass_pool_0()
+           || test_sizeclass_pool_1()
+           || test_arena_0()
+           || test_arena_1()
+           || test_arena_2();
+}
@@ -0,0 +1,132 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// four independent branches, two winograd convolutions, a 1x1 convolution and a gemm with constant B
+static const char* branch_param = "7767517\n"
+                                  "11 14\n"
+                                  "Input        in    0 1 in\n"
+                                  "Split        sp    1 4 in a0 a1 a2 a3\n"
+                                  "Convolution  c0    1 1 a0 b0 0=16 1=3 4=1 5=1 6=2304\n"
+                                  "Convolution  c1    1 1 a1 b1 0=16 1=1 5=1 6=256\n"
+                                  "Convolution  c2    1 1 a2 b2 0=16 1=3 4=1 5=1 6=2304\n"
+                                  "Reshape      rs    1 1 a3 r3 0=256 1=16\n"
+                                  "Gemm         gemm  1 1 r3 g3 5=1 8=32 9=256\n"
+                                  "Concat       cat   3 1 b0 b1 b2 cat0\n"
+                                  "InnerProduct ip0   1 1 cat0 o0 0=10 1=1 2=122880\n"
+                                  "InnerProduct ip1   1 1 g3 o1 0=10 1=1 2=5120\n"
+                                  "BinaryOp     add   2 1 o0 o1 out 0=0\n";
+
+static int load_branch_net(ncnn::Net& net, bool use_branch_parallel)
+{
+    net.opt.num_threads = 4;
+    net.opt.use_branch_parallel = use_branch_parallel;
+
+    int ret = net.load_param_mem(branch_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int extract_branch_net(ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("in", in);
+    return ex.extract("out", out);
+}
+
+static int test_branch_parallel_0()
+{
+    ncnn::Net net;
+    ncnn::Net net_branch;
+    if (load_branch_net(net, false) != 0 || load_branch_net(net_branch, true) != 0)
+    {
+        fprintf(stderr, "test_branch_parallel_0 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(16, 16, 16);
+
+    ncnn::Mat out;
+    if (extract_branch_net(net, in, out) != 0)
+    {
+        fprintf(stderr, "test_branch_parallel_0 extract failed\n");
+        return -1;
+    }
+
+    // repeat to catch races between the branches
+    for (int i = 0; i < 4; i++)
+    {
+        ncnn::Mat out_branch;
+        if (extract_branch_net(net_branch, in, out_branch) != 0)
+        {
+            fprintf(stderr, "test_branch_parallel_0 extract branch parallel failed\n");
+            return -1;
+        }
+
+        if (CompareMat(out, out_branch, 0.001) != 0)
+        {
+            fprintf(stderr, "test_branch_parallel_0 branch parallel output mismatch\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return test_branch_parallel_0();
+}
@@ -0,0 +1,226 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "layer/detectionoutput.h"
+#include "layer/proposal.h"
+#include "layer/yolodetectionoutput.h"
+#include "testutil.h"
+
+#include "detection_postprocess.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif // __AVX__
+#include "x86/detection_nms.h"
+#endif // __SSE2__
+
+// n boxes jittered around a few centers, most of them overlap heavily
+static void overlapping_boxes(int n, int num_center, std::vector<float>& xmin, std::vector<float>& ymin, std::vector<float>& xmax, std::vector<float>& ymax)
+{
+    xmin.resize(n);
+    ymin.resize(n);
+    xmax.resize(n);
+    ymax.resize(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        const float cx = (i % num_center) * 40.f + RandomFloat(-6.f, 6.f);
+        const float cy = (i % num_center) * 25.f + RandomFloat(-6.f, 6.f);
+        const float w = RandomFloat(10.f, 50.f);
+        const float h = RandomFloat(10.f, 50.f);
+
+        xmin[i] = cx - w * 0.5f;
+        ymin[i] = cy - h * 0.5f;
+        xmax[i] = cx + w * 0.5f;
+        ymax[i] = cy + h * 0.5f;
+    }
+}
+
+static int test_detection_nms_sorted(int n, int num_center, float nms_threshold, int max_keep)
+{
+#if __SSE2__
+    std::vector<float> xmin;
+    std::vector<float> ymin;
+    std::vector<float> xmax;
+    std::vector<float> ymax;
+    overlapping_boxes(n, num_center, xmin, ymin, xmax, ymax);
+
+    std::vector<int> picked;
+    detection_nms_sorted(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked, max_keep);
+
+    std::vector<int> picked_sse;
+    detection_nms_sorted_sse(xmin.data(), ymin.data(), xmax.data(), ymax.data(), n, nms_threshold, picked_sse, max_keep);
+
+    if (picked != picked_sse)
+    {
+        fprintf(stderr, "test_detection_nms_sorted failed n=%d num_center=%d nms_threshold=%f max_keep=%d kept %d vs %d\n", n, num_center, nms_threshold, max_keep, (int)picked.size(), (int)picked_sse.size());
+        return -1;
+    }
+#else
+    (void)n;
+    (void)num_center;
+    (void)nms_threshold;
+    (void)max_keep;
+#endif // __SSE2__
+
+    return 0;
+}
+
+static int test_detection_nms_0()
+{
+    return 0
+           || test_detection_nms_sorted(1, 1, 0.5f, 0)
+           || test_detection_nms_sorted(7, 2, 0.5f, 0)
+           || test_detection_nms_sorted(300, 5, 0.3f, 0)
+           || test_detection_nms_sorted(300, 5, 0.7f, 0)
+           || test_detection_nms_sorted(2000, 40, 0.45f, 0)
+           || test_detection_nms_sorted(2000, 40, 0.7f, 100)
+           || test_detection_nms_sorted(2000, 200, 0.9f, 13);
+}
+
+// the arch layers run the simd nms, test_layer compares them with the naive layers
+static int test_detectionoutput(int num_prior, int num_class, float nms_threshold)
+{
+    ncnn::Mat location = RandomMat(num_prior * 4, -0.5f, 0.5f);
+    // below 1 - confidence_threshold so that no prior is skipped as background
+    ncnn::Mat confidence = RandomMat(num_prior * num_class, 0.f, 0.9f);
+
+    // priors in a few clusters
+    ncnn::Mat priorbox(num_prior * 4, 2);
+    {
+        std::vector<float> xmin;
+        std::vector<float> ymin;
+        std::vector<float> xmax;
+        std::vector<float> ymax;
+        overlapping_boxes(num_prior, 6, xmin, ymin, xmax, ymax);
+
+        float* pb = priorbox.row(0);
+        float* var = priorbox.row(1);
+        for (int i = 0; i < num_prior; i++)
+        {
+            pb[i * 4] = xmin[i] / 256.f;
+            pb[i * 4 + 1] = ymin[i] / 256.f;
+            pb[i * 4 + 2] = xmax[i] / 256.f;
+            pb[i * 4 + 3] = ymax[i] / 256.f;
+            var[i * 4] = 0.1f;
+            var[i * 4 + 1] = 0.1f;
+            var[i * 4 + 2] = 0.2f;
+            var[i * 4 + 3] = 0.2f;
+        }
+    }
+
+    ncnn::ParamDict pd;
+    pd.set(0, num_class);
+    pd.set(1, nms_threshold);
+    pd.set(2, 400);
+    pd.set(3, 200);
+    pd.set(4, 0.05f);
+
+    std::vector<ncnn::Mat> weights(0);
+
+    std::vector<ncnn::Mat> a(3);
+    a[0] = location;
+    a[1] = confidence;
+    a[2] = priorbox;
+
+    int ret = test_layer<ncnn::DetectionOutput>("DetectionOutput", pd, weights, a);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_detectionoutput failed num_prior=%d num_class=%d nms_threshold=%f\n", num_prior, num_class, nms_threshold);
+    }
+
+    return ret;
+}
+
+static int test_proposal(int w, int h, float nms_thresh, int after_nms_topN)
+{
+    const int num_anchors = 9;
+
+    std::vector<ncnn::Mat> a(3);
+    a[0] = RandomMat(w, h, num_anchors * 2, 0.f, 1.f);
+    a[1] = RandomMat(w, h, num_anchors * 4, -0.2f, 0.2f);
+    a[2] = ncnn::Mat(3);
+    a[2][0] = h * 16.f;
+    a[2][1] = w * 16.f;
+    a[2][2] = 1.f;
+
+    ncnn::ParamDict pd;
+    pd.set(2, 6000);
+    pd.set(3, after_nms_topN);
+    pd.set(4, nms_thresh);
+
+    std::vector<ncnn::Mat> weights(0);
+
+    int ret = test_layer<ncnn::Proposal>("Proposal", pd, weights, a);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_proposal failed w=%d h=%d nms_thresh=%f after_nms_topN=%d\n", w, h, nms_thresh, after_nms_topN);
+    }
+
+    return ret;
+}
+
+static int test_yolodetectionoutput(int w, int h, int num_class, float nms_threshold)
+{
+    const int num_box = 5;
+
+    ncnn::Mat biases(num_box * 2);
+    const float b[10] = {1.08f, 1.19f, 3.42f, 4.41f, 6.63f, 11.38f, 9.42f, 5.11f, 16.62f, 10.52f};
+    for (int i = 0; i < num_box * 2; i++)
+    {
+        biases[i] = b[i];
+    }
+
+    std::vector<ncnn::Mat> a(1);
+    a[0] = RandomMat(w, h, num_box * (5 + num_class), -3.f, 3.f);
+
+    ncnn::ParamDict pd;
+    pd.set(0, num_class);
+    pd.set(1, num_box);
+    pd.set(2, 0.01f);
+    pd.set(3, nms_threshold);
+    pd.set(4, biases);
+
+    std::vector<ncnn::Mat> weights(0);
+
+    int ret = test_layer<ncnn::YoloDetectionOutput>("YoloDetectionOutput", pd, weights, a);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_yolodetectionoutput failed w=%d h=%d num_class=%d nms_threshold=%f\n", w, h, num_class, nms_threshold);
+    }
+
+    return ret;
+}
+
+static int test_detection_nms_1()
+{
+    return 0
+           || test_detectionoutput(300, 4, 0.45f)
+           || test_detectionoutput(1000, 3, 0.7f)
+           || test_proposal(20, 14, 0.7f, 300)
+           || test_proposal(32, 24, 0.5f, 50)
+           || test_yolodetectionoutput(13, 13, 4, 0.45f)
+           || test_yolodetectionoutput(19, 11, 2, 0.7f);
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_detection_nms_0()
+           || test_detection_nms_1();
+}
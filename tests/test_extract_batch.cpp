@@ -0,0 +1,196 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// 1-dim samples stack into the rows of one innerproduct matrix
+static const char* innerproduct_param = "7767517\n"
+                                        "4 4\n"
+                                        "Input        in   0 1 in\n"
+                                        "InnerProduct ip0  1 1 in x0 0=24 1=1 2=384\n"
+                                        "ReLU         relu 1 1 x0 x1\n"
+                                        "InnerProduct ip1  1 1 x1 out 0=8 1=1 2=192\n";
+
+// 2-dim samples stack along h into one gemm
+static const char* gemm_param = "7767517\n"
+                                "3 3\n"
+                                "Input     in   0 1 in\n"
+                                "Gemm      gemm 1 1 in x0 5=1 8=12 9=16\n"
+                                "HardSwish hs   1 1 x0 out\n";
+
+// convolution mixes rows, one pass per sample
+static const char* convolution_param = "7767517\n"
+                                       "2 2\n"
+                                       "Input       in   0 1 in\n"
+                                       "Convolution conv 1 1 in out 0=8 1=3 5=1 6=288\n";
+
+// 16x3 samples flattened by an innerproduct of 48 inputs, stacking them would change the layout
+static const char* flatten_param = "7767517\n"
+                                   "2 2\n"
+                                   "Input        in  0 1 in\n"
+                                   "InnerProduct ip0 1 1 in out 0=8 1=1 2=384\n";
+
+static int load_batch_net(ncnn::Net& net, const char* param)
+{
+    net.opt.num_threads = 1;
+
+    int ret = net.load_param_mem(param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+// extract_batch matches per-sample extract, expect_layer_runs is the profiled run count of the batched call
+static int test_extract_batch(const char* param, const std::vector<ncnn::Mat>& ins, int expect_layer_runs)
+{
+    ncnn::Net net;
+    if (load_batch_net(net, param) != 0)
+    {
+        fprintf(stderr, "test_extract_batch load failed\n");
+        return -1;
+    }
+
+    std::vector<ncnn::Mat> outs;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_profiling(true);
+        ex.input_batch("in", ins);
+        if (ex.extract_batch("out", outs) != 0 || outs.size() != ins.size())
+        {
+            fprintf(stderr, "test_extract_batch extract_batch failed\n");
+            return -1;
+        }
+
+        if ((int)ex.layer_profiles().size() != expect_layer_runs)
+        {
+            fprintf(stderr, "test_extract_batch expect %d layer runs but got %d\n", expect_layer_runs, (int)ex.layer_profiles().size());
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < ins.size(); i++)
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("in", ins[i]);
+
+        ncnn::Mat out;
+        if (ex.extract("out", out) != 0)
+        {
+            fprintf(stderr, "test_extract_batch extract failed\n");
+            return -1;
+        }
+
+        if (CompareMat(out, outs[i], 0.001) != 0)
+        {
+            fprintf(stderr, "test_extract_batch sample %d mismatch\n", (int)i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_extract_batch_0()
+{
+    std::vector<ncnn::Mat> ins(5);
+    for (int i = 0; i < 5; i++)
+    {
+        ins[i] = RandomMat(16);
+    }
+
+    // every layer runs once for all samples
+    return test_extract_batch(innerproduct_param, ins, 3);
+}
+
+static int test_extract_batch_1()
+{
+    std::vector<ncnn::Mat> ins(4);
+    for (int i = 0; i < 4; i++)
+    {
+        ins[i] = RandomMat(16, 3);
+    }
+
+    return test_extract_batch(gemm_param, ins, 2);
+}
+
+static int test_extract_batch_2()
+{
+    std::vector<ncnn::Mat> ins(3);
+    for (int i = 0; i < 3; i++)
+    {
+        ins[i] = RandomMat(6, 6, 4);
+    }
+
+    return test_extract_batch(convolution_param, ins, 3);
+}
+
+static int test_extract_batch_3()
+{
+    std::vector<ncnn::Mat> ins(4);
+    for (int i = 0; i < 4; i++)
+    {
+        ins[i] = RandomMat(16, 3);
+    }
+
+    return test_extract_batch(flatten_param, ins, 4);
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_extract_batch_0()
+           || test_extract_batch_1()
+           || test_extract_batch_2()
+           || test_extract_batch_3();
+}
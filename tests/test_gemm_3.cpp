@@ -0,0 +1,136 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "layer/gemm.h"
+#include "testutil.h"
+
+static int test_gemm_weight_quant(int M, int N, int K, const ncnn::Mat& C, int transA, int transB, int output_transpose, int constantA, int constantB, int bits, int group_size, int TILE_M, int TILE_N, int TILE_K)
+{
+    int broadcast_type_C = -1;
+    if (!C.empty())
+    {
+        if (C.dims == 1 && C.w == 1)
+            broadcast_type_C = 0;
+        if (C.dims == 1 && C.w == M)
+            broadcast_type_C = 1;
+        if (C.dims == 1 && C.w == N)
+            broadcast_type_C = 4;
+        if (C.dims == 2 && C.w == 1 && C.h == M)
+            broadcast_type_C = 2;
+        if (C.dims == 2 && C.w == N && C.h == M)
+            broadcast_type_C = 3;
+        if (C.dims == 2 && C.w == N && C.h == 1)
+            broadcast_type_C = 4;
+    }
+
+    // with both A and B constant, C is the only runtime input
+    const int constantC = !C.empty() && !(constantA && constantB);
+
+    ncnn::ParamDict pd;
+    pd.set(0, 1.f);
+    pd.set(1, 1.f);
+    pd.set(2, transA);
+    pd.set(3, transB);
+    pd.set(4, constantA);
+    pd.set(5, constantB);
+    pd.set(6, constantC);
+    pd.set(7, M);
+    pd.set(8, N);
+    pd.set(9, K);
+    pd.set(10, broadcast_type_C);
+    pd.set(14, output_transpose);
+    pd.set(20, TILE_M);
+    pd.set(21, TILE_N);
+    pd.set(22, TILE_K);
+    pd.set(23, bits);       // weight_quant_bits
+    pd.set(24, group_size); // weight_quant_group_size
+
+    // quantized constants are M / N rows of K packed values
+    const int row_bytes = bits == 4 ? (K + 31) / 32 * 16 : K;
+    const int groups = (K + group_size - 1) / group_size;
+    const float scale_max = bits == 4 ? 0.2f : 0.01f;
+
+    ncnn::Mat A = constantA ? RandomS8Mat(row_bytes * M) : transA ? RandomMat(M, K) : RandomMat(K, M);
+    ncnn::Mat B = constantB ? RandomS8Mat(row_bytes * N) : transB ? RandomMat(K, N) : RandomMat(N, K);
+
+    std::vector<ncnn::Mat> weights;
+    if (constantA) weights.push_back(A);
+    if (constantB) weights.push_back(B);
+    if (constantC) weights.push_back(C);
+    if (constantA) weights.push_back(RandomMat(groups * M, 0.001f, scale_max));
+    if (constantB) weights.push_back(RandomMat(groups * N, 0.001f, scale_max));
+
+    std::vector<ncnn::Mat> a;
+    if (!constantA) a.push_back(A);
+    if (!constantB) a.push_back(B);
+    if (!C.empty() && !constantC) a.push_back(C);
+
+    int ret = test_layer<ncnn::Gemm>("Gemm", pd, weights, a, 1, 0.001f, 0, TEST_LAYER_DISABLE_GPU_TESTING);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_gemm_weight_quant failed M=%d N=%d K=%d C.dims=%d C=(%d %d %d) transA=%d transB=%d output_transpose=%d constantA=%d constantB=%d bits=%d group_size=%d TILE=%d %d %d\n", M, N, K, C.dims, C.w, C.h, C.c, transA, transB, output_transpose, constantA, constantB, bits, group_size, TILE_M, TILE_N, TILE_K);
+    }
+
+    return ret;
+}
+
+static int test_gemm_0(int M, int N, int K)
+{
+    return 0
+           || test_gemm_weight_quant(M, N, K, ncnn::Mat(), 0, 0, 0, 1, 0, 8, 32, 0, 0, 0)
+           || test_gemm_weight_quant(M, N, K, ncnn::Mat(), 1, 1, 1, 1, 0, 4, 32, 0, 0, 0)
+           || test_gemm_weight_quant(M, N, K, ncnn::Mat(), 0, 1, 0, 0, 1, 4, 8, 0, 0, 0)
+           || test_gemm_weight_quant(M, N, K, ncnn::Mat(), 1, 0, 1, 0, 1, 8, 5, 0, 0, 0)
+           || test_gemm_weight_quant(M, N, K, RandomMat(N, M), 0, 0, 0, 1, 1, 4, 6, 0, 0, 0)
+           || test_gemm_weight_quant(M, N, K, RandomMat(M), 1, 0, 0, 1, 0, 4, 3, 8, 8, 6)
+           || test_gemm_weight_quant(M, N, K, RandomMat(N), 0, 1, 1, 0, 1, 8, 16, 8, 8, 6)
+           || test_gemm_weight_quant(M, N, K, RandomMat(1, M), 1, 1, 0, 0, 1, 4, 7, 4, 4, 5);
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    int mnk[][3] = {
+        {1, 1, 1},
+        {2, 3, 4},
+        {7, 7, 7},
+        {8, 8, 8},
+        {15, 15, 15},
+        {16, 16, 16},
+        {1, 35, 47},
+        {23, 31, 1},
+        {23, 1, 23},
+        {31, 7, 3},
+        {28, 20, 7},
+        {32, 32, 9},
+        {47, 35, 48},
+        {48, 35, 67}
+    };
+
+    int mnk_count = sizeof(mnk) / sizeof(int) / 3;
+
+    for (int i = 0; i < mnk_count; i++)
+    {
+        int M = mnk[i][0];
+        int N = mnk[i][1];
+        int K = mnk[i][2];
+
+        int ret = test_gemm_0(M, N, K);
+        if (ret != 0)
+            return -1;
+    }
+
+    return 0;
+}
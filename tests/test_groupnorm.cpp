@@ -56,7 +56,8 @@ static int test_groupnorm_1()
            || test_groupnorm(RandomMat(4, 5, 6), 3, 0.01f)
            || test_groupnorm(RandomMat(5, 6, 12), 4, 0.02f)
            || test_groupnorm(RandomMat(6, 7, 24), 2, 0.001f)
-           || test_groupnorm(RandomMat(8, 9, 24), 3, 0.0001f);
+           || test_groupnorm(RandomMat(8, 9, 24), 3, 0.0001f)
+           || test_groupnorm(RandomMat(9, 7, 64), 32, 0.00001f);
 }
 
 static int test_groupnorm_2()
@@ -87,6 +87,58 @@ static int test_innerproduct_2()
            || test_innerproduct(RandomMat(24), 32, 1);
 }
 
+static int test_innerproduct_weight_quant(const ncnn::Mat& a, int outch, int bias, int bits, int group_size)
+{
+    const int k = a.dims == 2 && a.h > 1 ? a.w : a.w * a.h * a.c;
+
+    ncnn::ParamDict pd;
+    pd.set(0, outch); // num_output
+    pd.set(1, bias);  // bias_term
+    pd.set(2, outch * k);
+    pd.set(11, bits);       // weight_quant_bits
+    pd.set(12, group_size); // weight_quant_group_size
+
+    int activation_type = RAND() % 7; // 0 1 2 3 4 5 6
+    ncnn::Mat activation_params(2);
+    activation_params[0] = (activation_type == 6) ? RandomFloat(0, 1) : RandomFloat(-1, 0); // alpha
+    activation_params[1] = RandomFloat(0, 1);                                               // beta
+    pd.set(9, activation_type);
+    pd.set(10, activation_params);
+
+    const int row_bytes = bits == 4 ? (k + 31) / 32 * 16 : k;
+    const int groups = (k + group_size - 1) / group_size;
+
+    std::vector<ncnn::Mat> weights(bias ? 3 : 2);
+    weights[0] = RandomS8Mat(outch * row_bytes);
+    if (bias)
+        weights[1] = RandomMat(outch);
+    weights[bias ? 2 : 1] = RandomMat(outch * groups, 0.001f, bits == 4 ? 0.2f : 0.01f);
+
+    int ret = test_layer<ncnn::InnerProduct>("InnerProduct", pd, weights, a);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_innerproduct_weight_quant failed a.dims=%d a=(%d %d %d) outch=%d bias=%d bits=%d group_size=%d act=%d actparams=[%f,%f]\n", a.dims, a.w, a.h, a.c, outch, bias, bits, group_size, activation_type, activation_params[0], activation_params[1]);
+    }
+
+    return ret;
+}
+
+static int test_innerproduct_6()
+{
+    return 0
+           || test_innerproduct_weight_quant(RandomMat(1, 3, 1), 1, 1, 8, 2)
+           || test_innerproduct_weight_quant(RandomMat(9, 3, 8), 7, 1, 4, 8)
+           || test_innerproduct_weight_quant(RandomMat(6, 2, 16), 16, 0, 8, 32)
+           || test_innerproduct_weight_quant(RandomMat(9, 8), 7, 1, 4, 6)
+           || test_innerproduct_weight_quant(RandomMat(13, 12), 8, 1, 8, 16)
+           || test_innerproduct_weight_quant(RandomMat(35, 4), 16, 0, 4, 32)
+           || test_innerproduct_weight_quant(RandomMat(1), 1, 1, 4, 32)
+           || test_innerproduct_weight_quant(RandomMat(15), 8, 1, 4, 5)
+           || test_innerproduct_weight_quant(RandomMat(67), 15, 0, 8, 17)
+           || test_innerproduct_weight_quant(RandomMat(128), 24, 1, 4, 64)
+           || test_innerproduct_weight_quant(RandomMat(131), 32, 1, 4, 32);
+}
+
 #if NCNN_INT8
 static int test_innerproduct_int8(const ncnn::Mat& a, int outch, int bias)
 {
@@ -267,12 +319,14 @@ int main()
            || test_innerproduct_2()
            || test_innerproduct_3()
            || test_innerproduct_4()
-           || test_innerproduct_5();
+           || test_innerproduct_5()
+           || test_innerproduct_6();
 #else
     return 0
            || test_innerproduct_0()
            || test_innerproduct_1()
            || test_innerproduct_2()
-           || test_innerproduct_4();
+           || test_innerproduct_4()
+           || test_innerproduct_6();
 #endif
 }
@@ -0,0 +1,173 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// conv + batchnorm + scalar mul + relu folds into the convolution
+// the scalar muls in front of the sub merge into an eltwise sum
+// the layernorm affine folds into the last innerproduct
+static const char* fusion_param = "7767517\n"
+                                  "12 13\n"
+                                  "Input        in     0 1 in\n"
+                                  "Convolution  conv0  1 1 in c0 0=8 1=3 4=1 5=1 6=288\n"
+                                  "BatchNorm    bn0    1 1 c0 b0 0=8 1=1.0\n"
+                                  "BinaryOp     mul0   1 1 b0 m0 0=2 1=1 2=0.5\n"
+                                  "ReLU         relu0  1 1 m0 r0\n"
+                                  "Split        split0 1 2 r0 r1 r2\n"
+                                  "BinaryOp     mul1   1 1 r1 s1 0=2 1=1 2=2.0 -23330=4,3,6,6,8\n"
+                                  "BinaryOp     mul2   1 1 r2 s2 0=2 1=1 2=-1.5 -23330=4,3,6,6,8\n"
+                                  "BinaryOp     sub0   2 1 s1 s2 e0 0=1\n"
+                                  "InnerProduct ip0    1 1 e0 f0 0=16 1=1 2=4608\n"
+                                  "LayerNorm    ln0    1 1 f0 n0 0=16 1=0.00001 2=1\n"
+                                  "InnerProduct ip1    1 1 n0 out 0=10 1=1 2=160\n";
+
+static int load_fusion_net(ncnn::Net& net, bool use_layer_fusion)
+{
+    net.opt.num_threads = 1;
+    net.opt.use_layer_fusion = use_layer_fusion;
+    // fp16 weights would round the fused and unfused weights apart
+    net.opt.use_fp16_storage = false;
+
+    int ret = net.load_param_mem(fusion_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int test_layer_fusion_0()
+{
+    ncnn::Net net;
+    ncnn::Net net_fused;
+    if (load_fusion_net(net, false) != 0 || load_fusion_net(net_fused, true) != 0)
+    {
+        fprintf(stderr, "test_layer_fusion_0 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(6, 6, 4);
+
+    ncnn::Mat out;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("in", in);
+        ex.extract("out", out);
+    }
+
+    ncnn::Mat out_fused;
+    {
+        ncnn::Extractor ex = net_fused.create_extractor();
+        ex.input("in", in);
+        if (ex.extract("out", out_fused) != 0)
+        {
+            fprintf(stderr, "test_layer_fusion_0 extract fused failed\n");
+            return -1;
+        }
+    }
+
+    if (CompareMat(out, out_fused, 0.00001) != 0)
+    {
+        fprintf(stderr, "test_layer_fusion_0 fused output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_layer_fusion_1()
+{
+    ncnn::Net net_fused;
+    if (load_fusion_net(net_fused, true) != 0)
+    {
+        fprintf(stderr, "test_layer_fusion_1 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(6, 6, 4);
+
+    ncnn::Extractor ex = net_fused.create_extractor();
+    ex.input("in", in);
+
+    // untouched blobs stay extractable
+    ncnn::Mat f0;
+    if (ex.extract("f0", f0) != 0)
+    {
+        fprintf(stderr, "test_layer_fusion_1 blob f0 not extracted\n");
+        return -1;
+    }
+
+    // folded into the convolution
+    ncnn::Mat b0;
+    if (ex.extract("b0", b0) == 0)
+    {
+        fprintf(stderr, "test_layer_fusion_1 folded blob b0 extracted\n");
+        return -1;
+    }
+
+    // still produced, but without the affine that went into ip1
+    ncnn::Mat n0;
+    if (ex.extract("n0", n0) == 0)
+    {
+        fprintf(stderr, "test_layer_fusion_1 fused blob n0 extracted\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_layer_fusion_0()
+           || test_layer_fusion_1();
+}
@@ -0,0 +1,186 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// random weights, with every byte handed out kept for writing the model file
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+        }
+        else
+        {
+            float* p = (float*)buf;
+            for (size_t i = 0; i < size / sizeof(float); i++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                p[i] = (seed >> 8) / 16777216.f - 0.5f;
+            }
+        }
+
+        const unsigned char* b = (const unsigned char*)buf;
+        data.insert(data.end(), b, b + size);
+        return size;
+    }
+
+    mutable unsigned int seed;
+    mutable std::vector<unsigned char> data;
+};
+
+static const char* mmap_param = "7767517\n"
+                                "5 5\n"
+                                "Input        in    0 1 in\n"
+                                "Convolution  conv0 1 1 in c0 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                                "Convolution  conv1 1 1 c0 c1 0=16 1=1 5=1 6=256\n"
+                                "Pooling      pool  1 1 c1 p0 0=1 4=1\n"
+                                "InnerProduct ip    1 1 p0 out 0=10 1=1 2=160\n";
+
+static const char* model_path = "test_load_model_mmap.bin";
+static const char* empty_path = "test_load_model_mmap_empty.bin";
+
+static int write_file(const char* path, const std::vector<unsigned char>& data)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+
+    size_t nwrite = data.empty() ? 0 : fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return nwrite == data.size() ? 0 : -1;
+}
+
+static int run_net(ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("in", in);
+    return ex.extract("out", out);
+}
+
+static int test_load_model_mmap_0()
+{
+    ncnn::Mat in = RandomMat(12, 12, 16);
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    DataReaderFromRandom dr(7767517);
+    if (net.load_param_mem(mmap_param) != 0 || net.load_model(dr) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 reference load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat out_ref;
+    if (run_net(net, in, out_ref) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 reference extract failed\n");
+        return -1;
+    }
+
+    if (write_file(model_path, dr.data) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 write %s failed\n", model_path);
+        return -1;
+    }
+
+    ncnn::Net net_copy;
+    net_copy.opt.num_threads = 1;
+    ncnn::Net net_mmap;
+    net_mmap.opt.num_threads = 1;
+    if (net_copy.load_param_mem(mmap_param) != 0 || net_copy.load_model(model_path) != 0
+            || net_mmap.load_param_mem(mmap_param) != 0 || net_mmap.load_model_mmap(model_path) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 load %s failed\n", model_path);
+        remove(model_path);
+        return -1;
+    }
+
+    // the mapping stays valid after the file is gone
+    remove(model_path);
+
+    ncnn::Mat out_copy;
+    ncnn::Mat out_mmap;
+    if (run_net(net_copy, in, out_copy) != 0 || run_net(net_mmap, in, out_mmap) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 extract failed\n");
+        return -1;
+    }
+
+    if (CompareMat(out_ref, out_copy, 0.0001) != 0 || CompareMat(out_copy, out_mmap, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_0 output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_load_model_mmap_1()
+{
+    ncnn::Net net;
+    if (net.load_param_mem(mmap_param) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_1 load param failed\n");
+        return -1;
+    }
+
+    // missing file
+    remove(empty_path);
+    if (net.load_model_mmap(empty_path) == 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_1 missing file loaded\n");
+        return -1;
+    }
+
+    // empty file
+    if (write_file(empty_path, std::vector<unsigned char>()) != 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_1 write %s failed\n", empty_path);
+        return -1;
+    }
+
+    int ret = net.load_model_mmap(empty_path);
+    remove(empty_path);
+    if (ret == 0)
+    {
+        fprintf(stderr, "test_load_model_mmap_1 empty file loaded\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_load_model_mmap_0()
+           || test_load_model_mmap_1();
+}
@@ -15,6 +15,7 @@
 #include "mat.h"
 #include "prng.h"
 
+#include <math.h>
 #include <string.h>
 
 static struct prng_rand_t g_prng_rand_state;
@@ -370,6 +371,77 @@ static int test_mat_pixel_yuv420sp2rgb(int w, int h)
     return 0;
 }
 
+static int test_mat_pixel_roi_resize_normalize(int w, int h, int roix, int roiy, int roiw, int roih, int target_width, int target_height)
+{
+    ncnn::Option opt;
+    opt.num_threads = 3;
+
+    const int pixel_types[8] = {ncnn::Mat::PIXEL_GRAY, ncnn::Mat::PIXEL_RGB, ncnn::Mat::PIXEL_RGB2BGR, ncnn::Mat::PIXEL_BGR2GRAY, ncnn::Mat::PIXEL_RGB2RGBA, ncnn::Mat::PIXEL_GRAY2RGBA, ncnn::Mat::PIXEL_RGBA2BGR, ncnn::Mat::PIXEL_BGRA2RGBA};
+    const int pixel_channels[8] = {1, 3, 3, 3, 3, 1, 4, 4};
+
+    const float mean_vals[4] = {104.f, 117.f, 123.f, 50.f};
+    const float norm_vals[4] = {0.017f, 0.018f, 0.019f, 0.02f};
+
+    for (int i = 0; i < 8; i++)
+    {
+        const int srcc = pixel_channels[i];
+        ncnn::Mat a = RandomMat(w, h, srcc);
+
+        ncnn::Mat ref = ncnn::Mat::from_pixels_roi_resize(a, pixel_types[i], w, h, w * srcc, roix, roiy, roiw, roih, target_width, target_height);
+        ref.substract_mean_normalize(mean_vals, norm_vals);
+
+        const int elempacks[3] = {1, 4, 8};
+        for (int j = 0; j < 3; j++)
+        {
+            const int elempack = elempacks[j];
+            if (ref.c % elempack != 0)
+                continue;
+
+            ncnn::Mat ref_packed;
+            ncnn::convert_packing(ref, ref_packed, elempack, opt);
+
+            for (int cast_type = 1; cast_type <= 4; cast_type++)
+            {
+                ncnn::Mat m = ncnn::Mat::from_pixels_roi_resize_normalize(a, pixel_types[i], w, h, w * srcc, roix, roiy, roiw, roih, target_width, target_height, mean_vals, norm_vals, elempack, cast_type, opt);
+
+                if (m.w != ref_packed.w || m.h != ref_packed.h || m.c != ref_packed.c || m.elempack != elempack)
+                {
+                    fprintf(stderr, "test_mat_pixel_roi_resize_normalize shape mismatch pixel_type=%d elempack=%d cast_type=%d\n", i, elempack, cast_type);
+                    return -1;
+                }
+
+                for (int q = 0; q < m.c; q++)
+                {
+                    const float* rp = ref_packed.channel(q);
+                    const unsigned char* mp = m.channel(q);
+                    for (int k = 0; k < target_width * target_height * elempack; k++)
+                    {
+                        float v = 0.f;
+                        float tol = 0.001f;
+                        if (cast_type == 1)
+                            v = ((const float*)mp)[k];
+                        if (cast_type == 2)
+                            v = ncnn::float16_to_float32(((const unsigned short*)mp)[k]), tol = 0.01f;
+                        if (cast_type == 3)
+                            v = ((const signed char*)mp)[k], tol = 1.f;
+                        if (cast_type == 4)
+                            v = ncnn::bfloat16_to_float32(((const unsigned short*)mp)[k]), tol = 0.05f;
+
+                        float r = cast_type == 3 ? std::min(std::max(rp[k], -128.f), 127.f) : rp[k];
+                        if (fabsf(v - r) > tol)
+                        {
+                            fprintf(stderr, "test_mat_pixel_roi_resize_normalize failed w=%d h=%d roi=[%d %d %d %d] target=%d %d pixel_type=%d elempack=%d cast_type=%d %f vs %f\n", w, h, roix, roiy, roiw, roih, target_width, target_height, i, elempack, cast_type, v, r);
+                            return -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
 static int test_mat_pixel_0()
 {
     return 0
@@ -439,6 +511,15 @@ static int test_mat_pixel_6()
            || test_mat_pixel_yuv420sp2rgb(6, 6);
 }
 
+static int test_mat_pixel_7()
+{
+    return 0
+           || test_mat_pixel_roi_resize_normalize(16, 16, 1, 2, 11, 9, 11, 9)
+           || test_mat_pixel_roi_resize_normalize(16, 16, 2, 1, 13, 11, 7, 5)
+           || test_mat_pixel_roi_resize_normalize(15, 15, 0, 0, 15, 15, 24, 20)
+           || test_mat_pixel_roi_resize_normalize(33, 17, 3, 4, 25, 9, 16, 32);
+}
+
 int main()
 {
     SRAND(7767517);
@@ -450,5 +531,6 @@ int main()
            || test_mat_pixel_3()
            || test_mat_pixel_4()
            || test_mat_pixel_5()
-           || test_mat_pixel_6();
+           || test_mat_pixel_6()
+           || test_mat_pixel_7();
 }
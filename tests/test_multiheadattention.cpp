@@ -115,6 +115,149 @@ static int test_multiheadattention_sameqkv(const ncnn::Mat& a, int num_heads)
     return ret;
 }
 
+static int test_multiheadattention_mask(const ncnn::Mat& q, const ncnn::Mat& kv, const ncnn::Mat& mask, int num_heads)
+{
+    int embed_dim = q.w;
+
+    ncnn::ParamDict pd;
+    pd.set(0, embed_dim);
+    pd.set(1, num_heads);
+    pd.set(2, embed_dim * embed_dim);
+    pd.set(3, kv.w);
+    pd.set(4, kv.w);
+    pd.set(5, 1);
+
+    std::vector<ncnn::Mat> weights(8);
+    weights[0] = RandomMat(embed_dim * embed_dim);
+    weights[1] = RandomMat(embed_dim);
+    weights[2] = RandomMat(embed_dim * kv.w);
+    weights[3] = RandomMat(embed_dim);
+    weights[4] = RandomMat(embed_dim * kv.w);
+    weights[5] = RandomMat(embed_dim);
+    weights[6] = RandomMat(embed_dim * embed_dim);
+    weights[7] = RandomMat(embed_dim);
+
+    std::vector<ncnn::Mat> as(3);
+    as[0] = q;
+    as[1] = kv;
+    as[2] = mask;
+
+    int ret = test_layer<ncnn::MultiHeadAttention>("MultiHeadAttention", pd, weights, as);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_multiheadattention_mask failed q=(%d %d) kv=(%d %d) mask=(%d %d %d)\n", q.w, q.h, kv.w, kv.h, mask.w, mask.h, mask.c);
+    }
+
+    return ret;
+}
+
+static int test_multiheadattention_kvcache(const ncnn::Mat& q, int past_seqlen, int num_heads, int with_mask)
+{
+    int embed_dim = q.w;
+    int src_seqlen = q.h;
+
+    ncnn::ParamDict pd;
+    pd.set(0, embed_dim);
+    pd.set(1, num_heads);
+    pd.set(2, embed_dim * embed_dim);
+    pd.set(5, with_mask);
+    pd.set(6, 1);
+
+    std::vector<ncnn::Mat> weights(8);
+    weights[0] = RandomMat(embed_dim * embed_dim);
+    weights[1] = RandomMat(embed_dim);
+    weights[2] = RandomMat(embed_dim * embed_dim);
+    weights[3] = RandomMat(embed_dim);
+    weights[4] = RandomMat(embed_dim * embed_dim);
+    weights[5] = RandomMat(embed_dim);
+    weights[6] = RandomMat(embed_dim * embed_dim);
+    weights[7] = RandomMat(embed_dim);
+
+    std::vector<ncnn::Mat> as;
+    as.push_back(q);
+    if (with_mask)
+        as.push_back(RandomMat(past_seqlen + src_seqlen, src_seqlen));
+    if (past_seqlen == 0)
+    {
+        // first decoding step, the cache is still empty
+        as.push_back(ncnn::Mat());
+        as.push_back(ncnn::Mat());
+    }
+    else
+    {
+        as.push_back(RandomMat(embed_dim, past_seqlen));
+        as.push_back(RandomMat(embed_dim, past_seqlen));
+    }
+
+    int ret = test_layer<ncnn::MultiHeadAttention>("MultiHeadAttention", pd, weights, as, 3);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_multiheadattention_kvcache failed q=(%d %d) past_seqlen=%d num_heads=%d with_mask=%d\n", q.w, q.h, past_seqlen, num_heads, with_mask);
+    }
+
+    return ret;
+}
+
+// per output channel int8 scales of a (outch, K) weight
+static ncnn::Mat WeightScales(const ncnn::Mat& weight, int outch)
+{
+    const int K = weight.w / outch;
+
+    ncnn::Mat scales(outch);
+    for (int p = 0; p < outch; p++)
+    {
+        float absmax = 0.f;
+        for (int k = 0; k < K; k++)
+        {
+            absmax = std::max(absmax, (float)fabs(weight[p * K + k]));
+        }
+        scales[p] = absmax == 0.f ? 1.f : 127.f / absmax;
+    }
+
+    return scales;
+}
+
+static int test_multiheadattention_int8(const ncnn::Mat& q, const ncnn::Mat& k, const ncnn::Mat& v, int num_heads, int kdim, int vdim)
+{
+    int embed_dim = q.w;
+
+    ncnn::ParamDict pd;
+    pd.set(0, embed_dim);
+    pd.set(1, num_heads);
+    pd.set(2, embed_dim * embed_dim);
+    pd.set(3, kdim);
+    pd.set(4, vdim);
+    pd.set(18, 2);
+
+    std::vector<ncnn::Mat> weights(12);
+    weights[0] = RandomMat(embed_dim * embed_dim);
+    weights[1] = RandomMat(embed_dim);
+    weights[2] = RandomMat(embed_dim * kdim);
+    weights[3] = RandomMat(embed_dim);
+    weights[4] = RandomMat(embed_dim * vdim);
+    weights[5] = RandomMat(embed_dim);
+    weights[6] = RandomMat(embed_dim * embed_dim);
+    weights[7] = RandomMat(embed_dim);
+    weights[8] = WeightScales(weights[0], embed_dim);
+    weights[9] = WeightScales(weights[2], embed_dim);
+    weights[10] = WeightScales(weights[4], embed_dim);
+    weights[11] = WeightScales(weights[6], embed_dim);
+
+    std::vector<ncnn::Mat> as(3);
+    as[0] = q;
+    as[1] = k;
+    as[2] = v;
+
+    // attention outputs near a rounding boundary may requantize to the neighbouring int8 level
+    int ret = test_layer<ncnn::MultiHeadAttention>("MultiHeadAttention", pd, weights, as, 1, 0.1f, 0, TEST_LAYER_DISABLE_GPU_TESTING);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_multiheadattention_int8 failed q=(%d %d) k=(%d %d) v=(%d %d)\n", q.w, q.h, k.w, k.h, v.w, v.h);
+    }
+
+    return ret;
+}
+
 static int test_multiheadattention_0()
 {
     return 0
@@ -144,6 +287,34 @@ static int test_multiheadattention_2()
            || test_multiheadattention_sameqkv(RandomMat(64, 127), 32);
 }
 
+static int test_multiheadattention_3()
+{
+    return 0
+           || test_multiheadattention_mask(RandomMat(64, 128), RandomMat(64, 128), RandomMat(128, 128), 4)
+           || test_multiheadattention_mask(RandomMat(16, 17), RandomMat(44, 127), RandomMat(127, 17), 2)
+           || test_multiheadattention_mask(RandomMat(12, 17), RandomMat(28, 32), RandomMat(32, 17, 3), 3)
+           || test_multiheadattention_mask(RandomMat(32, 21), RandomMat(24, 211), RandomMat(211, 21, 4), 4);
+}
+
+static int test_multiheadattention_4()
+{
+    return 0
+           || test_multiheadattention_kvcache(RandomMat(64, 1), 127, 4, 0)
+           || test_multiheadattention_kvcache(RandomMat(64, 1), 16, 8, 1)
+           || test_multiheadattention_kvcache(RandomMat(48, 5), 32, 3, 0)
+           || test_multiheadattention_kvcache(RandomMat(16, 8), 9, 2, 1)
+           || test_multiheadattention_kvcache(RandomMat(64, 1), 0, 4, 0)
+           || test_multiheadattention_kvcache(RandomMat(32, 6), 0, 2, 1);
+}
+
+static int test_multiheadattention_5()
+{
+    return 0
+           || test_multiheadattention_int8(RandomMat(64, 128), RandomMat(64, 128), RandomMat(64, 128), 4, 64, 64)
+           || test_multiheadattention_int8(RandomMat(16, 128), RandomMat(44, 127), RandomMat(55, 127), 4, 44, 55)
+           || test_multiheadattention_int8(RandomMat(12, 17), RandomMat(28, 32), RandomMat(11, 32), 3, 28, 11);
+}
+
 int main()
 {
     SRAND(7767517);
@@ -151,5 +322,8 @@ int main()
     return 0
            || test_multiheadattention_0()
            || test_multiheadattention_1()
-           || test_multiheadattention_2();
+           || test_multiheadattention_2()
+           || test_multiheadattention_3()
+           || test_multiheadattention_4()
+           || test_multiheadattention_5();
 }
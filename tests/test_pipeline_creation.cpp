@@ -0,0 +1,204 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "platform.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// winograd, sgemm and innerproduct all transform their weights in create_pipeline
+static const char* pipeline_param = "7767517\n"
+                                    "7 8\n"
+                                    "Input        in     0 1 in\n"
+                                    "Convolution  conv0  1 1 in c0 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                                    "Split        split0 1 2 c0 c1 c2\n"
+                                    "Convolution  conv1  1 1 c1 c3 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                                    "Convolution  conv2  1 1 c2 c4 0=16 1=1 5=1 6=256\n"
+                                    "BinaryOp     add0   2 1 c3 c4 s0 0=0\n"
+                                    "InnerProduct ip     1 1 s0 out 0=10 1=1 2=23040\n";
+
+enum
+{
+    PIPELINE_SERIAL = 0,
+    PIPELINE_PARALLEL = 1,
+    PIPELINE_LAZY = 2
+};
+
+static int load_pipeline_net(ncnn::Net& net, int mode)
+{
+    net.opt.num_threads = 4;
+    net.opt.use_parallel_pipeline_creation = mode == PIPELINE_PARALLEL;
+    net.opt.use_lazy_pipeline_creation = mode == PIPELINE_LAZY;
+
+    int ret = net.load_param_mem(pipeline_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int run_pipeline_net(const ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("in", in);
+    return ex.extract("out", out);
+}
+
+static int test_pipeline_creation_0()
+{
+    ncnn::Mat in = RandomMat(12, 12, 16);
+
+    ncnn::Net net_serial;
+    ncnn::Mat out_serial;
+    if (load_pipeline_net(net_serial, PIPELINE_SERIAL) != 0 || run_pipeline_net(net_serial, in, out_serial) != 0)
+    {
+        fprintf(stderr, "test_pipeline_creation_0 serial failed\n");
+        return -1;
+    }
+
+    const int modes[2] = {PIPELINE_PARALLEL, PIPELINE_LAZY};
+    for (int i = 0; i < 2; i++)
+    {
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_pipeline_net(net, modes[i]) != 0 || run_pipeline_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "test_pipeline_creation_0 mode %d failed\n", modes[i]);
+            return -1;
+        }
+
+        if (CompareMat(out_serial, out, 0.0001) != 0)
+        {
+            fprintf(stderr, "test_pipeline_creation_0 mode %d output mismatch\n", modes[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#define TEST_THREAD_COUNT 4
+
+struct pipeline_worker
+{
+    const ncnn::Net* net;
+    const ncnn::Mat* in;
+    ncnn::Mat out;
+    int ret;
+};
+
+static void* pipeline_worker_run(void* args)
+{
+    pipeline_worker* worker = (pipeline_worker*)args;
+
+    worker->ret = run_pipeline_net(*worker->net, *worker->in, worker->out);
+
+    return 0;
+}
+
+// the first extractors of a lazy net race to create the same pipelines
+static int test_pipeline_creation_1()
+{
+    ncnn::Mat in = RandomMat(12, 12, 16);
+
+    ncnn::Net net_serial;
+    ncnn::Mat out_serial;
+    if (load_pipeline_net(net_serial, PIPELINE_SERIAL) != 0 || run_pipeline_net(net_serial, in, out_serial) != 0)
+    {
+        fprintf(stderr, "test_pipeline_creation_1 serial failed\n");
+        return -1;
+    }
+
+    for (int round = 0; round < 4; round++)
+    {
+        ncnn::Net net;
+        if (load_pipeline_net(net, PIPELINE_LAZY) != 0)
+        {
+            fprintf(stderr, "test_pipeline_creation_1 load failed\n");
+            return -1;
+        }
+
+        pipeline_worker workers[TEST_THREAD_COUNT];
+        ncnn::Thread* threads[TEST_THREAD_COUNT];
+        for (int t = 0; t < TEST_THREAD_COUNT; t++)
+        {
+            workers[t].net = &net;
+            workers[t].in = &in;
+            workers[t].ret = 0;
+            threads[t] = new ncnn::Thread(pipeline_worker_run, &workers[t]);
+        }
+
+        int ret = 0;
+        for (int t = 0; t < TEST_THREAD_COUNT; t++)
+        {
+            threads[t]->join();
+            delete threads[t];
+
+            if (workers[t].ret != 0 || CompareMat(out_serial, workers[t].out, 0.0001) != 0)
+                ret = -1;
+        }
+
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_pipeline_creation_1 round %d concurrent lazy extract mismatch\n", round);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_pipeline_creation_0()
+           || test_pipeline_creation_1();
+}
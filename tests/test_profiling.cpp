@@ -0,0 +1,352 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "benchmark.h"
+#include "datareader.h"
+#include "layer.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// the quote and backslash in the conv name must be escaped in the trace
+static const char* profiling_param = "7767517\n"
+                                     "7 8\n"
+                                     "Input        in       0 1 in\n"
+                                     "Convolution  conv\"0\\a 1 1 in c0 0=8 1=3 4=1 5=1 6=288\n"
+                                     "ReLU         relu0    1 1 c0 r0\n"
+                                     "Split        split0   1 2 r0 r1 r2\n"
+                                     "Pooling      pool0    1 1 r1 p0 0=0 1=3 3=1\n"
+                                     "Convolution  conv1    1 1 r2 c1 0=8 1=1 5=1 6=64\n"
+                                     "Concat       concat0  2 1 p0 c1 out\n";
+
+// every layer but the input runs once per extract
+static const int profiling_layer_runs = 6;
+
+static const char* trace_path = "test_profiling.json";
+
+// minimal json syntax check, returns the position after the value or 0
+static const char* skip_json_value(const char* p);
+
+static const char* skip_json_space(const char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+    return p;
+}
+
+static const char* skip_json_string(const char* p)
+{
+    if (*p != '"')
+        return 0;
+
+    p++;
+    while (*p != '"')
+    {
+        if ((unsigned char)*p < 0x20)
+            return 0;
+
+        if (*p == '\\')
+        {
+            p++;
+            if (*p == 'u')
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    p++;
+                    if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F')))
+                        return 0;
+                }
+            }
+            else if (*p == 0 || !strchr("\"\\/bfnrt", *p))
+            {
+                return 0;
+            }
+        }
+        p++;
+    }
+
+    return p + 1;
+}
+
+static const char* skip_json_number(const char* p)
+{
+    const char* start = p;
+    if (*p == '-')
+        p++;
+    while ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')
+        p++;
+    return p == start ? 0 : p;
+}
+
+static const char* skip_json_container(const char* p, char close, bool is_object)
+{
+    p = skip_json_space(p + 1);
+    if (*p == close)
+        return p + 1;
+
+    while (1)
+    {
+        if (is_object)
+        {
+            p = skip_json_string(p);
+            if (!p)
+                return 0;
+            p = skip_json_space(p);
+            if (*p != ':')
+                return 0;
+            p = skip_json_space(p + 1);
+        }
+
+        p = skip_json_value(p);
+        if (!p)
+            return 0;
+
+        p = skip_json_space(p);
+        if (*p == close)
+            return p + 1;
+        if (*p != ',')
+            return 0;
+        p = skip_json_space(p + 1);
+    }
+}
+
+static const char* skip_json_value(const char* p)
+{
+    if (*p == '{')
+        return skip_json_container(p, '}', true);
+    if (*p == '[')
+        return skip_json_container(p, ']', false);
+    if (*p == '"')
+        return skip_json_string(p);
+    if (strncmp(p, "true", 4) == 0)
+        return p + 4;
+    if (strncmp(p, "false", 5) == 0)
+        return p + 5;
+    if (strncmp(p, "null", 4) == 0)
+        return p + 4;
+    return skip_json_number(p);
+}
+
+static int count_substr(const std::string& s, const char* sub)
+{
+    int count = 0;
+    for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + 1))
+        count++;
+    return count;
+}
+
+static int load_profiling_net(ncnn::Net& net)
+{
+    net.opt.num_threads = 1;
+    // keep every layer of the param in the net
+    net.opt.use_layer_fusion = false;
+    net.opt.use_fp16_storage = false;
+
+    int ret = net.load_param_mem(profiling_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int test_profiling_0()
+{
+    ncnn::Net net;
+    if (load_profiling_net(net) != 0)
+    {
+        fprintf(stderr, "test_profiling_0 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(9, 9, 4);
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_profiling(true);
+    ex.input("in", in);
+
+    ncnn::Mat out;
+    if (ex.extract("out", out) != 0)
+    {
+        fprintf(stderr, "test_profiling_0 extract failed\n");
+        return -1;
+    }
+
+    // already computed, nothing runs again
+    ncnn::Mat out2;
+    ex.extract("out", out2);
+
+    const std::vector<ncnn::LayerProfile>& profiles = ex.layer_profiles();
+    if ((int)profiles.size() != profiling_layer_runs)
+    {
+        fprintf(stderr, "test_profiling_0 expect %d layer runs but got %d\n", profiling_layer_runs, (int)profiles.size());
+        return -1;
+    }
+
+    std::vector<int> layer_runs(net.layers().size(), 0);
+    for (size_t i = 0; i < profiles.size(); i++)
+    {
+        const ncnn::LayerProfile& p = profiles[i];
+
+        if (p.layer_index < 0 || p.layer_index >= (int)net.layers().size() || net.layers()[p.layer_index] != p.layer)
+        {
+            fprintf(stderr, "test_profiling_0 profile %d has layer index %d\n", (int)i, p.layer_index);
+            return -1;
+        }
+
+        layer_runs[p.layer_index]++;
+
+        if (p.end < p.start || p.bottom_shapes.size() != p.layer->bottoms.size() || p.top_shapes.size() != p.layer->tops.size())
+        {
+            fprintf(stderr, "test_profiling_0 profile %s malformed\n", p.layer->name.c_str());
+            return -1;
+        }
+
+        // fp32 elements, plus the channel alignment of the packed layout
+        size_t top_data_bytes = 0;
+        for (size_t j = 0; j < p.top_shapes.size(); j++)
+        {
+            const ncnn::Mat& m = p.top_shapes[j];
+            top_data_bytes += (size_t)m.w * m.h * m.d * m.c * sizeof(float);
+        }
+        if (p.top_blob_bytes < top_data_bytes)
+        {
+            fprintf(stderr, "test_profiling_0 profile %s top_blob_bytes %d less than %d\n", p.layer->name.c_str(), (int)p.top_blob_bytes, (int)top_data_bytes);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < layer_runs.size(); i++)
+    {
+        const int expect = net.layers()[i]->type == "Input" ? 0 : 1;
+        if (layer_runs[i] != expect)
+        {
+            fprintf(stderr, "test_profiling_0 layer %s ran %d times\n", net.layers()[i]->name.c_str(), layer_runs[i]);
+            return -1;
+        }
+    }
+
+    ex.clear_layer_profiles();
+    if (!ex.layer_profiles().empty())
+    {
+        fprintf(stderr, "test_profiling_0 profiles not cleared\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_profiling_1()
+{
+    ncnn::Net net;
+    if (load_profiling_net(net) != 0)
+    {
+        fprintf(stderr, "test_profiling_1 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(9, 9, 4);
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_profiling(true);
+    ex.input("in", in);
+
+    ncnn::Mat out;
+    ex.extract("out", out);
+
+    if (ncnn::save_chrome_trace(ex.layer_profiles(), trace_path) != 0)
+    {
+        fprintf(stderr, "test_profiling_1 save_chrome_trace failed\n");
+        return -1;
+    }
+
+    std::string trace;
+    {
+        FILE* fp = fopen(trace_path, "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "test_profiling_1 open %s failed\n", trace_path);
+            return -1;
+        }
+
+        char buf[4096];
+        size_t nread;
+        while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+            trace.append(buf, nread);
+        fclose(fp);
+    }
+    remove(trace_path);
+
+    const char* end = skip_json_value(skip_json_space(trace.c_str()));
+    if (!end || *skip_json_space(end) != 0)
+    {
+        fprintf(stderr, "test_profiling_1 trace is not valid json\n%s\n", trace.c_str());
+        return -1;
+    }
+
+    if (count_substr(trace, "\"ph\":\"X\"") != profiling_layer_runs)
+    {
+        fprintf(stderr, "test_profiling_1 expect %d trace events\n%s\n", profiling_layer_runs, trace.c_str());
+        return -1;
+    }
+
+    if (count_substr(trace, "\"name\":\"conv\\\"0\\\\a\"") != 1)
+    {
+        fprintf(stderr, "test_profiling_1 layer name not escaped\n%s\n", trace.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_profiling_0()
+           || test_profiling_1();
+}
@@ -0,0 +1,253 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// random weights for every layer
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            p[i] = RandomFloat(-0.5f, 0.5f);
+        }
+
+        return size;
+    }
+};
+
+static const char* streaming_param = "7767517\n"
+                                     "4 4\n"
+                                     "Input  in   0 1 in\n"
+                                     "LSTM   lstm 1 1 in   x0  0=16 1=1024 2=0\n"
+                                     "GRU    gru  1 1 x0   x1  0=12 1=576 2=0\n"
+                                     "RNN    rnn  1 1 x1   out 0=8 1=96 2=0\n";
+
+// a second input joining the recurrent output
+static const char* streaming_add_param = "7767517\n"
+                                         "5 5\n"
+                                         "Input    in   0 1 in\n"
+                                         "Input    in2  0 1 in2\n"
+                                         "LSTM     lstm 1 1 in   x0  0=16 1=1024 2=0\n"
+                                         "GRU      gru  1 1 x0   x1  0=12 1=576 2=0\n"
+                                         "BinaryOp add  2 1 x1 in2 out 0=0\n";
+
+static int load_streaming_net(ncnn::Net& net, const char* param = streaming_param)
+{
+    net.opt.num_threads = 1;
+
+    int ret = net.load_param_mem(param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr;
+    return net.load_model(dr);
+}
+
+// run the rows [t, t + n) of seq as one chunk
+static int extract_chunk(ncnn::Extractor& ex, const ncnn::Mat& seq, int t, int n, ncnn::Mat& out)
+{
+    ex.input("in", seq.row_range(t, n).clone());
+    return ex.extract("out", out);
+}
+
+static int compare_rows(const ncnn::Mat& full, int t, const ncnn::Mat& chunk)
+{
+    return CompareMat(full.row_range(t, chunk.h).clone(), chunk, 0.0001);
+}
+
+static int test_streaming_0()
+{
+    ncnn::Net net;
+    if (load_streaming_net(net) != 0)
+    {
+        fprintf(stderr, "test_streaming_0 load failed\n");
+        return -1;
+    }
+
+    const int T = 12;
+    ncnn::Mat seq = RandomMat(16, T);
+
+    ncnn::Mat full;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("in", seq);
+        ex.extract("out", full);
+    }
+
+    // uneven chunks continue from the kept state
+    const int chunks[] = {1, 4, 2, 5};
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_streaming(true);
+
+    int t = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        ncnn::Mat out;
+        if (extract_chunk(ex, seq, t, chunks[i], out) != 0 || compare_rows(full, t, out) != 0)
+        {
+            fprintf(stderr, "test_streaming_0 chunk %d at %d mismatch\n", i, t);
+            return -1;
+        }
+
+        t += chunks[i];
+    }
+
+    // reset starts a new sequence
+    ex.reset_states();
+
+    ncnn::Mat out;
+    if (extract_chunk(ex, seq, 0, 3, out) != 0 || compare_rows(full, 0, out) != 0)
+    {
+        fprintf(stderr, "test_streaming_0 reset mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_streaming_1()
+{
+    ncnn::Net net;
+    if (load_streaming_net(net) != 0)
+    {
+        fprintf(stderr, "test_streaming_1 load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat seq = RandomMat(16, 10);
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_streaming(true);
+
+    ncnn::Mat out0;
+    extract_chunk(ex, seq, 0, 4, out0);
+
+    std::vector<std::vector<ncnn::Mat> > states;
+    ex.snapshot_states(states);
+
+    ncnn::Mat out1;
+    extract_chunk(ex, seq, 4, 3, out1);
+
+    // running past the snapshot does not touch it
+    ncnn::Mat out2;
+    extract_chunk(ex, seq, 7, 3, out2);
+
+    if (ex.restore_states(states) != 0)
+    {
+        fprintf(stderr, "test_streaming_1 restore failed\n");
+        return -1;
+    }
+
+    ncnn::Mat out1_restored;
+    if (extract_chunk(ex, seq, 4, 3, out1_restored) != 0 || CompareMat(out1, out1_restored, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_streaming_1 restored chunk mismatch\n");
+        return -1;
+    }
+
+    // a fresh extractor continues from the same state
+    ncnn::Extractor ex2 = net.create_extractor();
+    ex2.set_streaming(true);
+    ex2.restore_states(states);
+
+    ncnn::Mat out1_ex2;
+    if (extract_chunk(ex2, seq, 4, 3, out1_ex2) != 0 || CompareMat(out1, out1_ex2, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_streaming_1 restored extractor mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_streaming_2()
+{
+    ncnn::Net net;
+    if (load_streaming_net(net, streaming_add_param) != 0)
+    {
+        fprintf(stderr, "test_streaming_2 load failed\n");
+        return -1;
+    }
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_streaming(true);
+
+    ncnn::Mat out0;
+    ex.input("in", RandomMat(16, 4));
+    ex.input("in2", RandomMat(12, 4));
+    if (ex.extract("out", out0) != 0)
+    {
+        fprintf(stderr, "test_streaming_2 first chunk failed\n");
+        return -1;
+    }
+
+    // the intermediate blob fed first survives the second input of the same chunk
+    ncnn::Mat x1 = RandomMat(12, 3);
+    ncnn::Mat in2 = RandomMat(12, 3);
+    ex.input("x1", x1);
+    ex.input("in2", in2);
+
+    ncnn::Mat out1;
+    if (ex.extract("out", out1) != 0)
+    {
+        fprintf(stderr, "test_streaming_2 second chunk failed\n");
+        return -1;
+    }
+
+    ncnn::Mat expected = x1.clone();
+    for (int i = 0; i < expected.h; i++)
+    {
+        float* p = expected.row(i);
+        const float* q = in2.row(i);
+        for (int j = 0; j < expected.w; j++)
+        {
+            p[j] += q[j];
+        }
+    }
+
+    if (CompareMat(expected, out1, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_streaming_2 fed intermediate blob was dropped\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_streaming_0()
+           || test_streaming_1()
+           || test_streaming_2();
+}
@@ -0,0 +1,200 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the same random weights for every net loaded from it
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom(unsigned int _seed)
+        : seed(_seed)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        if (size == 4)
+        {
+            // the flag preceding each weight, zero for raw float32
+            memset(buf, 0, size);
+            return size;
+        }
+
+        float* p = (float*)buf;
+        for (size_t i = 0; i < size / sizeof(float); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (seed >> 8) / 16777216.f - 0.5f;
+        }
+
+        return size;
+    }
+
+    mutable unsigned int seed;
+};
+
+// winograd, sgemm and innerproduct all keep transformed weights
+static const char* cache_param = "7767517\n"
+                                 "5 5\n"
+                                 "Input        in    0 1 in\n"
+                                 "Convolution  conv0 1 1 in c0 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                                 "Convolution  conv1 1 1 c0 c1 0=16 1=1 5=1 6=256\n"
+                                 "Pooling      pool  1 1 c1 p0 0=1 4=1\n"
+                                 "InnerProduct ip    1 1 p0 out 0=10 1=1 2=160\n";
+
+static const char* cache_path = "test_weight_cache.bin";
+
+static int load_cache_net(ncnn::Net& net, const char* cachepath)
+{
+    net.opt.num_threads = 1;
+    net.set_weight_cache(cachepath);
+
+    int ret = net.load_param_mem(cache_param);
+    if (ret != 0)
+        return ret;
+
+    DataReaderFromRandom dr(7767517);
+    return net.load_model(dr);
+}
+
+static int run_cache_net(const char* cachepath, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Net net;
+    if (load_cache_net(net, cachepath) != 0)
+        return -1;
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("in", in);
+    return ex.extract("out", out);
+}
+
+static long file_size(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+// keep the first size bytes, then append tail_size bytes of value
+static int rewrite_cache(long size, int value, long tail_size)
+{
+    std::vector<unsigned char> data(size);
+    FILE* fp = fopen(cache_path, "rb");
+    if (!fp)
+        return -1;
+    size_t nread = fread(data.data(), 1, size, fp);
+    fclose(fp);
+    if ((long)nread != size)
+        return -1;
+
+    data.resize(size + tail_size, (unsigned char)value);
+
+    fp = fopen(cache_path, "wb");
+    if (!fp)
+        return -1;
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return 0;
+}
+
+static int test_weight_cache_0()
+{
+    ncnn::Mat in = RandomMat(12, 12, 16);
+
+    ncnn::Mat out_ref;
+    if (run_cache_net(0, in, out_ref) != 0)
+    {
+        fprintf(stderr, "test_weight_cache_0 reference failed\n");
+        return -1;
+    }
+
+    remove(cache_path);
+
+    // the first load writes the cache
+    ncnn::Mat out_save;
+    if (run_cache_net(cache_path, in, out_save) != 0 || file_size(cache_path) <= 0)
+    {
+        fprintf(stderr, "test_weight_cache_0 save failed\n");
+        return -1;
+    }
+
+    const long cache_size = file_size(cache_path);
+
+    // the second load reads it back
+    ncnn::Mat out_load;
+    if (run_cache_net(cache_path, in, out_load) != 0)
+    {
+        fprintf(stderr, "test_weight_cache_0 load failed\n");
+        return -1;
+    }
+
+    if (CompareMat(out_ref, out_save, 0.0001) != 0 || CompareMat(out_ref, out_load, 0.0001) != 0)
+    {
+        fprintf(stderr, "test_weight_cache_0 output mismatch\n");
+        remove(cache_path);
+        return -1;
+    }
+
+    // a truncated cache and garbage after the header fall back to create_pipeline
+    const long header_size = 48;
+    const long corrupt_sizes[2] = {cache_size / 2, header_size};
+    const long tail_sizes[2] = {0, cache_size - header_size};
+    for (int i = 0; i < 2; i++)
+    {
+        if (rewrite_cache(corrupt_sizes[i], 0x7f, tail_sizes[i]) != 0)
+        {
+            fprintf(stderr, "test_weight_cache_0 rewrite failed\n");
+            remove(cache_path);
+            return -1;
+        }
+
+        ncnn::Mat out_corrupt;
+        if (run_cache_net(cache_path, in, out_corrupt) != 0 || CompareMat(out_ref, out_corrupt, 0.0001) != 0)
+        {
+            fprintf(stderr, "test_weight_cache_0 corrupted cache %d not rejected\n", i);
+            remove(cache_path);
+            return -1;
+        }
+
+        // rewritten by the load
+        if (file_size(cache_path) != cache_size)
+        {
+            fprintf(stderr, "test_weight_cache_0 corrupted cache %d not rewritten\n", i);
+            remove(cache_path);
+            return -1;
+        }
+    }
+
+    remove(cache_path);
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return test_weight_cache_0();
+}
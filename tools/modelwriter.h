@@ -1588,6 +1588,49 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             fprintf_param_value(" 1=%e", beta)
             fprintf_param_value(" 2=%d", transA)
             fprintf_param_value(" 3=%d", transB)
+            fprintf_param_value(" 4=%d", constantA)
+            fprintf_param_value(" 5=%d", constantB)
+            fprintf_param_value(" 6=%d", constantC)
+            fprintf_param_value(" 7=%d", constantM)
+            fprintf_param_value(" 8=%d", constantN)
+            fprintf_param_value(" 9=%d", constantK)
+            fprintf_param_value(" 10=%d", constant_broadcast_type_C)
+            fprintf_param_value(" 11=%d", output_N1M)
+            fprintf_param_value(" 12=%d", output_elempack)
+            fprintf_param_value(" 13=%d", output_elemtype)
+            fprintf_param_value(" 14=%d", output_transpose)
+            fprintf_param_value(" 18=%d", int8_scale_term)
+            fprintf_param_value(" 20=%d", constant_TILE_M)
+            fprintf_param_value(" 21=%d", constant_TILE_N)
+            fprintf_param_value(" 22=%d", constant_TILE_K)
+            fprintf_param_value(" 23=%d", weight_quant_bits)
+            fprintf_param_value(" 24=%d", weight_quant_group_size)
+
+            if (op->constantA)
+                fwrite_weight_tag_data(op->A_data, bp);
+            if (op->constantB)
+                fwrite_weight_tag_data(op->B_data, bp);
+            if (op->constantC && op->constant_broadcast_type_C != -1)
+                fwrite_weight_tag_data(op->C_data, bp);
+
+            if (op->weight_quant_bits)
+            {
+                if (op->constantA)
+                    fwrite_weight_data(op->A_data_quant_scales, bp, 0.001, 0.01);
+                if (op->constantB)
+                    fwrite_weight_data(op->B_data_quant_scales, bp, 0.001, 0.01);
+            }
+
+#if NCNN_INT8
+            // write int8_scale data
+            if (op->int8_scale_term)
+            {
+                if (op->constantA)
+                    fwrite_weight_data(op->A_data_int8_scales, bp, 90, 100);
+                if (op->constantB)
+                    fwrite_weight_data(op->B_data_int8_scales, bp, 90, 100);
+            }
+#endif // NCNN_INT8
         }
         else if (layer->type == "GroupNorm")
         {
@@ -1644,10 +1687,17 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             {
                 if (!op->activation_params.empty()) fprintf_param_float_array(10, op->activation_params, pp);
             }
+            fprintf_param_value(" 11=%d", weight_quant_bits)
+            fprintf_param_value(" 12=%d", weight_quant_group_size)
 
             fwrite_weight_tag_data(op->weight_data, bp);
             fwrite_weight_data(op->bias_data, bp);
 
+            if (op->weight_quant_bits)
+            {
+                fwrite_weight_data(op->weight_data_quant_scales, bp, 0.001, 0.01);
+            }
+
 #if NCNN_INT8
             // write int8_scale data
             if (op->int8_scale_term)
@@ -1772,6 +1822,11 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             fprintf_param_value(" 0=%d", embed_dim)
             fprintf_param_value(" 1=%d", num_head)
             fprintf_param_value(" 2=%d", weight_data_size)
+            fprintf_param_value(" 3=%d", kdim)
+            fprintf_param_value(" 4=%d", vdim)
+            fprintf_param_value(" 5=%d", attn_mask)
+            fprintf_param_value(" 6=%d", kv_cache)
+            fprintf_param_value(" 18=%d", int8_scale_term)
 
             fwrite_weight_tag_data(op->q_weight_data, bp);
             fwrite_weight_data(op->q_bias_data, bp);
@@ -1781,6 +1836,17 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             fwrite_weight_data(op->v_bias_data, bp);
             fwrite_weight_tag_data(op->out_weight_data, bp);
             fwrite_weight_data(op->out_bias_data, bp);
+
+#if NCNN_INT8
+            // write int8_scale data
+            if (op->int8_scale_term)
+            {
+                fwrite_weight_data(op->q_weight_data_int8_scales, bp, 90, 100);
+                fwrite_weight_data(op->k_weight_data_int8_scales, bp, 90, 100);
+                fwrite_weight_data(op->v_weight_data_int8_scales, bp, 90, 100);
+                fwrite_weight_data(op->out_weight_data_int8_scales, bp, 90, 100);
+            }
+#endif // NCNN_INT8
         }
         else if (layer->type == "MVN")
         {
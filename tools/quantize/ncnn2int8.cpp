@@ -16,7 +16,10 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <map>
 #include <set>
@@ -74,6 +77,10 @@ static bool read_int8scale_table(const char* filepath, std::map<std::string, ncn
         char key[256];
         line[strcspn(line.data(), "\r\n")] = 0;
 
+        // layers kept in fp32 by the mixed precision search are commented out
+        if (line[0] == '#')
+            continue;
+
         pch = strtok(line.data(), " ");
 
         if (pch == NULL) break;
@@ -128,6 +135,10 @@ public:
     int quantize_convolution();
     int quantize_convolutiondepthwise();
     int quantize_innerproduct();
+    int quantize_gemm();
+    int quantize_multiheadattention();
+
+    int quantize_weight_only(int bits, int group_size);
 
     int fuse_requantize();
 };
@@ -312,6 +323,258 @@ int NetQuantize::quantize_innerproduct()
     return 0;
 }
 
+// absmax scales of the rows, or of the columns when per_column
+static ncnn::Mat absmax_int8_scales(const ncnn::Mat& m, int per_column)
+{
+    const int count = per_column ? m.w : m.h;
+    const int K = per_column ? m.h : m.w;
+
+    ncnn::Mat scales(count);
+    for (int i = 0; i < count; i++)
+    {
+        float absmax = 0.f;
+        for (int k = 0; k < K; k++)
+        {
+            const float v = per_column ? m.row(k)[i] : m.row(i)[k];
+            absmax = std::max(absmax, (float)fabs(v));
+        }
+
+        scales[i] = absmax == 0.f ? 1.f : 127.f / absmax;
+    }
+
+    return scales;
+}
+
+static ncnn::Mat quantize_to_int8_with_scales(const ncnn::Mat& m, int per_column, const ncnn::Mat& scales)
+{
+    ncnn::Mat m_int8(m.w, m.h, (size_t)1u);
+    if (m_int8.empty())
+        return m_int8;
+
+    for (int i = 0; i < m.h; i++)
+    {
+        const float* ptr = m.row(i);
+        signed char* outptr = m_int8.row<signed char>(i);
+
+        for (int j = 0; j < m.w; j++)
+        {
+            int v = static_cast<int>(round(ptr[j] * scales[per_column ? j : i]));
+            outptr[j] = (signed char)std::min(std::max(v, -127), 127);
+        }
+    }
+
+    return m_int8;
+}
+
+int NetQuantize::quantize_gemm()
+{
+    const int layer_count = static_cast<int>(layers.size());
+    for (int i = 0; i < layer_count; i++)
+    {
+        // find Gemm layer with constant weights
+        if (layers[i]->type != "Gemm")
+            continue;
+
+        ncnn::Gemm* gemm = (ncnn::Gemm*)layers[i];
+        if (!gemm->constantA && !gemm->constantB)
+            continue;
+
+        if (gemm->int8_scale_term)
+            continue;
+
+        fprintf(stderr, "quantize_gemm %s\n", gemm->name.c_str());
+
+        // Gemm - quantize constant A per row of output and constant B per column of output
+        // the other operand is quantized per token at runtime
+        if (gemm->constantA)
+        {
+            const int per_column = gemm->transA;
+
+            gemm->A_data_int8_scales = absmax_int8_scales(gemm->A_data, per_column);
+            gemm->A_data = quantize_to_int8_with_scales(gemm->A_data, per_column, gemm->A_data_int8_scales);
+            if (gemm->A_data.empty())
+                return -100;
+        }
+
+        if (gemm->constantB)
+        {
+            const int per_column = gemm->transB ? 0 : 1;
+
+            gemm->B_data_int8_scales = absmax_int8_scales(gemm->B_data, per_column);
+            gemm->B_data = quantize_to_int8_with_scales(gemm->B_data, per_column, gemm->B_data_int8_scales);
+            if (gemm->B_data.empty())
+                return -100;
+        }
+
+        gemm->int8_scale_term = 2;
+    }
+
+    return 0;
+}
+
+int NetQuantize::quantize_multiheadattention()
+{
+    const int layer_count = static_cast<int>(layers.size());
+    for (int i = 0; i < layer_count; i++)
+    {
+        // find MultiHeadAttention layer
+        if (layers[i]->type != "MultiHeadAttention")
+            continue;
+
+        ncnn::MultiHeadAttention* mha = (ncnn::MultiHeadAttention*)layers[i];
+
+        if (mha->int8_scale_term)
+            continue;
+
+        fprintf(stderr, "quantize_multiheadattention %s\n", mha->name.c_str());
+
+        // MultiHeadAttention - quantize the projection weights per output channel
+        const int embed_dim = mha->embed_dim;
+
+        ncnn::Mat* weights[4] = {&mha->q_weight_data, &mha->k_weight_data, &mha->v_weight_data, &mha->out_weight_data};
+        ncnn::Mat* scales[4] = {&mha->q_weight_data_int8_scales, &mha->k_weight_data_int8_scales, &mha->v_weight_data_int8_scales, &mha->out_weight_data_int8_scales};
+
+        for (int j = 0; j < 4; j++)
+        {
+            const int weight_data_size = weights[j]->w;
+
+            ncnn::Mat weight_data_r2 = weights[j]->reshape(weight_data_size / embed_dim, embed_dim);
+
+            *scales[j] = absmax_int8_scales(weight_data_r2, 0);
+
+            ncnn::Mat weight_data_int8 = quantize_to_int8_with_scales(weight_data_r2, 0, *scales[j]);
+            if (weight_data_int8.empty())
+                return -100;
+
+            *weights[j] = weight_data_int8.reshape(weight_data_size);
+        }
+
+        mha->int8_scale_term = 2;
+    }
+
+    return 0;
+}
+
+// group-wise weight-only quantization of the rows of m, or of its columns when per_column
+// rows are packed as the layers expect, see src/layer/weight_quant.h
+static int quantize_weight_only_rows(const ncnn::Mat& m, int per_column, int bits, int group_size, ncnn::Mat& mq, ncnn::Mat& scales)
+{
+    const int rows = per_column ? m.w : m.h;
+    const int K = per_column ? m.h : m.w;
+
+    const int row_bytes = bits == 4 ? (K + 31) / 32 * 16 : K;
+    const int groups = (K + group_size - 1) / group_size;
+    const int qmax = bits == 4 ? 7 : 127;
+
+    mq.create(row_bytes * rows, (size_t)1u);
+    scales.create(groups * rows);
+    if (mq.empty() || scales.empty())
+        return -100;
+
+    // int4 padding decodes to zero
+    memset(mq.data, bits == 4 ? 0x88 : 0, mq.total());
+
+    for (int i = 0; i < rows; i++)
+    {
+        unsigned char* outptr = (unsigned char*)mq.data + row_bytes * i;
+
+        for (int g = 0; g < groups; g++)
+        {
+            const int k0 = g * group_size;
+            const int k1 = std::min(k0 + group_size, K);
+
+            float absmax = 0.f;
+            for (int k = k0; k < k1; k++)
+            {
+                absmax = std::max(absmax, (float)fabs(per_column ? m.row(k)[i] : m.row(i)[k]));
+            }
+
+            const float scale = absmax / qmax;
+            scales[groups * i + g] = scale;
+
+            for (int k = k0; k < k1; k++)
+            {
+                const float v = per_column ? m.row(k)[i] : m.row(i)[k];
+                int q = scale == 0.f ? 0 : static_cast<int>(round(v / scale));
+                q = std::min(std::max(q, -qmax), qmax);
+
+                if (bits == 4)
+                {
+                    // value j and 16 + j of a 32 value block share byte j
+                    const int shift = k % 32 / 16 * 4;
+                    unsigned char& b = outptr[k / 32 * 16 + k % 16];
+                    b = (unsigned char)((b & ~(15 << shift)) | ((q + 8) << shift));
+                }
+                else
+                    outptr[k] = (unsigned char)(signed char)q;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int NetQuantize::quantize_weight_only(int bits, int group_size)
+{
+    const int layer_count = static_cast<int>(layers.size());
+    for (int i = 0; i < layer_count; i++)
+    {
+        if (layers[i]->type == "InnerProduct")
+        {
+            ncnn::InnerProduct* fc = (ncnn::InnerProduct*)layers[i];
+            if (fc->int8_scale_term || fc->weight_quant_bits)
+                continue;
+
+            fprintf(stderr, "quantize_weight_only %s\n", fc->name.c_str());
+
+            const int num_input = fc->weight_data_size / fc->num_output;
+
+            ncnn::Mat weight_data_r2 = fc->weight_data.reshape(num_input, fc->num_output);
+
+            int ret = quantize_weight_only_rows(weight_data_r2, 0, bits, group_size, fc->weight_data, fc->weight_data_quant_scales);
+            if (ret != 0)
+                return ret;
+
+            fc->weight_quant_bits = bits;
+            fc->weight_quant_group_size = group_size;
+        }
+
+        if (layers[i]->type == "Gemm")
+        {
+            ncnn::Gemm* gemm = (ncnn::Gemm*)layers[i];
+            if (!gemm->constantA && !gemm->constantB)
+                continue;
+
+            if (gemm->int8_scale_term || gemm->weight_quant_bits)
+                continue;
+
+            fprintf(stderr, "quantize_weight_only %s\n", gemm->name.c_str());
+
+            // quantized A is stored as M rows of K and B as N rows of K
+            if (gemm->constantA)
+            {
+                const ncnn::Mat A_data = gemm->A_data;
+                int ret = quantize_weight_only_rows(A_data, gemm->transA, bits, group_size, gemm->A_data, gemm->A_data_quant_scales);
+                if (ret != 0)
+                    return ret;
+            }
+
+            if (gemm->constantB)
+            {
+                const ncnn::Mat B_data = gemm->B_data;
+                int ret = quantize_weight_only_rows(B_data, gemm->transB ? 0 : 1, bits, group_size, gemm->B_data, gemm->B_data_quant_scales);
+                if (ret != 0)
+                    return ret;
+            }
+
+            gemm->weight_quant_bits = bits;
+            gemm->weight_quant_group_size = group_size;
+        }
+    }
+
+    return 0;
+}
+
 int NetQuantize::fuse_requantize()
 {
     const size_t layer_count = layers.size();
@@ -517,9 +780,12 @@ int NetQuantize::fuse_requantize()
 
 int main(int argc, char** argv)
 {
-    if (argc != 6)
+    const bool weight_only = argc == 8 && strcmp(argv[5], "weight-only") == 0;
+
+    if (argc != 6 && !weight_only)
     {
         fprintf(stderr, "usage: %s [inparam] [inbin] [outparam] [outbin] [calibration table]\n", argv[0]);
+        fprintf(stderr, "       %s [inparam] [inbin] [outparam] [outbin] weight-only [bits=4/8] [group size]\n", argv[0]);
         return -1;
     }
 
@@ -527,7 +793,15 @@ int main(int argc, char** argv)
     const char* inbin = argv[2];
     const char* outparam = argv[3];
     const char* outbin = argv[4];
-    const char* int8scale_table_path = argv[5];
+    const char* int8scale_table_path = weight_only ? 0 : argv[5];
+
+    const int weight_only_bits = weight_only ? atoi(argv[6]) : 0;
+    const int weight_only_group_size = weight_only ? atoi(argv[7]) : 0;
+    if (weight_only && ((weight_only_bits != 4 && weight_only_bits != 8) || weight_only_group_size <= 0))
+    {
+        fprintf(stderr, "weight-only bits must be 4 or 8 and group size must be positive\n");
+        return -1;
+    }
 
     NetQuantize quantizer;
 
@@ -552,11 +826,21 @@ int main(int argc, char** argv)
     else
         quantizer.load_model(inbin);
 
-    quantizer.quantize_convolution();
-    quantizer.quantize_convolutiondepthwise();
-    quantizer.quantize_innerproduct();
+    if (weight_only)
+    {
+        // activations stay fp32, only InnerProduct and Gemm weights are compressed
+        quantizer.quantize_weight_only(weight_only_bits, weight_only_group_size);
+    }
+    else
+    {
+        quantizer.quantize_convolution();
+        quantizer.quantize_convolutiondepthwise();
+        quantizer.quantize_innerproduct();
+        quantizer.quantize_gemm();
+        quantizer.quantize_multiheadattention();
 
-    quantizer.fuse_requantize();
+        quantizer.fuse_requantize();
+    }
 
     quantizer.save(outparam, outbin);
 
@@ -36,6 +36,8 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #endif
+#include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -87,13 +89,25 @@ public:
     std::vector<int> type_to_pixels;
     int quantize_num_threads;
 
+    // keep layers in fp32 until the estimated output similarity reaches this, 0 quantizes all
+    float mixed_precision_target;
+
+    // decode the images once into this file, empty decodes on every pass
+    std::string cache_path;
+
 public:
     int init();
+    int init_cache();
+    // hash of the image paths and preprocessing params that decide the cached inputs
+    uint64_t cache_input_hash() const;
+    ncnn::Mat decode_input(int input_index, int image_index) const;
+    ncnn::Mat load_input(int input_index, int image_index) const;
     void print_quant_info() const;
     int save_table(const char* tablepath);
     int quantize_KL();
     int quantize_ACIQ();
     int quantize_EQ();
+    int select_mixed_precision();
 
 public:
     std::vector<int> input_blobs;
@@ -105,12 +119,20 @@ public:
     std::vector<QuantBlobStat> quant_blob_stats;
     std::vector<ncnn::Mat> weight_scales;
     std::vector<ncnn::Mat> bottom_blob_scales;
+
+    // mixed precision
+    std::vector<float> layer_similarities;
+    std::vector<int> layer_fp32;
+
+    // record offset of every image and input in the cache file
+    std::vector<int64_t> cache_offsets;
 };
 
 QuantNet::QuantNet()
     : blobs(mutable_blobs()), layers(mutable_layers())
 {
     quantize_num_threads = ncnn::get_cpu_count();
+    mixed_precision_target = 0.f;
 }
 
 int QuantNet::init()
@@ -143,6 +165,8 @@ int QuantNet::init()
     quant_blob_stats.resize(conv_bottom_blob_count);
     weight_scales.resize(conv_layer_count);
     bottom_blob_scales.resize(conv_bottom_blob_count);
+    layer_similarities.resize(conv_layer_count, 1.f);
+    layer_fp32.resize(conv_layer_count, 0);
 
     return 0;
 }
@@ -163,7 +187,8 @@ int QuantNet::save_table(const char* tablepath)
     {
         const ncnn::Mat& weight_scale = weight_scales[i];
 
-        fprintf(fp, "%s_param_0 ", layers[conv_layers[i]]->name.c_str());
+        // commented out layers stay in fp32
+        fprintf(fp, "%s%s_param_0 ", layer_fp32[i] ? "#" : "", layers[conv_layers[i]]->name.c_str());
         for (int j = 0; j < weight_scale.w; j++)
         {
             fprintf(fp, "%f ", weight_scale[j]);
@@ -175,7 +200,7 @@ int QuantNet::save_table(const char* tablepath)
     {
         const ncnn::Mat& bottom_blob_scale = bottom_blob_scales[i];
 
-        fprintf(fp, "%s ", layers[conv_layers[i]]->name.c_str());
+        fprintf(fp, "%s%s ", layer_fp32[i] ? "#" : "", layers[conv_layers[i]]->name.c_str());
         for (int j = 0; j < bottom_blob_scale.w; j++)
         {
             fprintf(fp, "%f ", bottom_blob_scale[j]);
@@ -238,6 +263,262 @@ inline ncnn::Mat read_and_resize_image(const std::vector<int>& shape, const std:
     return ncnn::Mat::from_pixels_resize(bgr.data, pixel_convert_type, bgr.cols, bgr.rows, target_w, target_h);
 }
 
+// the calibration cache file stores every preprocessed input once
+// header = magic image_count input_blob_count input_hash_lo input_hash_hi
+// record = image_index input_index w h c, then w * h * c floats
+static const int QUANT_CACHE_MAGIC = 0x4e435143;
+
+// fnv-1a over bytes
+static uint64_t fnv1a_update(uint64_t hash, const void* buf, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)buf;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static int64_t ftell64(FILE* fp)
+{
+#ifdef _MSC_VER
+    return _ftelli64(fp);
+#else
+    return ftello(fp);
+#endif
+}
+
+static int fseek64(FILE* fp, int64_t offset)
+{
+#ifdef _MSC_VER
+    return _fseeki64(fp, offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+ncnn::Mat QuantNet::decode_input(int input_index, int image_index) const
+{
+    const int type_to_pixel = type_to_pixels[input_index];
+    const std::vector<float>& mean_vals = means[input_index];
+    const std::vector<float>& norm_vals = norms[input_index];
+
+    int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
+    if (type_to_pixel != pixel_convert_type)
+    {
+        pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
+    }
+
+    ncnn::Mat in = read_and_resize_image(shapes[input_index], listspaths[input_index][image_index], pixel_convert_type);
+
+    in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+
+    return in;
+}
+
+ncnn::Mat QuantNet::load_input(int input_index, int image_index) const
+{
+    if (cache_offsets.empty())
+        return decode_input(input_index, image_index);
+
+    const int input_blob_count = (int)input_blobs.size();
+    const int64_t offset = cache_offsets[image_index * input_blob_count + input_index];
+
+    ncnn::Mat in;
+
+    // every reader opens its own handle so the extractor threads never share a file position
+    FILE* fp = fopen(cache_path.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", cache_path.c_str());
+        return in;
+    }
+
+    int shape[5];
+    if (fseek64(fp, offset) == 0 && fread(shape, sizeof(int), 5, fp) == 5)
+    {
+        in.create(shape[2], shape[3], shape[4]);
+
+        const size_t size = (size_t)shape[2] * shape[3];
+        for (int q = 0; q < in.c; q++)
+        {
+            if (fread(in.channel(q), sizeof(float), size, fp) != size)
+            {
+                fprintf(stderr, "read cache %s failed\n", cache_path.c_str());
+                in.release();
+                break;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return in;
+}
+
+uint64_t QuantNet::cache_input_hash() const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    const int input_blob_count = (int)input_blobs.size();
+    for (int j = 0; j < input_blob_count; j++)
+    {
+        const int mean_count = (int)means[j].size();
+        const int norm_count = (int)norms[j].size();
+        const int shape_count = (int)shapes[j].size();
+        hash = fnv1a_update(hash, &type_to_pixels[j], sizeof(int));
+        hash = fnv1a_update(hash, &mean_count, sizeof(int));
+        hash = fnv1a_update(hash, means[j].data(), sizeof(float) * mean_count);
+        hash = fnv1a_update(hash, &norm_count, sizeof(int));
+        hash = fnv1a_update(hash, norms[j].data(), sizeof(float) * norm_count);
+        hash = fnv1a_update(hash, &shape_count, sizeof(int));
+        hash = fnv1a_update(hash, shapes[j].data(), sizeof(int) * shape_count);
+
+        // the terminating zero keeps adjacent paths apart
+        for (size_t i = 0; i < listspaths[j].size(); i++)
+        {
+            const std::string& path = listspaths[j][i];
+            hash = fnv1a_update(hash, path.c_str(), path.size() + 1);
+        }
+    }
+
+    return hash;
+}
+
+int QuantNet::init_cache()
+{
+    const int input_blob_count = (int)input_blobs.size();
+    const int image_count = (int)listspaths[0].size();
+    const uint64_t input_hash = cache_input_hash();
+    const int input_hash_lo = (int)(uint32_t)input_hash;
+    const int input_hash_hi = (int)(uint32_t)(input_hash >> 32);
+
+    std::vector<int64_t> offsets(image_count * input_blob_count, -1);
+
+    // resume from the complete records of a previous run, a torn record at the end is overwritten
+    int64_t valid_end = 0;
+
+    FILE* fp = fopen(cache_path.c_str(), "rb");
+    if (fp)
+    {
+        // images decoded with other paths or preprocessing params are stale
+        int header[5];
+        if (fread(header, sizeof(int), 5, fp) == 5 && header[0] == QUANT_CACHE_MAGIC && header[1] == image_count && header[2] == input_blob_count && header[3] == input_hash_lo && header[4] == input_hash_hi)
+        {
+            valid_end = ftell64(fp);
+
+            int shape[5];
+            while (fread(shape, sizeof(int), 5, fp) == 5)
+            {
+                const int image_index = shape[0];
+                const int input_index = shape[1];
+                if (image_index < 0 || image_index >= image_count || input_index < 0 || input_index >= input_blob_count || shape[2] <= 0 || shape[3] <= 0 || shape[4] <= 0)
+                    break;
+
+                const int64_t record_offset = valid_end;
+                const int64_t record_end = record_offset + (int64_t)sizeof(int) * 5 + (int64_t)sizeof(float) * shape[2] * shape[3] * shape[4];
+
+                // the last float of the record must be readable
+                float last;
+                if (fseek64(fp, record_end - (int64_t)sizeof(float)) != 0 || fread(&last, sizeof(float), 1, fp) != 1)
+                    break;
+
+                offsets[image_index * input_blob_count + input_index] = record_offset;
+                valid_end = record_end;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "cache %s does not match the image lists or preprocessing, rebuild it\n", cache_path.c_str());
+        }
+
+        fclose(fp);
+    }
+
+    std::vector<int> missing_images;
+    for (int i = 0; i < image_count; i++)
+    {
+        for (int j = 0; j < input_blob_count; j++)
+        {
+            if (offsets[i * input_blob_count + j] == -1)
+            {
+                missing_images.push_back(i);
+                break;
+            }
+        }
+    }
+
+    const int missing_count = (int)missing_images.size();
+
+    fprintf(stderr, "cache %s has %d / %d images\n", cache_path.c_str(), image_count - missing_count, image_count);
+
+    if (missing_count > 0)
+    {
+        fp = fopen(cache_path.c_str(), valid_end > 0 ? "r+b" : "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", cache_path.c_str());
+            return -1;
+        }
+
+        if (valid_end > 0)
+        {
+            fseek64(fp, valid_end);
+        }
+        else
+        {
+            int header[5] = {QUANT_CACHE_MAGIC, image_count, input_blob_count, input_hash_lo, input_hash_hi};
+            fwrite(header, sizeof(int), 5, fp);
+            valid_end = ftell64(fp);
+        }
+
+        #pragma omp parallel for num_threads(quantize_num_threads) schedule(static, 1)
+        for (int ii = 0; ii < missing_count; ii++)
+        {
+            const int i = missing_images[ii];
+
+            if (ii % 100 == 0)
+            {
+                fprintf(stderr, "decode images %.2f%% [ %d / %d ]\n", ii * 100.f / missing_count, ii, missing_count);
+            }
+
+            std::vector<ncnn::Mat> ins(input_blob_count);
+            for (int j = 0; j < input_blob_count; j++)
+            {
+                ins[j] = decode_input(j, i);
+            }
+
+            #pragma omp critical
+            {
+                for (int j = 0; j < input_blob_count; j++)
+                {
+                    const ncnn::Mat& in = ins[j];
+
+                    int shape[5] = {i, j, in.w, in.h, in.c};
+                    fwrite(shape, sizeof(int), 5, fp);
+                    for (int q = 0; q < in.c; q++)
+                    {
+                        fwrite(in.channel(q), sizeof(float), (size_t)in.w * in.h, fp);
+                    }
+
+                    offsets[i * input_blob_count + j] = valid_end;
+                    valid_end = ftell64(fp);
+                }
+
+                // completed images survive an interrupted run
+                fflush(fp);
+            }
+        }
+
+        fclose(fp);
+    }
+
+    cache_offsets = offsets;
+
+    return 0;
+}
+
 static float compute_kl_divergence(const std::vector<float>& a, const std::vector<float>& b)
 {
     const size_t length = a.size();
@@ -361,7 +642,9 @@ int QuantNet::quantize_KL()
         }
     }
 
-    // count the absmax
+    // count the absmax, every thread keeps its own maximum of every blob
+    std::vector<float> thread_absmaxs(quantize_num_threads * conv_bottom_blob_count, 0.f);
+
     #pragma omp parallel for num_threads(quantize_num_threads) schedule(static, 1)
     for (int i = 0; i < image_count; i++)
     {
@@ -379,19 +662,7 @@ int QuantNet::quantize_KL()
 
         for (int j = 0; j < input_blob_count; j++)
         {
-            const int type_to_pixel = type_to_pixels[j];
-            const std::vector<float>& mean_vals = means[j];
-            const std::vector<float>& norm_vals = norms[j];
-
-            int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
-            if (type_to_pixel != pixel_convert_type)
-            {
-                pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
-            }
-
-            ncnn::Mat in = read_and_resize_image(shapes[j], listspaths[j][i], pixel_convert_type);
-
-            in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+            ncnn::Mat in = load_input(j, i);
 
             ex.input(input_blobs[j], in);
         }
@@ -416,15 +687,21 @@ int QuantNet::quantize_KL()
                     }
                 }
 
-                #pragma omp critical
-                {
-                    QuantBlobStat& stat = quant_blob_stats[j];
-                    stat.absmax = std::max(stat.absmax, absmax);
-                }
+                float& thread_absmax = thread_absmaxs[thread_num * conv_bottom_blob_count + j];
+                thread_absmax = std::max(thread_absmax, absmax);
             }
         }
     }
 
+    for (int t = 0; t < quantize_num_threads; t++)
+    {
+        for (int j = 0; j < conv_bottom_blob_count; j++)
+        {
+            QuantBlobStat& stat = quant_blob_stats[j];
+            stat.absmax = std::max(stat.absmax, thread_absmaxs[t * conv_bottom_blob_count + j]);
+        }
+    }
+
     // initialize histogram
     #pragma omp parallel for num_threads(quantize_num_threads)
     for (int i = 0; i < conv_bottom_blob_count; i++)
@@ -435,7 +712,9 @@ int QuantNet::quantize_KL()
         stat.histogram_normed.resize(num_histogram_bins, 0);
     }
 
-    // build histogram
+    // build histogram, every thread accumulates into its own bins and they are merged at the end
+    std::vector<std::vector<uint64_t> > thread_histograms(quantize_num_threads);
+
     #pragma omp parallel for num_threads(quantize_num_threads) schedule(static, 1)
     for (int i = 0; i < image_count; i++)
     {
@@ -453,19 +732,7 @@ int QuantNet::quantize_KL()
 
         for (int j = 0; j < input_blob_count; j++)
         {
-            const int type_to_pixel = type_to_pixels[j];
-            const std::vector<float>& mean_vals = means[j];
-            const std::vector<float>& norm_vals = norms[j];
-
-            int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
-            if (type_to_pixel != pixel_convert_type)
-            {
-                pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
-            }
-
-            ncnn::Mat in = read_and_resize_image(shapes[j], listspaths[j][i], pixel_convert_type);
-
-            in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+            ncnn::Mat in = load_input(j, i);
 
             ex.input(input_blobs[j], in);
         }
@@ -479,7 +746,11 @@ int QuantNet::quantize_KL()
             {
                 const float absmax = quant_blob_stats[j].absmax;
 
-                std::vector<uint64_t> histogram(num_histogram_bins, 0);
+                std::vector<uint64_t>& thread_histogram = thread_histograms[thread_num];
+                if (thread_histogram.empty())
+                    thread_histogram.resize(conv_bottom_blob_count * num_histogram_bins, 0);
+
+                uint64_t* histogram = &thread_histogram[j * num_histogram_bins];
 
                 const int outc = out.c;
                 const int outsize = out.w * out.h;
@@ -496,16 +767,24 @@ int QuantNet::quantize_KL()
                         histogram[index] += 1;
                     }
                 }
+            }
+        }
+    }
 
-                #pragma omp critical
-                {
-                    QuantBlobStat& stat = quant_blob_stats[j];
+    #pragma omp parallel for num_threads(quantize_num_threads)
+    for (int i = 0; i < conv_bottom_blob_count; i++)
+    {
+        QuantBlobStat& stat = quant_blob_stats[i];
 
-                    for (int k = 0; k < num_histogram_bins; k++)
-                    {
-                        stat.histogram[k] += histogram[k];
-                    }
-                }
+        for (int t = 0; t < quantize_num_threads; t++)
+        {
+            if (thread_histograms[t].empty())
+                continue;
+
+            const uint64_t* histogram = &thread_histograms[t][i * num_histogram_bins];
+            for (int k = 0; k < num_histogram_bins; k++)
+            {
+                stat.histogram[k] += histogram[k];
             }
         }
     }
@@ -845,19 +1124,7 @@ int QuantNet::quantize_ACIQ()
 
         for (int j = 0; j < input_blob_count; j++)
         {
-            const int type_to_pixel = type_to_pixels[j];
-            const std::vector<float>& mean_vals = means[j];
-            const std::vector<float>& norm_vals = norms[j];
-
-            int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
-            if (type_to_pixel != pixel_convert_type)
-            {
-                pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
-            }
-
-            ncnn::Mat in = read_and_resize_image(shapes[j], listspaths[j][i], pixel_convert_type);
-
-            in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+            ncnn::Mat in = load_input(j, i);
 
             ex.input(input_blobs[j], in);
         }
@@ -1089,19 +1356,7 @@ int QuantNet::quantize_EQ()
 
                 for (int jj = 0; jj < input_blob_count; jj++)
                 {
-                    const int type_to_pixel = type_to_pixels[jj];
-                    const std::vector<float>& mean_vals = means[jj];
-                    const std::vector<float>& norm_vals = norms[jj];
-
-                    int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
-                    if (type_to_pixel != pixel_convert_type)
-                    {
-                        pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
-                    }
-
-                    ncnn::Mat in = read_and_resize_image(shapes[jj], listspaths[jj][ii], pixel_convert_type);
-
-                    in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+                    ncnn::Mat in = load_input(jj, ii);
 
                     ex.input(input_blobs[jj], in);
                 }
@@ -1199,19 +1454,7 @@ int QuantNet::quantize_EQ()
 
                 for (int jj = 0; jj < input_blob_count; jj++)
                 {
-                    const int type_to_pixel = type_to_pixels[jj];
-                    const std::vector<float>& mean_vals = means[jj];
-                    const std::vector<float>& norm_vals = norms[jj];
-
-                    int pixel_convert_type = ncnn::Mat::PIXEL_BGR;
-                    if (type_to_pixel != pixel_convert_type)
-                    {
-                        pixel_convert_type = pixel_convert_type | (type_to_pixel << ncnn::Mat::PIXEL_CONVERT_SHIFT);
-                    }
-
-                    ncnn::Mat in = read_and_resize_image(shapes[jj], listspaths[jj][ii], pixel_convert_type);
-
-                    in.substract_mean_normalize(mean_vals.data(), norm_vals.data());
+                    ncnn::Mat in = load_input(jj, ii);
 
                     ex.input(input_blobs[jj], in);
                 }
@@ -1290,6 +1533,141 @@ int QuantNet::quantize_EQ()
     return 0;
 }
 
+int QuantNet::select_mixed_precision()
+{
+    const int input_blob_count = (int)input_blobs.size();
+    const int conv_layer_count = (int)conv_layers.size();
+
+    std::vector<ncnn::UnlockedPoolAllocator> blob_allocators(quantize_num_threads);
+    std::vector<ncnn::UnlockedPoolAllocator> workspace_allocators(quantize_num_threads);
+
+    // max 50 images for sensitivity
+    const int image_count = std::min((int)listspaths[0].size(), 50);
+
+    ncnn::Option opt_int8;
+    opt_int8.num_threads = 1;
+    opt_int8.use_packing_layout = false;
+
+    // every layer quantized alone with the calibrated scales
+    std::vector<ncnn::Layer*> layers_int8(conv_layer_count);
+    for (int i = 0; i < conv_layer_count; i++)
+    {
+        const ncnn::Layer* layer = layers[conv_layers[i]];
+
+        ncnn::Layer* layer_int8 = ncnn::create_layer(layer->typeindex);
+
+        ncnn::ParamDict pd;
+        get_layer_param(layer, pd);
+        pd.set(8, 1); //int8_scale_term
+        layer_int8->load_param(pd);
+
+        std::vector<ncnn::Mat> weights;
+        get_layer_weights(layer, weights);
+        weights.push_back(weight_scales[i]);
+        weights.push_back(bottom_blob_scales[i]);
+        layer_int8->load_model(ncnn::ModelBinFromMatArray(weights.data()));
+
+        layer_int8->create_pipeline(opt_int8);
+
+        layers_int8[i] = layer_int8;
+    }
+
+    std::vector<double> avgsims(conv_layer_count, 0.0);
+
+    #pragma omp parallel for num_threads(quantize_num_threads) schedule(static, 1)
+    for (int ii = 0; ii < image_count; ii++)
+    {
+        if (ii % 10 == 0)
+        {
+            fprintf(stderr, "measure layer sensitivity %.2f%% [ %d / %d ]\n", ii * 100.f / image_count, ii, image_count);
+        }
+
+        // keep the intermediate blobs so one inference serves all layers
+        ncnn::Extractor ex = create_extractor();
+        ex.set_light_mode(false);
+
+        const int thread_num = ncnn::get_omp_thread_num();
+        ex.set_blob_allocator(&blob_allocators[thread_num]);
+        ex.set_workspace_allocator(&workspace_allocators[thread_num]);
+
+        for (int jj = 0; jj < input_blob_count; jj++)
+        {
+            ncnn::Mat in = load_input(jj, ii);
+
+            ex.input(input_blobs[jj], in);
+        }
+
+        std::vector<float> sims(conv_layer_count);
+        for (int i = 0; i < conv_layer_count; i++)
+        {
+            ncnn::Mat in;
+            ex.extract(conv_bottom_blobs[i], in);
+
+            ncnn::Mat out;
+            ex.extract(conv_top_blobs[i], out);
+
+            ncnn::Mat out_int8;
+            layers_int8[i]->forward(in, out_int8, opt_int8);
+
+            sims[i] = cosine_similarity(out, out_int8);
+        }
+
+        #pragma omp critical
+        {
+            for (int i = 0; i < conv_layer_count; i++)
+            {
+                avgsims[i] += sims[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < conv_layer_count; i++)
+    {
+        layers_int8[i]->destroy_pipeline(opt_int8);
+        delete layers_int8[i];
+
+        layer_similarities[i] = (float)(avgsims[i] / image_count);
+    }
+
+    // quantize the least sensitive layers first
+    // the product of the similarities of the quantized layers estimates the similarity of the whole model
+    std::vector<std::pair<float, int> > order(conv_layer_count);
+    for (int i = 0; i < conv_layer_count; i++)
+    {
+        order[i] = std::make_pair(layer_similarities[i], i);
+    }
+
+    std::sort(order.begin(), order.end(), std::greater<std::pair<float, int> >());
+
+    float estimated_similarity = 1.f;
+    for (int k = 0; k < conv_layer_count; k++)
+    {
+        const int i = order[k].second;
+
+        if (estimated_similarity * layer_similarities[i] >= mixed_precision_target)
+        {
+            estimated_similarity *= layer_similarities[i];
+            layer_fp32[i] = 0;
+        }
+        else
+        {
+            layer_fp32[i] = 1;
+        }
+    }
+
+    int fp32_count = 0;
+    for (int i = 0; i < conv_layer_count; i++)
+    {
+        fprintf(stderr, "%-40s : similarity = %-15f  %s\n", layers[conv_layers[i]]->name.c_str(), layer_similarities[i], layer_fp32[i] ? "fp32" : "int8");
+
+        fp32_count += layer_fp32[i];
+    }
+
+    fprintf(stderr, "keep %d / %d layers in fp32, estimated similarity = %f\n", fp32_count, conv_layer_count, estimated_similarity);
+
+    return 0;
+}
+
 static std::vector<std::vector<std::string> > parse_comma_path_list(char* s)
 {
     std::vector<std::vector<std::string> > aps;
@@ -1586,6 +1964,8 @@ static void show_usage()
     fprintf(stderr, "  pixel=RAW/RGB/BGR/GRAY/RGBA/BGRA,...\n");
     fprintf(stderr, "  thread=8\n");
     fprintf(stderr, "  method=kl/aciq/eq\n");
+    fprintf(stderr, "  cache=calibration.cache\n");
+    fprintf(stderr, "  mixed=0.99 keep sensitive layers in fp32 until the estimated output similarity reaches it\n");
     fprintf(stderr, "Sample usage: ncnn2table squeezenet.param squeezenet.bin imagelist.txt squeezenet.table mean=[104.0,117.0,123.0] norm=[1.0,1.0,1.0] shape=[227,227,3] pixel=BGR method=kl\n");
 }
 
@@ -1660,6 +2040,10 @@ int main(int argc, char** argv)
             net.quantize_num_threads = atoi(value);
         if (memcmp(key, "method", 6) == 0)
             method = std::string(value);
+        if (memcmp(key, "mixed", 5) == 0)
+            net.mixed_precision_target = (float)atof(value);
+        if (memcmp(key, "cache", 5) == 0)
+            net.cache_path = std::string(value);
     }
 
     // sanity check
@@ -1694,6 +2078,11 @@ int main(int argc, char** argv)
         fprintf(stderr, "malformed thread %d\n", net.quantize_num_threads);
         return -1;
     }
+    if (net.mixed_precision_target < 0.f || net.mixed_precision_target > 1.f)
+    {
+        fprintf(stderr, "malformed mixed %f\n", net.mixed_precision_target);
+        return -1;
+    }
 
     // print quantnet config
     {
@@ -1711,9 +2100,18 @@ int main(int argc, char** argv)
         fprintf(stderr, "\n");
         fprintf(stderr, "thread = %d\n", net.quantize_num_threads);
         fprintf(stderr, "method = %s\n", method.c_str());
+        fprintf(stderr, "mixed = %f\n", net.mixed_precision_target);
+        fprintf(stderr, "cache = %s\n", net.cache_path.c_str());
         fprintf(stderr, "---------------------------------------\n");
     }
 
+    if (!net.cache_path.empty())
+    {
+        int ret = net.init_cache();
+        if (ret != 0)
+            return -1;
+    }
+
     if (method == "kl")
     {
         net.quantize_KL();
@@ -1735,6 +2133,11 @@ int main(int argc, char** argv)
 
     net.print_quant_info();
 
+    if (net.mixed_precision_target > 0.f)
+    {
+        net.select_mixed_precision();
+    }
+
     net.save_table(outtable);
 
     return 0;